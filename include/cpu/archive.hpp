@@ -0,0 +1,86 @@
+#ifndef _CPU_ARCHIVE_HPP_
+#define _CPU_ARCHIVE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+// Iteration archive (.frac): the raw per-pixel results of a render, stored
+// so that coloring can be changed without iterating again.
+//
+// Layout (little endian):
+//   header      "FRAC", version, width, height, tile_size, max_iter, tiles_x, tiles_y (uint32 each)
+//   tile index  tiles_x * tiles_y entries of { uint64 offset; uint32 size; }, row major
+//   tiles       one payload per tile, anywhere after the index
+//
+// A tile payload holds two channels, each one predicted from its already
+// decoded neighbours (median edge detector), zigzag mapped and Rice coded
+// with a per-tile parameter:
+//   iteration   smooth iteration in 24.8 fixed point, max_iter << 8 inside the set
+//   distance    log2 of the distance estimate in 1/128 steps, 0 inside the set
+const uint32_t ARCHIVE_VERSION = 1;
+const unsigned int ARCHIVE_ITERATION_BITS = 8;
+
+uint32_t quantize_iteration(float smooth, bool escaped, unsigned int max_iter);
+float dequantize_iteration(uint32_t q);
+uint32_t quantize_distance(float de);
+float dequantize_distance(uint32_t q);
+
+// Quantized content of one tile, row major
+struct ArchiveTile {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    vector<uint32_t> iteration;
+    vector<uint32_t> distance;
+};
+
+class IterationArchive {
+    public:
+        IterationArchive();
+        ~IterationArchive();
+
+        // Tiles are encoded in parallel
+        static bool write(const string& filename, const IterationBuffer& buffer, unsigned int tile_size = 64);
+
+        // Maps the file in memory, only the header and the index are read
+        bool open(const string& filename);
+        void close();
+
+        unsigned int width() const;
+        unsigned int height() const;
+        unsigned int max_iter() const;
+        unsigned int tile_size() const;
+        unsigned int tiles_x() const;
+        unsigned int tiles_y() const;
+
+        // Random access to one tile, safe to call from several threads
+        bool read_tile(unsigned int tx, unsigned int ty, ArchiveTile& tile) const;
+        // Decodes every tile in parallel
+        bool read(IterationBuffer& out) const;
+
+    private:
+        struct TileEntry {
+            uint64_t offset;
+            uint32_t size;
+        };
+
+        const uint8_t* m_data;
+        size_t m_size;
+
+        unsigned int m_width;
+        unsigned int m_height;
+        unsigned int m_max_iter;
+        unsigned int m_tile_size;
+        unsigned int m_tiles_x;
+        unsigned int m_tiles_y;
+        vector<TileEntry> m_index;
+};
+
+#endif
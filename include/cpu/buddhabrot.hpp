@@ -0,0 +1,91 @@
+#ifndef _CPU_BUDDHABROT_HPP_
+#define _CPU_BUDDHABROT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+// Buddhabrot: density of the orbits of the points c outside the Mandelbrot
+// set, plotted in the z plane. The Nebulabrot gives each color channel its
+// own iteration limit, an orbit escaping after n iterations lands in the
+// channels whose limit is at least n.
+
+// How the values of c are drawn
+enum BuddhabrotSampling {
+    BUDDHABROT_UNIFORM = 0,
+    // Metropolis-Hastings chains, with the number of orbit points inside the
+    // view as importance. Most uniform samples never cross a zoomed in view,
+    // the chains stay around the ones that do.
+    BUDDHABROT_METROPOLIS = 1,
+    // A uniform pilot of BUDDHABROT_PILOT_SAMPLES, then Metropolis when less
+    // than BUDDHABROT_METROPOLIS_BELOW of its orbits crossed the view
+    BUDDHABROT_AUTOMATIC = 2
+};
+
+const size_t BUDDHABROT_PILOT_SAMPLES = 1 << 16;
+// Crossover in contributing orbits per second, measured at 400x300 around
+// -0.16+1.035i: uniform is 1.8 times ahead at zoom 2 (10.5% contributing),
+// Metropolis 4.4 times ahead at zoom 4 (3.6%)
+const float BUDDHABROT_METROPOLIS_BELOW = 0.08f;
+
+struct BuddhabrotParams {
+    // Red, green and blue limits, all equal for the plain Buddhabrot
+    unsigned int max_iter[3] = {5000, 500, 50};
+    // Orbits escaping sooner than this are not plotted
+    unsigned int min_iter = 1;
+    // Candidate values of c, uniform or proposed by the Metropolis chains
+    size_t samples = 10000000;
+
+    BuddhabrotSampling sampling = BUDDHABROT_AUTOMATIC;
+    // Probability of a proposal anywhere in |c| < 2 rather than around the
+    // current c, it keeps the chains from getting stuck on one island
+    float large_step = 0.1f;
+
+    uint64_t seed = 1;
+};
+
+struct BuddhabrotStats {
+    // Values of c sampled
+    size_t samples = 0;
+    // Samples skipped by the cardioid and period 2 bulb test
+    size_t skipped = 0;
+    // Samples whose orbit escaped and crossed the view
+    size_t contributing = 0;
+    // Proposals accepted by the Metropolis chains
+    size_t accepted = 0;
+    // Sampling used, never BUDDHABROT_AUTOMATIC
+    BuddhabrotSampling sampling = BUDDHABROT_UNIFORM;
+    double seconds = 0.0;
+};
+
+// Orbit density, 3 floats (red, green, blue) per pixel, row 0 at the top
+struct BuddhabrotBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    vector<float> density;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        density.assign(size_t(w) * h * 3, 0.f);
+    }
+};
+
+// True when c is in the main cardioid or in the period 2 bulb, whose
+// points never escape
+bool in_main_components(float re_c, float im_c);
+
+// Samples are spread over all cores, every thread splats into its own
+// buffer and the buffers are summed at the end
+BuddhabrotStats render_buddhabrot(const View& view, const BuddhabrotParams& params, BuddhabrotBuffer& out);
+
+// Square root tone mapping, each channel scaled so that its brightest 0.1%
+// of the pixels saturate
+void tonemap(const BuddhabrotBuffer& buffer, Image& image);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _CPU_COLORING_HPP_
+#define _CPU_COLORING_HPP_
+
+#include "cpu/archive.hpp"
+#include "cpu/histogram.hpp"
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+#include "cpu/palette.hpp"
+
+// Maps a smooth iteration count onto the palette: t = offset + density * iteration,
+// wrapped to [0, 1) when cyclic and clamped otherwise. The defaults give the
+// original coloring of frag_fractals.glsl, density = 5 / (max_iter - 1).
+// With equalize, density * iteration is replaced by the histogram CDF.
+// frag_coloring.glsl implements the same mapping.
+struct ColorMapping {
+    float density = 5.f / 99.f;
+    float offset = 0.f;
+    bool cyclic = false;
+    bool equalize = false;
+};
+
+const unsigned int PALETTE_LUT_SIZE = 4096;
+
+// Colors `count` pixels, SIMD_LANES at a time with a gather from the LUT.
+// histogram is only used (and required) when mapping.equalize is set.
+void color_span(const float* iteration, const uint8_t* escaped, size_t count,
+                const vector<uint32_t>& lut, uint32_t interior, const ColorMapping& mapping,
+                const IterationHistogram* histogram, uint8_t* rgb);
+
+void colorize(const IterationBuffer& buffer, const Palette& palette, const ColorMapping& mapping, Image& out);
+
+// Colors an archive straight from the quantized tiles: tiles are decoded in
+// parallel and each pixel costs a single table lookup. Equalization needs the
+// histogram first, the archive is then decoded once before coloring.
+bool recolor_archive(const IterationArchive& archive, const Palette& palette, const ColorMapping& mapping, Image& out);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _CPU_FLAME_HPP_
+#define _CPU_FLAME_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+#include "cpu/palette.hpp"
+
+using namespace std;
+
+// Nonlinear variations of the fractal flame algorithm (Draves & Reckase),
+// applied to the output of the affine part of a transform
+enum FlameVariation {
+    VARIATION_LINEAR,
+    VARIATION_SINUSOIDAL,
+    VARIATION_SPHERICAL,
+    VARIATION_SWIRL,
+    VARIATION_HORSESHOE,
+    VARIATION_POLAR,
+    VARIATION_HEART,
+    VARIATION_DISC,
+    VARIATION_SPIRAL,
+    VARIATION_HYPERBOLIC,
+    VARIATION_COUNT
+};
+
+// One function of the system:
+//   (x', y') = sum_v variations[v] * V_v(a x + b y + c, d x + e y + f)
+// A plain IFS only uses VARIATION_LINEAR.
+struct FlameTransform {
+    // Probability of the transform, relative to the other ones
+    float weight = 1.f;
+    // Palette position the points move halfway to when going through it
+    float color = 0.f;
+    float a = 1.f, b = 0.f, c = 0.f;
+    float d = 0.f, e = 1.f, f = 0.f;
+    float variations[VARIATION_COUNT] = {1.f};
+};
+
+struct Flame {
+    vector<FlameTransform> transforms;
+    // View framing the attractor, as the fields of View
+    double center_x = 0.0;
+    double center_y = 0.0;
+    double zoom = 0.8;
+};
+
+// Built-in systems: "sierpinski", "fern" and "swirl", each with the view
+// framing it. False for other names.
+bool flame_preset(const string& name, Flame& flame);
+
+struct FlameParams {
+    // Points of all the walkers, the first skip ones of each walker
+    // not included
+    size_t points = 100000000;
+    // Iterations before a walker is close enough to the attractor to plot
+    unsigned int skip = 20;
+    uint64_t seed = 1;
+};
+
+struct FlameStats {
+    size_t points = 0;
+    // Points that landed inside the view
+    size_t plotted = 0;
+    double seconds = 0.0;
+};
+
+// Hits and sum of the colors of the points of each pixel, row 0 at the top
+struct FlameBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    vector<float> density;
+    vector<float> color;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        density.assign(size_t(w) * h, 0.f);
+        color.assign(size_t(w) * h, 0.f);
+    }
+};
+
+// Chaos game: SIMD_LANES walkers per task go through random transforms
+// together, with the coefficients of the chosen transforms gathered per
+// lane. Every thread plots into its own buffer, there are no locks or
+// atomics, and the buffers are summed at the end.
+FlameStats render_flame(const Flame& flame, const View& view, const FlameParams& params, FlameBuffer& out);
+
+// Log density tone mapping, the densest 0.1% of the pixels saturate. The
+// hue of a pixel is its mean color through the palette.
+void tonemap(const FlameBuffer& buffer, const Palette& palette, float gamma, Image& image);
+
+#endif
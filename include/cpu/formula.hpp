@@ -0,0 +1,385 @@
+#ifndef _CPU_FORMULA_HPP_
+#define _CPU_FORMULA_HPP_
+
+#include <cmath>
+#include <string>
+
+#include "cpu/iteration.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Iteration count and escape radius of the escape-time kernels, the
+// defaults are the ones of in_mandelbrot_set()
+struct EscapeParams {
+    unsigned int max_iter = 100;
+    float bailout = 2.f;
+};
+
+// SIMD lanes of a given precision and the masks their comparisons give
+template<typename Real> struct RealLanes;
+
+template<> struct RealLanes<float> {
+    typedef vfloat type;
+    typedef vint mask;
+};
+
+template<> struct RealLanes<double> {
+    typedef vdouble type;
+    typedef vlong mask;
+};
+
+// z^N, unrolled at compile time
+template<unsigned int N> struct ComplexPower {
+    template<typename V>
+    static inline void apply(V re, V im, V& re_out, V& im_out) {
+        V re_p, im_p;
+        ComplexPower<N - 1>::apply(re, im, re_p, im_p);
+        re_out = re_p * re - im_p * im;
+        im_out = re_p * im + im_p * re;
+    }
+};
+
+template<> struct ComplexPower<2> {
+    template<typename V>
+    static inline void apply(V re, V im, V& re_out, V& im_out) {
+        re_out = re * re - im * im;
+        im_out = 2 * re * im;
+    }
+};
+
+template<> struct ComplexPower<1> {
+    template<typename V>
+    static inline void apply(V re, V im, V& re_out, V& im_out) {
+        re_out = re;
+        im_out = im;
+    }
+};
+
+// Formulas are policies with a static step() applying z -> f(z) and, when
+// Derivative is set, dz -> f'(z) dz. The engine adds c (and 1 to dz for
+// the derivative with respect to c), so a step is the same for the
+// Mandelbrot and the Julia sets of a formula. degree is the one of f, it
+// scales the smooth iteration count.
+
+// z -> z^D + c, D = 2 is the Mandelbrot set
+template<unsigned int D>
+struct Multibrot {
+    static const unsigned int degree = D;
+
+    template<bool Derivative, typename V>
+    static inline void step(V& re_z, V& im_z, V& re_dz, V& im_dz) {
+        // z^(D-1) is shared by z^D and by the derivative D z^(D-1) dz
+        V re_p, im_p;
+        ComplexPower<D - 1>::apply(re_z, im_z, re_p, im_p);
+        if(Derivative) {
+            V re_dz_next = float(D) * (re_p * re_dz - im_p * im_dz);
+            im_dz = float(D) * (re_p * im_dz + im_p * re_dz);
+            re_dz = re_dz_next;
+        }
+        if(D == 2) {
+            ComplexPower<2>::apply(re_z, im_z, re_z, im_z);
+        } else {
+            V re_z_next = re_p * re_z - im_p * im_z;
+            im_z = re_p * im_z + im_p * re_z;
+            re_z = re_z_next;
+        }
+    }
+};
+
+// z -> (|Re z| + i |Im z|)^2 + c. The fold is not holomorphic, dz follows
+// the sign flips of the fold, which is enough for the distance estimate.
+struct BurningShip {
+    static const unsigned int degree = 2;
+
+    template<bool Derivative, typename V>
+    static inline void step(V& re_z, V& im_z, V& re_dz, V& im_dz) {
+        if(Derivative) {
+            re_dz = re_z < 0 ? -re_dz : re_dz;
+            im_dz = im_z < 0 ? -im_dz : im_dz;
+        }
+        re_z = re_z < 0 ? -re_z : re_z;
+        im_z = im_z < 0 ? -im_z : im_z;
+        Multibrot<2>::step<Derivative>(re_z, im_z, re_dz, im_dz);
+    }
+};
+
+// z -> conj(z)^2 + c, the Mandelbar set
+struct Tricorn {
+    static const unsigned int degree = 2;
+
+    template<bool Derivative, typename V>
+    static inline void step(V& re_z, V& im_z, V& re_dz, V& im_dz) {
+        im_z = -im_z;
+        if(Derivative) {
+            im_dz = -im_dz;
+        }
+        Multibrot<2>::step<Derivative>(re_z, im_z, re_dz, im_dz);
+    }
+};
+
+// Writes pixel idx of an orbit that escaped at iteration n (or never did
+// when inside is set): smooth iteration count for a formula of the given
+// degree (mean growth of the exponent of |z| per iteration), distance estimate when dz was tracked, z and dz.
+template<typename Real>
+inline void store_orbit(Real re_z, Real im_z, Real re_dz, Real im_dz, Real n, bool inside, float degree,
+                        bool derivative, const EscapeParams& params, IterationBuffer& out, size_t idx) {
+    out.z[2 * idx] = float(re_z);
+    out.z[2 * idx + 1] = float(im_z);
+    out.dz[2 * idx] = float(re_dz);
+    out.dz[2 * idx + 1] = float(im_dz);
+    if(inside) {
+        out.smooth[idx] = float(params.max_iter);
+        out.de[idx] = 0.f;
+        out.escaped[idx] = 0;
+        return;
+    }
+
+    Real r2 = re_z * re_z + im_z * im_z;
+    Real dz2 = re_dz * re_dz + im_dz * im_dz;
+    Real log_r = Real(0.5) * std::log(r2);
+    Real smooth = n + 1 - std::log2(log_r / std::log(Real(params.bailout))) / std::log2(Real(degree));
+    out.smooth[idx] = std::fmin(std::fmax(float(smooth), 0.f), std::nextafter(float(params.max_iter), 0.f));
+    out.de[idx] = derivative ? float(Real(0.5) * std::sqrt(r2) * log_r / std::sqrt(dz2)) : 0.f;
+    out.escaped[idx] = 1;
+}
+
+enum FormulaFeatures {
+    // Track dz for the distance estimate and the slope lighting
+    FEATURE_DERIVATIVE = 1,
+    // z0 is the pixel and c is fixed, instead of z0 = 0 and c the pixel.
+    // dz is then the derivative with respect to z0.
+    FEATURE_JULIA = 2
+};
+
+// Formulas applied in turn, one per iteration. A formula alone is a
+// sequence of one, Hybrid<...> (cpu/hybrid.hpp) makes longer ones.
+template<typename Formula>
+struct FormulaSequence {
+    static const unsigned int period = 1;
+
+    template<unsigned int Phase>
+    using at = Formula;
+
+    static float degree() {
+        return float(Formula::degree);
+    }
+};
+
+// State of SIMD_LANES orbits when they escaped
+template<typename Real>
+struct EscapeLanes {
+    typedef typename RealLanes<Real>::type vreal;
+    typedef typename RealLanes<Real>::mask vmask;
+
+    // Lanes that never escaped
+    vmask inside;
+    // Iteration of the escape
+    vreal n;
+    vreal re_z, im_z;
+    vreal re_dz, im_dz;
+};
+
+// State of SIMD_LANES orbits between two iterations
+template<typename Real>
+struct EscapeOrbit {
+    typedef typename RealLanes<Real>::type vreal;
+    typedef typename RealLanes<Real>::mask vmask;
+
+    vreal re_z, im_z;
+    vreal re_dz, im_dz;
+    vreal re_c, im_c;
+    // Lanes that did not escape yet
+    vmask active;
+};
+
+// Escape-time renderer of a formula. Every instantiation gets its own
+// inner loop with the step inlined, the formula costs neither a virtual
+// call nor a switch per iteration. Hybrid sequences are unrolled over
+// their period.
+//
+// Real is float or double, there are SIMD_LANES lanes in both cases.
+template<typename Formula, typename Real = float, unsigned int Features = FEATURE_DERIVATIVE>
+class FormulaEngine {
+    public:
+        typedef typename RealLanes<Real>::type vreal;
+        typedef typename RealLanes<Real>::mask vmask;
+        typedef FormulaSequence<Formula> Sequence;
+        typedef EscapeLanes<Real> Lanes;
+        typedef EscapeOrbit<Real> Orbit;
+
+        // c is only used with FEATURE_JULIA
+        FormulaEngine(const EscapeParams& params, Real re_c = 0, Real im_c = 0) :
+            m_params(params), m_re_c(re_c), m_im_c(im_c) {
+        }
+
+        // Iterates every lane until all of them escaped
+        static inline Lanes iterate(vreal re_z, vreal im_z, vreal re_c, vreal im_c, const EscapeParams& params);
+        // Smooth iteration, distance estimate, z and dz of lane k written to pixel idx
+        static void store(const Lanes& lanes, unsigned int k, const EscapeParams& params, IterationBuffer& out, size_t idx);
+
+        // Orbits starting at z, with the escape record of no escape yet
+        static inline void start(vreal re_z, vreal im_z, vreal re_c, vreal im_c, unsigned int max_iter, Orbit& orbit, Lanes& out);
+        // Iteration n with the formula at Phase of the sequence, escaping
+        // lanes are recorded in out. false once every lane escaped.
+        template<unsigned int Phase>
+        static inline bool advance(Orbit& orbit, Lanes& out, unsigned int n, Real bailout2);
+
+        // Pixels are iterated SIMD_LANES at a time and rows are spread over all cores
+        void render(const View& view, IterationBuffer& out) const;
+
+    private:
+        // Iterations n + Phase to n + period - 1, false once every lane
+        // escaped or max_iter is reached
+        template<unsigned int Phase>
+        static inline bool advance_period(Orbit& orbit, Lanes& out, unsigned int n, unsigned int max_iter, Real bailout2);
+
+        static inline vreal broadcast(Real x) {
+            return vreal{} + x;
+        }
+
+    private:
+        EscapeParams m_params;
+        Real m_re_c;
+        Real m_im_c;
+};
+
+template<typename Formula, typename Real, unsigned int Features>
+inline void FormulaEngine<Formula, Real, Features>::start(vreal re_z, vreal im_z, vreal re_c, vreal im_c, unsigned int max_iter, Orbit& orbit, Lanes& out) {
+    const bool julia = (Features & FEATURE_JULIA) != 0;
+
+    orbit.re_z = re_z;
+    orbit.im_z = im_z;
+    orbit.re_dz = broadcast(julia ? 1 : 0);
+    orbit.im_dz = broadcast(0);
+    orbit.re_c = re_c;
+    orbit.im_c = im_c;
+    orbit.active = vmask{} - 1;
+
+    out.n = broadcast(Real(max_iter));
+    out.re_z = orbit.re_z;
+    out.im_z = orbit.im_z;
+    out.re_dz = orbit.re_dz;
+    out.im_dz = orbit.im_dz;
+}
+
+template<typename Formula, typename Real, unsigned int Features>
+template<unsigned int Phase>
+inline bool FormulaEngine<Formula, Real, Features>::advance(Orbit& orbit, Lanes& out, unsigned int n, Real bailout2) {
+    const bool derivative = (Features & FEATURE_DERIVATIVE) != 0;
+    const bool julia = (Features & FEATURE_JULIA) != 0;
+
+    vreal re_z_next = orbit.re_z, im_z_next = orbit.im_z;
+    vreal re_dz_next = orbit.re_dz, im_dz_next = orbit.im_dz;
+    Sequence::template at<Phase>::template step<derivative>(re_z_next, im_z_next, re_dz_next, im_dz_next);
+    re_z_next += orbit.re_c;
+    im_z_next += orbit.im_c;
+    if(derivative && !julia) {
+        re_dz_next += 1;
+    }
+
+    orbit.re_z = select(orbit.active, re_z_next, orbit.re_z);
+    orbit.im_z = select(orbit.active, im_z_next, orbit.im_z);
+    if(derivative) {
+        orbit.re_dz = select(orbit.active, re_dz_next, orbit.re_dz);
+        orbit.im_dz = select(orbit.active, im_dz_next, orbit.im_dz);
+    }
+
+    vmask escaping = orbit.active & (orbit.re_z * orbit.re_z + orbit.im_z * orbit.im_z > bailout2);
+    if(any(escaping)) {
+        out.n = select(escaping, broadcast(Real(n)), out.n);
+        out.re_z = select(escaping, orbit.re_z, out.re_z);
+        out.im_z = select(escaping, orbit.im_z, out.im_z);
+        out.re_dz = select(escaping, orbit.re_dz, out.re_dz);
+        out.im_dz = select(escaping, orbit.im_dz, out.im_dz);
+        orbit.active &= ~escaping;
+        return any(orbit.active);
+    }
+    return true;
+}
+
+template<typename Formula, typename Real, unsigned int Features>
+template<unsigned int Phase>
+inline bool FormulaEngine<Formula, Real, Features>::advance_period(Orbit& orbit, Lanes& out, unsigned int n, unsigned int max_iter, Real bailout2) {
+    if constexpr(Phase == Sequence::period) {
+        return true;
+    } else {
+        if(n + Phase >= max_iter) {
+            return false;
+        }
+        return advance<Phase>(orbit, out, n + Phase, bailout2) &&
+            advance_period<Phase + 1>(orbit, out, n, max_iter, bailout2);
+    }
+}
+
+template<typename Formula, typename Real, unsigned int Features>
+inline typename FormulaEngine<Formula, Real, Features>::Lanes
+FormulaEngine<Formula, Real, Features>::iterate(vreal re_z, vreal im_z, vreal re_c, vreal im_c, const EscapeParams& params) {
+    const Real bailout2 = Real(params.bailout) * Real(params.bailout);
+
+    Orbit orbit;
+    Lanes out;
+    start(re_z, im_z, re_c, im_c, params.max_iter, orbit, out);
+
+    for(unsigned int n = 0; n < params.max_iter; n += Sequence::period) {
+        if(!advance_period<0>(orbit, out, n, params.max_iter, bailout2)) {
+            break;
+        }
+    }
+    out.inside = orbit.active;
+    return out;
+}
+
+template<typename Formula, typename Real, unsigned int Features>
+void FormulaEngine<Formula, Real, Features>::store(const Lanes& lanes, unsigned int k, const EscapeParams& params, IterationBuffer& out, size_t idx) {
+    store_orbit<Real>(lanes.re_z[k], lanes.im_z[k], lanes.re_dz[k], lanes.im_dz[k], lanes.n[k], lanes.inside[k] != 0,
+        Sequence::degree(), (Features & FEATURE_DERIVATIVE) != 0, params, out, idx);
+}
+
+template<typename Formula, typename Real, unsigned int Features>
+void FormulaEngine<Formula, Real, Features>::render(const View& view, IterationBuffer& out) const {
+    out.resize(view.width, view.height);
+    out.max_iter = m_params.max_iter;
+
+    const vreal lanes = __builtin_convertvector(vlane_index(), vreal);
+    const vreal zero = broadcast(0);
+    const vreal re_c = broadcast(m_re_c);
+    const vreal im_c = broadcast(m_im_c);
+    const Real re_left = Real(view.center_x - 1.0 / view.zoom);
+    const Real re_step = Real(2.0 / (view.zoom * view.width));
+
+    parallel_for(view.height, 4, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const vreal im = broadcast(Real(view.im(j)));
+            for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                const vreal re = broadcast(re_left) + (broadcast(Real(i)) + lanes + Real(0.5)) * re_step;
+
+                Lanes result = (Features & FEATURE_JULIA) ?
+                    iterate(re, im, re_c, im_c, m_params) :
+                    iterate(zero, zero, re, im, m_params);
+                for(unsigned int k = 0; k < SIMD_LANES && i + k < view.width; k++) {
+                    store(result, k, m_params, out, j * view.width + i + k);
+                }
+            }
+        }
+    });
+}
+
+// Parameter plane of a formula in single or double precision
+template<typename Formula>
+void render_engine(bool double_precision, const View& view, const EscapeParams& params, IterationBuffer& out) {
+    if(double_precision) {
+        FormulaEngine<Formula, double>(params).render(view, out);
+    } else {
+        FormulaEngine<Formula, float>(params).render(view, out);
+    }
+}
+
+// Formulas selectable at run time: "mandelbrot", "multibrot3", "multibrot4",
+// "multibrot5", "burning_ship" and "tricorn", or a hybrid sequence of them
+// (see cpu/hybrid.hpp). The formula is chosen once per image, false when a
+// name is unknown.
+bool render_formula(const string& formula, bool double_precision, const View& view, const EscapeParams& params, IterationBuffer& out);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _CPU_FORMULA_PROGRAM_HPP_
+#define _CPU_FORMULA_PROGRAM_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu/formula.hpp"
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+// Iteration formulas written as text, for new formulas without a rebuild.
+// A formula is the right hand side of z <- f(z, c):
+//
+//   expr     := term (('+' | '-') term)*
+//   term     := unary (('*' | '/') unary)*
+//   unary    := '-' unary | power
+//   power    := primary ('^' integer)?
+//   primary  := number | 'z' | 'c' | 'i' | function '(' expr ')' | '(' expr ')'
+//   function := conj | fold | sqr | re | im | exp
+//
+// fold(x) is |Re x| + i |Im x|, so "fold(z)^2 + c" is the Burning Ship and
+// "conj(z)^2 + c" the Tricorn. Powers are integers from 1 to 64.
+//
+// The formula is compiled to a register bytecode, one register per
+// intermediate complex value. Every register also carries the derivative
+// with respect to c (or z0 for Julia sets), so that the distance estimate
+// and the slope lighting work as with the built-in formulas.
+enum FormulaOpcode {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_NEG,
+    OP_SQR,
+    OP_CONJ,
+    OP_FOLD,
+    OP_RE,
+    OP_IM,
+    OP_EXP
+};
+
+struct FormulaInstruction {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    // Unused by the unary operations
+    uint8_t b;
+};
+
+struct FormulaConstant {
+    uint8_t reg;
+    float re;
+    float im;
+};
+
+// Registers 0 and 1 hold z and c, constants and intermediate values follow
+const unsigned int FORMULA_REGISTER_Z = 0;
+const unsigned int FORMULA_REGISTER_C = 1;
+const unsigned int FORMULA_MAX_REGISTERS = 256;
+
+// The interpreter runs each instruction on FORMULA_BLOCKS * SIMD_LANES
+// pixels, which amortizes the dispatch over 16 pixels
+const unsigned int FORMULA_BLOCKS = 2;
+
+class FormulaProgram {
+    public:
+        FormulaProgram();
+
+        // Prints the error and returns false when the source does not parse
+        bool compile(const string& source);
+
+        const string& source() const;
+        const vector<FormulaInstruction>& code() const;
+        unsigned int registers() const;
+        // Highest power of z, which scales the smooth iteration count. At
+        // least 2, lower degrees only escape linearly.
+        unsigned int degree() const;
+
+        // Human readable listing of the bytecode
+        string disassemble() const;
+        // Defines of the frag_fractals.glsl variant running this formula
+        vector<string> glsl_defines() const;
+
+        // Parameter plane (z0 = 0, c is the pixel) rendered by the
+        // interpreter, rows are spread over all cores
+        void render(const View& view, const EscapeParams& params, IterationBuffer& out) const;
+
+    private:
+        // Recursive descent parser, each rule returns the register of its value
+        bool parse_expression(int& reg);
+        bool parse_term(int& reg);
+        bool parse_unary(int& reg);
+        bool parse_power(int& reg);
+        bool parse_primary(int& reg);
+
+        void skip_spaces();
+        bool fail(const string& message);
+        // Both allocate a new register, false when there are none left
+        bool emit(FormulaOpcode op, int a, int b, int& reg);
+        bool constant(float re, float im, int& reg);
+
+    private:
+        string m_source;
+        size_t m_position;
+
+        vector<FormulaInstruction> m_code;
+        vector<FormulaConstant> m_constants;
+        // Degree in z of the value of every register
+        vector<unsigned int> m_degrees;
+        unsigned int m_result;
+        unsigned int m_degree;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _CPU_GLSL_HPP_
+#define _CPU_GLSL_HPP_
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// Float literal that GLSL accepts, with the 9 digits that round trip a
+// float. Integers get a ".0", GLSL does not convert them in every context.
+inline string glsl_float(double x) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", x);
+    string s = buffer;
+    if(s.find_first_of(".en") == string::npos) {
+        s += ".0";
+    }
+    return s;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _CPU_HISTOGRAM_HPP_
+#define _CPU_HISTOGRAM_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu/iteration.hpp"
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Histogram equalization of the smooth iteration counts: a pixel is mapped
+// to the fraction of escaped pixels with a lower count, which keeps the
+// contrast stable whatever the zoom depth.
+class IterationHistogram {
+    public:
+        IterationHistogram(unsigned int bins = 1024);
+
+        // Per-thread histograms merged by a tree reduction, then a parallel
+        // prefix sum gives the normalized CDF
+        void build(const IterationBuffer& buffer);
+
+        // Equalized coordinate in [0, 1], linearly interpolated inside a bin
+        vfloat equalize(vfloat iteration) const;
+        float equalize(float iteration) const;
+
+        unsigned int bins() const;
+        const vector<uint64_t>& counts() const;
+        // bins + 1 entries, cdf[0] = 0 and cdf[bins] = 1
+        const vector<float>& cdf() const;
+
+    private:
+        unsigned int m_bins;
+        // bins / max_iter
+        float m_scale;
+        vector<uint64_t> m_counts;
+        vector<float> m_cdf;
+};
+
+#endif
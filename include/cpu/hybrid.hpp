@@ -0,0 +1,60 @@
+#ifndef _CPU_HYBRID_HPP_
+#define _CPU_HYBRID_HPP_
+
+#include <cmath>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cpu/formula.hpp"
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+// Hybrid fractals: the iteration goes through a sequence of formulas, e.g.
+// Hybrid<Multibrot<2>, Multibrot<2>, BurningShip> applies the Mandelbrot
+// step twice then the Burning Ship one. FormulaEngine unrolls the sequence
+// so that each iteration knows its formula at compile time.
+template<typename... Formulas>
+struct Hybrid {
+};
+
+template<typename... Formulas>
+struct FormulaSequence<Hybrid<Formulas...>> {
+    static const unsigned int period = sizeof...(Formulas);
+
+    template<unsigned int Phase>
+    using at = typename tuple_element<Phase, tuple<Formulas...>>::type;
+
+    // Geometric mean of the degrees, |z| grows by their product over a period
+    static float degree() {
+        float product = (float(Formulas::degree) * ...);
+        return std::pow(product, 1.f / period);
+    }
+};
+
+// Formulas that sequences are made of, by name
+enum FormulaId {
+    FORMULA_MANDELBROT,
+    FORMULA_MULTIBROT3,
+    FORMULA_MULTIBROT4,
+    FORMULA_MULTIBROT5,
+    FORMULA_BURNING_SHIP,
+    FORMULA_TRICORN,
+    FORMULA_COUNT
+};
+
+// "mandelbrot*2,burning_ship": names of render_formula(), each one with an
+// optional repeat count. Prints the error and returns false when a name is
+// unknown.
+bool parse_formula_sequence(const string& text, vector<FormulaId>& sequence);
+
+// Parameter plane of a sequence. The common sequences have a compiled
+// FormulaEngine<Hybrid<...>>, the others go through a jump table holding
+// one compiled iteration per formula, indexed by the sequence.
+void render_hybrid(const vector<FormulaId>& sequence, bool double_precision, const View& view, const EscapeParams& params, IterationBuffer& out);
+
+// Defines of the frag_fractals.glsl variant running a sequence
+vector<string> hybrid_glsl_defines(const vector<FormulaId>& sequence);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _CPU_IMAGE_HPP_
+#define _CPU_IMAGE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 8 bits per channel RGB image, row 0 at the top.
+struct Image {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    vector<uint8_t> rgb;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        rgb.assign(size_t(w) * h * 3, 0);
+    }
+
+    // Binary PPM (P6), readable by most image tools
+    bool write_ppm(const string& filename) const;
+};
+
+#endif
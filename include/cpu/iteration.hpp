@@ -0,0 +1,59 @@
+#ifndef _CPU_ITERATION_HPP_
+#define _CPU_ITERATION_HPP_
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Region of the complex plane covered by an image. With the default values
+// a pixel maps to the same point as pos_screen in frag_fractals.glsl.
+struct View {
+    double center_x = 0.0;
+    double center_y = 0.0;
+    double zoom = 1.0;
+
+    unsigned int width = 1024;
+    unsigned int height = 768;
+
+    // Complex plane distance between two neighbouring pixels (along x)
+    double pixel_size() const {
+        return 2.0 / (zoom * width);
+    }
+    double re(double i) const {
+        return center_x + (2.0 * (i + 0.5) / width - 1.0) / zoom;
+    }
+    // Row 0 is the top of the image
+    double im(double j) const {
+        return center_y + (1.0 - 2.0 * (j + 0.5) / height) / zoom;
+    }
+};
+
+// Raw per-pixel result of an escape-time iteration, before any coloring.
+struct IterationBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int max_iter = 0;
+
+    // Continuous (smooth) iteration count in [0, max_iter), max_iter inside the set
+    vector<float> smooth;
+    // Exterior distance estimate, 0 for points inside the set
+    vector<float> de;
+    // 1 when the orbit escaped before max_iter
+    vector<uint8_t> escaped;
+    // z and dz/dc when the orbit escaped, interleaved (re, im) pairs
+    vector<float> z;
+    vector<float> dz;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        smooth.assign(size_t(w) * h, 0.f);
+        de.assign(size_t(w) * h, 0.f);
+        escaped.assign(size_t(w) * h, 0);
+        z.assign(2 * size_t(w) * h, 0.f);
+        dz.assign(2 * size_t(w) * h, 0.f);
+    }
+};
+
+#endif
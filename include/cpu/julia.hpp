@@ -0,0 +1,20 @@
+#ifndef _CPU_JULIA_HPP_
+#define _CPU_JULIA_HPP_
+
+#include "cpu/formula.hpp"
+#include "cpu/iteration.hpp"
+
+// CPU port of in_julia_set() from frag_fractals.glsl: z0 is the pixel and c
+// is fixed. Pixels are iterated SIMD_LANES at a time.
+void render_julia(const View& view, float re_c, float im_c, const EscapeParams& params, IterationBuffer& out);
+
+// Parameter-space atlas of c_grid.width x c_grid.height thumbnails. The
+// thumbnail in column i and row j shows the Julia set of
+// c = (c_grid.re(i), c_grid.im(j)) over the `thumb` view of the z0 plane.
+//
+// The SIMD lanes hold SIMD_LANES different values of c at the same pixel
+// rather than neighbouring pixels, so that many small images cost no more
+// than one large image.
+void render_julia_atlas(const View& c_grid, const View& thumb, const EscapeParams& params, IterationBuffer& atlas);
+
+#endif
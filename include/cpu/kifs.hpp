@@ -0,0 +1,116 @@
+#ifndef _CPU_KIFS_HPP_
+#define _CPU_KIFS_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+enum KifsFold {
+    // Folds on the symmetry planes of a regular tetrahedron
+    KIFS_SIERPINSKI = 0,
+    // Folds on the symmetry planes of a cube
+    KIFS_MENGER = 1
+};
+
+// Kaleidoscopic IFS (Knighty): the point is folded into a fundamental
+// domain of the solid's symmetry group, scaled about one of its vertices,
+// and this is repeated. The distance is then the one to the solid itself,
+// divided by scale^iterations. Without escape test every lane runs all
+// the iterations. KIFS_SIERPINSKI and KIFS_MENGER in frag_raymarch.glsl
+// are the same distance estimates.
+struct KaleidoscopicIFS {
+    KifsFold fold = KIFS_SIERPINSKI;
+    // 2 for the Sierpinski tetrahedron, 3 for the Menger sponge
+    float scale = 2.f;
+    unsigned int iterations = 10;
+
+    static KaleidoscopicIFS sierpinski() {
+        return KaleidoscopicIFS();
+    }
+
+    static KaleidoscopicIFS menger() {
+        KaleidoscopicIFS kifs;
+        kifs.fold = KIFS_MENGER;
+        kifs.scale = 3.f;
+        kifs.iterations = 5;
+        return kifs;
+    }
+
+    // Both solids fit in [-1, 1]^3
+    float bound() const {
+        return 1.75f;
+    }
+
+    vfloat distance(vfloat px, vfloat py, vfloat pz) const {
+        vfloat x = px, y = py, z = pz;
+        const float shift = scale - 1.f;
+        if(fold == KIFS_SIERPINSKI) {
+            for(unsigned int n = 0; n < iterations; n++) {
+                // Reflections on the planes x + y = 0, x + z = 0, y + z = 0
+                vint m = x + y < 0.f;
+                vfloat t = select(m, -y, x);
+                y = select(m, -x, y);
+                x = t;
+                m = x + z < 0.f;
+                t = select(m, -z, x);
+                z = select(m, -x, z);
+                x = t;
+                m = y + z < 0.f;
+                t = select(m, -z, y);
+                z = select(m, -y, z);
+                y = t;
+                // Scaled about the vertex (1, 1, 1)
+                x = scale * x - shift;
+                y = scale * y - shift;
+                z = scale * z - shift;
+            }
+            // Tetrahedron of vertices (1, 1, 1), (1, -1, -1), (-1, 1, -1),
+            // (-1, -1, 1)
+            vfloat d = vmax(vmax(-x - y - z, x + y - z), vmax(-x + y + z, x - y + z));
+            return (d - 1.f) * (0.57735027f * std::pow(scale, -float(iterations)));
+        }
+
+        for(unsigned int n = 0; n < iterations; n++) {
+            // Absolute values and sorting, x >= y >= z >= 0
+            x = vabs(x);
+            y = vabs(y);
+            z = vabs(z);
+            vfloat t = vmax(x, y);
+            y = vmin(x, y);
+            x = t;
+            t = vmax(x, z);
+            z = vmin(x, z);
+            x = t;
+            t = vmax(y, z);
+            z = vmin(y, z);
+            y = t;
+            // Scaled about the corner (1, 1, 1), the middle of the z edge
+            // being left in the central layer
+            x = scale * x - shift;
+            y = scale * y - shift;
+            z = scale * z;
+            z = select(z > 0.5f * shift, z - shift, z);
+        }
+        // Cube [-1, 1]^3
+        vfloat dx = vabs(x) - 1.f, dy = vabs(y) - 1.f, dz = vabs(z) - 1.f;
+        vfloat ox = vmax(dx, vbroadcast(0.f)), oy = vmax(dy, vbroadcast(0.f)), oz = vmax(dz, vbroadcast(0.f));
+        vfloat d = vsqrt(ox * ox + oy * oy + oz * oz) + vmin(vmax(dx, vmax(dy, dz)), vbroadcast(0.f));
+        return d * std::pow(scale, -float(iterations));
+    }
+
+    // Defines of the frag_raymarch.glsl variant
+    vector<string> glsl_defines() const {
+        return vector<string>({
+            fold == KIFS_SIERPINSKI ? "KIFS_SIERPINSKI" : "KIFS_MENGER",
+            "KIFS_SCALE float(" + to_string(scale) + ")",
+            "KIFS_ITERATIONS " + to_string(iterations),
+            "SCENE_BOUND 1.75"
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _CPU_LIGHTING_HPP_
+#define _CPU_LIGHTING_HPP_
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+
+// Relief lighting of the exterior: the slope direction z/(dz/dc) is turned
+// into a surface normal and lit with Blinn-Phong. frag_lighting.glsl
+// implements the same model.
+struct Light {
+    // Direction toward the light, in degrees
+    float azimuth = 45.f;
+    float elevation = 45.f;
+    // Larger values flatten the relief
+    float height = 1.5f;
+
+    float ambient = 0.35f;
+    float diffuse = 0.65f;
+    float specular = 0.25f;
+    float shininess = 24.f;
+
+    // Unit vector toward the light
+    void direction(float dir[3]) const;
+};
+
+// Post-stage applied to an already colored image, the points inside the set
+// are left untouched
+void shade_slope(const IterationBuffer& buffer, const Light& light, Image& image);
+
+#endif
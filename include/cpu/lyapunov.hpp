@@ -0,0 +1,72 @@
+#ifndef _CPU_LYAPUNOV_HPP_
+#define _CPU_LYAPUNOV_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+struct LyapunovParams {
+    // Steps of the logistic map before the exponent is measured, while the
+    // orbit settles on its attractor
+    unsigned int warmup = 200;
+    // Steps the exponent is averaged over
+    unsigned int iterations = 1000;
+    // fast_log() of cpu/simd.hpp instead of a libm log per lane, 7.4 to 7.9
+    // times faster on an AVX2 Xeon. On [2, 4]^2 the exponents moved by
+    // 2e-5 at most, 5e-9 on average (tools/lyapunov -c 1).
+    bool fast_log = true;
+};
+
+// Lyapunov exponent of each pixel, row 0 at the top
+struct LyapunovBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    vector<float> exponent;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        exponent.assign(size_t(w) * h, 0.f);
+    }
+};
+
+// Lyapunov fractal (Markus): the pixel (a, b) runs the logistic map
+// x <- r x (1 - x) from x = 1/2, r going through a and b in the order of a
+// sequence of letters A and B, repeated. The exponent is the mean of
+// log |r (1 - 2x)|, negative where the orbit is stable and positive where
+// it is chaotic. Outside of [0, 4]^2 the orbits diverge.
+class LyapunovSequence {
+    public:
+        LyapunovSequence();
+
+        // Letters A and B, in either case: "AB", "AABAB", "BBBBBBAAAAAA".
+        // Prints the error and returns false for anything else.
+        bool parse(const string& letters);
+
+        const string& letters() const;
+
+        // Defines of the frag_fractals.glsl variant drawing this fractal
+        vector<string> glsl_defines(const LyapunovParams& params) const;
+
+        // Rows are spread over all cores, SIMD_LANES pixels step together.
+        // The cost is the same for every pixel: warmup + iterations steps
+        // and a logarithm for each of the last iterations.
+        void render(const View& view, const LyapunovParams& params, LyapunovBuffer& out) const;
+
+    private:
+        string m_letters;
+        // 1 where r is b
+        vector<uint8_t> m_sequence;
+};
+
+// Stable pixels in yellow, chaotic ones in blue, both darker as the
+// exponent gets closer to 0. frag_fractals.glsl colors its LYAPUNOV
+// variant the same way.
+void colorize_lyapunov(const LyapunovBuffer& buffer, Image& out);
+
+#endif
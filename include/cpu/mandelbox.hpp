@@ -0,0 +1,60 @@
+#ifndef _CPU_MANDELBOX_HPP_
+#define _CPU_MANDELBOX_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Mandelbox (Lowe): the point is folded into the cube [-1, 1]^3 (box
+// fold), inverted in a sphere of radius 1 and scaled up 4 times inside the
+// sphere of radius 0.5 (sphere fold), then scaled and translated back by
+// the original point. The derivative follows the folds and the scale, the
+// distance is |z| / |dr|. With a negative scale the set is a maze of thin
+// walls, which the camera flies through rather than orbits.
+// MANDELBOX in frag_raymarch.glsl is the same distance estimate.
+struct Mandelbox {
+    float scale = -1.5f;
+    unsigned int iterations = 12;
+
+    // The set fits in [-2, 2]^3 for negative scales, and in the cube of
+    // half side 2 (scale + 1) / (scale - 1) above 1
+    float bound() const {
+        const float side = scale < 0.f ? 2.f : 2.f * (scale + 1.f) / (scale - 1.f);
+        return 1.7321f * side;
+    }
+
+    vfloat distance(vfloat px, vfloat py, vfloat pz) const {
+        vfloat x = px, y = py, z = pz;
+        vfloat dr = vbroadcast(1.f);
+        for(unsigned int n = 0; n < iterations; n++) {
+            // Box fold
+            x = 2.f * vclamp(x, -1.f, 1.f) - x;
+            y = 2.f * vclamp(y, -1.f, 1.f) - y;
+            z = 2.f * vclamp(z, -1.f, 1.f) - z;
+            // Sphere fold, radii 0.5 and 1
+            vfloat r2 = x * x + y * y + z * z;
+            vfloat k = select(r2 < 0.25f, vbroadcast(4.f), select(r2 < 1.f, 1.f / r2, vbroadcast(1.f)));
+            x = scale * k * x + px;
+            y = scale * k * y + py;
+            z = scale * k * z + pz;
+            dr = std::abs(scale) * k * dr + 1.f;
+        }
+        return vsqrt(x * x + y * y + z * z) / dr;
+    }
+
+    // Defines of the frag_raymarch.glsl variant
+    vector<string> glsl_defines() const {
+        return vector<string>({
+            "MANDELBOX",
+            "MANDELBOX_SCALE float(" + to_string(scale) + ")",
+            "MANDELBOX_ITERATIONS " + to_string(iterations),
+            "SCENE_BOUND float(" + to_string(bound()) + ")"
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef _CPU_MANDELBROT_HPP_
+#define _CPU_MANDELBROT_HPP_
+
+#include "cpu/formula.hpp"
+#include "cpu/iteration.hpp"
+
+// CPU port of in_mandelbrot_set() from frag_fractals.glsl. Pixels are
+// iterated SIMD_LANES at a time and rows are spread over all cores.
+void render_mandelbrot(const View& view, const EscapeParams& params, IterationBuffer& out);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _CPU_MANDELBULB_HPP_
+#define _CPU_MANDELBULB_HPP_
+
+#include <string>
+#include <vector>
+
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Power 8 Mandelbulb, the z axis being the pole of the spherical
+// coordinates. The triplex power is expanded into polynomials (Quilez), so
+// that an iteration has no trigonometry and a single square root.
+// MANDELBULB in frag_raymarch.glsl is the same distance estimate.
+struct Mandelbulb {
+    unsigned int iterations = 5;
+
+    float bound() const {
+        return 1.25f;
+    }
+
+    // 0.25 log(r) r / |dw| (Hubbard-Douady potential), lanes stop
+    // iterating once |w|^2 > 256
+    vfloat distance(vfloat px, vfloat py, vfloat pz) const {
+        vfloat wx = px, wy = py, wz = pz;
+        vfloat m = wx * wx + wy * wy + wz * wz;
+        vfloat dw = vbroadcast(1.f);
+        vint active = m <= 256.f;
+        for(unsigned int n = 0; n < iterations && any(active); n++) {
+            // x and y span the equator, the polynomials are written with
+            // b for the pole
+            vfloat a = wx, b = wz, c = wy;
+            vfloat a2 = a * a, b2 = b * b, c2 = c * c;
+            vfloat a4 = a2 * a2, b4 = b2 * b2, c4 = c2 * c2;
+            vfloat k3 = a2 + c2;
+            vfloat k3_2 = k3 * k3;
+            vfloat k2 = 1.f / vsqrt(k3_2 * k3_2 * k3_2 * k3);
+            vfloat k1 = a4 + b4 + c4 - 6.f * b2 * c2 - 6.f * a2 * b2 + 2.f * c2 * a2;
+            vfloat k4 = a2 - b2 + c2;
+
+            // |w|^7 = m^3 sqrt(m)
+            dw = select(active, 8.f * m * m * m * vsqrt(m) * dw + 1.f, dw);
+            vfloat na = 64.f * a * b * c * (a2 - c2) * k4 * (a4 - 6.f * a2 * c2 + c4) * k1 * k2;
+            vfloat nb = -16.f * b2 * k3 * k4 * k4 + k1 * k1;
+            vfloat nc = -8.f * b * k4 * (a4 * a4 - 28.f * a4 * a2 * c2 + 70.f * a4 * c4 - 28.f * a2 * c2 * c4 + c4 * c4) * k1 * k2;
+            wx = select(active, px + na, wx);
+            wz = select(active, pz + nb, wz);
+            wy = select(active, py + nc, wy);
+            m = select(active, wx * wx + wy * wy + wz * wz, m);
+            active &= m <= 256.f;
+        }
+        return 0.25f * fast_log(m) * vsqrt(m) / dw;
+    }
+
+    // Defines of the frag_raymarch.glsl variant
+    vector<string> glsl_defines() const {
+        return vector<string>({"MANDELBULB", "MANDELBULB_ITERATIONS " + to_string(iterations), "SCENE_BOUND 1.25"});
+    }
+};
+
+#endif
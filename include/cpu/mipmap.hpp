@@ -0,0 +1,57 @@
+#ifndef _CPU_MIPMAP_HPP_
+#define _CPU_MIPMAP_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Streams an 8 bits RGB image to disk band of rows after band of rows,
+// with its mipmap chain. Level k, of max(1, width >> k) x max(1, height >> k)
+// pixels, goes to stem_mip<k>.ppm, level 0 to stem.ppm. A pixel of a level
+// is the mean of the area it covers in the level above, fractions of pixels
+// included: the levels of a tileable image tile too, whatever its size.
+// Every band is filtered on all cores as it arrives and the levels are
+// kept as floats, only a few rows of each are ever held in memory.
+class MipmapWriter {
+    public:
+        MipmapWriter(const string& stem, unsigned int width, unsigned int height, bool mipmaps);
+        ~MipmapWriter();
+
+        // rows x width pixels, the top one first. False once a write failed.
+        bool write(const uint8_t* rgb, unsigned int rows);
+        // True when every level was written whole
+        bool close();
+
+        unsigned int getLevels() const;
+
+    private:
+        struct Level {
+            unsigned int width;
+            unsigned int height;
+            string filename;
+            ofstream file;
+            // Rows received, and rows of the next level written
+            unsigned int rows_in;
+            unsigned int rows_out;
+            // Next level row in progress, filtered along x
+            vector<float> carry;
+            // Taps of the filter along x, taps_per_pixel per pixel of the
+            // next level from its first column
+            vector<unsigned int> first;
+            vector<float> taps;
+            unsigned int taps_per_pixel;
+        };
+
+        bool writeLevel(unsigned int k, const float* rgb, unsigned int rows);
+        bool writeFile(Level& level, const float* rgb, unsigned int rows);
+
+    private:
+        vector<unique_ptr<Level>> m_levels;
+        bool m_good;
+};
+
+#endif
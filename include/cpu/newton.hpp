@@ -0,0 +1,85 @@
+#ifndef _CPU_NEWTON_HPP_
+#define _CPU_NEWTON_HPP_
+
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+
+using namespace std;
+
+const unsigned int NEWTON_MAX_DEGREE = 16;
+// Roots closer than this, relative to 1 + |z|, are one repeated root
+const double NEWTON_ROOT_MERGE = 1e-4;
+
+struct NewtonParams {
+    unsigned int max_iter = 50;
+    // A pixel stops once z is closer than this to one of the roots
+    float epsilon = 1e-3f;
+};
+
+// Root each pixel converged to and after how many Newton steps, row 0 at
+// the top. -1 when it did not converge within max_iter steps.
+struct NewtonBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int max_iter = 0;
+    // Degree of the polynomial, the number of roots
+    unsigned int degree = 0;
+
+    // Steps until z came within epsilon of the root, with the fraction of
+    // the last step interpolated on log(distance)
+    vector<float> smooth;
+    vector<int8_t> root;
+
+    void resize(unsigned int w, unsigned int h, unsigned int iter) {
+        width = w;
+        height = h;
+        max_iter = iter;
+        smooth.assign(size_t(w) * h, float(iter));
+        root.assign(size_t(w) * h, int8_t(-1));
+    }
+};
+
+// Newton fractal of a polynomial with real coefficients: every pixel is the
+// starting point of z <- z - p(z)/p'(z), colored by the root it ends on.
+// The roots are computed once, with the Durand-Kerner method, and the steps
+// evaluate p'/p from them, which keeps repeated roots within float reach.
+class NewtonPolynomial {
+    public:
+        NewtonPolynomial();
+
+        // Coefficients from the highest degree down, separated by spaces or
+        // commas: "1 0 0 -1" is z^3 - 1. Prints the error and returns false
+        // when the text does not parse, the degree is not in [2, 16] or the
+        // roots are not found, the polynomial is then left as it was.
+        bool parse(const string& coefficients);
+
+        unsigned int degree() const;
+        const vector<double>& coefficients() const;
+        const vector<complex<double>>& roots() const;
+
+        // Defines of the frag_fractals.glsl variant drawing this fractal
+        vector<string> glsl_defines() const;
+
+        // Rows are spread over all cores, SIMD_LANES pixels step together
+        // until they all converged
+        void render(const View& view, const NewtonParams& params, NewtonBuffer& out) const;
+
+    private:
+        // False when a root estimate is not finite
+        bool solve();
+
+    private:
+        vector<double> m_coefficients;
+        vector<complex<double>> m_roots;
+};
+
+// Hue of the root, darker with the number of steps. frag_fractals.glsl
+// colors its NEWTON variant the same way.
+void colorize_newton(const NewtonBuffer& buffer, Image& out);
+
+#endif
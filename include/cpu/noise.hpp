@@ -0,0 +1,341 @@
+#ifndef _CPU_NOISE_HPP_
+#define _CPU_NOISE_HPP_
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/iteration.hpp"
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Domain warping kernels of shaders/noise.glsl: fbm() of the plane point,
+// or fbm() of the point moved by one (warp_second()) or two (warp_third())
+// fbm vector fields.
+enum class WarpKernel {
+    FBM,
+    WARP_SECOND,
+    WARP_THIRD
+};
+
+// Hash of the lattice points of the noise, the defines of shaders/noise.glsl
+enum class NoiseBasis {
+    // rand(), fraction of a sine. GPUs round sin() differently, the
+    // values only agree within 1e-3 and the warps drift further apart.
+    SIN,
+    // NOISE_HASH, PCG integer hash: the same lattice values everywhere
+    HASH,
+    // NOISE_GRADIENT, gradient noise with gradients picked by the PCG hash
+    GRADIENT
+};
+
+// Kernel value of each pixel, row 0 at the top
+struct NoiseBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    vector<float> value;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        value.assign(size_t(w) * h, 0.f);
+    }
+};
+
+// Tileable noise texture of NOISE_TEXTURE in shaders/noise.glsl: noise()
+// over period x period lattice cells, whose corners wrap around, sampled
+// texels_per_cell times along each side of a cell. With a single texel per
+// cell the texels hold the lattice values, the sample point is moved along
+// the smoothstep and the bilinear filter does the blend: value noise only.
+struct NoiseTile {
+    NoiseBasis basis = NoiseBasis::HASH;
+    // Both powers of two
+    unsigned int period = 128;
+    unsigned int texels_per_cell = 4;
+    // size() x size() texels from bake_noise_tile(), row 0 at t = 0
+    NoiseBuffer texels;
+
+    unsigned int size() const {
+        return period * texels_per_cell;
+    }
+};
+
+struct NoiseParams {
+    NoiseBasis basis = NoiseBasis::SIN;
+    // numOctaves and H of fbm(): each octave doubles the frequency and
+    // scales the amplitude by 2^-H
+    unsigned int octaves = 10;
+    float H = 1.f;
+    // time uniform, which slides the inner fields of warp_second()
+    float time = 0.f;
+    // NOISE_PERIOD, the lattice wraps around every period cells when not 0.
+    // A power of two.
+    unsigned int period = 0;
+    // Baked noise read by fbm() instead of noise(), when not null
+    const NoiseTile* tile = nullptr;
+};
+
+// sin(x) of floats below 2^24, rounded from double precision: rand()
+// multiplies it by 43758.5453 and keeps the fraction, so that a single ulp
+// moves the hash by 1e-3 and may wrap it around. The reduction by the
+// multiples of pi/2 and the Taylor polynomials on [-pi/4, pi/4] both run
+// on doubles, fast_sincos() loses the low bits past |x| = 1000 and the
+// higher octaves reach 1e5.
+inline vfloat noise_sin(vfloat x) {
+    const vdouble xd = __builtin_convertvector(x, vdouble);
+    const vdouble k = xd * 0.63661977236758134 + 0.5;
+    vdouble j = __builtin_convertvector(__builtin_convertvector(k, vlong), vdouble);
+    j = j > k ? j - 1.0 : j;
+    const vdouble r = (xd - j * 1.5707963267948966) - j * 6.123233995736766e-17;
+    const vdouble rr = r * r;
+    const vdouble s = r + r * rr * (-1.0 / 6 + rr * (1.0 / 120 + rr * (-1.0 / 5040 + rr * (1.0 / 362880
+                    + rr * (-1.0 / 39916800 + rr * (1.0 / 6227020800.0))))));
+    const vdouble c = 1.0 + rr * (-0.5 + rr * (1.0 / 24 + rr * (-1.0 / 720 + rr * (1.0 / 40320
+                    + rr * (-1.0 / 3628800 + rr * (1.0 / 479001600))))));
+    const vint q = __builtin_convertvector(j, vint) & 3;
+    const vfloat v = select((q & 1) != 0, __builtin_convertvector(c, vfloat), __builtin_convertvector(s, vfloat));
+    return select((q & 2) != 0, -v, v);
+}
+
+inline vfloat fract(vfloat x) {
+    return x - vfloor(x);
+}
+
+// rand() of shaders/noise.glsl, in [0, 1)
+inline vfloat noise_rand(vfloat x, vfloat y) {
+    return fract(noise_sin(x * 12.9898f + y * 4.1414f) * 43758.5453f);
+}
+
+// PCG hash (Jarzynski and Olano, Hash Functions for GPU Rendering, 2020)
+inline vuint pcg_hash(vuint v) {
+    const vuint state = v * 747796405u + 2891336453u;
+    const vuint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Hash of the integer points (x, y), lattice_hash() of shaders/noise.glsl
+inline vuint lattice_hash(vfloat x, vfloat y) {
+    return pcg_hash((vuint)to_int(x) + pcg_hash((vuint)to_int(y)));
+}
+
+// rand() of NOISE_HASH, 24 bits of the hash in [0, 1)
+inline vfloat hash_rand(vfloat x, vfloat y) {
+    return to_float((vint)(lattice_hash(x, y) >> 8u)) * (1.f / 16777216.f);
+}
+
+// Gradient of the point (x, y) projected on (dx, dy): the 3 top bits of
+// its hash pick (1, 0), (-1, 0), (0, 1), (0, -1), (1, 1), (-1, 1), (1, -1)
+// or (-1, -1), corner() of shaders/noise.glsl. The products are exact,
+// only the sum rounds.
+inline vfloat hash_gradient(vfloat x, vfloat y, vfloat dx, vfloat dy) {
+    const vint k = (vint)(lattice_hash(x, y) >> 29u);
+    const vint flip_x = (k & 1) != 0, flip_y = (k & 2) != 0;
+    const vfloat sx = select(flip_x, -dx, dx), sy = select(flip_y, -dy, dy);
+    return select(k >= 4, sx + sy, select(flip_y, select(flip_x, -dy, dy), sx));
+}
+
+// The corners (x0, y0) to (x1, y1) of the cell of the point at offset
+// (fx, fy) from (x0, y0): their values, or their gradients projected on
+// the offsets to the point, blended along the smoothstep of the offset
+template <NoiseBasis Basis>
+inline vfloat cell_noise(vfloat x0, vfloat y0, vfloat x1, vfloat y1, vfloat fx, vfloat fy) {
+    const vfloat ux = fx * fx * (3.f - 2.f * fx), uy = fy * fy * (3.f - 2.f * fy);
+    vfloat a, b, c, d;
+    if(Basis == NoiseBasis::SIN) {
+        a = noise_rand(x0, y0);
+        b = noise_rand(x1, y0);
+        c = noise_rand(x0, y1);
+        d = noise_rand(x1, y1);
+    } else if(Basis == NoiseBasis::HASH) {
+        a = hash_rand(x0, y0);
+        b = hash_rand(x1, y0);
+        c = hash_rand(x0, y1);
+        d = hash_rand(x1, y1);
+    } else {
+        a = hash_gradient(x0, y0, fx, fy);
+        b = hash_gradient(x1, y0, fx - 1.f, fy);
+        c = hash_gradient(x0, y1, fx, fy - 1.f);
+        d = hash_gradient(x1, y1, fx - 1.f, fy - 1.f);
+    }
+    const vfloat bottom = a + (b - a) * ux, top = c + (d - c) * ux;
+    const vfloat n = bottom + (top - bottom) * uy;
+    return Basis == NoiseBasis::GRADIENT ? 0.5f + 0.5f * n : n;
+}
+
+// noise() of shaders/noise.glsl with the define of Basis
+template <NoiseBasis Basis>
+inline vfloat lattice_noise(vfloat x, vfloat y) {
+    const vfloat bx = vfloor(x), by = vfloor(y);
+    return cell_noise<Basis>(bx, by, bx + 1.f, by + 1.f, x - bx, y - by);
+}
+
+// lattice_noise() whose lattice wraps around every period cells
+template <NoiseBasis Basis>
+inline vfloat periodic_noise(vfloat x, vfloat y, float period) {
+    const vfloat bx = vfloor(x), by = vfloor(y);
+    const vfloat x0 = bx - vfloor(bx / period) * period, y0 = by - vfloor(by / period) * period;
+    const vfloat x1 = select(x0 + 1.f == period, vbroadcast(0.f), x0 + 1.f);
+    const vfloat y1 = select(y0 + 1.f == period, vbroadcast(0.f), y0 + 1.f);
+    return cell_noise<Basis>(x0, y0, x1, y1, x - bx, y - by);
+}
+
+// texture() of the GL_REPEAT, GL_LINEAR tile at the texel coordinates
+// (s, t), texel centers on the integers
+inline vfloat tile_texture(const NoiseTile& tile, vfloat s, vfloat t) {
+    const vfloat s0 = vfloor(s), t0 = vfloor(t);
+    const vfloat ws = s - s0, wt = t - t0;
+    const vint mask = vbroadcast(int32_t(tile.size() - 1));
+    const vint i0 = to_int(s0) & mask, j0 = to_int(t0) & mask;
+    const vint i1 = (i0 + 1) & mask, j1 = (j0 + 1) & mask;
+    const vint row0 = j0 * int32_t(tile.size()), row1 = j1 * int32_t(tile.size());
+    const float* texels = tile.texels.value.data();
+    const vfloat a = gather(texels, row0 + i0), b = gather(texels, row0 + i1);
+    const vfloat c = gather(texels, row1 + i0), d = gather(texels, row1 + i1);
+    const vfloat bottom = a + (b - a) * ws, top = c + (d - c) * ws;
+    return bottom + (top - bottom) * wt;
+}
+
+// noise() of NOISE_TEXTURE, read from the baked tile
+inline vfloat tile_noise(const NoiseTile& tile, vfloat x, vfloat y) {
+    if(tile.texels_per_cell == 1) {
+        const vfloat bx = vfloor(x), by = vfloor(y);
+        const vfloat fx = x - bx, fy = y - by;
+        return tile_texture(tile, bx + fx * fx * (3.f - 2.f * fx), by + fy * fy * (3.f - 2.f * fy));
+    }
+    return tile_texture(tile, x * float(tile.texels_per_cell), y * float(tile.texels_per_cell));
+}
+
+template <NoiseBasis Basis>
+inline vfloat fbm(vfloat x, vfloat y, const NoiseParams& params) {
+    const float gain = std::exp2(-params.H);
+    float f = 1.f, a = 1.f;
+    vfloat t = vbroadcast(0.f);
+    for(unsigned int i = 0; i < params.octaves; i++) {
+        t += a * (params.period ? periodic_noise<Basis>(f * x, f * y, float(params.period)) : lattice_noise<Basis>(f * x, f * y));
+        f *= 2.f;
+        a *= gain;
+    }
+    return t;
+}
+
+inline vfloat tile_fbm(vfloat x, vfloat y, const NoiseParams& params) {
+    const float gain = std::exp2(-params.H);
+    float f = 1.f, a = 1.f;
+    vfloat t = vbroadcast(0.f);
+    for(unsigned int i = 0; i < params.octaves; i++) {
+        t += a * tile_noise(*params.tile, f * x, f * y);
+        f *= 2.f;
+        a *= gain;
+    }
+    return t;
+}
+
+inline vfloat fbm(vfloat x, vfloat y, const NoiseParams& params) {
+    if(params.tile) {
+        return tile_fbm(x, y, params);
+    }
+    switch(params.basis) {
+        case NoiseBasis::HASH:
+            return fbm<NoiseBasis::HASH>(x, y, params);
+        case NoiseBasis::GRADIENT:
+            return fbm<NoiseBasis::GRADIENT>(x, y, params);
+        default:
+            return fbm<NoiseBasis::SIN>(x, y, params);
+    }
+}
+
+// Offset of the point by the inner fields of warp_second()
+inline void warp_second_offset(vfloat x, vfloat y, const NoiseParams& params, vfloat& dx, vfloat& dy) {
+    const float shift = params.time / 2.f;
+    dx = 4.f * fbm(x + 0.f * shift, y + 0.2f * shift, params);
+    dy = 4.f * fbm(x + 2.2f * shift, y + 0.3f * shift, params);
+}
+
+inline vfloat warp_second(vfloat x, vfloat y, const NoiseParams& params) {
+    vfloat dx, dy;
+    warp_second_offset(x, y, params, dx, dy);
+    return fbm(x + dx, y + dy, params);
+}
+
+inline vfloat warp_third(vfloat x, vfloat y, const NoiseParams& params) {
+    const vfloat qx = fbm(x + 5.f, y + 7.2f, params);
+    const vfloat qy = fbm(x - 2.5f, y + 5.3f, params);
+    return warp_second(x + 4.f * qx, y + 4.f * qy, params);
+}
+
+// Offset of the point by the inner fields of warp_third(), whose value is
+// fbm() of the point moved by it up to the rounding of the sum
+inline void warp_third_offset(vfloat x, vfloat y, const NoiseParams& params, vfloat& dx, vfloat& dy) {
+    const vfloat qx = 4.f * fbm(x + 5.f, y + 7.2f, params);
+    const vfloat qy = 4.f * fbm(x - 2.5f, y + 5.3f, params);
+    warp_second_offset(x + qx, y + qy, params, dx, dy);
+    dx += qx;
+    dy += qy;
+}
+
+// Catmull-Rom weights of the 4 samples around the position t in [0, 1)
+// between the second and the third one
+inline void catmull_rom(vfloat t, vfloat w[4]) {
+    const vfloat tt = t * t;
+    w[0] = t * (-0.5f + t * (1.f - 0.5f * t));
+    w[1] = 1.f + tt * (-2.5f + 1.5f * t);
+    w[2] = t * (0.5f + t * (2.f - 1.5f * t));
+    w[3] = tt * (-0.5f + 0.5f * t);
+}
+
+// Defines of the shaders/noise.glsl variant
+inline vector<string> noise_defines(const NoiseParams& params) {
+    if(params.tile) {
+        return params.tile->texels_per_cell == 1 ? vector<string>({"NOISE_TEXTURE", "NOISE_TEXTURE_LATTICE"})
+                                                 : vector<string>({"NOISE_TEXTURE"});
+    }
+    vector<string> defines;
+    if(params.basis == NoiseBasis::HASH) {
+        defines.push_back("NOISE_HASH");
+    } else if(params.basis == NoiseBasis::GRADIENT) {
+        defines.push_back("NOISE_GRADIENT");
+    }
+    if(params.period) {
+        defines.push_back("NOISE_PERIOD " + to_string(params.period));
+    }
+    return defines;
+}
+
+// Fills tile.texels, rows are spread over all cores
+void bake_noise_tile(NoiseTile& tile);
+
+// The kernel at the center of each pixel of the view. Rows are spread
+// over all cores, SIMD_LANES pixels step together.
+void render_warp(const View& view, WarpKernel kernel, const NoiseParams& params, NoiseBuffer& out);
+
+// The warps shift their inner fields by (0, 0.1) and (1.1, 0.15) times the
+// time: on noise of the given period, they come back to the same image
+// after 20 periods of time
+inline float warp_loop_time(unsigned int period) {
+    return 20.f * float(period);
+}
+
+// Loopable animation of the kernel on noise of params.period (non zero):
+// frame k is at params.time + k / frames of warp_loop_time(). Whole frames
+// are spread over all cores, each rendered by a single thread, and handed
+// to done(k, frame) on that thread, in no particular order. Long animations
+// scale better than with render_warp() frame after frame, the threads
+// never wait for each other at the end of a frame.
+void render_warp_loop(const View& view, WarpKernel kernel, const NoiseParams& params, unsigned int frames,
+                      const function<void(unsigned int, const NoiseBuffer&)>& done);
+
+// render_warp() with the offset of the inner fields of warp_second() or
+// warp_third() computed once per divisor x divisor pixels, and upsampled
+// along Catmull-Rom splines: only the outer fbm() runs for every pixel. The
+// field has a margin of two samples on every side, the splines never leave
+// it. The inner fields are smooth but for their high octaves, whose
+// amplitude is small.
+void render_warp_field(const View& view, WarpKernel kernel, const NoiseParams& params, unsigned int divisor, NoiseBuffer& out);
+
+// Grey levels, value * scale clamped to [0, 1]
+void colorize_noise(const NoiseBuffer& buffer, float scale, Image& out);
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef _CPU_OCCLUSION_HPP_
+#define _CPU_OCCLUSION_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "cpu/raymarch.hpp"
+#include "settings.hpp"
+
+using namespace std;
+
+// Shadows and ambient occlusion of the 3D scenes. Neither depends on the
+// camera: the shadow map only changes with the light and the scene, the
+// occlusion volume with the scene, so a camera move reuses both and only
+// marches the primary rays again. frag_raymarch.glsl implements the same
+// passes (SHADOW_PASS and OCCLUSION_PASS).
+struct OcclusionParams {
+    // Texels of the shadow map, over the disc of the bounding sphere seen
+    // from the light
+    unsigned int shadow_width = SHADOW_WIDTH;
+    unsigned int shadow_height = SHADOW_HEIGHT;
+    // Shaded points are moved off the surface along the normal by that
+    // many shadow texels before the depth test, against shadow acne
+    float shadow_bias = 2.f;
+    // Voxels along each side of the bounding cube of the scene
+    unsigned int volume_size = 64;
+    // Occlusion directions added at each accumulation, and in total
+    unsigned int directions = 4;
+    unsigned int max_directions = 32;
+    // Length of the occlusion rays, as a fraction of the scene bound, and
+    // the distance evaluations along them
+    float radius = 0.3f;
+    unsigned int occlusion_steps = 16;
+};
+
+// Depth of the scene seen from the light by parallel rays, which start on
+// the plane tangent to the bounding sphere and go along -light
+struct ShadowMap {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    float bound = 0.f;
+    // Unit vector toward the light, and the axes of the map
+    float light[3] = {0.f, 0.f, 1.f};
+    float right[3] = {1.f, 0.f, 0.f};
+    float up[3] = {0.f, 1.f, 0.f};
+    // Distance from the plane to the surface, INFINITY where the ray
+    // missed. Rows from the bottom, as the GL texture.
+    vector<float> depth;
+
+    // Horizontal right axis as for Camera::rays(), up = right x -light
+    static void basis(const float light[3], float right[3], float up[3]);
+
+    // Fraction of p lit, the depth test of the 2x2 nearest texels
+    // bilinearly weighted
+    float visibility(const float p[3]) const;
+};
+
+// Mean visibility of the directions around the centers of a grid of
+// voxels over the bounding cube of the scene, accumulated a few
+// directions at a time
+struct OcclusionVolume {
+    unsigned int size = 0;
+    float bound = 0.f;
+    // Directions accumulated so far
+    unsigned int directions = 0;
+    // x fastest, then y, then z
+    vector<float> visibility;
+
+    // Ambient term at p, trilinear in the voxels: twice the visibility, as
+    // a point of a plane only sees half of the directions, at most 1
+    float ambient(const float p[3]) const;
+};
+
+// k-th of count directions spread on the sphere (spherical Fibonacci
+// lattice), the same set whatever the accumulation order
+void fibonacci_direction(unsigned int k, unsigned int count, float dir[3]);
+
+// Shadow map of the scene for the unit vector toward the light
+template<typename Scene>
+MarchStats render_shadow_map(const Scene& scene, const float light[3], const MarchParams& params,
+                             const OcclusionParams& occlusion, ShadowMap& out) {
+    auto start = chrono::steady_clock::now();
+    const unsigned int width = occlusion.shadow_width, height = occlusion.shadow_height;
+    const float bound = scene.bound();
+    out.width = width;
+    out.height = height;
+    out.bound = bound;
+    for(unsigned int c = 0; c < 3; c++) {
+        out.light[c] = light[c];
+    }
+    ShadowMap::basis(light, out.right, out.up);
+    out.depth.assign(size_t(width) * height, INFINITY);
+
+    const float texel = 2.f * bound / float(std::min(width, height));
+    const vfloat lanes = vlane_index();
+    vector<size_t> thread_hits(worker_count(), 0), thread_steps(worker_count(), 0);
+    parallel_for(height, 4, [&](size_t begin, size_t end, unsigned int thread) {
+        for(size_t j = begin; j < end; j++) {
+            const float v = 2.f * (float(j) + 0.5f) / float(height) - 1.f;
+            for(unsigned int i = 0; i < width; i += SIMD_LANES) {
+                vfloat u = 2.f * (float(i) + lanes + 0.5f) / float(width) - 1.f;
+                vfloat eye[3], dir[3];
+                for(unsigned int c = 0; c < 3; c++) {
+                    eye[c] = bound * (light[c] + u * out.right[c] + v * out.up[c]);
+                    dir[c] = vbroadcast(-light[c]);
+                }
+                // The corners of the map are outside of the bounding sphere
+                vint active = ((float(i) + lanes) < float(width)) & (u * u + v * v <= 1.f);
+                vfloat t = vbroadcast(0.f);
+                vint steps = vbroadcast(int32_t(0));
+                vint hit = march_packet(scene, eye, dir, t, vbroadcast(2.f * bound), active, params, 0.f, steps, texel);
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < width; l++) {
+                    thread_steps[thread] += steps[l];
+                    if(hit[l]) {
+                        out.depth[j * width + i + l] = t[l];
+                        thread_hits[thread]++;
+                    }
+                }
+            }
+        }
+    });
+
+    MarchStats stats;
+    stats.rays = size_t(width) * height;
+    for(unsigned int k = 0; k < worker_count(); k++) {
+        stats.hits += thread_hits[k];
+        stats.steps += thread_steps[k];
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Soft visibility of SIMD_LANES points along dir up to radius: the
+// smallest 4 distance / (t + voxel) on the way, a cone of about 14
+// degrees around the ray, 0 once the ray is stopped by the surface
+template<typename Scene>
+vfloat occlusion_packet(const Scene& scene, const vfloat p[3], const float dir[3], float radius, float voxel,
+                        unsigned int max_steps, vint& steps) {
+    vfloat t = vbroadcast(0.f);
+    vfloat visibility = vbroadcast(1.f);
+    vint active = vbroadcast(int32_t(-1));
+    for(unsigned int n = 0; n < max_steps && any(active); n++) {
+        vfloat d = scene.distance(p[0] + t * dir[0], p[1] + t * dir[1], p[2] + t * dir[2]);
+        steps -= active;
+        visibility = select(active, vmin(visibility, 4.f * d / (t + voxel)), visibility);
+        t += vmax(d, vbroadcast(0.25f * voxel));
+        active &= (t < radius) & (visibility > 0.f);
+    }
+    return vclamp(visibility, 0.f, 1.f);
+}
+
+// Adds the next occlusion.directions directions to the volume, which is
+// reset when it does not match the scene. Nothing is done once
+// max_directions are in.
+template<typename Scene>
+MarchStats accumulate_occlusion(const Scene& scene, const OcclusionParams& occlusion, OcclusionVolume& volume) {
+    auto start = chrono::steady_clock::now();
+    const unsigned int size = occlusion.volume_size;
+    if(volume.size != size || volume.bound != scene.bound()) {
+        volume.size = size;
+        volume.bound = scene.bound();
+        volume.directions = 0;
+        volume.visibility.assign(size_t(size) * size * size, 1.f);
+    }
+    MarchStats stats;
+    if(volume.directions >= occlusion.max_directions) {
+        return stats;
+    }
+
+    const unsigned int first = volume.directions;
+    const unsigned int count = std::min(occlusion.directions, occlusion.max_directions - first);
+    vector<float> dirs(3 * count);
+    for(unsigned int k = 0; k < count; k++) {
+        fibonacci_direction(first + k, occlusion.max_directions, &dirs[3 * k]);
+    }
+    // Running mean over the directions
+    const float weight = float(count) / float(first + count);
+    const float voxel = 2.f * volume.bound / float(size);
+    const float radius = occlusion.radius * volume.bound;
+    const vfloat lanes = vlane_index();
+
+    vector<size_t> thread_steps(worker_count(), 0);
+    parallel_for(size_t(size) * size, 8, [&](size_t begin, size_t end, unsigned int thread) {
+        for(size_t row = begin; row < end; row++) {
+            const float y = (float(row % size) + 0.5f) * voxel - volume.bound;
+            const float z = (float(row / size) + 0.5f) * voxel - volume.bound;
+            for(unsigned int i = 0; i < size; i += SIMD_LANES) {
+                vfloat p[3] = {(float(i) + lanes + 0.5f) * voxel - volume.bound, vbroadcast(y), vbroadcast(z)};
+                vint steps = vbroadcast(int32_t(0));
+                vfloat sum = vbroadcast(0.f);
+                for(unsigned int k = 0; k < count; k++) {
+                    sum += occlusion_packet(scene, p, &dirs[3 * k], radius, voxel, occlusion.occlusion_steps, steps);
+                }
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < size; l++) {
+                    float& v = volume.visibility[row * size + i + l];
+                    v = weight * (sum[l] / float(count)) + (1.f - weight) * v;
+                    thread_steps[thread] += steps[l];
+                }
+            }
+        }
+    });
+    volume.directions += count;
+
+    stats.rays = volume.visibility.size() * count;
+    for(size_t s : thread_steps) {
+        stats.steps += s;
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Lit fraction of the diffuse term and ambient term of every hit of the
+// buffer, 1 for the background, to be given to shade_march()
+void light_march(const MarchBuffer& buffer, const Camera& camera, const ShadowMap& shadow, const OcclusionVolume& volume,
+                 const OcclusionParams& occlusion, vector<float>& lit, vector<float>& ambient);
+
+#endif
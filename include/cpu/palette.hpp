@@ -0,0 +1,49 @@
+#ifndef _CPU_PALETTE_HPP_
+#define _CPU_PALETTE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Gradient stop, color channels in [0, 1]
+struct PaletteStop {
+    float position;
+    float r, g, b;
+};
+
+// Color gradient applied to the iteration results. Consecutive stops are
+// blended with a smoothstep, like the mix()/smoothstep() chain of main() in
+// frag_fractals.glsl.
+class Palette {
+    public:
+        // The c0..c3 gradient of frag_fractals.glsl
+        Palette();
+
+        // Text file, one "position r g b" stop per line with colors in [0, 255].
+        // An "interior r g b" line sets the color of the points inside the set.
+        bool load(const string& filename);
+
+        // t is clamped to [0, 1]
+        void sample(float t, float rgb[3]) const;
+        const float* interior() const;
+
+        // RGBA8 colors sampled uniformly over [0, 1] (alpha is 255)
+        vector<uint32_t> lut(unsigned int size) const;
+        uint32_t interior_rgba() const;
+
+    private:
+        vector<PaletteStop> m_stops;
+        float m_interior[3];
+};
+
+inline uint32_t pack_rgba(const float rgb[3]) {
+    auto to_byte = [](float c) {
+        c = c < 0.f ? 0.f : (c > 1.f ? 1.f : c);
+        return uint32_t(c * 255.f + 0.5f);
+    };
+    return to_byte(rgb[0]) | (to_byte(rgb[1]) << 8) | (to_byte(rgb[2]) << 16) | (255u << 24);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _CPU_PARALLEL_HPP_
+#define _CPU_PARALLEL_HPP_
+
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// Number of worker threads used by parallel_for (one per hardware thread).
+unsigned int worker_count();
+
+// Runs fn(begin, end, thread) over [0, count) in chunks of `grain` items.
+// Chunks are handed out dynamically so that uneven rows (e.g. the inside of
+// the Mandelbrot set) do not leave threads idle. `thread` is in [0, worker_count()).
+void parallel_for(size_t count, size_t grain, const function<void(size_t, size_t, unsigned int)>& fn);
+
+#endif
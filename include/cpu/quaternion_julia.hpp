@@ -0,0 +1,62 @@
+#ifndef _CPU_QUATERNION_JULIA_HPP_
+#define _CPU_QUATERNION_JULIA_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Julia set of q -> q^2 + c over the quaternions, cut by the hyperplane
+// w = slice: the point (x, y, z) is the quaternion x + y i + z j + slice k.
+// QUATERNION_JULIA in frag_raymarch.glsl is the same distance estimate.
+struct QuaternionJulia {
+    float c[4] = {-0.291f, -0.399f, 0.339f, 0.437f};
+    float slice = 0.f;
+    unsigned int iterations = 11;
+
+    float bound() const {
+        return 1.5f;
+    }
+
+    // 0.5 |q| log|q| / |dq|. The norm of a quaternion product is the
+    // product of the norms, so |dq| follows 2 |q| |dq| without tracking dq.
+    vfloat distance(vfloat px, vfloat py, vfloat pz) const {
+        vfloat qx = px, qy = py, qz = pz, qw = vbroadcast(slice);
+        vfloat m = qx * qx + qy * qy + qz * qz + qw * qw;
+        // |dq|^2
+        vfloat md = vbroadcast(1.f);
+        vint active = m <= 256.f;
+        for(unsigned int n = 0; n < iterations && any(active); n++) {
+            md = select(active, 4.f * m * md, md);
+            vfloat nx = qx * qx - qy * qy - qz * qz - qw * qw + c[0];
+            vfloat ny = 2.f * qx * qy + c[1];
+            vfloat nz = 2.f * qx * qz + c[2];
+            vfloat nw = 2.f * qx * qw + c[3];
+            qx = select(active, nx, qx);
+            qy = select(active, ny, qy);
+            qz = select(active, nz, qz);
+            qw = select(active, nw, qw);
+            m = select(active, qx * qx + qy * qy + qz * qz + qw * qw, m);
+            active &= m <= 256.f;
+        }
+        return 0.25f * vsqrt(m / md) * fast_log(m);
+    }
+
+    // Defines of the frag_raymarch.glsl variant
+    vector<string> glsl_defines() const {
+        char constant[128];
+        snprintf(constant, sizeof(constant), "QUATERNION_JULIA_C vec4(%.9g, %.9g, %.9g, %.9g)", c[0], c[1], c[2], c[3]);
+        return vector<string>({
+            "QUATERNION_JULIA",
+            constant,
+            "QUATERNION_JULIA_SLICE float(" + to_string(slice) + ")",
+            "QUATERNION_JULIA_ITERATIONS " + to_string(iterations),
+            "SCENE_BOUND 1.5"
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,393 @@
+#ifndef _CPU_RAYMARCH_HPP_
+#define _CPU_RAYMARCH_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpu/image.hpp"
+#include "cpu/lighting.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+// Pinhole camera of the 3D scenes, z is up as for Light::direction()
+struct Camera {
+    float eye[3] = {3.f, 0.f, 0.f};
+    // Heading around the z axis and elevation of the view direction, in
+    // degrees. (0, 0) looks down the x axis.
+    float yaw = 180.f;
+    float pitch = 0.f;
+    // Vertical field of view, in degrees
+    float fov = 45.f;
+    // Offset of the rays from the pixel centers, in pixels (x to the right,
+    // y down), for the jittered frames averaged while the camera is still
+    float jitter[2] = {0.f, 0.f};
+
+    // Eye at distance from target, in the direction given by azimuth and
+    // elevation (degrees, as for Light), looking at the target
+    void orbit(const float target[3], float distance, float azimuth, float elevation);
+
+    // View direction, and the right and up vectors scaled so that
+    // forward + x right + y up, x and y in [-1, 1], spans the image
+    void rays(unsigned int width, unsigned int height, float right[3], float up[3], float forward[3]) const;
+
+    // Angle under a pixel, in radians: a ray is a cone that hits the
+    // surface when t * pixel_angle covers the distance to it
+    float pixel_angle(unsigned int height) const;
+};
+
+struct MarchParams {
+    unsigned int max_steps = 192;
+    float max_distance = 20.f;
+    // Over-relaxation of sphere tracing: steps are relaxation times the
+    // distance bound, a step overshooting the surface is taken back and the
+    // ray carries on with plain steps (Keinert et al., Enhanced Sphere
+    // Tracing). 1 is plain sphere tracing. The distance estimates of the
+    // fractals are loose near the surface and larger factors overshoot too
+    // often: on the Mandelbulb 1.3 saves 20% of the steps, 1.6 none.
+    float relaxation = 1.3f;
+    // Hit when the distance is below epsilon pixel cones
+    float epsilon = 1.f;
+    // Side in pixels of the tiles of the cone marching prepass, 0 turns
+    // it off. A single cone wide enough to hold the rays of a tile is
+    // marched first, and they all start where it stopped instead of at
+    // the camera. On the Mandelbulb and the quaternion Julia set, tiles
+    // of 4 pixels take half of the steps away, prepass included.
+    unsigned int cone_tile = 4;
+    // Temporal reprojection (reprojection_start()): the rays start
+    // reproject_margin pixel cones short of the hit of the previous frame
+    // reprojected into their pixel, or of the nearest one around it where
+    // the depths of the neighbourhood spread over more than
+    // reproject_smooth of it. Beyond reproject_edge the pixel is taken as
+    // disoccluded, as the ones without any hit around, and is marched from
+    // the camera. Orbiting by 3 degrees per frame at 480x270, cone prepass
+    // included, the Mandelbulb goes from 3.8 to 2.1 steps per pixel. The
+    // Mandelbox only goes from 7.1 to 5.8: the orbit runs through the maze,
+    // hits 0.05 to 0.3 away move by tens of pixels and most pixels are
+    // disoccluded. Its fly-through gets 1.5 times fewer steps, turning by
+    // 1.7 degrees or moving forward, but the 4 evaluations of the normals
+    // of every hit keep the frame time within 5%. Reprojection falls short
+    // of halving the steps on both, it pays only on the Mandelbulb.
+    float reproject_margin = 0.5f;
+    float reproject_smooth = 0.03f;
+    float reproject_edge = 0.1f;
+    // Jittered frames averaged while the camera is still
+    unsigned int samples = 16;
+};
+
+// Distance along the ray and normal of each pixel, row 0 at the top
+struct MarchBuffer {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    // INFINITY where the ray missed
+    vector<float> depth;
+    // Interleaved (x, y, z), 0 where the ray missed
+    vector<float> normal;
+    // Distance evaluations along the ray
+    vector<uint16_t> steps;
+
+    void resize(unsigned int w, unsigned int h) {
+        width = w;
+        height = h;
+        depth.assign(size_t(w) * h, INFINITY);
+        normal.assign(3 * size_t(w) * h, 0.f);
+        steps.assign(size_t(w) * h, 0);
+    }
+};
+
+struct MarchStats {
+    size_t rays = 0;
+    size_t hits = 0;
+    // Distance evaluations of the rays and of the prepass cones
+    size_t steps = 0;
+    size_t cone_steps = 0;
+    // Rays started from the reprojected hits of the previous frame
+    size_t reprojected = 0;
+    double seconds = 0.0;
+};
+
+// Scenes are policies with
+//   vfloat distance(vfloat x, vfloat y, vfloat z) const
+// a lower bound of the distance to the surface at SIMD_LANES points, and
+//   float bound() const
+// the radius of a sphere around the origin containing the surface, where
+// the rays start and stop.
+
+// [t_enter, t_exit] of the rays inside the bounding sphere of radius r,
+// t_enter > t_exit for the ones missing it
+inline void bound_interval(const float eye[3], const vfloat dir[3], float r, vfloat& t_enter, vfloat& t_exit) {
+    // |eye + t dir|^2 = r^2 with |dir| = 1
+    vfloat b = eye[0] * dir[0] + eye[1] * dir[1] + eye[2] * dir[2];
+    float c = eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2] - r * r;
+    vfloat h = b * b - c;
+    vint through = h >= 0.f;
+    h = vsqrt(vmax(h, vbroadcast(0.f)));
+    t_enter = select(through, vmax(-b - h, vbroadcast(0.f)), vbroadcast(INFINITY));
+    t_exit = select(through, -b + h, vbroadcast(0.f));
+}
+
+// Normalized direction of the rays through (u, v) in [-1, 1]^2, see
+// Camera::rays()
+inline void ray_directions(const float right[3], const float up[3], const float forward[3], vfloat u, vfloat v, vfloat dir[3]) {
+    for(unsigned int c = 0; c < 3; c++) {
+        dir[c] = forward[c] + u * right[c] + v * up[c];
+    }
+    vfloat norm = vsqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    for(unsigned int c = 0; c < 3; c++) {
+        dir[c] /= norm;
+    }
+}
+
+// Relaxed sphere tracing of SIMD_LANES rays from eye, each active lane
+// starting at t and giving up past t_max. Returns the lanes that hit, t is
+// then on the surface. Lanes that run out of steps near the surface count
+// as hits. steps gets the distance evaluations of each lane added.
+// The eye is either shared (float) or one per lane (vfloat), parallel rays
+// have a pixel_size instead of a pixel_angle.
+template<typename Scene, typename Eye>
+vint march_packet(const Scene& scene, const Eye eye[3], const vfloat dir[3], vfloat& t, vfloat t_max, vint active,
+                  const MarchParams& params, float pixel_angle, vint& steps, float pixel_size = 0.f) {
+    vfloat omega = vbroadcast(params.relaxation);
+    vfloat step = vbroadcast(0.f);
+    vfloat previous = vbroadcast(0.f);
+    vfloat radius = vbroadcast(INFINITY);
+    const float cone = params.epsilon * pixel_angle;
+    const float size = params.epsilon * pixel_size;
+    vint hit = vbroadcast(int32_t(0));
+    active &= t <= t_max;
+    for(unsigned int n = 0; n < params.max_steps && any(active); n++) {
+        radius = vabs(scene.distance(eye[0] + t * dir[0], eye[1] + t * dir[1], eye[2] + t * dir[2]));
+        steps -= active;
+
+        // The spheres of this point and of the previous one do not overlap,
+        // the relaxed step may have crossed the surface
+        vint overshoot = active & (omega > 1.f) & (radius + previous < step);
+        vint reached = active & ~overshoot & (radius < cone * t + size);
+        hit |= reached;
+        active &= ~reached;
+
+        step = select(overshoot, step - omega * step, radius * omega);
+        omega = select(overshoot, vbroadcast(1.f), omega);
+        previous = radius;
+        t = select(active, t + step, t);
+        active &= t <= t_max;
+    }
+    return hit | (active & (radius < 4.f * (cone * t + size)));
+}
+
+// Cone marching of SIMD_LANES cones of half angle `angle` from eye: at t
+// the cone has radius t angle, and the rays inside it are at least
+// distance - t angle away from the surface. Every ray of a cone can then
+// safely move up to the returned t. A cone stops when it would move by
+// less than its own radius, or past t_max.
+template<typename Scene>
+vfloat cone_packet(const Scene& scene, const float eye[3], const vfloat dir[3], vfloat t, vfloat t_max,
+                   float angle, unsigned int max_steps, vint& steps) {
+    vint active = t <= t_max;
+    for(unsigned int n = 0; n < max_steps && any(active); n++) {
+        vfloat distance = scene.distance(eye[0] + t * dir[0], eye[1] + t * dir[1], eye[2] + t * dir[2]);
+        steps -= active;
+        vfloat step = distance - t * angle;
+        active &= step > t * angle;
+        t = select(active, t + step, t);
+        active &= t <= t_max;
+    }
+    return t;
+}
+
+// Start depth of the rays of each cone_tile x cone_tile tile of a
+// width x height image, tiles in rows from the top. Given the start depths
+// of reprojection_start(), only the tiles holding a disoccluded pixel are
+// marched, the others are left at 0. Returns the distance evaluations.
+template<typename Scene>
+size_t cone_prepass(const Scene& scene, const Camera& camera, unsigned int width, unsigned int height,
+                    const MarchParams& params, vector<float>& start, const vector<float>& reprojected = {}) {
+    const unsigned int tile = params.cone_tile;
+    const unsigned int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+    start.assign(size_t(tiles_x) * tiles_y, 0.f);
+    float right[3], up[3], forward[3];
+    camera.rays(width, height, right, up, forward);
+    // Half diagonal of a tile, pixels are widest at the center of the image
+    const float angle = 0.7072f * float(tile) * camera.pixel_angle(height);
+    const vfloat lanes = vlane_index();
+    // Past |eye| + bound every ray has left the bounding sphere
+    const float far = std::min(std::sqrt(camera.eye[0] * camera.eye[0] + camera.eye[1] * camera.eye[1] + camera.eye[2] * camera.eye[2])
+                               + scene.bound(), params.max_distance);
+
+    vector<size_t> thread_steps(worker_count(), 0);
+    parallel_for(tiles_y, 1, [&](size_t begin, size_t end, unsigned int thread) {
+        for(size_t j = begin; j < end; j++) {
+            const float v = 1.f - 2.f * ((float(j) + 0.5f) * float(tile) + camera.jitter[1]) / float(height);
+            for(unsigned int i = 0; i < tiles_x; i += SIMD_LANES) {
+                vfloat u = 2.f * ((float(i) + lanes + 0.5f) * float(tile) + camera.jitter[0]) / float(width) - 1.f;
+                vfloat dir[3];
+                ray_directions(right, up, forward, u, vbroadcast(v), dir);
+                vfloat t_max = vbroadcast(far);
+                if(!reprojected.empty()) {
+                    for(unsigned int l = 0; l < SIMD_LANES && i + l < tiles_x; l++) {
+                        bool disoccluded = false;
+                        for(size_t y = j * tile; y < std::min(size_t(j + 1) * tile, size_t(height)) && !disoccluded; y++) {
+                            for(size_t x = size_t(i + l) * tile; x < std::min(size_t(i + l + 1) * tile, size_t(width)); x++) {
+                                disoccluded |= reprojected[y * width + x] < 0.f;
+                            }
+                        }
+                        t_max[l] = disoccluded ? far : -1.f;
+                    }
+                }
+                vint steps = vbroadcast(int32_t(0));
+                vfloat t = cone_packet(scene, camera.eye, dir, vbroadcast(0.f), t_max, angle, params.max_steps, steps);
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < tiles_x; l++) {
+                    start[j * tiles_x + i + l] = t[l];
+                    thread_steps[thread] += steps[l];
+                }
+            }
+        }
+    });
+    size_t steps = 0;
+    for(size_t s : thread_steps) {
+        steps += s;
+    }
+    return steps;
+}
+
+// Surface normal from the gradient of the distance, sampled on a
+// tetrahedron of size h around p
+template<typename Scene>
+void scene_normal(const Scene& scene, const vfloat p[3], vfloat h, vfloat n[3]) {
+    const float k[4][3] = {{1.f, -1.f, -1.f}, {-1.f, -1.f, 1.f}, {-1.f, 1.f, -1.f}, {1.f, 1.f, 1.f}};
+    n[0] = n[1] = n[2] = vbroadcast(0.f);
+    for(unsigned int v = 0; v < 4; v++) {
+        vfloat d = scene.distance(p[0] + k[v][0] * h, p[1] + k[v][1] * h, p[2] + k[v][2] * h);
+        n[0] += k[v][0] * d;
+        n[1] += k[v][1] * d;
+        n[2] += k[v][2] * d;
+    }
+    // 0 where the gradient vanishes or is not finite (the Mandelbulb
+    // polynomials divide by zero on the pole axis)
+    vfloat norm = vsqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    vint valid = (norm > 0.f) & (norm < INFINITY);
+    norm = select(valid, norm, vbroadcast(1.f));
+    for(unsigned int c = 0; c < 3; c++) {
+        n[c] = select(valid, n[c] / norm, vbroadcast(0.f));
+    }
+}
+
+// Ray packets of SIMD_LANES neighbouring pixels of a row, the rows are
+// spread over all cores. With a cone_tile, the rays start at the depth of
+// the cone prepass of their tile. Given the start depths of
+// reprojection_start(), the rays of the pixels that are not disoccluded
+// start at theirs instead.
+template<typename Scene>
+MarchStats march(const Scene& scene, const Camera& camera, unsigned int width, unsigned int height,
+                 const MarchParams& params, MarchBuffer& out, const vector<float>& reprojected = {}) {
+    auto start = chrono::steady_clock::now();
+    out.resize(width, height);
+    float right[3], up[3], forward[3];
+    camera.rays(width, height, right, up, forward);
+    const float pixel_angle = camera.pixel_angle(height);
+    const vfloat lanes = vlane_index();
+
+    MarchStats stats;
+    vector<float> cone_start;
+    const unsigned int tile = params.cone_tile;
+    const unsigned int tiles_x = tile ? (width + tile - 1) / tile : 0;
+    if(tile) {
+        stats.cone_steps = cone_prepass(scene, camera, width, height, params, cone_start, reprojected);
+    }
+
+    vector<size_t> thread_hits(worker_count(), 0), thread_steps(worker_count(), 0), thread_reprojected(worker_count(), 0);
+    parallel_for(height, 2, [&](size_t begin, size_t end, unsigned int thread) {
+        for(size_t j = begin; j < end; j++) {
+            const float v = 1.f - 2.f * (float(j) + 0.5f + camera.jitter[1]) / float(height);
+            for(unsigned int i = 0; i < width; i += SIMD_LANES) {
+                vfloat u = 2.f * (float(i) + lanes + 0.5f + camera.jitter[0]) / float(width) - 1.f;
+                vfloat dir[3];
+                ray_directions(right, up, forward, u, vbroadcast(v), dir);
+
+                vfloat t, t_max;
+                bound_interval(camera.eye, dir, scene.bound(), t, t_max);
+                t_max = vmin(t_max, vbroadcast(params.max_distance));
+                if(tile || !reprojected.empty()) {
+                    vfloat first = vbroadcast(0.f);
+                    for(unsigned int l = 0; l < SIMD_LANES; l++) {
+                        const unsigned int x = std::min(i + l, width - 1);
+                        const float previous = reprojected.empty() ? -1.f : reprojected[j * width + x];
+                        first[l] = previous >= 0.f ? previous : tile ? cone_start[(j / tile) * tiles_x + x / tile] : 0.f;
+                    }
+                    t = vmax(t, first);
+                }
+                vint active = (float(i) + lanes) < float(width);
+                vint steps = vbroadcast(int32_t(0));
+                vint hit = march_packet(scene, camera.eye, dir, t, t_max, active, params, pixel_angle, steps);
+
+                vfloat n[3] = {vbroadcast(0.f), vbroadcast(0.f), vbroadcast(0.f)};
+                if(any(hit)) {
+                    vfloat p[3];
+                    for(unsigned int c = 0; c < 3; c++) {
+                        p[c] = camera.eye[c] + t * dir[c];
+                    }
+                    scene_normal(scene, p, vmax(0.5f * pixel_angle * t, vbroadcast(1e-5f)), n);
+                }
+
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < width; l++) {
+                    size_t idx = j * width + i + l;
+                    out.steps[idx] = uint16_t(steps[l]);
+                    thread_steps[thread] += steps[l];
+                    if(!reprojected.empty() && reprojected[idx] >= 0.f) {
+                        thread_reprojected[thread]++;
+                    }
+                    if(hit[l]) {
+                        out.depth[idx] = t[l];
+                        for(unsigned int c = 0; c < 3; c++) {
+                            out.normal[3 * idx + c] = n[c][l];
+                        }
+                        thread_hits[thread]++;
+                    }
+                }
+            }
+        }
+    });
+
+    stats.rays = size_t(width) * height;
+    for(unsigned int k = 0; k < worker_count(); k++) {
+        stats.hits += thread_hits[k];
+        stats.steps += thread_steps[k];
+        stats.reprojected += thread_reprojected[k];
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Temporal reprojection of a moving camera: the hits of the previous frame,
+// marched with previous_camera, are scattered into the width x height
+// pixels of camera, each pixel keeping the nearest distance to the eye.
+// INFINITY where no hit landed.
+void reproject_hits(const MarchBuffer& previous, const Camera& previous_camera, const Camera& camera,
+                    unsigned int width, unsigned int height, vector<float>& depth);
+
+// Depth the ray of each pixel starts from, out of the reprojected hits of
+// its 3x3 neighbourhood: its own on a smooth surface, the nearest one
+// where the depth varies faster or no hit landed in the pixel (the gaps
+// of a surface coming closer). -1 for the disoccluded pixels, which the
+// cone prepass and a full march take over: none of the neighbours got a
+// hit, or their depths jump as on an edge, where the background the
+// foreground uncovers was never seen.
+void reprojection_start(const vector<float>& depth, unsigned int width, unsigned int height, float pixel_angle,
+                        const MarchParams& params, vector<float>& start);
+
+// k-th offset of the Halton (2, 3) sequence in [-0.5, 0.5)^2, 0 for k = 0,
+// the jitter of the k-th frame averaged by a still camera
+void halton_jitter(unsigned int k, float jitter[2]);
+
+// Diffuse lighting of the hits, the background is a vertical gradient.
+// frag_raymarch.glsl shades its pixels the same way. When given, lit
+// scales the diffuse term and ambient the ambient one, per pixel (see
+// light_march() of cpu/occlusion.hpp).
+void shade_march(const MarchBuffer& buffer, const Light& light, Image& image,
+                 const vector<float>& lit = {}, const vector<float>& ambient = {});
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef _CPU_SIMD_HPP_
+#define _CPU_SIMD_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Portable SIMD lanes built on the GCC/Clang vector extensions.
+// 8 floats map onto one AVX register or onto two SSE/NEON registers.
+const unsigned int SIMD_LANES = 8;
+
+typedef float vfloat __attribute__((vector_size(SIMD_LANES * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(SIMD_LANES * sizeof(int32_t))));
+// Unsigned lanes, for integer hashes: shifts are logical, products wrap
+typedef uint32_t vuint __attribute__((vector_size(SIMD_LANES * sizeof(uint32_t))));
+// Double precision lanes, as wide as the float ones. Comparisons give vlong masks.
+typedef double vdouble __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+typedef int64_t vlong __attribute__((vector_size(SIMD_LANES * sizeof(int64_t))));
+
+inline vfloat vbroadcast(float x) {
+    return vfloat{} + x;
+}
+
+inline vint vbroadcast(int32_t x) {
+    return vint{} + x;
+}
+
+// 0, 1, 2, ... SIMD_LANES - 1
+inline vfloat vlane_index() {
+    vfloat v;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        v[i] = float(i);
+    }
+    return v;
+}
+
+inline vfloat vload(const float* p) {
+    vfloat v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void vstore(float* p, vfloat v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// Masks are the result of a lane-wise comparison: all bits set or zero.
+inline bool any(vint mask) {
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        if(mask[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool any(vlong mask) {
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        if(mask[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool all(vint mask) {
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        if(!mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline vfloat select(vint mask, vfloat a, vfloat b) {
+    return mask ? a : b;
+}
+
+inline vint select(vint mask, vint a, vint b) {
+    return mask ? a : b;
+}
+
+inline vdouble select(vlong mask, vdouble a, vdouble b) {
+    return mask ? a : b;
+}
+
+inline vfloat vmin(vfloat a, vfloat b) {
+    return a < b ? a : b;
+}
+
+inline vfloat vmax(vfloat a, vfloat b) {
+    return a > b ? a : b;
+}
+
+inline vfloat vabs(vfloat a) {
+    return a < 0.f ? -a : a;
+}
+
+inline vfloat vsqrt(vfloat a) {
+#ifdef __AVX2__
+    __m256 r = _mm256_sqrt_ps((__m256)a);
+    return (vfloat)r;
+#else
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::sqrt(a[i]);
+    }
+    return r;
+#endif
+}
+
+inline vfloat vlog(vfloat a) {
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::log(a[i]);
+    }
+    return r;
+}
+
+inline vfloat vlog2(vfloat a) {
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::log2(a[i]);
+    }
+    return r;
+}
+
+inline vfloat vexp(vfloat a) {
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::exp(a[i]);
+    }
+    return r;
+}
+
+inline vfloat vsin(vfloat a) {
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::sin(a[i]);
+    }
+    return r;
+}
+
+inline vfloat vcos(vfloat a) {
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = std::cos(a[i]);
+    }
+    return r;
+}
+
+inline vint to_int(vfloat a) {
+    return __builtin_convertvector(a, vint);
+}
+
+inline vfloat to_float(vint a) {
+    return __builtin_convertvector(a, vfloat);
+}
+
+inline vfloat vfloor(vfloat a) {
+    vfloat t = to_float(to_int(a));
+    return select(t > a, t - 1.f, t);
+}
+
+inline vfloat vclamp(vfloat a, float lo, float hi) {
+    return vmin(vmax(a, vbroadcast(lo)), vbroadcast(hi));
+}
+
+// Polynomial approximations, all lanes at once instead of a libm call per
+// lane. Cephes' sinf/cosf polynomials after a reduction to [-pi/4, pi/4],
+// the error stays under 2e-7 for |x| < 1000 and grows with |x| beyond.
+inline void fast_sincos(vfloat x, vfloat& s, vfloat& c) {
+    vint negative = x < 0.f;
+    vfloat ax = vabs(x);
+    // Even multiple of pi/4 closest to x, x = j pi/4 + z
+    vint j = to_int(ax * 1.27323954473516f);
+    j = (j + 1) & ~1;
+    vfloat y = to_float(j);
+    vfloat z = ((ax - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+    vfloat zz = z * z;
+    vfloat pc = ((2.443315711809948e-5f * zz - 1.388731625493765e-3f) * zz + 4.166664568298827e-2f) * zz * zz - 0.5f * zz + 1.f;
+    vfloat ps = ((-1.9515295891e-4f * zz + 8.3321608736e-3f) * zz - 1.6666654611e-1f) * zz * z + z;
+
+    // Quadrant q of x = q pi/2 + z
+    vint q = (j >> 1) & 3;
+    vint odd = (q & 1) != 0;
+    vfloat sv = select(odd, pc, ps);
+    vfloat cv = select(odd, ps, pc);
+    s = select(((q & 2) != 0) ^ negative, -sv, sv);
+    c = select(((q + 1) & 2) != 0, -cv, cv);
+}
+
+// atan2(y, x) within 2e-4 radians, 0 when x = y = 0
+inline vfloat fast_atan2(vfloat y, vfloat x) {
+    vfloat ax = vabs(x), ay = vabs(y);
+    vfloat a = vmin(ax, ay) / vmax(vmax(ax, ay), vbroadcast(1e-30f));
+    vfloat s = a * a;
+    vfloat r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    r = select(ay > ax, 1.57079637f - r, r);
+    r = select(x < 0.f, 3.14159274f - r, r);
+    return select(y < 0.f, -r, r);
+}
+
+// Natural logarithm of x > 0, relative error below 8.1e-8 (measured over
+// [1e-30, 1e30] where |log x| > 1e-3), 5e-7 absolute on [1e-6, 4]. Cephes'
+// logf: the exponent is split off with bit operations and the mantissa,
+// reduced to [sqrt(1/2), sqrt(2)), goes through a degree 9 polynomial.
+// 0 and denormals give about -88.
+inline vfloat fast_log(vfloat x) {
+    vint bits;
+    memcpy(&bits, &x, sizeof(bits));
+    vint e = ((bits >> 23) & 0xff) - 126;
+    bits = (bits & 0x007fffff) | 0x3f000000;
+    vfloat m;
+    memcpy(&m, &bits, sizeof(m));
+
+    // m in [0.5, 1), moved to [sqrt(1/2), sqrt(2)) - 1
+    vint small = m < 0.707106781186547524f;
+    e += small;
+    m = select(small, m + m, m) - 1.f;
+
+    vfloat fe = to_float(e);
+    vfloat z = m * m;
+    vfloat y = vbroadcast(7.0376836292e-2f);
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y += -2.12194440e-4f * fe;
+    y += -0.5f * z;
+    return m + y + 0.693359375f * fe;
+}
+
+// Indexed loads, a single instruction when AVX2 is available.
+inline vint gather(const int32_t* base, vint idx) {
+#ifdef __AVX2__
+    __m256i r = _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), (__m256i)idx, 4);
+    return (vint)r;
+#else
+    vint r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = base[idx[i]];
+    }
+    return r;
+#endif
+}
+
+inline vfloat gather(const float* base, vint idx) {
+#ifdef __AVX2__
+    __m256 r = _mm256_i32gather_ps(base, (__m256i)idx, 4);
+    return (vfloat)r;
+#else
+    vfloat r;
+    for(unsigned int i = 0; i < SIMD_LANES; i++) {
+        r[i] = base[idx[i]];
+    }
+    return r;
+#endif
+}
+
+#endif
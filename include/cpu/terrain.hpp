@@ -0,0 +1,65 @@
+#ifndef _CPU_TERRAIN_HPP_
+#define _CPU_TERRAIN_HPP_
+
+#include <string>
+#include <vector>
+
+#include "cpu/noise.hpp"
+
+using namespace std;
+
+// Heightfield z = height fbm(x, y) of periodic value noise (the lattice
+// hash of NoiseBasis::HASH, H = 1), ray marched by frag_terrain.glsl. The
+// noise wraps around every period cells, the terrain repeats every period
+// units and its heights fit in a pyramid of finite size.
+struct TerrainParams {
+    // Lattice cells of the first octave along a side, a power of two
+    unsigned int period = 64;
+    unsigned int octaves = 10;
+    float height = 0.6f;
+    // The texels of the base of the height pyramid are the lattice cells
+    // of this octave: 1/16 units and 1024^2 texels for a period of 64
+    unsigned int pyramid_octave = 4;
+    // Octaves finer than lod pixels at the distance of the point are left
+    // out, the last one fades out as the pixel grows
+    float lod = 1.f;
+    unsigned int max_steps = 256;
+    float max_distance = 40.f;
+
+    unsigned int pyramid_size() const {
+        return period << pyramid_octave;
+    }
+
+    NoiseParams noise() const {
+        NoiseParams params;
+        params.basis = NoiseBasis::HASH;
+        params.octaves = octaves;
+        params.period = period;
+        return params;
+    }
+
+    vector<string> glsl_defines() const {
+        vector<string> defines = noise_defines(this->noise());
+        defines.push_back("TERRAIN_OCTAVES " + to_string(octaves));
+        defines.push_back("TERRAIN_PYRAMID_OCTAVE " + to_string(pyramid_octave));
+        return defines;
+    }
+};
+
+// Upper bounds of fbm() (height 1) over the texels of each level: level 0
+// has pyramid_size()^2 texels, the next ones halve it down to a single
+// texel. Value noise stays within the hull of the 4 corners of its cell,
+// the bound of a texel sums the highest corner of the cells it overlaps in
+// every octave: it holds for the lower octave counts of the level of
+// detail too, the noise is never negative.
+struct HeightPyramid {
+    vector<NoiseBuffer> levels;
+};
+
+// Level 0 is built on all cores
+void build_height_pyramid(const TerrainParams& params, HeightPyramid& pyramid);
+
+// Height of the terrain under (x, y), all octaves
+float terrain_height(const TerrainParams& params, float x, float y);
+
+#endif
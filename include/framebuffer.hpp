@@ -0,0 +1,47 @@
+#ifndef _FRAMEBUFFER_HPP_
+#define _FRAMEBUFFER_HPP_
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+// Offscreen render target. Each internal format (GL_R32F, GL_RG32F, ...)
+// gets its own texture attached to GL_COLOR_ATTACHMENT0 + i.
+class FrameBuffer {
+    public:
+        FrameBuffer(unsigned int width, unsigned int height, const vector<GLenum>& formats);
+        ~FrameBuffer();
+
+        // Binds the framebuffer and sets the viewport to its size
+        void bind() const;
+        void unbind() const;
+
+        // Copies the first attachment onto the default framebuffer of size
+        // width x height, filtered when the sizes differ
+        void blitTo(unsigned int width, unsigned int height) const;
+
+        // Reallocates the attachments, their content is lost
+        void resize(unsigned int width, unsigned int height);
+
+        GLuint getTexture(unsigned int attachment) const;
+        GLuint getFramebuffer() const;
+        unsigned int getWidth() const;
+        unsigned int getHeight() const;
+
+    private:
+        void create();
+        void destroy();
+
+    private:
+        GLuint m_fbo;
+        vector<GLuint> m_textures;
+        vector<GLenum> m_formats;
+
+        unsigned int m_width;
+        unsigned int m_height;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _GBUFFER_HPP_
+#define _GBUFFER_HPP_
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+// Attachments written by the iteration pass (frag_fractals.glsl) and read
+// by the deferred passes, so that the iteration loop only runs once per view.
+enum GBufferAttachment {
+    // Smooth iteration count, max_iter inside the set
+    GBUFFER_ITERATION = 0,
+    // Exterior distance estimate, 0 inside the set
+    GBUFFER_DISTANCE = 1,
+    // z when the orbit escaped
+    GBUFFER_Z = 2,
+    // dz/dc when the orbit escaped
+    GBUFFER_DERIVATIVE = 3,
+    // Color picked by the iteration pass itself (orbit trap image, Newton
+    // basin), alpha 0 where the palette applies
+    GBUFFER_COLOR = 4
+};
+
+inline vector<GLenum> gbuffer_formats() {
+    return vector<GLenum>({GL_R32F, GL_R32F, GL_RG32F, GL_RG32F, GL_RGBA8});
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _HISTOGRAM_PASS_HPP_
+#define _HISTOGRAM_PASS_HPP_
+
+#include <memory>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "framebuffer.hpp"
+#include "screen.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// Histogram of an iteration texture built on the GPU, and its prefix sum:
+//   1. every texel is scattered as a point into one of HISTOGRAM_COPIES
+//      private histograms with additive blending
+//   2. the private histograms are merged into one row
+//   3. log2(bins) Hillis-Steele passes give the inclusive prefix sum
+// frag_coloring.glsl reads the result to equalize the palette.
+const unsigned int HISTOGRAM_COPIES = 64;
+
+class HistogramPass {
+    public:
+        HistogramPass(unsigned int bins);
+        ~HistogramPass();
+
+        void update(const ScreenQuad& screen, GLuint iteration, unsigned int width, unsigned int height, int max_iter);
+
+        // bins x 1 R32F texture, texel b holds the number of escaped pixels in bins [0, b]
+        GLuint getCdf() const;
+        unsigned int getBins() const;
+
+    private:
+        unsigned int m_bins;
+
+        shared_ptr<Shader> m_scatter;
+        shared_ptr<Shader> m_merge;
+        shared_ptr<Shader> m_scan;
+
+        unique_ptr<FrameBuffer> m_private;
+        unique_ptr<FrameBuffer> m_sums[2];
+        unsigned int m_result;
+
+        // The points have no attributes but core profile needs a VAO bound
+        GLuint m_vao;
+};
+
+#endif
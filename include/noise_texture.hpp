@@ -0,0 +1,48 @@
+#ifndef _NOISE_TEXTURE_HPP_
+#define _NOISE_TEXTURE_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/noise.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// Baked noise tiles are cached here, next to the trap images
+const string NOISE_CACHE_DIRECTORY = "./cache/";
+
+// GL_R32F texture of a noise tile (NoiseTile of cpu/noise.hpp), repeated and
+// linearly filtered, which shaders/noise.glsl reads under NOISE_TEXTURE.
+// The tile is read from the cache, or baked on all cores and written to
+// the cache for the next runs.
+class NoiseTexture {
+    public:
+        // The texels of the tile are not used, only its basis, period and
+        // texels per cell
+        NoiseTexture(const NoiseTile& tile);
+        ~NoiseTexture();
+
+        void bind(unsigned int unit) const;
+        // Binds the texture and sets the uniforms of noise.glsl
+        void sendUniforms(const shared_ptr<Shader>& shader, unsigned int unit) const;
+
+        // Defines of the noise.glsl variant reading the texture
+        vector<string> glsl_defines() const;
+        const NoiseTile& getTile() const;
+
+    private:
+        bool readCache(vector<float>& texels) const;
+        void writeCache(const vector<float>& texels) const;
+        string cacheFilename() const;
+
+    private:
+        GLuint m_texture;
+        NoiseTile m_tile;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _PALETTE_TEXTURE_HPP_
+#define _PALETTE_TEXTURE_HPP_
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/palette.hpp"
+
+// 1D RGBA8 texture holding a palette LUT, sampled by frag_coloring.glsl.
+class PaletteTexture {
+    public:
+        PaletteTexture(const Palette& palette, unsigned int size);
+        ~PaletteTexture();
+
+        // Re-uploads the LUT after a palette edit
+        void update(const Palette& palette);
+        void bind(unsigned int unit) const;
+
+        unsigned int getSize() const;
+
+    private:
+        GLuint m_texture;
+        unsigned int m_size;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef _RAYMARCH_PASS_HPP_
+#define _RAYMARCH_PASS_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/lighting.hpp"
+#include "cpu/occlusion.hpp"
+#include "cpu/raymarch.hpp"
+#include "framebuffer.hpp"
+#include "screen.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// Attachments of the offscreen target of the 3D scenes
+enum RaymarchAttachment {
+    RAYMARCH_COLOR = 0,
+    // Distance along the ray, 1e30 where it missed
+    RAYMARCH_DEPTH = 1,
+    // Distance evaluations of the ray
+    RAYMARCH_STEPS = 2
+};
+
+// Attachments of the cone marching prepass target, one texel per tile
+enum ConeAttachment {
+    // Depth the rays of the tile start from
+    CONE_DEPTH = 0,
+    // Distance evaluations of the cone
+    CONE_STEPS = 1
+};
+
+// Lowest fraction of the window resolution interactiveScale() goes down to
+const float RAYMARCH_MIN_SCALE = 0.125f;
+
+// Distance-estimated 3D scenes marched by frag_raymarch.glsl, one shader
+// variant per scene. The scene is marched offscreen at a fraction of the
+// window resolution and stretched onto the window, so that the camera
+// stays interactive on software rasterizers. With a cone_tile, a first
+// pass marches one cone per tile into a low resolution target, whose
+// depths seed the rays of the full pass (cone_prepass() on the CPU).
+//
+// The shadow map and the ambient occlusion volume (cpu/occlusion.hpp) are
+// kept between frames: the shadow map is only rendered again when the
+// scene or the light changes, the occlusion volume is started over for a
+// new scene and refined by refineOcclusion(). A camera move only runs the
+// cone prepass and the full pass.
+//
+// Frames are rendered into two targets in turn, so that the previous one
+// can be reprojected (reproject_hits() on the CPU): its hits are drawn as
+// points into the pixels of the new camera, where frag_temporal.glsl
+// turns them into the depths the rays start from. Only the tiles holding a
+// disoccluded pixel run the cone prepass. The window shows the running
+// mean of the frames accumulated since the last one that was not.
+class RaymarchPass {
+    public:
+        RaymarchPass();
+        ~RaymarchPass();
+
+        // Compiles the frag_raymarch.glsl variants of a scene, the defines
+        // come from the glsl_defines() of its CPU policy. Adding a scene
+        // again, with other parameters, drops its shadow map and occlusion.
+        void addScene(const string& name, const vector<string>& defines);
+
+        // Marches the scene into a (scale width) x (scale height) target.
+        // With reproject, the rays start from the hits of the previous
+        // frame when it shows the same scene. With accumulate, the frame is
+        // added to the running mean of the previous ones, of the same size,
+        // instead of starting it over.
+        void render(const ScreenQuad& screen, const string& scene, const Camera& camera, const MarchParams& params,
+                    const OcclusionParams& occlusion, const Light& light, unsigned int width, unsigned int height, float scale,
+                    bool reproject = false, bool accumulate = false);
+
+        // Fraction of the window resolution whose frames take about
+        // budget_ms of GPU time, in steps of 1/32 from RAYMARCH_MIN_SCALE
+        // to 1. The GPU time of the frames is measured with a timer query,
+        // read back frames later to never stall, and averaged per pixel.
+        // 0.5 until a frame was measured.
+        float interactiveScale(unsigned int width, unsigned int height, float budget_ms) const;
+
+        // Adds occlusion.directions directions to the occlusion volume of
+        // the last scene rendered, false once it has max_directions
+        bool refineOcclusion(const ScreenQuad& screen, const OcclusionParams& occlusion);
+
+        // Copies the running mean of the frames onto the default
+        // framebuffer of size width x height, linearly filtered
+        void display(unsigned int width, unsigned int height) const;
+
+        GLuint getTexture(RaymarchAttachment attachment) const;
+        GLuint getConeTexture(ConeAttachment attachment) const;
+        GLuint getShadowTexture() const;
+        GLuint getOcclusionTexture() const;
+        unsigned int getOcclusionDirections() const;
+        // Frames in the running mean
+        unsigned int getSamples() const;
+        unsigned int getWidth() const;
+        unsigned int getHeight() const;
+
+    private:
+        struct SceneShaders {
+            shared_ptr<Shader> march;
+            shared_ptr<Shader> cone;
+            shared_ptr<Shader> shadow;
+            shared_ptr<Shader> occlusion;
+        };
+
+        map<string, SceneShaders> m_scenes;
+        // Last frame, and the one before it
+        unique_ptr<FrameBuffer> m_frames[2];
+        unsigned int m_frame;
+        unique_ptr<FrameBuffer> m_cone;
+
+        // Reprojection of the previous frame, of m_previous_scene seen by
+        // m_previous_camera: nearest hit landed in each pixel, and the
+        // start depths
+        shared_ptr<Shader> m_splat;
+        shared_ptr<Shader> m_start;
+        unique_ptr<FrameBuffer> m_reprojected;
+        unique_ptr<FrameBuffer> m_reprojection;
+        string m_previous_scene;
+        Camera m_previous_camera;
+        // The points have no attributes but core profile needs a VAO bound
+        GLuint m_vao;
+
+        // Running mean of the colors of the last m_samples frames
+        shared_ptr<Shader> m_accumulate;
+        unique_ptr<FrameBuffer> m_accumulation;
+        unsigned int m_samples;
+
+        // Shadow map, of m_shadow_scene lit from m_shadow_light
+        unique_ptr<FrameBuffer> m_shadow;
+        string m_shadow_scene;
+        float m_shadow_light[3];
+        float m_shadow_right[3];
+        float m_shadow_up[3];
+
+        // Occlusion volume of m_occlusion_scene, occlusion_tiles x
+        // occlusion_tiles slices side by side
+        unique_ptr<FrameBuffer> m_occlusion;
+        string m_occlusion_scene;
+        unsigned int m_occlusion_size;
+        unsigned int m_occlusion_tiles;
+        unsigned int m_occlusion_directions;
+
+        // Moving average of the GPU time of a pixel of the cone prepass,
+        // reprojection and full pass, and the query of the last frame
+        float m_pixel_ms;
+        GLuint m_query;
+        bool m_query_pending;
+        unsigned int m_query_pixels;
+};
+
+#endif
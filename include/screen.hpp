@@ -17,6 +17,8 @@ class ScreenQuad {
         ~ScreenQuad();
 
         void draw(const shared_ptr<Shader> shader, float time, float depl_x, float depl_y, float zoom) const;
+        // Full-screen pass, the uniforms are expected to be set already
+        void draw(const shared_ptr<Shader> shader) const;
 
     private:
         // Vertex Array Object
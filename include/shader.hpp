@@ -2,6 +2,7 @@
 #define _SHADER_HPP_
 
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,7 +11,11 @@ using namespace std;
 
 class Shader {
     public:
-        Shader(const string& vertex_filename, const string& fragment_filename);
+        // Each define is inserted as "#define <define>" right after the
+        // #version line, so that one source builds several variants.
+        // The lines #include "file" are replaced by the file, next to the
+        // shader, for the functions shared between shaders.
+        Shader(const string& vertex_filename, const string& fragment_filename, const vector<string>& defines = {});
         ~Shader();
 
         void bind() const;
@@ -20,6 +25,8 @@ class Shader {
 
         void sendUniform1f(const std::string& attribute, float data) const;
         void sendUniform1i(const std::string& attribute, unsigned int data) const;
+        void sendUniform2f(const std::string& attribute, float x, float y) const;
+        void sendUniform3f(const std::string& attribute, float x, float y, float z) const;
         //void sendUniform4f(const std::string& attribute, const glm::vec4& data) const;
         //void sendUniform3f(const std::string& attribute, const glm::vec3& data) const;
         //void sendUniformMatrix4fv(const std::string& attribute, const glm::mat4& data) const;
@@ -30,6 +37,7 @@ class Shader {
 
     private:
         GLuint m_program;
+        vector<string> m_defines;
 };
 
 #endif
\ No newline at end of file
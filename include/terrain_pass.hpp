@@ -0,0 +1,59 @@
+#ifndef _TERRAIN_PASS_HPP_
+#define _TERRAIN_PASS_HPP_
+
+#include <memory>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/lighting.hpp"
+#include "cpu/raymarch.hpp"
+#include "cpu/terrain.hpp"
+#include "framebuffer.hpp"
+#include "screen.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// Attachments of the offscreen target of the terrain
+enum TerrainAttachment {
+    TERRAIN_COLOR = 0,
+    // Distance along the ray, 1e30 where it missed
+    TERRAIN_DEPTH = 1,
+    // fbm() evaluations of the ray and of its shadow ray
+    TERRAIN_STEPS = 2
+};
+
+// fbm() heightfield of TerrainParams, ray marched by frag_terrain.glsl at
+// a fraction of the window resolution. The pyramid of the highest heights
+// (HeightPyramid) is built on the CPU once and kept in the mipmaps of a
+// GL_R32F texture: the rays skip the texels they pass over, their shadow
+// rays toward the light leave the terrain in a few of them.
+class TerrainPass {
+    public:
+        TerrainPass(const TerrainParams& params);
+        ~TerrainPass();
+
+        // Marches the terrain into a (scale width) x (scale height) target
+        void render(const ScreenQuad& screen, const Camera& camera, const Light& light, unsigned int width,
+                    unsigned int height, float scale);
+
+        // Copies the colors onto the default framebuffer of size width x
+        // height, linearly filtered
+        void display(unsigned int width, unsigned int height) const;
+
+        GLuint getTexture(TerrainAttachment attachment) const;
+        GLuint getPyramidTexture() const;
+        const TerrainParams& getParams() const;
+        unsigned int getWidth() const;
+        unsigned int getHeight() const;
+
+    private:
+        TerrainParams m_params;
+        shared_ptr<Shader> m_shader;
+        unique_ptr<FrameBuffer> m_target;
+        GLuint m_pyramid;
+        unsigned int m_pyramid_levels;
+};
+
+#endif
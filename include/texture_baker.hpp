@@ -0,0 +1,76 @@
+#ifndef _TEXTURE_BAKER_HPP_
+#define _TEXTURE_BAKER_HPP_
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/mipmap.hpp"
+#include "cpu/noise.hpp"
+#include "framebuffer.hpp"
+#include "screen.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// A texture to bake: the kernel over one period of the noise, period
+// lattice cells of the first octave along both sides of a width x height
+// image. The noise wraps around the period, the texture tiles whatever its
+// size (non square ones stretch the noise).
+struct BakeJob {
+    // output.ppm, and output_mip1.ppm, ... with the mipmaps
+    string output = "texture";
+    WarpKernel kernel = WarpKernel::WARP_THIRD;
+    // The sine hash has no period
+    NoiseBasis basis = NoiseBasis::HASH;
+    unsigned int width = 1024;
+    unsigned int height = 1024;
+    // A power of two
+    unsigned int period = 8;
+    // warp_second() animates with it
+    float time = 0.f;
+    bool mipmaps = true;
+};
+
+// Reads a job from the options of a line, as the tools take them:
+//   -o output -k fbm|second|third -N hash|gradient -w width -h height
+//   -P period -t time -m 0|1
+// The options left out keep their values in job.
+bool parse_bake_job(const string& line, BakeJob& job);
+
+// Bakes the domain warping kernels of frag_warp.glsl into seamless textures
+// on disk. The image is drawn tile by tile into an offscreen target of
+// tile_size x tile_size pixels, a band of tiles across the image at a time.
+// Bands are read back into a pixel buffer, then handed to MipmapWriter
+// while the GPU draws the next one: the writer streams them to the file and
+// filters the mipmap chain on all cores. A texture of any size only holds
+// two bands in memory.
+class TextureBaker {
+    public:
+        TextureBaker(unsigned int tile_size = 1024);
+        ~TextureBaker();
+
+        // False when the job is invalid or its files could not be written
+        bool bake(const ScreenQuad& screen, const BakeJob& job);
+
+    private:
+        // Compiled once per noise and kernel
+        shared_ptr<Shader> shader(const BakeJob& job);
+        // Hands the band read into m_bands[slot] to the writer
+        bool flush(MipmapWriter& writer, unsigned int slot, unsigned int width, unsigned int rows);
+
+    private:
+        unsigned int m_tile_size;
+        unique_ptr<FrameBuffer> m_tile;
+        map<string, shared_ptr<Shader>> m_shaders;
+        // Two pixel buffers, of a band each
+        array<GLuint, 2> m_bands;
+        size_t m_band_bytes;
+        vector<uint8_t> m_rows;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _TRAP_TEXTURE_HPP_
+#define _TRAP_TEXTURE_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+// Decoded images and their mipmaps are cached here, so that the next runs
+// skip the decoding
+const string TRAP_CACHE_DIRECTORY = "./cache/";
+
+// Mipmapped RGBA8 texture of the orbit trap image, sampled by
+// frag_fractals.glsl. Changing the image never blocks the render loop:
+//   1. a background thread reads the decoded image from the cache, or
+//      decodes it with stb_image, builds its mipmaps and writes the cache
+//   2. update() maps a pixel buffer object, which the thread fills
+//   3. update() uploads all the levels to the back texture from the
+//      buffer, which runs asynchronously on the GPU
+//   4. the back and front textures are swapped once their fence signals
+// Until then the previous image stays bound.
+class TrapTexture {
+    public:
+        TrapTexture();
+        ~TrapTexture();
+
+        // Loads an image in the background. A request made while another
+        // one is still pending replaces it.
+        void request(const string& filename);
+        // Moves the pending image one step further, once per frame. Returns
+        // true when a new image has just replaced the previous one.
+        bool update();
+        void bind(unsigned int unit) const;
+
+        // False until the first image is uploaded
+        bool isReady() const;
+        const string& getFilename() const;
+        unsigned int getWidth() const;
+        unsigned int getHeight() const;
+
+    private:
+        enum State {
+            // Nothing to upload
+            TRAP_IDLE,
+            // The thread knows the size of the image and waits for a buffer
+            TRAP_SIZED,
+            // The pixel buffer is mapped, the thread copies the image into it
+            TRAP_MAPPED,
+            // The pixel buffer is filled and can be unmapped
+            TRAP_FILLED
+        };
+
+        void decode();
+        // Reads the cached image and its mipmaps, false when it is missing or
+        // older than the image file. pixels is only read when size_only is
+        // false.
+        bool readCache(const string& filename, bool size_only, unsigned int& width, unsigned int& height, uint8_t* pixels) const;
+        void writeCache(const string& filename, unsigned int width, unsigned int height, const uint8_t* pixels) const;
+
+    private:
+        // Front texture is sampled, back texture receives the next image
+        GLuint m_textures[2];
+        unsigned int m_front;
+        GLuint m_pbo;
+        // Signals when the upload and the mipmaps of the back texture are done
+        GLsync m_fence;
+
+        string m_filename;
+        unsigned int m_width;
+        unsigned int m_height;
+        // Image of the back texture, until the swap
+        string m_back_filename;
+        unsigned int m_back_width;
+        unsigned int m_back_height;
+        bool m_ready;
+
+        // Shared with the decoding thread
+        mutable mutex m_mutex;
+        condition_variable m_condition;
+        thread m_thread;
+        bool m_quit;
+        State m_state;
+        string m_pending;
+        string m_decoding;
+        unsigned int m_decoded_width;
+        unsigned int m_decoded_height;
+        uint8_t* m_mapped;
+};
+
+#endif
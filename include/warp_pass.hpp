@@ -0,0 +1,135 @@
+#ifndef _WARP_PASS_HPP_
+#define _WARP_PASS_HPP_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "cpu/noise.hpp"
+#include "framebuffer.hpp"
+#include "noise_texture.hpp"
+#include "screen.hpp"
+#include "shader.hpp"
+
+using namespace std;
+
+// Attachments of the offscreen target of the warps
+enum WarpAttachment {
+    // Grey levels of the value, as colorize_noise() with a scale of 0.5
+    WARP_COLOR = 0,
+    // Value of the kernel
+    WARP_VALUE = 1
+};
+
+// Lattice cells along a side of the noise textures: at the default view the
+// first octave spans 20 cells, the repeats hide in the higher ones
+const unsigned int WARP_TILE_PERIOD = 128;
+
+// Side of the tiles of the time sliced animation in pixels, 135 tiles at 4K
+const unsigned int WARP_SLICE_TILE = 256;
+
+// Domain warping kernels of shaders/noise.glsl over the plane view, drawn
+// by frag_warp.glsl. Each kernel is compiled once per noise source:
+// source 0 hashes the lattice in every octave, as the CPU port does, the
+// next ones read the noise from a NoiseTexture each.
+//
+// With a field divisor above 1 the warps take two passes, as
+// render_warp_field() on the CPU: the offsets of their inner fields are
+// drawn into a target divisor times smaller, then every pixel runs the
+// outer fbm() of its point moved by the upsampled offset. A divisor of 2
+// runs 2 fbm() per pixel instead of 5 for warp_third().
+class WarpPass {
+    public:
+        // One noise texture per entry of texels_per_cell, tiles of period
+        // cells of params.basis. The procedural source keeps params.period.
+        WarpPass(const NoiseParams& params, const vector<unsigned int>& texels_per_cell, unsigned int period);
+        ~WarpPass();
+
+        // Draws the kernel on the noise of source into a width x height
+        // target, the view as the one of ScreenQuad::draw()
+        void render(const ScreenQuad& screen, WarpKernel kernel, unsigned int source, float time, float center_x,
+                    float center_y, float zoom, unsigned int width, unsigned int height, unsigned int field_divisor = 1);
+
+        // render() of an animation, spread over several frames: every call
+        // draws the next tiles of the target, as many as fit in budget_ms
+        // of GPU time, at the time they will be drawn again. Each tile keeps
+        // its last two keys, the target interpolates between them. Tiles
+        // are visited in a scattered order, the seams of the updates move
+        // all over the image. Another view, kernel, source or divisor draws
+        // the whole target at once.
+        //
+        // The GPU time of a tile is measured with a timer query, read back
+        // frames later to never stall, the time between two frames from the
+        // times of the calls.
+        void renderSliced(const ScreenQuad& screen, WarpKernel kernel, unsigned int source, float time, float center_x,
+                          float center_y, float zoom, unsigned int width, unsigned int height, float budget_ms,
+                          unsigned int field_divisor = 1);
+
+        // Copies the colors onto the default framebuffer of size width x height
+        void display(unsigned int width, unsigned int height) const;
+
+        GLuint getTexture(WarpAttachment attachment) const;
+        unsigned int getSources() const;
+        // "procedural", or the tile of the texture
+        string getSourceName(unsigned int source) const;
+
+    private:
+        // Draws the kernel over the region (x, y, w, h) of target only
+        void draw(const ScreenQuad& screen, FrameBuffer& target, WarpKernel kernel, unsigned int source, float time,
+                  float center_x, float center_y, float zoom, unsigned int field_divisor, unsigned int x,
+                  unsigned int y, unsigned int w, unsigned int h);
+        void drawTile(const ScreenQuad& screen, FrameBuffer& target, unsigned int tile, float time);
+        void compose(const ScreenQuad& screen, float time);
+
+    private:
+        struct SourceShaders {
+            // One per WarpKernel
+            array<shared_ptr<Shader>, 3> kernels;
+            // Inner fields of warp_second() and warp_third()
+            array<shared_ptr<Shader>, 2> fields;
+            // Outer fbm() of the upsampled field
+            shared_ptr<Shader> upsample;
+        };
+
+        vector<SourceShaders> m_shaders;
+        vector<unique_ptr<NoiseTexture>> m_textures;
+        unique_ptr<FrameBuffer> m_target;
+        // RG32F offsets of the inner fields
+        unique_ptr<FrameBuffer> m_field;
+
+        // What the keys of the time slicing hold
+        struct SliceView {
+            WarpKernel kernel;
+            unsigned int source;
+            float center_x, center_y, zoom;
+            unsigned int width, height, field_divisor;
+
+            bool same(const SliceView& other) const {
+                return kernel == other.kernel && source == other.source && center_x == other.center_x &&
+                       center_y == other.center_y && zoom == other.zoom && width == other.width &&
+                       height == other.height && field_divisor == other.field_divisor;
+            }
+        };
+        SliceView m_slice;
+        bool m_slice_valid;
+        shared_ptr<Shader> m_compose;
+        // The two keys of every tile, and their times in m_key_times
+        array<unique_ptr<FrameBuffer>, 2> m_keys;
+        GLuint m_key_times;
+        vector<float> m_times;
+        unsigned int m_tiles_x, m_tiles_y;
+        // Position in the scattered order of the tiles, and its step
+        unsigned int m_next_tile, m_tile_step;
+        // Moving averages of the GPU time of a tile and of the time between
+        // two frames, and the time of the last call
+        float m_tile_ms, m_frame_time, m_last_time;
+        GLuint m_query;
+        bool m_query_pending;
+        unsigned int m_query_tiles;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#version 330 core
+precision highp float;
+
+out vec4 color;
+
+in vec3 pos_screen;
+
+// G-buffer written by frag_fractals.glsl
+uniform sampler2D iteration;
+uniform sampler2D distance_estimate;
+uniform sampler1D palette;
+uniform int palette_size;
+
+uniform int max_iter;
+// t = offset + density*iteration, wrapped when cyclic
+uniform float density;
+uniform float offset;
+uniform int cyclic;
+uniform vec3 interior;
+
+// Histogram equalization, density*iteration is replaced by the CDF
+uniform int equalize;
+// Inclusive prefix sum of the iteration histogram (bins x 1)
+uniform sampler2D cdf;
+uniform int bins;
+
+// Boundary antialiasing from the distance estimate: pixels closer to the set
+// than pixel_size are blended toward the interior color by their coverage.
+uniform int edge_aa;
+uniform float pixel_size;
+
+// Colors picked by the iteration pass, orbit trap or Newton basin. They
+// replace the palette where their alpha is not 0.
+uniform int direct;
+uniform sampler2D direct_color;
+
+float equalized(float n) {
+    float x = min(n/float(max_iter)*float(bins), float(bins) - 1e-3f);
+    int b = int(x);
+    float total = texelFetch(cdf, ivec2(bins - 1, 0), 0).r;
+    float below = (b > 0) ? texelFetch(cdf, ivec2(b - 1, 0), 0).r : 0.f;
+    float upto = texelFetch(cdf, ivec2(b, 0), 0).r;
+    return mix(below, upto, fract(x))/max(total, 1.f);
+}
+
+void main() {
+    if(direct != 0) {
+        vec4 hit = texelFetch(direct_color, ivec2(gl_FragCoord.xy), 0);
+        if(hit.a > 0.f) {
+            color = vec4(hit.rgb, 1.f);
+            return;
+        }
+    }
+
+    float n = texelFetch(iteration, ivec2(gl_FragCoord.xy), 0).r;
+    if(n >= float(max_iter)) {
+        color = vec4(interior, 1.f);
+        return;
+    }
+
+    float t = offset + ((equalize != 0) ? equalized(n) : density*n);
+    t = (cyclic != 0) ? fract(t) : clamp(t, 0.f, 1.f);
+    // Hit the centers of the first and last texels at t = 0 and t = 1
+    float size = float(palette_size);
+    color = texture(palette, (t*(size - 1.f) + 0.5f)/size);
+
+    if(edge_aa != 0) {
+        float de = texelFetch(distance_estimate, ivec2(gl_FragCoord.xy), 0).r;
+        color.rgb = mix(interior, color.rgb, clamp(de/pixel_size, 0.f, 1.f));
+    }
+}
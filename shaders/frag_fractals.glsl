@@ -1,7 +1,12 @@
 #version 330 core
 precision highp float;
 
-out vec4 color;
+// G-buffer (see gbuffer.hpp), read by the deferred passes
+layout(location = 0) out float iteration;
+layout(location = 1) out float distance_estimate;
+layout(location = 2) out vec2 final_z;
+layout(location = 3) out vec2 derivative;
+layout(location = 4) out vec4 direct_color;
 
 in vec3 pos_screen;
 
@@ -9,84 +14,289 @@ uniform float time;
 uniform float zoom;
 uniform float deplt_x;
 uniform float deplt_y;
+uniform int max_iter;
 
-float rand(vec2 n) { 
-	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
+#ifdef JULIA
+// Fixed parameter of the Julia set, the pixel is the starting point z0
+uniform vec2 julia_c;
+#endif
+
+// Image orbit trap: the image covers the square of side trap_size around
+// trap_center, the first orbit point landing on it colors the pixel
+uniform int trap;
+uniform sampler2D trap_image;
+uniform vec2 trap_center;
+uniform float trap_size;
+// Width of a pixel in the plane, for the mipmap level of the trap
+uniform float pixel_size;
+// Trap color of the orbit so far, alpha 0 until it hits the image
+vec4 trap_hit = vec4(0.f);
+
+#include "noise.glsl"
+
+// Formula variants, selected with a define injected by Shader:
+//   (none)        z -> z^2 + c, the Mandelbrot set
+//   DEGREE n      z -> z^n + c, Multibrot sets
+//   BURNING_SHIP  z -> (|Re z| + i |Im z|)^2 + c
+//   TRICORN       z -> conj(z)^2 + c
+//   HYBRID        a sequence of the above, one per iteration
+// They mirror the formula policies of cpu/formula.hpp and the sequences of
+// cpu/hybrid.hpp, which generates the HYBRID statement. A formula written in
+// the language of cpu/formula_program.hpp is compiled to a CUSTOM_FORMULA
+// statement, which then replaces formula_step(), with its own DEGREE.
+// NEWTON draws the Newton fractal of a polynomial instead, see newton(),
+// and LYAPUNOV the Lyapunov fractal of a sequence, see lyapunov().
+#ifndef DEGREE
+#define DEGREE 2
+#endif
+// Hybrids use the mean degree of their sequence
+#ifndef LOG2_DEGREE
+#define LOG2_DEGREE log2(float(DEGREE))
+#endif
+
+vec2 complex_mul(in vec2 a, in vec2 b) {
+    return vec2(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);
+}
+
+vec2 complex_div(in vec2 a, in vec2 b) {
+    return vec2(a.x*b.x + a.y*b.y, a.y*b.x - a.x*b.y)/dot(b, b);
 }
 
-float noise(vec2 n) {
-	const vec2 d = vec2(0.0, 1.0);
-    vec2 b = floor(n), f = smoothstep(vec2(0.0), vec2(1.0), fract(n));
-	return mix(mix(rand(b), rand(b + d.yx), f.x), mix(rand(b + d.xy), rand(b + d.yy), f.x), f.y);
+vec2 complex_exp(in vec2 a) {
+    return exp(a.x)*vec2(cos(a.y), sin(a.y));
 }
 
-int numOctaves = 10;
-float fbm(in vec2 x, in float H)
-{    
-    float G = exp2(-H);
-    float f = 1.0;
-    float a = 1.0;
-    float t = 0.0;
-    for(int i=0; i<numOctaves; i++) {
-        t += a*noise(f*x);
-        f *= 2.0;
-        a *= G;
+// Steps z -> f(z) and dz -> f'(z) dz of each formula, c is added by the caller
+void step_quadratic(inout vec2 z, inout vec2 dz) {
+    // dz = 2*z*dz
+    float re_dz_next = 2.f*(z.x*dz.x - z.y*dz.y);
+    dz.y = 2.f*(z.x*dz.y + z.y*dz.x);
+    dz.x = re_dz_next;
+
+    z = vec2(z.x*z.x - z.y*z.y, 2.f*z.x*z.y);
+}
+
+void step_power(inout vec2 z, inout vec2 dz, in int degree) {
+    // z^(degree-1), degree is a constant and the loop is unrolled
+    vec2 p = z;
+    for(int i = 2; i < degree; i++) {
+        p = complex_mul(p, z);
     }
-    return t;
+    dz = float(degree)*complex_mul(p, dz);
+    z = complex_mul(p, z);
 }
 
-float warp_second(in vec2 x) {
-    vec2 q = vec2(fbm(x + vec2(0.0, 0.2)*time/2.f, 1.f),
-                  fbm(x + vec2(2.2, 0.3)*time/2.f, 1.f));
-    return fbm(x + 4.0f*q, 1.f);
+void step_burning_ship(inout vec2 z, inout vec2 dz) {
+    // The fold is not holomorphic, dz follows its sign flips
+    dz = vec2(z.x < 0.f ? -dz.x : dz.x, z.y < 0.f ? -dz.y : dz.y);
+    z = abs(z);
+    step_quadratic(z, dz);
 }
 
-float warp_third(in vec2 x) {
-    vec2 q = vec2(fbm(x + vec2(5.0, 7.2), 1.f),
-                  fbm(x + vec2(-2.5, 5.3), 1.f));
+void step_tricorn(inout vec2 z, inout vec2 dz) {
+    z.y = -z.y;
+    dz.y = -dz.y;
+    step_quadratic(z, dz);
+}
 
-    return warp_second(x + 4.0f*q);
+// Step of iteration n
+void formula_step(inout vec2 z, inout vec2 dz, in int n) {
+#if defined(HYBRID)
+    HYBRID
+#elif defined(BURNING_SHIP)
+    step_burning_ship(z, dz);
+#elif defined(TRICORN)
+    step_tricorn(z, dz);
+#elif DEGREE == 2
+    step_quadratic(z, dz);
+#else
+    step_power(z, dz, DEGREE);
+#endif
 }
 
-float in_mandelbrot_set(in vec2 x) {
-    float re_c = x.x;
-    float im_c = x.y;
-    
-    float re_z = 0.f;
-    float im_z = 0.f;
+// Samples the trap image at z unless an earlier point of the orbit did. A
+// pixel covers |dz| pixel_size around z, which gives the mipmap level.
+void sample_trap(in vec2 z, in vec2 dz) {
+    vec2 uv = (z - trap_center)/trap_size + 0.5f;
+    if(trap_hit.a > 0.f || any(lessThan(uv, vec2(0.f))) || any(greaterThan(uv, vec2(1.f)))) {
+        return;
+    }
+    float texels = length(dz)*pixel_size/trap_size*float(textureSize(trap_image, 0).x);
+    trap_hit = textureLod(trap_image, uv, log2(max(texels, 1e-6f)));
+}
 
-    int N = 100;
+// Smooth iteration count of the orbit of z under z -> f(z) + c, max_iter
+// when it never escaped. dc is 1 for the derivative with respect to c and
+// 0 for the one with respect to z0. z and dz are returned as they were
+// when escaping.
+float escape_time(in vec2 c, in float dc, inout vec2 z, inout vec2 dz) {
+    int N = max_iter;
 
-    float factor = 1.f;
+    float factor = float(N);
     for(int n = 0; n < N; n++) {
-        float re_z_next = re_z*re_z - im_z*im_z + re_c;
-        im_z = im_c + 2.f*re_z*im_z;
-        re_z = re_z_next;
+#ifdef CUSTOM_FORMULA
+        CUSTOM_FORMULA
+#else
+        formula_step(z, dz, n);
+        z += c;
+        dz.x += dc;
+#endif
+        if(trap != 0) {
+            sample_trap(z, dz);
+        }
 
-        float r = length(vec2(re_z, im_z));
+        float r = length(z);
 
         if(r > 2.f) {
-            factor = float(n)/(N - 1);
+            factor = float(n) + 1.f - log2(log(r)/log(2.f))/LOG2_DEGREE;
             break;
         }
     }
-
     return factor;
 }
 
+// Smooth iteration count, max_iter when x belongs to the set.
+// z and its derivative dz/dc are returned as they were when escaping.
+float in_mandelbrot_set(in vec2 x, out vec2 z, out vec2 dz) {
+    z = vec2(0.f);
+    dz = vec2(0.f);
+    return escape_time(x, 1.f, z, dz);
+}
+
+// Same as in_mandelbrot_set() but z starts at x and c is fixed, so the
+// derivative dz/dz0 starts at 1 and has no constant term.
+float in_julia_set(in vec2 x, in vec2 c, out vec2 z, out vec2 dz) {
+    z = x;
+    dz = vec2(1.f, 0.f);
+    return escape_time(c, 0.f, z, dz);
+}
+
+#ifdef NEWTON
+// Newton fractal of a polynomial, NEWTON_DEGREE and NEWTON_ROOTS come from
+// cpu/newton.hpp. The pixel is the starting point of z <- z - p(z)/p'(z).
+#ifndef NEWTON_EPSILON
+#define NEWTON_EPSILON 1e-3f
+#endif
+
+// Steps until z is within NEWTON_EPSILON of a root, with the fraction of
+// the last step interpolated on log(distance). max_iter and root -1 when
+// it never gets there.
+float newton(in vec2 x, out vec2 z, out int root) {
+    const vec2 roots[NEWTON_DEGREE] = NEWTON_ROOTS;
+
+    z = x;
+    root = -1;
+    float previous = 1e30f;
+    for(int n = 0; n < max_iter; n++) {
+        // p'(z)/p(z) = sum 1/(z - root), as NewtonPolynomial::render()
+        vec2 s = vec2(0.f);
+        for(int k = 0; k < NEWTON_DEGREE; k++) {
+            vec2 d = z - roots[k];
+            s += vec2(d.x, -d.y)/max(dot(d, d), 1e-30f);
+        }
+        if(dot(s, s) > 0.f) {
+            z -= vec2(s.x, -s.y)/dot(s, s);
+        }
+
+        float distance = 1e30f;
+        int nearest = 0;
+        for(int k = 0; k < NEWTON_DEGREE; k++) {
+            vec2 d = z - roots[k];
+            if(dot(d, d) < distance) {
+                distance = dot(d, d);
+                nearest = k;
+            }
+        }
+        if(distance < NEWTON_EPSILON*NEWTON_EPSILON) {
+            root = nearest;
+            float log_previous = 0.5f*log(previous);
+            float log_distance = 0.5f*log(max(distance, 1e-30f));
+            return float(n) + clamp((log(NEWTON_EPSILON) - log_previous)/(log_distance - log_previous), 0.f, 1.f);
+        }
+        previous = distance;
+    }
+    return float(max_iter);
+}
+
+// Hue of the root, darker with the number of steps, as colorize_newton()
+vec3 basin_color(in int root, in float steps) {
+    if(root < 0) {
+        return vec3(0.f);
+    }
+    float hue = float(root)/float(NEWTON_DEGREE);
+    vec3 rgb = clamp(abs(fract(hue + vec3(0.f, 2.f/3.f, 1.f/3.f))*6.f - 3.f) - 1.f, 0.f, 1.f);
+    return pow(0.92f, steps)*mix(vec3(1.f), rgb, 0.75f);
+}
+#endif
+
+#ifdef LYAPUNOV
+// Lyapunov fractal, LYAPUNOV_SEQUENCE (true where r is b), LYAPUNOV_LENGTH,
+// LYAPUNOV_WARMUP and LYAPUNOV_ITERATIONS come from cpu/lyapunov.hpp. The
+// pixel is (a, b), r goes through them in the order of the sequence.
+
+// Mean of log |r (1 - 2x)| along the orbit of the logistic map, after
+// LYAPUNOV_WARMUP steps to settle on the attractor
+float lyapunov(in vec2 ab) {
+    const bool sequence[LYAPUNOV_LENGTH] = LYAPUNOV_SEQUENCE;
+
+    float x = 0.5f;
+    int k = 0;
+    for(int n = 0; n < LYAPUNOV_WARMUP; n++) {
+        float r = sequence[k] ? ab.y : ab.x;
+        x = r*x*(1.f - x);
+        k = (k + 1 == LYAPUNOV_LENGTH) ? 0 : k + 1;
+    }
+    float sum = 0.f;
+    for(int n = 0; n < LYAPUNOV_ITERATIONS; n++) {
+        float r = sequence[k] ? ab.y : ab.x;
+        sum += log(max(abs(r*(1.f - 2.f*x)), 1e-30f));
+        x = r*x*(1.f - x);
+        k = (k + 1 == LYAPUNOV_LENGTH) ? 0 : k + 1;
+    }
+    return sum/float(LYAPUNOV_ITERATIONS);
+}
+
+// Yellow when stable, blue when chaotic, as colorize_lyapunov()
+vec3 exponent_color(in float exponent) {
+    if(isnan(exponent)) {
+        return vec3(0.f);
+    }
+    vec3 color = exponent < 0.f ? vec3(1.f, 0.85f, 0.15f) : vec3(0.1f, 0.25f, 0.8f);
+    return (1.f - exp(-2.f*abs(exponent)))*color;
+}
+#endif
+
 void main() {
-    vec2 p = pos_screen.xy;
+    vec2 p = pos_screen.xy/zoom + vec2(deplt_x, deplt_y);
     //float factor = warp_third(p*10)/3.f;
 
     //vec2 h = vec2(fbm(p + time*vec2(0.6, 0.8), 1.0f), fbm(p + time*vec2(-5.6, 8.8), 1.0f));
-    float factor = 5*in_mandelbrot_set(p);
-
-    vec4 c0 = vec4(10/255.f, 10/255.f, 100/255.f, 1.f);
-    vec4 c1 = vec4(10/255.f, 10/255.f, 130/255.f, 1.f);
-    vec4 c2 = vec4(50/255.f, 10/255.f, 176/255.f, 1.f);
-    vec4 c3 = vec4(10/255.f, 10/255.f, 0/255.f, 1.f);
+    vec2 z, dz;
+#ifdef NEWTON
+    int root;
+    iteration = newton(p, z, root);
+    distance_estimate = 0.f;
+    final_z = z;
+    derivative = vec2(0.f);
+    direct_color = vec4(basin_color(root, iteration), 1.f);
+#elif defined(LYAPUNOV)
+    float exponent = lyapunov(p);
+    iteration = float(max_iter);
+    distance_estimate = 0.f;
+    final_z = vec2(exponent, 0.f);
+    derivative = vec2(0.f);
+    direct_color = vec4(exponent_color(exponent), 1.f);
+#else
+#ifdef JULIA
+    iteration = in_julia_set(p, julia_c, z, dz);
+#else
+    iteration = in_mandelbrot_set(p, z, dz);
+#endif
 
-    color = mix(c0, c1, smoothstep(0.f, 0.33f, factor));
-    color = mix(color, c2, smoothstep(0.33f, 0.66f, factor));
-    color = mix(color, c3, smoothstep(0.66f, 1.f, factor));
+    float r = length(z);
+    distance_estimate = (iteration < float(max_iter)) ? 0.5f*r*log(r)/length(dz) : 0.f;
+    final_z = z;
+    derivative = dz;
+    direct_color = trap_hit;
+#endif
 }
\ No newline at end of file
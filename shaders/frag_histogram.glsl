@@ -0,0 +1,7 @@
+#version 330 core
+
+layout(location = 0) out float count;
+
+void main() {
+    count = 1.f;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+layout(location = 0) out float count;
+
+// bins x copies private histograms
+uniform sampler2D histograms;
+uniform int copies;
+
+void main() {
+    int bin = int(gl_FragCoord.x);
+
+    float sum = 0.f;
+    for(int row = 0; row < copies; row++) {
+        sum += texelFetch(histograms, ivec2(bin, row), 0).r;
+    }
+    count = sum;
+}
@@ -0,0 +1,44 @@
+#version 330 core
+precision highp float;
+
+out vec4 color;
+
+in vec3 pos_screen;
+
+// Output of the coloring pass
+uniform sampler2D colors;
+// G-buffer written by frag_fractals.glsl
+uniform sampler2D iteration;
+uniform sampler2D final_z;
+uniform sampler2D derivative;
+uniform int max_iter;
+
+// Unit vector toward the light
+uniform vec3 light;
+// Larger values flatten the relief
+uniform float height;
+uniform float ambient;
+uniform float diffuse;
+uniform float specular;
+uniform float shininess;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    color = texelFetch(colors, texel, 0);
+    if(texelFetch(iteration, texel, 0).r >= float(max_iter)) {
+        return;
+    }
+
+    // Slope direction u = z/dz
+    vec2 z = texelFetch(final_z, texel, 0).xy;
+    vec2 dz = texelFetch(derivative, texel, 0).xy;
+    vec2 u = vec2(z.x*dz.x + z.y*dz.y, z.y*dz.x - z.x*dz.y);
+    u = (length(u) > 0.f) ? normalize(u) : u;
+    vec3 n = normalize(vec3(u, height));
+
+    // Blinn-Phong, the viewer looks down the z axis
+    vec3 h = normalize(light + vec3(0.f, 0.f, 1.f));
+    float d = max(dot(n, light), 0.f);
+    float s = pow(max(dot(n, h), 0.f), shininess);
+    color.rgb = min(color.rgb*(ambient + diffuse*d) + specular*s, vec3(1.f));
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+layout(location = 0) out float sum;
+
+// One step of an inclusive Hillis-Steele scan, stride = 1, 2, 4, ...
+uniform sampler2D counts;
+uniform int stride;
+
+void main() {
+    int x = int(gl_FragCoord.x);
+
+    float s = texelFetch(counts, ivec2(x, 0), 0).r;
+    if(x >= stride) {
+        s += texelFetch(counts, ivec2(x - stride, 0), 0).r;
+    }
+    sum = s;
+}
@@ -0,0 +1,438 @@
+#version 330 core
+precision highp float;
+
+#if defined(CONE_PREPASS)
+// Cone marching prepass, one fragment per cone_tile x cone_tile tile: the
+// depth the rays of the tile can start from. Tiles are counted from the
+// top left corner of the image, as cone_prepass().
+layout(location = 0) out float depth;
+layout(location = 1) out float steps;
+#elif defined(SHADOW_PASS)
+// Shadow map, distance from the plane tangent to the bounding sphere
+// toward the light (1e30 where it missed), as render_shadow_map()
+layout(location = 0) out float depth;
+#elif defined(OCCLUSION_PASS)
+// Mean visibility of a voxel over the directions of the pass, blended
+// into the volume, as accumulate_occlusion(). The volume is stored as
+// occlusion_tiles x occlusion_tiles slices of occlusion_size^2 texels.
+layout(location = 0) out float visibility;
+#else
+// Color, distance along the ray (1e30 where it missed) and distance
+// evaluations of the ray, see raymarch_pass.hpp
+layout(location = 0) out vec4 color;
+layout(location = 1) out float depth;
+layout(location = 2) out float steps;
+#endif
+
+in vec3 pos_screen;
+
+// Camera::rays(): the ray of pos_screen is forward + x right + y up,
+// moved by jitter pixels (y down)
+uniform vec3 camera_eye;
+uniform vec3 camera_right;
+uniform vec3 camera_up;
+uniform vec3 camera_forward;
+uniform vec2 jitter;
+uniform float pixel_angle;
+
+// MarchParams
+uniform int max_steps;
+uniform float max_distance;
+uniform float relaxation;
+uniform float epsilon;
+// Footprint of the parallel rays of the shadow map relative to
+// SCENE_BOUND, 0 for the camera
+uniform float pixel_size;
+
+// Cone prepass, off when cone_tile is 0: half angle of the cone of a tile,
+// size of the full resolution target, and the depths of the prepass
+uniform int cone_tile;
+uniform float cone_angle;
+uniform vec2 resolution;
+uniform sampler2D cone_start;
+
+// Temporal reprojection, when reprojection is not 0: depth the ray of each
+// pixel starts from, -1 where it is disoccluded (frag_temporal.glsl).
+// The cone prepass skips the tiles without disoccluded pixels.
+uniform int reprojection;
+uniform sampler2D reprojection_start;
+
+// Light::direction() and its diffuse model
+uniform vec3 light;
+uniform float ambient;
+uniform float diffuse;
+
+// ShadowMap: axes of the map, and normal offset of the shaded points in
+// shadow texels
+uniform sampler2D shadow_map;
+uniform vec3 shadow_right;
+uniform vec3 shadow_up;
+uniform float shadow_bias;
+
+// OcclusionVolume, ignored while occlusion_directions is 0, and the
+// directions [occlusion_first, occlusion_first + occlusion_count) of
+// occlusion_total marched by OCCLUSION_PASS, up to occlusion_radius
+// SCENE_BOUND
+uniform sampler2D occlusion;
+uniform int occlusion_size;
+uniform int occlusion_tiles;
+uniform int occlusion_directions;
+uniform int occlusion_first;
+uniform int occlusion_count;
+uniform int occlusion_total;
+uniform int occlusion_steps;
+uniform float occlusion_radius;
+
+// Scene variants, selected with a define injected by Shader, and the
+// radius SCENE_BOUND of a sphere around the origin holding the surface:
+//   MANDELBULB        power 8 Mandelbulb, cpu/mandelbulb.hpp
+//   QUATERNION_JULIA  slice of a quaternion Julia set, cpu/quaternion_julia.hpp
+//   KIFS_SIERPINSKI   Sierpinski tetrahedron, cpu/kifs.hpp
+//   KIFS_MENGER       Menger sponge, cpu/kifs.hpp
+//   MANDELBOX         Mandelbox, cpu/mandelbox.hpp
+#ifndef SCENE_BOUND
+#define SCENE_BOUND 2.f
+#endif
+
+#ifdef MANDELBULB
+#ifndef MANDELBULB_ITERATIONS
+#define MANDELBULB_ITERATIONS 5
+#endif
+
+// Distance estimate of the power 8 Mandelbulb, the triplex power expanded
+// into polynomials with the z axis as the pole, as Mandelbulb::distance()
+float scene_distance(in vec3 p) {
+    vec3 w = p;
+    float m = dot(w, w);
+    float dw = 1.f;
+    for(int n = 0; n < MANDELBULB_ITERATIONS && m <= 256.f; n++) {
+        float a = w.x, b = w.z, c = w.y;
+        float a2 = a*a, b2 = b*b, c2 = c*c;
+        float a4 = a2*a2, b4 = b2*b2, c4 = c2*c2;
+        float k3 = a2 + c2;
+        float k2 = inversesqrt(k3*k3*k3*k3*k3*k3*k3);
+        float k1 = a4 + b4 + c4 - 6.f*b2*c2 - 6.f*a2*b2 + 2.f*c2*a2;
+        float k4 = a2 - b2 + c2;
+
+        dw = 8.f*m*m*m*sqrt(m)*dw + 1.f;
+        w.x = p.x + 64.f*a*b*c*(a2 - c2)*k4*(a4 - 6.f*a2*c2 + c4)*k1*k2;
+        w.z = p.z - 16.f*b2*k3*k4*k4 + k1*k1;
+        w.y = p.y - 8.f*b*k4*(a4*a4 - 28.f*a4*a2*c2 + 70.f*a4*c4 - 28.f*a2*c2*c4 + c4*c4)*k1*k2;
+        m = dot(w, w);
+    }
+    return 0.25f*log(m)*sqrt(m)/dw;
+}
+#endif
+
+#ifdef QUATERNION_JULIA
+#ifndef QUATERNION_JULIA_ITERATIONS
+#define QUATERNION_JULIA_ITERATIONS 11
+#endif
+
+// Distance estimate of the Julia set of q -> q^2 + QUATERNION_JULIA_C at
+// w = QUATERNION_JULIA_SLICE, |dq| follows 2 |q| |dq|, as
+// QuaternionJulia::distance()
+float scene_distance(in vec3 p) {
+    vec4 q = vec4(p, QUATERNION_JULIA_SLICE);
+    float m = dot(q, q);
+    float md = 1.f;
+    for(int n = 0; n < QUATERNION_JULIA_ITERATIONS && m <= 256.f; n++) {
+        md *= 4.f*m;
+        q = vec4(q.x*q.x - dot(q.yzw, q.yzw), 2.f*q.x*q.yzw) + QUATERNION_JULIA_C;
+        m = dot(q, q);
+    }
+    return 0.25f*sqrt(m/md)*log(m);
+}
+#endif
+
+#if defined(KIFS_SIERPINSKI) || defined(KIFS_MENGER)
+#ifndef KIFS_SCALE
+#define KIFS_SCALE 2.f
+#endif
+#ifndef KIFS_ITERATIONS
+#define KIFS_ITERATIONS 10
+#endif
+
+// Folds into the fundamental domain of the solid and scaling about one of
+// its vertices, then the distance to the solid, as
+// KaleidoscopicIFS::distance()
+float scene_distance(in vec3 p) {
+    const float shift = KIFS_SCALE - 1.f;
+    for(int n = 0; n < KIFS_ITERATIONS; n++) {
+#ifdef KIFS_SIERPINSKI
+        if(p.x + p.y < 0.f) p.xy = -p.yx;
+        if(p.x + p.z < 0.f) p.xz = -p.zx;
+        if(p.y + p.z < 0.f) p.yz = -p.zy;
+        p = KIFS_SCALE*p - shift;
+#else
+        p = abs(p);
+        p.xy = vec2(max(p.x, p.y), min(p.x, p.y));
+        p.xz = vec2(max(p.x, p.z), min(p.x, p.z));
+        p.yz = vec2(max(p.y, p.z), min(p.y, p.z));
+        p = vec3(KIFS_SCALE*p.xy - shift, KIFS_SCALE*p.z);
+        if(p.z > 0.5f*shift) p.z -= shift;
+#endif
+    }
+#ifdef KIFS_SIERPINSKI
+    float d = (max(max(-p.x - p.y - p.z, p.x + p.y - p.z), max(-p.x + p.y + p.z, p.x - p.y + p.z)) - 1.f)*0.57735027f;
+#else
+    vec3 q = abs(p) - 1.f;
+    float d = length(max(q, 0.f)) + min(max(q.x, max(q.y, q.z)), 0.f);
+#endif
+    return d*pow(KIFS_SCALE, -float(KIFS_ITERATIONS));
+}
+#endif
+
+#ifdef MANDELBOX
+#ifndef MANDELBOX_SCALE
+#define MANDELBOX_SCALE -1.5f
+#endif
+#ifndef MANDELBOX_ITERATIONS
+#define MANDELBOX_ITERATIONS 12
+#endif
+
+// Box fold, sphere fold of radii 0.5 and 1, scaling and translation by p,
+// |z| / |dr| at the end, as Mandelbox::distance()
+float scene_distance(in vec3 p) {
+    vec3 z = p;
+    float dr = 1.f;
+    for(int n = 0; n < MANDELBOX_ITERATIONS; n++) {
+        z = 2.f*clamp(z, -1.f, 1.f) - z;
+        float r2 = dot(z, z);
+        float k = r2 < 0.25f ? 4.f : (r2 < 1.f ? 1.f/r2 : 1.f);
+        z = MANDELBOX_SCALE*k*z + p;
+        dr = abs(MANDELBOX_SCALE)*k*dr + 1.f;
+    }
+    return length(z)/dr;
+}
+#endif
+
+// [t_enter, t_exit] of the ray in the bounding sphere, false when it misses
+bool bound_interval(in vec3 eye, in vec3 dir, out float t_enter, out float t_exit) {
+    float b = dot(eye, dir);
+    float h = b*b - dot(eye, eye) + SCENE_BOUND*SCENE_BOUND;
+    if(h < 0.f) {
+        return false;
+    }
+    h = sqrt(h);
+    t_enter = max(-b - h, 0.f);
+    t_exit = -b + h;
+    return true;
+}
+
+// Relaxed sphere tracing from t, as march_packet() of cpu/raymarch.hpp.
+// Returns whether the ray hit, t is then on the surface.
+bool march(in vec3 eye, in vec3 dir, inout float t, in float t_max, inout int n) {
+    float omega = relaxation;
+    float step = 0.f;
+    float previous = 0.f;
+    float radius = 1e30f;
+    float cone = epsilon*pixel_angle;
+    float size = epsilon*pixel_size*SCENE_BOUND;
+    while(n < max_steps && t <= t_max) {
+        radius = abs(scene_distance(eye + t*dir));
+        n++;
+        // The spheres of this point and of the previous one do not overlap,
+        // the relaxed step may have crossed the surface
+        bool overshoot = omega > 1.f && radius + previous < step;
+        if(!overshoot && radius < cone*t + size) {
+            return true;
+        }
+        if(overshoot) {
+            step -= omega*step;
+            omega = 1.f;
+        } else {
+            step = radius*omega;
+        }
+        previous = radius;
+        t += step;
+    }
+    return t <= t_max && radius < 4.f*(cone*t + size);
+}
+
+// Cone of half angle cone_angle from the camera, as cone_packet(): the
+// rays inside it are at least distance - t cone_angle away from the
+// surface. Stops when it would move by less than its own radius.
+float cone_march(in vec3 eye, in vec3 dir, in float t_max, inout int n) {
+    float t = 0.f;
+    while(n < max_steps && t <= t_max) {
+        float step = scene_distance(eye + t*dir) - t*cone_angle;
+        n++;
+        if(step <= t*cone_angle) {
+            break;
+        }
+        t += step;
+    }
+    return t;
+}
+
+// Gradient of the distance on a tetrahedron of size h around p
+vec3 scene_normal(in vec3 p, in float h) {
+    const vec2 k = vec2(1.f, -1.f);
+    return normalize(k.xyy*scene_distance(p + k.xyy*h) + k.yyx*scene_distance(p + k.yyx*h) +
+                     k.yxy*scene_distance(p + k.yxy*h) + k.xxx*scene_distance(p + k.xxx*h));
+}
+
+// Background gradient and diffuse surface, as shade_march()
+vec3 sky(in float y) {
+    return mix(vec3(0.12f, 0.16f, 0.24f), vec3(0.02f, 0.02f, 0.04f), y);
+}
+
+vec3 shade(in vec3 n, in float lit, in float occluded) {
+    return min(ambient*occluded + diffuse*max(dot(n, light), 0.f)*lit, 1.f)*vec3(0.85f, 0.72f, 0.55f);
+}
+
+// Depth test of the 2x2 nearest texels of the shadow map, bilinearly
+// weighted, as ShadowMap::visibility()
+float shadow_visibility(in vec3 p) {
+    ivec2 size = textureSize(shadow_map, 0);
+    vec2 uv = vec2(dot(p, shadow_right), dot(p, shadow_up))/SCENE_BOUND;
+    float d = SCENE_BOUND - dot(p, light);
+    vec2 s = (0.5f*uv + 0.5f)*vec2(size) - 0.5f;
+    ivec2 i0 = ivec2(floor(s));
+    vec2 f = s - floor(s);
+    vec4 lit;
+    lit.x = d <= texelFetch(shadow_map, clamp(i0, ivec2(0), size - 1), 0).r ? 1.f : 0.f;
+    lit.y = d <= texelFetch(shadow_map, clamp(i0 + ivec2(1, 0), ivec2(0), size - 1), 0).r ? 1.f : 0.f;
+    lit.z = d <= texelFetch(shadow_map, clamp(i0 + ivec2(0, 1), ivec2(0), size - 1), 0).r ? 1.f : 0.f;
+    lit.w = d <= texelFetch(shadow_map, clamp(i0 + ivec2(1, 1), ivec2(0), size - 1), 0).r ? 1.f : 0.f;
+    return mix(mix(lit.x, lit.y, f.x), mix(lit.z, lit.w, f.x), f.y);
+}
+
+// Visibility of the voxel v in the volume
+float voxel(in ivec3 v) {
+    ivec2 slice = ivec2(v.z % occlusion_tiles, v.z/occlusion_tiles);
+    return texelFetch(occlusion, v.xy + slice*occlusion_size, 0).r;
+}
+
+// Ambient term at p, trilinear in the voxels, as OcclusionVolume::ambient()
+float ambient_occlusion(in vec3 p) {
+    if(occlusion_directions == 0) {
+        return 1.f;
+    }
+    vec3 x = clamp((p + SCENE_BOUND)/(2.f*SCENE_BOUND)*float(occlusion_size) - 0.5f, 0.f, float(occlusion_size - 1));
+    ivec3 i0 = min(ivec3(x), ivec3(occlusion_size - 2));
+    vec3 s = x - vec3(i0);
+    float bottom0 = mix(voxel(i0), voxel(i0 + ivec3(1, 0, 0)), s.x);
+    float top0 = mix(voxel(i0 + ivec3(0, 1, 0)), voxel(i0 + ivec3(1, 1, 0)), s.x);
+    float bottom1 = mix(voxel(i0 + ivec3(0, 0, 1)), voxel(i0 + ivec3(1, 0, 1)), s.x);
+    float top1 = mix(voxel(i0 + ivec3(0, 1, 1)), voxel(i0 + ivec3(1, 1, 1)), s.x);
+    return min(2.f*mix(mix(bottom0, top0, s.y), mix(bottom1, top1, s.y), s.z), 1.f);
+}
+
+// k-th of count directions of the spherical Fibonacci lattice, as
+// fibonacci_direction()
+vec3 fibonacci_direction(in int k, in int count) {
+    float z = 1.f - (2.f*float(k) + 1.f)/float(count);
+    float r = sqrt(max(1.f - z*z, 0.f));
+    float phi = 2.39996323f*float(k);
+    return vec3(r*cos(phi), r*sin(phi), z);
+}
+
+// Soft visibility of p along dir, as occlusion_packet()
+float occlusion_ray(in vec3 p, in vec3 dir, in float voxel_size) {
+    float t = 0.f;
+    float v = 1.f;
+    for(int n = 0; n < occlusion_steps; n++) {
+        float d = scene_distance(p + t*dir);
+        v = min(v, 4.f*d/(t + voxel_size));
+        t += max(d, 0.25f*voxel_size);
+        if(t >= occlusion_radius*SCENE_BOUND || v <= 0.f) {
+            break;
+        }
+    }
+    return clamp(v, 0.f, 1.f);
+}
+
+#if defined(SHADOW_PASS)
+void main() {
+    // Parallel rays along -light from the plane tangent to the bounding
+    // sphere, the corners of the map miss the sphere
+    vec2 uv = 2.f*gl_FragCoord.xy/resolution - 1.f;
+    depth = 1e30f;
+    if(dot(uv, uv) <= 1.f) {
+        vec3 eye = SCENE_BOUND*(light + uv.x*shadow_right + uv.y*shadow_up);
+        float t = 0.f;
+        int n = 0;
+        if(march(eye, -light, t, 2.f*SCENE_BOUND, n)) {
+            depth = t;
+        }
+    }
+}
+#elif defined(OCCLUSION_PASS)
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec3 v = ivec3(texel % occlusion_size, (texel.y/occlusion_size)*occlusion_tiles + texel.x/occlusion_size);
+    if(v.z >= occlusion_size) {
+        discard;
+    }
+    float voxel_size = 2.f*SCENE_BOUND/float(occlusion_size);
+    vec3 p = (vec3(v) + 0.5f)*voxel_size - SCENE_BOUND;
+    float sum = 0.f;
+    for(int k = 0; k < occlusion_count; k++) {
+        sum += occlusion_ray(p, fibonacci_direction(occlusion_first + k, occlusion_total), voxel_size);
+    }
+    visibility = sum/float(occlusion_count);
+}
+#elif defined(CONE_PREPASS)
+void main() {
+    // Tiles whose pixels all start from their reprojected hit
+    ivec2 tile = ivec2(gl_FragCoord.xy);
+    if(reprojection != 0) {
+        bool disoccluded = false;
+        for(int y = tile.y*cone_tile; y < min((tile.y + 1)*cone_tile, int(resolution.y)); y++) {
+            for(int x = tile.x*cone_tile; x < min((tile.x + 1)*cone_tile, int(resolution.x)); x++) {
+                disoccluded = disoccluded || texelFetch(reprojection_start, ivec2(x, int(resolution.y) - 1 - y), 0).r < 0.f;
+            }
+        }
+        if(!disoccluded) {
+            depth = 0.f;
+            steps = 0.f;
+            return;
+        }
+    }
+
+    // Ray through the center of the tile, row 0 being the top of the image
+    vec2 center = 2.f*((vec2(tile) + 0.5f)*float(cone_tile) + jitter)/resolution - 1.f;
+    center.y = -center.y;
+    vec3 dir = normalize(camera_forward + center.x*camera_right + center.y*camera_up);
+
+    // Past |eye| + SCENE_BOUND every ray has left the bounding sphere
+    int n = 0;
+    depth = cone_march(camera_eye, dir, min(length(camera_eye) + SCENE_BOUND, max_distance), n);
+    steps = float(n);
+}
+#else
+void main() {
+    vec2 uv = pos_screen.xy + 2.f*vec2(jitter.x, -jitter.y)/resolution;
+    vec3 dir = normalize(camera_forward + uv.x*camera_right + uv.y*camera_up);
+
+    int n = 0;
+    float t, t_max;
+    bool hit = false;
+    if(bound_interval(camera_eye, dir, t, t_max)) {
+        float previous = reprojection != 0 ? texelFetch(reprojection_start, ivec2(gl_FragCoord.xy), 0).r : -1.f;
+        if(previous >= 0.f) {
+            t = max(t, previous);
+        } else if(cone_tile > 0) {
+            ivec2 pixel = ivec2(gl_FragCoord.x, resolution.y - gl_FragCoord.y);
+            t = max(t, texelFetch(cone_start, pixel/cone_tile, 0).r);
+        }
+        hit = march(camera_eye, dir, t, min(t_max, max_distance), n);
+    }
+
+    steps = float(n);
+    if(hit) {
+        depth = t;
+        vec3 p = camera_eye + t*dir;
+        vec3 normal = scene_normal(p, max(0.5f*pixel_angle*t, 1e-5f));
+        ivec2 shadow_size = textureSize(shadow_map, 0);
+        float lit = shadow_visibility(p + shadow_bias*2.f*SCENE_BOUND/float(min(shadow_size.x, shadow_size.y))*normal);
+        float occluded = ambient_occlusion(p + 2.f*SCENE_BOUND/float(max(occlusion_size, 1))*normal);
+        color = vec4(shade(normal, lit, occluded), 1.f);
+    } else {
+        depth = 1e30f;
+        color = vec4(sky(0.5f - 0.5f*pos_screen.y), 1.f);
+    }
+}
+#endif
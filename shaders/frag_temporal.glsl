@@ -0,0 +1,65 @@
+#version 330 core
+precision highp float;
+
+// Passes between the frames of the 3D scenes, see raymarch_pass.hpp:
+//   REPROJECT_SPLAT  distance of a hit of the previous frame reprojected by
+//                    vertex_reproject.glsl, GL_MIN blended
+//   REPROJECT_START  depth the ray of each pixel starts from, out of the
+//                    reprojected hits of its 3x3 neighbourhood, -1 where
+//                    it is disoccluded, as reprojection_start()
+//   otherwise        color of the frame, blended into the running mean of
+//                    the jittered frames of a still camera
+#if defined(REPROJECT_SPLAT)
+in float reprojected;
+
+layout(location = 0) out float depth;
+
+void main() {
+    depth = reprojected;
+}
+#elif defined(REPROJECT_START)
+// Nearest reprojected hit of each pixel, 1e30 where none landed
+uniform sampler2D reprojected;
+
+// MarchParams, and Camera::pixel_angle()
+uniform float reproject_margin;
+uniform float reproject_smooth;
+uniform float reproject_edge;
+uniform float epsilon;
+uniform float pixel_angle;
+
+layout(location = 0) out float start;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(reprojected, 0);
+    float nearest = 1e30f;
+    float farthest = 0.f;
+    for(int y = max(pixel.y - 1, 0); y <= min(pixel.y + 1, size.y - 1); y++) {
+        for(int x = max(pixel.x - 1, 0); x <= min(pixel.x + 1, size.x - 1); x++) {
+            float d = texelFetch(reprojected, ivec2(x, y), 0).r;
+            if(d < 1e30f) {
+                nearest = min(nearest, d);
+                farthest = max(farthest, d);
+            }
+        }
+    }
+
+    start = -1.f;
+    if(nearest < 1e30f && farthest - nearest <= reproject_edge*nearest) {
+        // The own hit of the pixel moved back by the change of depth over
+        // half a pixel, see reprojection_start()
+        float own = texelFetch(reprojected, pixel, 0).r;
+        bool smooth_depth = own < 1e30f && farthest - nearest <= reproject_smooth*nearest;
+        start = (1.f - reproject_margin*epsilon*pixel_angle)*(smooth_depth ? max(nearest, own - 0.25f*(farthest - nearest)) : nearest);
+    }
+}
+#else
+uniform sampler2D frame;
+
+layout(location = 0) out vec4 color;
+
+void main() {
+    color = texelFetch(frame, ivec2(gl_FragCoord.xy), 0);
+}
+#endif
@@ -0,0 +1,216 @@
+#version 330 core
+precision highp float;
+// Heightfield z = height fbm(x, y) of TerrainParams (cpu/terrain.hpp).
+// The rays walk down the pyramid of the highest heights: a texel the ray
+// passes over is skipped whole and the walk goes up a level, one the ray
+// dips into is split into its 4 children. The texels of the base, or the
+// ones already smaller than lod pixels, are leaves where the ray samples
+// the terrain itself. The octaves of fbm() are cut with the distance, and
+// the normals come from its analytic gradient.
+
+// Color, distance along the ray (1e30 where it missed) and fbm()
+// evaluations of the ray, see terrain_pass.hpp
+layout(location = 0) out vec4 color;
+layout(location = 1) out float depth;
+layout(location = 2) out float steps;
+
+in vec3 pos_screen;
+
+// noise.glsl animates warp_second() with it, the terrain is still
+uniform float time;
+
+// Camera::rays(), as frag_raymarch.glsl
+uniform vec3 camera_eye;
+uniform vec3 camera_right;
+uniform vec3 camera_up;
+uniform vec3 camera_forward;
+uniform float pixel_angle;
+
+// TerrainParams, and the levels of HeightPyramid in the mipmaps
+uniform sampler2D pyramid;
+uniform int pyramid_levels;
+uniform int pyramid_size;
+uniform float height;
+uniform float lod;
+uniform int max_steps;
+uniform float max_distance;
+
+// Light::direction() and its diffuse model
+uniform vec3 light;
+uniform float ambient;
+uniform float diffuse;
+
+#include "noise.glsl"
+
+#ifndef NOISE_HASH
+#error The height pyramid bounds value noise of the lattice hash
+#endif
+
+// noise() and its gradient
+vec3 noise_gradient(vec2 n) {
+    const vec2 d = vec2(0.0, 1.0);
+    vec2 b = floor(n), f = n - b, u = f*f*(3.f - 2.f*f), du = 6.f*f*(1.f - f);
+    vec2 b0 = lattice_wrap(b), b1 = lattice_wrap(b + d.yy);
+    float c00 = corner(b0, f);
+    float c10 = corner(vec2(b1.x, b0.y), f);
+    float c01 = corner(vec2(b0.x, b1.y), f);
+    float c11 = corner(b1, f);
+    float k = c00 - c10 - c01 + c11;
+    return vec3(mix(mix(c00, c10, u.x), mix(c01, c11, u.x), u.y), du*vec2(c10 - c00 + k*u.y, c01 - c00 + k*u.x));
+}
+
+// fbm() up to octaves, the last one weighted by the fraction of octaves.
+// Leaving octaves out only lowers the noise, the pyramid still bounds it.
+// The loop runs to a count known at run time only, the compilers unrolling
+// it to TERRAIN_OCTAVES evaluate every octave.
+float terrain_height(vec2 p, float octaves) {
+    float f = 1.f, a = 1.f, t = 0.f;
+    int count = int(ceil(octaves));
+    for(int i = 0; i < count; i++) {
+        t += min(octaves - float(i), 1.f)*a*noise(f*p);
+        f *= 2.f;
+        a *= 0.5f;
+    }
+    return height*t;
+}
+
+vec3 terrain_normal(vec2 p, float octaves) {
+    float f = 1.f, a = 1.f;
+    vec2 g = vec2(0.f);
+    int count = int(ceil(octaves));
+    for(int i = 0; i < count; i++) {
+        g += min(octaves - float(i), 1.f)*a*f*noise_gradient(f*p).yz;
+        f *= 2.f;
+        a *= 0.5f;
+    }
+    return normalize(vec3(-height*g, 1.f));
+}
+
+// Octaves whose lattice spans at least lod pixels at distance t
+float lod_octaves(float t) {
+    return clamp(1.f - log2(max(lod*pixel_angle*t, 1e-20f)), 1.f, float(TERRAIN_OCTAVES));
+}
+
+// The ray between t0 and t1 in 4 steps, the crossing refined by regula
+// falsi. The octaves are the ones at t0 all along.
+bool march_leaf(vec3 eye, vec3 dir, float t0, float t1, out float t, inout int n) {
+    float octaves = lod_octaves(t0);
+    float ta = t0;
+    float da = eye.z + ta*dir.z - terrain_height(eye.xy + ta*dir.xy, octaves);
+    n++;
+    t = ta;
+    if(da <= 0.f) {
+        return true;
+    }
+    for(int k = 1; k <= 4; k++) {
+        float tb = mix(t0, t1, 0.25f*float(k));
+        float db = eye.z + tb*dir.z - terrain_height(eye.xy + tb*dir.xy, octaves);
+        n++;
+        if(db <= 0.f) {
+            for(int r = 0; r < 3; r++) {
+                float tm = ta + (tb - ta)*da/(da - db);
+                float dm = eye.z + tm*dir.z - terrain_height(eye.xy + tm*dir.xy, octaves);
+                n++;
+                if(dm > 0.f) {
+                    ta = tm;
+                    da = dm;
+                } else {
+                    tb = tm;
+                    db = dm;
+                }
+            }
+            t = ta + (tb - ta)*da/(da - db);
+            return true;
+        }
+        ta = tb;
+        da = db;
+    }
+    return false;
+}
+
+// Walk down the pyramid from the eye, t is on the terrain when the ray hits
+bool march(vec3 eye, vec3 dir, float t_max, out float t, inout int n) {
+    const int base = TERRAIN_PYRAMID_OCTAVE;
+    int top = pyramid_levels - 1;
+    float z_max = height*texelFetch(pyramid, ivec2(0), top).r;
+    t = 0.f;
+    if(eye.z > z_max) {
+        if(dir.z >= 0.f) {
+            return false;
+        }
+        t = (z_max - eye.z)/dir.z;
+    }
+    vec2 inverse = 1.f/vec2(abs(dir.x) > 1e-8f ? dir.x : 1e-8f, abs(dir.y) > 1e-8f ? dir.y : 1e-8f);
+    vec2 ahead = step(0.f, dir.xy);
+    // The walk starts on texels of a lattice cell of the first octave, the
+    // coarser ones are seldom above the rays
+    int level = min(base, top);
+    for(int k = 0; k < max_steps && t < t_max; k++) {
+        vec2 p = eye.xy + t*dir.xy;
+        float size = exp2(float(level - base));
+        vec2 cell = floor(p/size);
+        vec2 exits = ((cell + ahead)*size - eye.xy)*inverse;
+        float t_exit = min(exits.x, exits.y);
+        int mask = (pyramid_size >> level) - 1;
+        float z_top = height*texelFetch(pyramid, ivec2(cell) & mask, level).r;
+
+        // Where the ray goes below the top of the texel
+        float z = eye.z + t*dir.z;
+        float t_in = z <= z_top ? t : (dir.z < 0.f ? (z_top - eye.z)/dir.z : 1e30f);
+        if(t_in < t_exit) {
+            if(level > 0 && size > lod*pixel_angle*t_in) {
+                level--;
+                t = t_in;
+                continue;
+            }
+            if(march_leaf(eye, dir, t_in, min(t_exit, t_max), t, n)) {
+                return true;
+            }
+        }
+        // Up a level once the ray leaves the parent texel, whose children
+        // it dips into are already known
+        vec2 parent = floor(0.5f*cell);
+        t = t_exit + 1e-3f*size;
+        if(level < top && floor((eye.xy + t*dir.xy)/(2.f*size)) != parent) {
+            level++;
+        }
+    }
+    return false;
+}
+
+vec3 sky(vec3 dir) {
+    return mix(vec3(0.62f, 0.7f, 0.8f), vec3(0.25f, 0.4f, 0.65f), clamp(dir.z*2.f, 0.f, 1.f));
+}
+
+// Grass on the flat low ground, rock on the slopes and snow on the tops
+vec3 albedo(vec3 p, vec3 normal) {
+    vec3 ground = mix(vec3(0.45f, 0.36f, 0.27f), vec3(0.3f, 0.42f, 0.18f), smoothstep(0.75f, 0.9f, normal.z));
+    return mix(ground, vec3(0.92f), smoothstep(1.2f, 1.3f, p.z/height - 0.3f*(1.f - normal.z)));
+}
+
+void main() {
+    vec3 dir = normalize(camera_forward + pos_screen.x*camera_right + pos_screen.y*camera_up);
+
+    int n = 0;
+    float t;
+    if(march(camera_eye, dir, max_distance, t, n)) {
+        depth = t;
+        vec3 p = camera_eye + t*dir;
+        float octaves = lod_octaves(t);
+        vec3 normal = terrain_normal(p.xy, octaves);
+        // The shadow ray walks the pyramid upward in a few steps. It sees
+        // the octaves left out at the hit, up to 2^(1 - octaves) high, and
+        // leaves from above them.
+        float t_shadow;
+        int shadow_steps = 0;
+        vec3 origin = p + (pixel_angle*t + height*exp2(1.f - octaves))*normal;
+        float lit = march(origin, light, max_distance, t_shadow, shadow_steps) ? 0.f : 1.f;
+        n += shadow_steps;
+        vec3 shaded = (ambient + diffuse*max(dot(normal, light), 0.f)*lit)*albedo(p, normal);
+        color = vec4(mix(sky(dir), shaded, exp(-0.05f*t)), 1.f);
+    } else {
+        depth = 1e30f;
+        color = vec4(sky(dir), 1.f);
+    }
+    steps = float(n);
+}
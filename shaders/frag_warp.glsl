@@ -0,0 +1,108 @@
+#version 330 core
+// Domain warping kernels of noise.glsl over the plane view: fbm(), unless
+// WARP_SECOND or WARP_THIRD is defined. The warps can also be drawn in two
+// passes, as render_warp_field() of cpu/noise.hpp does:
+//   WARP_FIELD    offset of the point by the inner fields of the kernel,
+//                 once per field_divisor x field_divisor pixels of the
+//                 target of size resolution, with a margin of two samples
+//   WARP_UPSAMPLE fbm() of the point moved by the field, upsampled along
+//                 Catmull-Rom splines
+// WARP_COMPOSE draws the time sliced animation of WarpPass instead: the
+// value at time, interpolated between the two keys of the pixel's tile.
+// WARP_BAKE draws texture pixels instead of the plane view, for TextureBaker:
+// the pixel (i, j) of the texture, j going up, is at the point
+// (i + 0.5, j + 0.5)*bake_texel, and the fragment (0, 0) at bake_origin.
+#ifdef WARP_FIELD
+layout (location = 0) out vec2 offset;
+#else
+layout (location = 0) out vec4 color;
+layout (location = 1) out float value;
+#endif
+
+in vec3 pos_screen;
+
+uniform float time;
+uniform float zoom;
+uniform float deplt_x;
+uniform float deplt_y;
+
+uniform vec2 resolution;
+uniform float field_divisor;
+uniform sampler2D field;
+
+// Values of the keys, and the times of both keys of every tile
+uniform sampler2D keys[2];
+uniform sampler2D key_times;
+uniform float tile_size;
+
+uniform vec2 bake_origin;
+uniform vec2 bake_texel;
+
+#include "noise.glsl"
+
+// Weights of the 4 samples around the position t in [0, 1) between the
+// second and the third one, catmull_rom() of cpu/noise.hpp
+vec4 catmull_rom(float t) {
+    float tt = t*t;
+    return vec4(t*(-0.5f + t*(1.f - 0.5f*t)), 1.f + tt*(-2.5f + 1.5f*t), t*(0.5f + t*(2.f - 1.5f*t)), tt*(-0.5f + 0.5f*t));
+}
+
+// The 2 middle samples of each axis blend in a single linearly filtered
+// fetch at the ratio of their weights, 9 fetches instead of 16
+vec2 upsampled_offset() {
+    float center = 0.5f*(field_divisor - 1.f);
+    vec2 f = (gl_FragCoord.xy - 0.5f - center)/field_divisor + 2.f;
+    vec2 b = floor(f);
+    vec4 wx = catmull_rom(f.x - b.x), wy = catmull_rom(f.y - b.y);
+    vec2 size = vec2(textureSize(field, 0));
+    vec3 ux = (b.x + vec3(-1.f, wx.z/(wx.y + wx.z), 2.f) + 0.5f)/size.x;
+    vec3 uy = (b.y + vec3(-1.f, wy.z/(wy.y + wy.z), 2.f) + 0.5f)/size.y;
+    vec3 vx = vec3(wx.x, wx.y + wx.z, wx.w), vy = vec3(wy.x, wy.y + wy.z, wy.w);
+    vec2 d = vec2(0.f);
+    for(int m = 0; m < 3; m++) {
+        vec2 row = vx.x*textureLod(field, vec2(ux.x, uy[m]), 0.f).rg + vx.y*textureLod(field, vec2(ux.y, uy[m]), 0.f).rg
+                 + vx.z*textureLod(field, vec2(ux.z, uy[m]), 0.f).rg;
+        d += vy[m]*row;
+    }
+    return d;
+}
+
+// The older key weighs in until time reaches the newer one. An empty key
+// is far in the past and never weighs in.
+float composed_value() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec2 t = texelFetch(key_times, ivec2(gl_FragCoord.xy/tile_size), 0).rg;
+    float w = t.x == t.y ? 0.f : clamp((time - t.x)/(t.y - t.x), 0.f, 1.f);
+    return mix(texelFetch(keys[0], pixel, 0).r, texelFetch(keys[1], pixel, 0).r, w);
+}
+
+void main() {
+#ifdef WARP_FIELD
+    vec2 u = (gl_FragCoord.xy - 2.5f)*field_divisor + 0.5f*(field_divisor - 1.f);
+    vec2 p = (2.f*(u + 0.5f)/resolution - 1.f)/zoom + vec2(deplt_x, deplt_y);
+#ifdef WARP_THIRD
+    offset = warp_third_offset(p);
+#else
+    offset = warp_second_offset(p);
+#endif
+#else
+#ifdef WARP_BAKE
+    vec2 p = (bake_origin + gl_FragCoord.xy)*bake_texel;
+#else
+    vec2 p = pos_screen.xy/zoom + vec2(deplt_x, deplt_y);
+#endif
+#if defined(WARP_COMPOSE)
+    value = composed_value();
+#elif defined(WARP_UPSAMPLE)
+    value = fbm(p + upsampled_offset(), 1.f);
+#elif defined(WARP_THIRD)
+    value = warp_third(p);
+#elif defined(WARP_SECOND)
+    value = warp_second(p);
+#else
+    value = fbm(p, 1.f);
+#endif
+    // fbm() stays below 2 for H = 1
+    color = vec4(vec3(clamp(0.5f*value, 0.f, 1.f)), 1.f);
+#endif
+}
@@ -0,0 +1,140 @@
+// Value noise, fbm and domain warping, included by the shaders drawing
+// them. cpu/noise.hpp is the CPU port. warp_second() reads the time
+// uniform of the including shader. The hash of the lattice points of
+// noise() is selected with a define:
+//   (none)          rand(), fraction of a sine: a single ulp of sin() moves
+//                   it by 1e-3, and GPUs round sin() differently
+//   NOISE_HASH      PCG integer hash of the lattice point, the same bits
+//                   on every GPU and in cpu/noise.hpp
+//   NOISE_GRADIENT  gradient noise, 8 gradients picked by the PCG hash,
+//                   moved to [0, 1]
+// NOISE_PERIOD p wraps the lattice around every p cells, a power of two,
+// for the noise to tile. NOISE_TEXTURE reads noise() from a tile baked on
+// the CPU (NoiseTile of cpu/noise.hpp) with the bilinear filter of the
+// sampler instead, 4 hashes and their blends become a single fetch.
+#ifdef NOISE_PERIOD
+vec2 lattice_wrap(vec2 b) {
+    return mod(b, float(NOISE_PERIOD));
+}
+#else
+vec2 lattice_wrap(vec2 b) {
+    return b;
+}
+#endif
+
+#ifdef NOISE_TEXTURE
+uniform sampler2D noise_texture;
+// Texels along a side of the tile, and along a side of a lattice cell
+uniform float noise_size;
+uniform float noise_texels_per_cell;
+
+// With a texel per lattice point, the sample point moves along the
+// smoothstep and the filter blends the 4 corners as mix() does
+float noise(vec2 n) {
+#ifdef NOISE_TEXTURE_LATTICE
+    vec2 b = floor(n), f = n - b;
+    return textureLod(noise_texture, (b + f*f*(3.f - 2.f*f) + 0.5f)/noise_size, 0.f).r;
+#else
+    return textureLod(noise_texture, (n*noise_texels_per_cell + 0.5f)/noise_size, 0.f).r;
+#endif
+}
+#elif defined(NOISE_HASH) || defined(NOISE_GRADIENT)
+// PCG hash (Jarzynski and Olano, Hash Functions for GPU Rendering, 2020)
+uint pcg(uint v) {
+    uint state = v*747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state)*277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Hash of an integer point, the coordinates wrap around 2^32
+uint lattice_hash(vec2 n) {
+    return pcg(uint(int(n.x)) + pcg(uint(int(n.y))));
+}
+
+// Lattice point b seen from the point at offset f: 24 bits of the hash in
+// [0, 1), or a gradient projected on f. The 3 top bits of the hash pick
+// (1, 0), (-1, 0), (0, 1), (0, -1), (1, 1), (-1, 1), (1, -1) or (-1, -1):
+// their products with f are exact, only the sum rounds.
+float corner(vec2 b, vec2 f) {
+    uint h = lattice_hash(b);
+#ifdef NOISE_GRADIENT
+    uint k = h >> 29u;
+    float sx = (k & 1u) != 0u ? -f.x : f.x;
+    float sy = (k & 2u) != 0u ? -f.y : f.y;
+    return k >= 4u ? sx + sy : ((k & 2u) != 0u ? ((k & 1u) != 0u ? -f.y : f.y) : sx);
+#else
+    return float(h >> 8u)*(1.f/16777216.f);
+#endif
+}
+
+// The smoothstep is spelled out as in lattice_noise() of cpu/noise.hpp,
+// the builtin rounds differently on some drivers. Drivers fusing the
+// products of mix() into its sums still move the result by an ulp.
+float noise(vec2 n) {
+    const vec2 d = vec2(0.0, 1.0);
+    vec2 b = floor(n), f = n - b, u = f*f*(3.f - 2.f*f);
+    vec2 b0 = lattice_wrap(b), b1 = lattice_wrap(b + d.yy);
+    float c00 = corner(b0, f);
+    float c10 = corner(vec2(b1.x, b0.y), f - d.yx);
+    float c01 = corner(vec2(b0.x, b1.y), f - d.xy);
+    float c11 = corner(b1, f - d.yy);
+    float v = mix(mix(c00, c10, u.x), mix(c01, c11, u.x), u.y);
+#ifdef NOISE_GRADIENT
+    return 0.5f + 0.5f*v;
+#else
+    return v;
+#endif
+}
+#else
+float rand(vec2 n) {
+	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
+}
+
+float noise(vec2 n) {
+	const vec2 d = vec2(0.0, 1.0);
+    vec2 b = floor(n), f = smoothstep(vec2(0.0), vec2(1.0), fract(n));
+    vec2 b0 = lattice_wrap(b), b1 = lattice_wrap(b + d.yy);
+	return mix(mix(rand(b0), rand(vec2(b1.x, b0.y)), f.x), mix(rand(vec2(b0.x, b1.y)), rand(b1), f.x), f.y);
+}
+#endif
+
+int numOctaves = 10;
+float fbm(in vec2 x, in float H)
+{
+    float G = exp2(-H);
+    float f = 1.0;
+    float a = 1.0;
+    float t = 0.0;
+    for(int i=0; i<numOctaves; i++) {
+        t += a*noise(f*x);
+        f *= 2.0;
+        a *= G;
+    }
+    return t;
+}
+
+// Offset of the point by the inner fields of warp_second()
+vec2 warp_second_offset(in vec2 x) {
+    vec2 q = vec2(fbm(x + vec2(0.0, 0.2)*time/2.f, 1.f),
+                  fbm(x + vec2(2.2, 0.3)*time/2.f, 1.f));
+    return 4.0f*q;
+}
+
+float warp_second(in vec2 x) {
+    return fbm(x + warp_second_offset(x), 1.f);
+}
+
+float warp_third(in vec2 x) {
+    vec2 q = vec2(fbm(x + vec2(5.0, 7.2), 1.f),
+                  fbm(x + vec2(-2.5, 5.3), 1.f));
+
+    return warp_second(x + 4.0f*q);
+}
+
+// Offset of the point by the inner fields of warp_third(), whose value is
+// fbm() of the point moved by it up to the rounding of the sum
+vec2 warp_third_offset(in vec2 x) {
+    vec2 q = 4.0f*vec2(fbm(x + vec2(5.0, 7.2), 1.f),
+                       fbm(x + vec2(-2.5, 5.3), 1.f));
+    return q + warp_second_offset(x + q);
+}
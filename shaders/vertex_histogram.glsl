@@ -0,0 +1,25 @@
+#version 330 core
+// One point per texel of the iteration texture, drawn with additive blending
+// into the bin of its iteration count. Consecutive texels go to different
+// rows (private copies of the histogram) to spread the blending on one bin.
+uniform sampler2D iteration;
+uniform int max_iter;
+uniform int bins;
+uniform int copies;
+
+void main() {
+    ivec2 size = textureSize(iteration, 0);
+    ivec2 texel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    float n = texelFetch(iteration, texel, 0).r;
+
+    // Points inside the set are clipped
+    if(n >= float(max_iter)) {
+        gl_Position = vec4(2.f, 2.f, 0.f, 1.f);
+        return;
+    }
+
+    int bin = min(int(n/float(max_iter)*float(bins)), bins - 1);
+    int row = gl_VertexID % copies;
+    gl_Position = vec4((float(bin) + 0.5f)/float(bins)*2.f - 1.f,
+                       (float(row) + 0.5f)/float(copies)*2.f - 1.f, 0.f, 1.f);
+}
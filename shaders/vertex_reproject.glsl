@@ -0,0 +1,41 @@
+#version 330 core
+// One point per texel of the depth of the previous frame, drawn with GL_MIN
+// blending in the pixel of the current camera its hit lands in, as
+// reproject_hits() of cpu/raymarch.hpp. Misses and hits behind the camera
+// are clipped.
+uniform sampler2D previous_depth;
+
+// Camera::rays() and jitter in pixels (y down) of the previous frame and
+// of the current one, and the size of the current target
+uniform vec3 previous_eye;
+uniform vec3 previous_right;
+uniform vec3 previous_up;
+uniform vec3 previous_forward;
+uniform vec2 previous_jitter;
+uniform vec3 camera_eye;
+uniform vec3 camera_right;
+uniform vec3 camera_up;
+uniform vec3 camera_forward;
+uniform vec2 jitter;
+uniform vec2 resolution;
+
+out float reprojected;
+
+void main() {
+    ivec2 size = textureSize(previous_depth, 0);
+    ivec2 texel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    float t = texelFetch(previous_depth, texel, 0).r;
+
+    // Rows from the bottom
+    vec2 uv = 2.f*(vec2(texel) + 0.5f + vec2(previous_jitter.x, -previous_jitter.y))/vec2(size) - 1.f;
+    vec3 d = previous_eye + t*normalize(previous_forward + uv.x*previous_right + uv.y*previous_up) - camera_eye;
+    // camera_forward is a unit vector, right and up are orthogonal to it
+    float z = dot(d, camera_forward);
+    if(t >= 1e30f || z <= 0.f) {
+        gl_Position = vec4(2.f, 2.f, 0.f, 1.f);
+        return;
+    }
+    vec2 q = vec2(dot(d, camera_right)/dot(camera_right, camera_right), dot(d, camera_up)/dot(camera_up, camera_up))/z;
+    gl_Position = vec4(q - 2.f*vec2(jitter.x, -jitter.y)/resolution, 0.f, 1.f);
+    reprojected = length(d);
+}
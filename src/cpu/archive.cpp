@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu/archive.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+
+const char ARCHIVE_MAGIC[4] = {'F', 'R', 'A', 'C'};
+const size_t HEADER_SIZE = 8 * sizeof(uint32_t);
+const size_t INDEX_ENTRY_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+// Rice codes longer than this are replaced by an escape and the raw value
+const unsigned int RICE_LIMIT = 24;
+const unsigned int RAW_BITS = 34;
+
+// log2(distance) is stored with this offset so that it stays positive
+const float DISTANCE_LOG_OFFSET = 128.f;
+const float DISTANCE_LOG_STEPS = 128.f;
+
+class BitWriter {
+    public:
+        BitWriter(vector<uint8_t>& out) : m_out(out), m_acc(0), m_count(0) {}
+
+        // n <= 32
+        void put(uint64_t value, unsigned int n) {
+            m_acc = (m_acc << n) | (value & ((uint64_t(1) << n) - 1));
+            m_count += n;
+            while(m_count >= 8) {
+                m_count -= 8;
+                m_out.push_back(uint8_t(m_acc >> m_count));
+            }
+        }
+
+        void flush() {
+            if(m_count > 0) {
+                m_out.push_back(uint8_t(m_acc << (8 - m_count)));
+                m_count = 0;
+            }
+        }
+
+    private:
+        vector<uint8_t>& m_out;
+        uint64_t m_acc;
+        unsigned int m_count;
+};
+
+class BitReader {
+    public:
+        BitReader(const uint8_t* begin, const uint8_t* end) : m_p(begin), m_end(end), m_acc(0), m_count(0) {}
+
+        // n <= 32
+        uint64_t get(unsigned int n) {
+            if(n == 0) {
+                return 0;
+            }
+            this->refill();
+            uint64_t value = m_acc >> (64 - n);
+            m_acc <<= n;
+            m_count -= n;
+            return value;
+        }
+
+        // Counts (and consumes) up to `limit` leading one bits
+        unsigned int ones(unsigned int limit) {
+            this->refill();
+            unsigned int n = (~m_acc == 0) ? 64 : __builtin_clzll(~m_acc);
+            n = std::min(n, limit);
+            m_acc <<= n;
+            m_count -= n;
+            return n;
+        }
+
+    private:
+        void refill() {
+            while(m_count <= 56) {
+                uint64_t byte = m_p < m_end ? *m_p++ : 0;
+                m_acc |= byte << (56 - m_count);
+                m_count += 8;
+            }
+        }
+
+        const uint8_t* m_p;
+        const uint8_t* m_end;
+        // Left aligned
+        uint64_t m_acc;
+        unsigned int m_count;
+};
+
+uint32_t predict(const uint32_t* values, unsigned int x, unsigned int y, unsigned int width) {
+    if(y == 0) {
+        return x == 0 ? 0 : values[x - 1];
+    }
+    const uint32_t* row = values + size_t(y) * width;
+    const uint32_t* up = row - width;
+    uint32_t b = up[x];
+    if(x == 0) {
+        return b;
+    }
+    uint32_t a = row[x - 1];
+    uint32_t c = up[x - 1];
+    // Median edge detector from LOCO-I
+    if(c >= std::max(a, b)) {
+        return std::min(a, b);
+    }
+    if(c <= std::min(a, b)) {
+        return std::max(a, b);
+    }
+    return a + b - c;
+}
+
+uint64_t zigzag(int64_t v) {
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+void encode_channel(const vector<uint32_t>& values, unsigned int width, unsigned int height, vector<uint8_t>& out) {
+    vector<uint64_t> residuals(values.size());
+    uint64_t sum = 0;
+    for(unsigned int y = 0; y < height; y++) {
+        for(unsigned int x = 0; x < width; x++) {
+            size_t i = size_t(y) * width + x;
+            residuals[i] = zigzag(int64_t(values[i]) - int64_t(predict(values.data(), x, y, width)));
+            sum += residuals[i];
+        }
+    }
+
+    // Pick the Rice parameter around log2 of the mean residual
+    uint64_t mean = residuals.empty() ? 0 : sum / residuals.size();
+    unsigned int guess = 0;
+    while(guess < 31 && (uint64_t(1) << (guess + 1)) <= mean) {
+        guess++;
+    }
+    unsigned int best_k = guess;
+    uint64_t best_cost = UINT64_MAX;
+    for(unsigned int k = (guess > 0 ? guess - 1 : 0); k <= std::min(guess + 1, 31u); k++) {
+        uint64_t cost = 0;
+        for(uint64_t r: residuals) {
+            uint64_t q = r >> k;
+            cost += q < RICE_LIMIT ? q + 1 + k : RICE_LIMIT + RAW_BITS;
+        }
+        if(cost < best_cost) {
+            best_cost = cost;
+            best_k = k;
+        }
+    }
+
+    out.push_back(uint8_t(best_k));
+    BitWriter writer(out);
+    for(uint64_t r: residuals) {
+        uint64_t q = r >> best_k;
+        if(q < RICE_LIMIT) {
+            writer.put(((uint64_t(1) << q) - 1) << 1, unsigned(q) + 1);
+            writer.put(r, best_k);
+        } else {
+            writer.put((uint64_t(1) << RICE_LIMIT) - 1, RICE_LIMIT);
+            writer.put(r >> 17, RAW_BITS - 17);
+            writer.put(r, 17);
+        }
+    }
+    writer.flush();
+}
+
+void decode_channel(const uint8_t* begin, const uint8_t* end, unsigned int width, unsigned int height, vector<uint32_t>& values) {
+    values.resize(size_t(width) * height);
+    if(begin >= end) {
+        return;
+    }
+    unsigned int k = *begin;
+    BitReader reader(begin + 1, end);
+    for(unsigned int y = 0; y < height; y++) {
+        for(unsigned int x = 0; x < width; x++) {
+            uint64_t r;
+            unsigned int q = reader.ones(RICE_LIMIT);
+            if(q < RICE_LIMIT) {
+                reader.get(1);
+                r = (uint64_t(q) << k) | reader.get(k);
+            } else {
+                r = reader.get(RAW_BITS - 17) << 17;
+                r |= reader.get(17);
+            }
+            size_t i = size_t(y) * width + x;
+            values[i] = uint32_t(int64_t(predict(values.data(), x, y, width)) + unzigzag(r));
+        }
+    }
+}
+
+void put_u32(vector<uint8_t>& out, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        out.push_back(uint8_t(v >> (8 * i)));
+    }
+}
+
+void put_u64(vector<uint8_t>& out, uint64_t v) {
+    for(int i = 0; i < 8; i++) {
+        out.push_back(uint8_t(v >> (8 * i)));
+    }
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    return uint64_t(get_u32(p)) | (uint64_t(get_u32(p + 4)) << 32);
+}
+
+}
+
+uint32_t quantize_iteration(float smooth, bool escaped, unsigned int max_iter) {
+    uint32_t interior = uint32_t(max_iter) << ARCHIVE_ITERATION_BITS;
+    if(!escaped) {
+        return interior;
+    }
+    float q = std::round(std::max(smooth, 0.f) * float(1 << ARCHIVE_ITERATION_BITS));
+    return std::min(uint32_t(q), interior - 1);
+}
+
+float dequantize_iteration(uint32_t q) {
+    return float(q) / float(1 << ARCHIVE_ITERATION_BITS);
+}
+
+uint32_t quantize_distance(float de) {
+    if(!(de > 0.f)) {
+        return 0;
+    }
+    float q = std::round((std::log2(de) + DISTANCE_LOG_OFFSET) * DISTANCE_LOG_STEPS);
+    return uint32_t(std::min(std::max(q, 1.f), 65535.f));
+}
+
+float dequantize_distance(uint32_t q) {
+    if(q == 0) {
+        return 0.f;
+    }
+    return std::exp2(float(q) / DISTANCE_LOG_STEPS - DISTANCE_LOG_OFFSET);
+}
+
+IterationArchive::IterationArchive() :
+    m_data(nullptr), m_size(0),
+    m_width(0), m_height(0), m_max_iter(0),
+    m_tile_size(0), m_tiles_x(0), m_tiles_y(0) {
+}
+
+IterationArchive::~IterationArchive() {
+    this->close();
+}
+
+bool IterationArchive::write(const string& filename, const IterationBuffer& buffer, unsigned int tile_size) {
+    tile_size = std::max(tile_size, 1u);
+    unsigned int tiles_x = (buffer.width + tile_size - 1) / tile_size;
+    unsigned int tiles_y = (buffer.height + tile_size - 1) / tile_size;
+
+    vector<vector<uint8_t>> payloads(size_t(tiles_x) * tiles_y);
+    parallel_for(payloads.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+        vector<uint32_t> iteration, distance;
+        for(size_t t = begin; t < end; t++) {
+            unsigned int x0 = unsigned(t % tiles_x) * tile_size;
+            unsigned int y0 = unsigned(t / tiles_x) * tile_size;
+            unsigned int w = std::min(tile_size, buffer.width - x0);
+            unsigned int h = std::min(tile_size, buffer.height - y0);
+
+            iteration.resize(size_t(w) * h);
+            distance.resize(size_t(w) * h);
+            for(unsigned int y = 0; y < h; y++) {
+                for(unsigned int x = 0; x < w; x++) {
+                    size_t src = size_t(y0 + y) * buffer.width + x0 + x;
+                    size_t dst = size_t(y) * w + x;
+                    iteration[dst] = quantize_iteration(buffer.smooth[src], buffer.escaped[src], buffer.max_iter);
+                    distance[dst] = quantize_distance(buffer.de[src]);
+                }
+            }
+
+            vector<uint8_t>& payload = payloads[t];
+            vector<uint8_t> channel;
+            encode_channel(iteration, w, h, channel);
+            put_u32(payload, uint32_t(channel.size()));
+            payload.insert(payload.end(), channel.begin(), channel.end());
+            channel.clear();
+            encode_channel(distance, w, h, channel);
+            payload.insert(payload.end(), channel.begin(), channel.end());
+        }
+    });
+
+    vector<uint8_t> header;
+    header.insert(header.end(), ARCHIVE_MAGIC, ARCHIVE_MAGIC + 4);
+    put_u32(header, ARCHIVE_VERSION);
+    put_u32(header, buffer.width);
+    put_u32(header, buffer.height);
+    put_u32(header, tile_size);
+    put_u32(header, buffer.max_iter);
+    put_u32(header, tiles_x);
+    put_u32(header, tiles_y);
+
+    uint64_t offset = header.size() + payloads.size() * INDEX_ENTRY_SIZE;
+    for(const auto& payload: payloads) {
+        put_u64(header, offset);
+        put_u32(header, uint32_t(payload.size()));
+        offset += payload.size();
+    }
+
+    ofstream file(filename, ios::binary);
+    if(!file.is_open()) {
+        std::cout << "ERROR::ARCHIVE::CANNOT_OPEN " << filename << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    for(const auto& payload: payloads) {
+        file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    }
+    return file.good();
+}
+
+bool IterationArchive::open(const string& filename) {
+    this->close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cout << "ERROR::ARCHIVE::CANNOT_OPEN " << filename << std::endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+        std::cout << "ERROR::ARCHIVE::TRUNCATED " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        std::cout << "ERROR::ARCHIVE::CANNOT_MAP " << filename << std::endl;
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = st.st_size;
+
+    if(memcmp(m_data, ARCHIVE_MAGIC, 4) != 0 || get_u32(m_data + 4) != ARCHIVE_VERSION) {
+        std::cout << "ERROR::ARCHIVE::BAD_HEADER " << filename << std::endl;
+        this->close();
+        return false;
+    }
+    m_width = get_u32(m_data + 8);
+    m_height = get_u32(m_data + 12);
+    m_tile_size = get_u32(m_data + 16);
+    m_max_iter = get_u32(m_data + 20);
+    m_tiles_x = get_u32(m_data + 24);
+    m_tiles_y = get_u32(m_data + 28);
+
+    // The tile grid must cover the image exactly, read_tile() relies on it
+    if(m_tile_size == 0 || m_tiles_x != (uint64_t(m_width) + m_tile_size - 1) / m_tile_size ||
+       m_tiles_y != (uint64_t(m_height) + m_tile_size - 1) / m_tile_size) {
+        std::cout << "ERROR::ARCHIVE::BAD_HEADER " << filename << std::endl;
+        this->close();
+        return false;
+    }
+    // Colorings divide by max_iter - 1, and max_iter << 8 marks the interior
+    if(m_max_iter < 2 || m_max_iter >= (1u << (32 - ARCHIVE_ITERATION_BITS))) {
+        std::cout << "ERROR::ARCHIVE::BAD_HEADER " << filename << std::endl;
+        this->close();
+        return false;
+    }
+
+    // Compared by division, the header can claim 2^64 tiles
+    size_t n_tiles = size_t(m_tiles_x) * m_tiles_y;
+    if(n_tiles > (m_size - HEADER_SIZE) / INDEX_ENTRY_SIZE) {
+        std::cout << "ERROR::ARCHIVE::TRUNCATED " << filename << std::endl;
+        this->close();
+        return false;
+    }
+    m_index.resize(n_tiles);
+    for(size_t t = 0; t < n_tiles; t++) {
+        const uint8_t* entry = m_data + HEADER_SIZE + t * INDEX_ENTRY_SIZE;
+        m_index[t].offset = get_u64(entry);
+        m_index[t].size = get_u32(entry + 8);
+        if(m_index[t].offset > m_size || m_index[t].size > m_size - m_index[t].offset) {
+            std::cout << "ERROR::ARCHIVE::TRUNCATED " << filename << std::endl;
+            this->close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void IterationArchive::close() {
+    if(m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_index.clear();
+}
+
+unsigned int IterationArchive::width() const {
+    return m_width;
+}
+
+unsigned int IterationArchive::height() const {
+    return m_height;
+}
+
+unsigned int IterationArchive::max_iter() const {
+    return m_max_iter;
+}
+
+unsigned int IterationArchive::tile_size() const {
+    return m_tile_size;
+}
+
+unsigned int IterationArchive::tiles_x() const {
+    return m_tiles_x;
+}
+
+unsigned int IterationArchive::tiles_y() const {
+    return m_tiles_y;
+}
+
+bool IterationArchive::read_tile(unsigned int tx, unsigned int ty, ArchiveTile& tile) const {
+    if(!m_data || tx >= m_tiles_x || ty >= m_tiles_y) {
+        return false;
+    }
+    const TileEntry& entry = m_index[size_t(ty) * m_tiles_x + tx];
+    const uint8_t* payload = m_data + entry.offset;
+    const uint8_t* end = payload + entry.size;
+    if(entry.size < 4) {
+        return false;
+    }
+    uint32_t iteration_size = get_u32(payload);
+    if(iteration_size > entry.size - 4) {
+        return false;
+    }
+    const uint8_t* distance = payload + 4 + iteration_size;
+
+    tile.x = tx * m_tile_size;
+    tile.y = ty * m_tile_size;
+    tile.width = std::min(m_tile_size, m_width - tile.x);
+    tile.height = std::min(m_tile_size, m_height - tile.y);
+    decode_channel(payload + 4, distance, tile.width, tile.height, tile.iteration);
+    decode_channel(distance, end, tile.width, tile.height, tile.distance);
+    return true;
+}
+
+bool IterationArchive::read(IterationBuffer& out) const {
+    out.resize(m_width, m_height);
+    out.max_iter = m_max_iter;
+    const uint32_t interior = uint32_t(m_max_iter) << ARCHIVE_ITERATION_BITS;
+
+    atomic<bool> ok(true);
+    parallel_for(m_index.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+        ArchiveTile tile;
+        for(size_t t = begin; t < end; t++) {
+            if(!this->read_tile(unsigned(t % m_tiles_x), unsigned(t / m_tiles_x), tile)) {
+                ok = false;
+                continue;
+            }
+            for(unsigned int y = 0; y < tile.height; y++) {
+                for(unsigned int x = 0; x < tile.width; x++) {
+                    size_t src = size_t(y) * tile.width + x;
+                    size_t dst = size_t(tile.y + y) * m_width + tile.x + x;
+                    out.smooth[dst] = dequantize_iteration(tile.iteration[src]);
+                    out.de[dst] = dequantize_distance(tile.distance[src]);
+                    out.escaped[dst] = tile.iteration[src] < interior;
+                }
+            }
+        }
+    });
+    return ok.load();
+}
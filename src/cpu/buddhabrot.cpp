@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "cpu/buddhabrot.hpp"
+#include "cpu/formula.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+    // in_mandelbrot_set() without the derivative, for the escape test only
+    typedef FormulaEngine<Multibrot<2>, float, 0> EscapeTest;
+
+    // Escaping orbit of one c and the pixels it crosses
+    struct Orbit {
+        float re_c = 0.f;
+        float im_c = 0.f;
+        // Bit k set when the orbit is plotted in channel k
+        unsigned int channels = 0;
+        vector<uint32_t> pixels;
+    };
+
+    class Sampler {
+        public:
+            Sampler(const View& view, const BuddhabrotParams& params, uint64_t seed, float* density) :
+                m_view(view), m_params(params), m_random(seed), m_uniform(0.f, 1.f), m_density(density) {
+                m_escape.max_iter = *std::max_element(params.max_iter, params.max_iter + 3);
+                m_left = float(view.center_x - 1.0 / view.zoom);
+                m_top = float(view.center_y + 1.0 / view.zoom);
+                m_scale_x = float(view.zoom * view.width / 2.0);
+                m_scale_y = float(view.zoom * view.height / 2.0);
+            }
+
+            // Plain Buddhabrot, every sample counts the same
+            void uniform(size_t samples, BuddhabrotStats& stats) {
+                Orbit orbits[SIMD_LANES];
+                for(size_t s = 0; s < samples; s += SIMD_LANES) {
+                    unsigned int count = unsigned(std::min<size_t>(SIMD_LANES, samples - s));
+                    for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                        random_c(orbits[k].re_c, orbits[k].im_c);
+                    }
+                    evaluate(orbits, count, stats);
+                    for(unsigned int k = 0; k < count; k++) {
+                        splat(orbits[k], 1.f);
+                    }
+                }
+            }
+
+            // SIMD_LANES Metropolis-Hastings chains proposing together
+            void metropolis(size_t samples, BuddhabrotStats& stats) {
+                Orbit current[SIMD_LANES], proposed[SIMD_LANES];
+
+                // Starting points: uniform samples until every chain has one
+                // whose orbit crosses the view
+                unsigned int started = 0;
+                size_t s = 0;
+                while(started < SIMD_LANES && s < samples) {
+                    for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                        random_c(proposed[k].re_c, proposed[k].im_c);
+                    }
+                    evaluate(proposed, SIMD_LANES, stats);
+                    s += SIMD_LANES;
+                    for(unsigned int k = 0; k < SIMD_LANES && started < SIMD_LANES; k++) {
+                        if(!proposed[k].pixels.empty()) {
+                            std::swap(current[started++], proposed[k]);
+                        }
+                    }
+                }
+                if(started < SIMD_LANES) {
+                    return;
+                }
+
+                // Small steps scale with the view, from 10% of its half size
+                // down to 1e-4 of it
+                const float extent = float(1.0 / m_view.zoom);
+                const float log_range = std::log(1000.f);
+                for(; s < samples; s += SIMD_LANES) {
+                    for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                        if(m_uniform(m_random) < m_params.large_step) {
+                            random_c(proposed[k].re_c, proposed[k].im_c);
+                        } else {
+                            float r = 0.1f * extent * std::exp(-log_range * m_uniform(m_random));
+                            float angle = 2.f * float(M_PI) * m_uniform(m_random);
+                            proposed[k].re_c = current[k].re_c + r * std::cos(angle);
+                            proposed[k].im_c = current[k].im_c + r * std::sin(angle);
+                        }
+                    }
+                    evaluate(proposed, SIMD_LANES, stats);
+
+                    // Both kinds of proposals are symmetric, the acceptance is
+                    // the ratio of the importances
+                    for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                        float ratio = float(proposed[k].pixels.size()) / float(current[k].pixels.size());
+                        if(ratio >= 1.f || m_uniform(m_random) < ratio) {
+                            std::swap(current[k], proposed[k]);
+                            stats.accepted++;
+                        }
+                        // The chain visits c in proportion to its importance,
+                        // weighting by the inverse keeps the density unbiased
+                        splat(current[k], 1.f / float(current[k].pixels.size()));
+                    }
+                }
+            }
+
+        private:
+            void random_c(float& re_c, float& im_c) {
+                re_c = 4.f * m_uniform(m_random) - 2.f;
+                im_c = 4.f * m_uniform(m_random) - 2.f;
+            }
+
+            // Escape test of the first count orbits together, then the pixels
+            // of those that escaped. Orbits that are not plotted end up
+            // without pixels.
+            void evaluate(Orbit* orbits, unsigned int count, BuddhabrotStats& stats) {
+                vfloat re_c, im_c;
+                for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                    bool skip = k >= count || in_main_components(orbits[k].re_c, orbits[k].im_c);
+                    if(skip && k < count) {
+                        stats.skipped++;
+                    }
+                    // Skipped lanes escape at once
+                    re_c[k] = skip ? 4.f : orbits[k].re_c;
+                    im_c[k] = skip ? 4.f : orbits[k].im_c;
+                    orbits[k].pixels.clear();
+                    orbits[k].channels = 0;
+                }
+                stats.samples += count;
+
+                const vfloat zero = vbroadcast(0.f);
+                EscapeTest::Lanes result = EscapeTest::iterate(zero, zero, re_c, im_c, m_escape);
+                for(unsigned int k = 0; k < count; k++) {
+                    if(result.inside[k] || re_c[k] == 4.f) {
+                        continue;
+                    }
+                    unsigned int n = unsigned(result.n[k]) + 1;
+                    if(n < m_params.min_iter) {
+                        continue;
+                    }
+                    for(unsigned int channel = 0; channel < 3; channel++) {
+                        if(n <= m_params.max_iter[channel]) {
+                            orbits[k].channels |= 1u << channel;
+                        }
+                    }
+                    trace(orbits[k], n);
+                    if(!orbits[k].pixels.empty()) {
+                        stats.contributing++;
+                    }
+                }
+            }
+
+            // Replays the n iterations of the orbit and keeps the pixels inside the view
+            void trace(Orbit& orbit, unsigned int n) {
+                float re_z = 0.f, im_z = 0.f;
+                for(unsigned int i = 0; i < n; i++) {
+                    float re_z_next = re_z * re_z - im_z * im_z + orbit.re_c;
+                    im_z = 2.f * re_z * im_z + orbit.im_c;
+                    re_z = re_z_next;
+
+                    float x = (re_z - m_left) * m_scale_x;
+                    float y = (m_top - im_z) * m_scale_y;
+                    if(x >= 0.f && y >= 0.f && x < float(m_view.width) && y < float(m_view.height)) {
+                        orbit.pixels.push_back(uint32_t(y) * m_view.width + uint32_t(x));
+                    }
+                }
+            }
+
+            void splat(const Orbit& orbit, float weight) {
+                for(uint32_t pixel : orbit.pixels) {
+                    float* rgb = m_density + 3 * size_t(pixel);
+                    for(unsigned int channel = 0; channel < 3; channel++) {
+                        if(orbit.channels & (1u << channel)) {
+                            rgb[channel] += weight;
+                        }
+                    }
+                }
+            }
+
+        private:
+            const View& m_view;
+            const BuddhabrotParams& m_params;
+            EscapeParams m_escape;
+
+            mt19937_64 m_random;
+            uniform_real_distribution<float> m_uniform;
+            float* m_density;
+
+            float m_left;
+            float m_top;
+            float m_scale_x;
+            float m_scale_y;
+    };
+}
+
+bool in_main_components(float re_c, float im_c) {
+    // Main cardioid
+    float x = re_c - 0.25f;
+    float q = x * x + im_c * im_c;
+    if(q * (q + x) <= 0.25f * im_c * im_c) {
+        return true;
+    }
+    // Period 2 bulb, the disk of radius 1/4 around -1
+    float y = re_c + 1.f;
+    return y * y + im_c * im_c <= 0.0625f;
+}
+
+BuddhabrotStats render_buddhabrot(const View& view, const BuddhabrotParams& params, BuddhabrotBuffer& out) {
+    auto start = chrono::steady_clock::now();
+    out.resize(view.width, view.height);
+
+    // Several tasks per thread for the load balance, each one with its own
+    // random sequence (and its own chains)
+    const size_t n_tasks = size_t(worker_count()) * 4;
+    vector<vector<float>> buffers(worker_count());
+    vector<BuddhabrotStats> task_stats(n_tasks);
+
+    auto sample = [&](BuddhabrotSampling sampling, size_t total, uint64_t first_seed) {
+        parallel_for(n_tasks, 1, [&](size_t begin, size_t end, unsigned int thread) {
+            if(buffers[thread].empty()) {
+                buffers[thread].assign(out.density.size(), 0.f);
+            }
+            for(size_t task = begin; task < end; task++) {
+                size_t samples = total / n_tasks + (task < total % n_tasks ? 1 : 0);
+                Sampler sampler(view, params, first_seed + task, buffers[thread].data());
+                if(sampling == BUDDHABROT_METROPOLIS) {
+                    sampler.metropolis(samples, task_stats[task]);
+                } else {
+                    sampler.uniform(samples, task_stats[task]);
+                }
+            }
+        });
+    };
+
+    const uint64_t seed = params.seed * 0x9E3779B97F4A7C15ull;
+    BuddhabrotSampling sampling = params.sampling;
+    size_t remaining = params.samples;
+    if(sampling == BUDDHABROT_AUTOMATIC) {
+        // The pilot orbits are kept when uniform sampling goes on, the
+        // Metropolis chains weight theirs differently and start over
+        size_t pilot = std::min(params.samples, BUDDHABROT_PILOT_SAMPLES);
+        sample(BUDDHABROT_UNIFORM, pilot, seed + n_tasks);
+        size_t contributing = 0;
+        for(const BuddhabrotStats& s : task_stats) {
+            contributing += s.contributing;
+        }
+        if(contributing < BUDDHABROT_METROPOLIS_BELOW * pilot) {
+            sampling = BUDDHABROT_METROPOLIS;
+            task_stats.assign(n_tasks, BuddhabrotStats());
+            for(vector<float>& buffer : buffers) {
+                std::fill(buffer.begin(), buffer.end(), 0.f);
+            }
+        } else {
+            sampling = BUDDHABROT_UNIFORM;
+            remaining -= pilot;
+        }
+    }
+    sample(sampling, remaining, seed);
+
+    // Sum of the per-thread buffers, by blocks of pixels
+    parallel_for(out.density.size(), 1 << 16, [&](size_t begin, size_t end, unsigned int) {
+        for(const vector<float>& buffer : buffers) {
+            if(buffer.empty()) {
+                continue;
+            }
+            for(size_t i = begin; i < end; i++) {
+                out.density[i] += buffer[i];
+            }
+        }
+    });
+
+    BuddhabrotStats stats;
+    for(const BuddhabrotStats& s : task_stats) {
+        stats.samples += s.samples;
+        stats.skipped += s.skipped;
+        stats.contributing += s.contributing;
+        stats.accepted += s.accepted;
+    }
+    stats.sampling = sampling;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void tonemap(const BuddhabrotBuffer& buffer, Image& image) {
+    image.resize(buffer.width, buffer.height);
+    size_t n = size_t(buffer.width) * buffer.height;
+    if(n == 0) {
+        return;
+    }
+
+    for(unsigned int channel = 0; channel < 3; channel++) {
+        // The brightest 0.1% saturate, a few pixels collect far more orbit
+        // points than the rest and would leave the image black
+        vector<float> values(n);
+        for(size_t i = 0; i < n; i++) {
+            values[i] = buffer.density[3 * i + channel];
+        }
+        size_t rank = std::min(n - 1, size_t(0.999 * n));
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        float white = values[rank] > 0.f ? values[rank] : 1.f;
+
+        for(size_t i = 0; i < n; i++) {
+            float v = std::min(buffer.density[3 * i + channel] / white, 1.f);
+            image.rgb[3 * i + channel] = uint8_t(255.f * std::sqrt(v) + 0.5f);
+        }
+    }
+}
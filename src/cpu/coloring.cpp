@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <atomic>
+
+#include "cpu/coloring.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+namespace {
+
+void store_rgb(uint8_t* dst, uint32_t rgba) {
+    dst[0] = uint8_t(rgba);
+    dst[1] = uint8_t(rgba >> 8);
+    dst[2] = uint8_t(rgba >> 16);
+}
+
+vint lut_index(vfloat n, const ColorMapping& mapping, const IterationHistogram* histogram, unsigned int lut_size) {
+    vfloat t = mapping.offset + (histogram ? histogram->equalize(n) : mapping.density * n);
+    t = mapping.cyclic ? t - vfloor(t) : vclamp(t, 0.f, 1.f);
+    return to_int(t * float(lut_size - 1) + 0.5f);
+}
+
+}
+
+void color_span(const float* iteration, const uint8_t* escaped, size_t count,
+                const vector<uint32_t>& lut, uint32_t interior, const ColorMapping& mapping,
+                const IterationHistogram* histogram, uint8_t* rgb) {
+    if(!mapping.equalize) {
+        histogram = nullptr;
+    }
+    const int32_t* table = reinterpret_cast<const int32_t*>(lut.data());
+    const vint interior_v = vbroadcast(int32_t(interior));
+
+    size_t i = 0;
+    for(; i + SIMD_LANES <= count; i += SIMD_LANES) {
+        vint inside;
+        for(unsigned int k = 0; k < SIMD_LANES; k++) {
+            inside[k] = escaped[i + k] ? 0 : -1;
+        }
+        vint rgba = select(inside, interior_v, gather(table, lut_index(vload(iteration + i), mapping, histogram, lut.size())));
+        for(unsigned int k = 0; k < SIMD_LANES; k++) {
+            store_rgb(rgb + 3 * (i + k), uint32_t(rgba[k]));
+        }
+    }
+    for(; i < count; i++) {
+        vint idx = lut_index(vbroadcast(iteration[i]), mapping, histogram, lut.size());
+        store_rgb(rgb + 3 * i, escaped[i] ? lut[idx[0]] : interior);
+    }
+}
+
+void colorize(const IterationBuffer& buffer, const Palette& palette, const ColorMapping& mapping, Image& out) {
+    out.resize(buffer.width, buffer.height);
+    const vector<uint32_t> lut = palette.lut(PALETTE_LUT_SIZE);
+    const uint32_t interior = palette.interior_rgba();
+
+    IterationHistogram histogram;
+    if(mapping.equalize) {
+        histogram.build(buffer);
+    }
+
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        size_t first = begin * buffer.width;
+        color_span(&buffer.smooth[first], &buffer.escaped[first], (end - begin) * buffer.width,
+                   lut, interior, mapping, &histogram, &out.rgb[3 * first]);
+    });
+}
+
+bool recolor_archive(const IterationArchive& archive, const Palette& palette, const ColorMapping& mapping, Image& out) {
+    if(mapping.equalize) {
+        IterationBuffer buffer;
+        if(!archive.read(buffer)) {
+            return false;
+        }
+        colorize(buffer, palette, mapping, out);
+        return true;
+    }
+
+    out.resize(archive.width(), archive.height());
+    const vector<uint32_t> lut = palette.lut(PALETTE_LUT_SIZE);
+    const uint32_t interior_rgba = palette.interior_rgba();
+    const uint32_t interior = uint32_t(archive.max_iter()) << ARCHIVE_ITERATION_BITS;
+
+    atomic<bool> ok(true);
+    size_t n_tiles = size_t(archive.tiles_x()) * archive.tiles_y();
+    parallel_for(n_tiles, 1, [&](size_t begin, size_t end, unsigned int) {
+        ArchiveTile tile;
+        vector<float> iteration;
+        vector<uint8_t> escaped;
+        for(size_t t = begin; t < end; t++) {
+            if(!archive.read_tile(unsigned(t % archive.tiles_x()), unsigned(t / archive.tiles_x()), tile)) {
+                ok = false;
+                continue;
+            }
+            iteration.resize(tile.width);
+            escaped.resize(tile.width);
+            for(unsigned int y = 0; y < tile.height; y++) {
+                const uint32_t* src = &tile.iteration[size_t(y) * tile.width];
+                for(unsigned int x = 0; x < tile.width; x++) {
+                    iteration[x] = dequantize_iteration(src[x]);
+                    escaped[x] = src[x] < interior;
+                }
+                uint8_t* dst = &out.rgb[3 * (size_t(tile.y + y) * out.width + tile.x)];
+                color_span(iteration.data(), escaped.data(), tile.width, lut, interior_rgba, mapping, nullptr, dst);
+            }
+        }
+    });
+    return ok.load();
+}
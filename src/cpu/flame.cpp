@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "cpu/flame.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+namespace {
+    // Transforms as arrays of coefficients, gathered by the index of the
+    // transform each lane goes through
+    struct TransformTable {
+        // Cumulative probabilities of all the transforms but the last one
+        vector<float> thresholds;
+        vector<float> a, b, c, d, e, f;
+        vector<float> color;
+        vector<float> variations[VARIATION_COUNT];
+        // Bit v set when a transform uses variation v
+        unsigned int used = 0;
+
+        explicit TransformTable(const Flame& flame) {
+            float total = 0.f;
+            for(const FlameTransform& t : flame.transforms) {
+                total += t.weight;
+            }
+            float sum = 0.f;
+            for(size_t i = 0; i < flame.transforms.size(); i++) {
+                const FlameTransform& t = flame.transforms[i];
+                sum += t.weight;
+                if(i + 1 < flame.transforms.size()) {
+                    thresholds.push_back(sum / total);
+                }
+                a.push_back(t.a);
+                b.push_back(t.b);
+                c.push_back(t.c);
+                d.push_back(t.d);
+                e.push_back(t.e);
+                f.push_back(t.f);
+                color.push_back(t.color);
+                for(unsigned int v = 0; v < VARIATION_COUNT; v++) {
+                    variations[v].push_back(t.variations[v]);
+                    if(t.variations[v] != 0.f) {
+                        used |= 1u << v;
+                    }
+                }
+            }
+        }
+    };
+
+    // xorshift32 in every lane, the lanes are seeded differently
+    inline vfloat random_uniform(vuint& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return __builtin_convertvector(state >> 8, vfloat) * (1.f / 16777216.f);
+    }
+
+    // New point of every lane through the transform of index t
+    inline void apply(const TransformTable& table, vint t, vfloat& x, vfloat& y, vfloat& color) {
+        vfloat tx = gather(table.a.data(), t) * x + gather(table.b.data(), t) * y + gather(table.c.data(), t);
+        vfloat ty = gather(table.d.data(), t) * x + gather(table.e.data(), t) * y + gather(table.f.data(), t);
+        color = 0.5f * (color + gather(table.color.data(), t));
+
+        // Only the variations used by some transform are evaluated, each
+        // lane weights them by its own transform
+        const unsigned int used = table.used;
+        const unsigned int radial = (1u << VARIATION_SPHERICAL) | (1u << VARIATION_SWIRL) |
+                                    (1u << VARIATION_HORSESHOE) | (1u << VARIATION_POLAR) |
+                                    (1u << VARIATION_HEART) | (1u << VARIATION_DISC) |
+                                    (1u << VARIATION_SPIRAL) | (1u << VARIATION_HYPERBOLIC);
+        const unsigned int angular = (1u << VARIATION_POLAR) | (1u << VARIATION_HEART) |
+                                     (1u << VARIATION_DISC) | (1u << VARIATION_SPIRAL) |
+                                     (1u << VARIATION_HYPERBOLIC);
+        vfloat r2 = tx * tx + ty * ty;
+        vfloat r = (used & radial) ? vsqrt(r2) : r2;
+        // Kept away from 0 for the variations dividing by r
+        vfloat r_safe = vmax(r, vbroadcast(1e-6f));
+        vfloat theta = (used & angular) ? fast_atan2(tx, ty) : r2;
+
+        vfloat nx = vbroadcast(0.f), ny = vbroadcast(0.f);
+        auto add = [&](unsigned int v, vfloat vx, vfloat vy) {
+            vfloat w = gather(table.variations[v].data(), t);
+            nx += w * vx;
+            ny += w * vy;
+        };
+        if(used & (1u << VARIATION_LINEAR)) {
+            add(VARIATION_LINEAR, tx, ty);
+        }
+        vfloat s, k;
+        if(used & (1u << VARIATION_SINUSOIDAL)) {
+            vfloat sy;
+            fast_sincos(tx, s, k);
+            fast_sincos(ty, sy, k);
+            add(VARIATION_SINUSOIDAL, s, sy);
+        }
+        if(used & (1u << VARIATION_SPHERICAL)) {
+            vfloat inv = 1.f / (r_safe * r_safe);
+            add(VARIATION_SPHERICAL, tx * inv, ty * inv);
+        }
+        if(used & (1u << VARIATION_SWIRL)) {
+            fast_sincos(r2, s, k);
+            add(VARIATION_SWIRL, tx * s - ty * k, tx * k + ty * s);
+        }
+        if(used & (1u << VARIATION_HORSESHOE)) {
+            vfloat inv = 1.f / r_safe;
+            add(VARIATION_HORSESHOE, (tx - ty) * (tx + ty) * inv, 2.f * tx * ty * inv);
+        }
+        if(used & (1u << VARIATION_POLAR)) {
+            add(VARIATION_POLAR, theta * float(M_1_PI), r - 1.f);
+        }
+        if(used & (1u << VARIATION_HEART)) {
+            fast_sincos(theta * r, s, k);
+            add(VARIATION_HEART, r * s, -r * k);
+        }
+        if(used & (1u << VARIATION_DISC)) {
+            fast_sincos(float(M_PI) * r, s, k);
+            vfloat t_pi = theta * float(M_1_PI);
+            add(VARIATION_DISC, t_pi * s, t_pi * k);
+        }
+        if(used & (1u << VARIATION_SPIRAL)) {
+            vfloat inv = 1.f / r_safe;
+            vfloat s_r, k_r;
+            fast_sincos(theta, s, k);
+            fast_sincos(r, s_r, k_r);
+            add(VARIATION_SPIRAL, inv * (k + s_r), inv * (s - k_r));
+        }
+        if(used & (1u << VARIATION_HYPERBOLIC)) {
+            fast_sincos(theta, s, k);
+            add(VARIATION_HYPERBOLIC, s / r_safe, r * k);
+        }
+        x = nx;
+        y = ny;
+    }
+
+    // SIMD_LANES walkers playing the chaos game for points / SIMD_LANES
+    // plotted iterations
+    void walk(const TransformTable& table, const View& view, size_t points, unsigned int skip, uint64_t seed,
+              float* density, float* colors, FlameStats& stats) {
+        vuint state;
+        for(unsigned int k = 0; k < SIMD_LANES; k++) {
+            // splitmix64 of the seed, xorshift32 must not start at 0
+            uint64_t z = seed * SIMD_LANES + k + 0x9E3779B97F4A7C15ull;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            state[k] = uint32_t(z ^ (z >> 31)) | 1u;
+        }
+
+        vfloat x = 2.f * random_uniform(state) - 1.f;
+        vfloat y = 2.f * random_uniform(state) - 1.f;
+        vfloat color = random_uniform(state);
+
+        const float left = float(view.center_x - 1.0 / view.zoom);
+        const float top = float(view.center_y + 1.0 / view.zoom);
+        const float scale_x = float(view.zoom * view.width / 2.0);
+        const float scale_y = float(view.zoom * view.height / 2.0);
+        const vfloat width = vbroadcast(float(view.width));
+        const vfloat height = vbroadcast(float(view.height));
+        const vint stride = vbroadcast(int32_t(view.width));
+
+        const size_t iterations = (points + SIMD_LANES - 1) / SIMD_LANES + skip;
+        const size_t n_thresholds = table.thresholds.size();
+        for(size_t n = 0; n < iterations; n++) {
+            // Index of the transform: the number of thresholds below r
+            vfloat r = random_uniform(state);
+            vint t = vbroadcast(int32_t(0));
+            for(size_t i = 0; i < n_thresholds; i++) {
+                t -= (r >= table.thresholds[i]);
+            }
+            apply(table, t, x, y, color);
+
+            // Walkers sent to infinity or NaN start again at random
+            vint lost = (vabs(x) >= 1e10f) | (vabs(y) >= 1e10f) | (x != x) | (y != y);
+            if(any(lost)) {
+                x = select(lost, 2.f * random_uniform(state) - 1.f, x);
+                y = select(lost, 2.f * random_uniform(state) - 1.f, y);
+            }
+            if(n < skip) {
+                continue;
+            }
+
+            vfloat px = (x - left) * scale_x;
+            vfloat py = (top - y) * scale_y;
+            vint inside = (px >= 0.f) & (py >= 0.f) & (px < width) & (py < height) & !lost;
+            vint pixel = to_int(py) * stride + to_int(px);
+            for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                if(inside[k]) {
+                    density[pixel[k]] += 1.f;
+                    colors[pixel[k]] += color[k];
+                    stats.plotted++;
+                }
+            }
+        }
+        stats.points += (iterations - skip) * SIMD_LANES;
+    }
+}
+
+bool flame_preset(const string& name, Flame& flame) {
+    flame = Flame();
+    if(name == "sierpinski") {
+        // Halfway to one of the corners of a triangle
+        const float corners[3][2] = {{0.f, 1.f}, {-0.866f, -0.5f}, {0.866f, -0.5f}};
+        for(unsigned int i = 0; i < 3; i++) {
+            FlameTransform t;
+            t.a = t.e = 0.5f;
+            t.c = 0.5f * corners[i][0];
+            t.f = 0.5f * corners[i][1];
+            t.color = 0.5f * i;
+            flame.transforms.push_back(t);
+        }
+    } else if(name == "fern") {
+        // Barnsley fern, spans [-2.2, 2.7] x [0, 10]
+        const float coefficients[4][7] = {
+            // weight, a, b, c, d, e, f
+            {0.01f, 0.f, 0.f, 0.f, 0.f, 0.16f, 0.f},
+            {0.85f, 0.85f, 0.04f, 0.f, -0.04f, 0.85f, 1.6f},
+            {0.07f, 0.2f, -0.26f, 0.f, 0.23f, 0.22f, 1.6f},
+            {0.07f, -0.15f, 0.28f, 0.f, 0.26f, 0.24f, 0.44f}
+        };
+        for(unsigned int i = 0; i < 4; i++) {
+            FlameTransform t;
+            t.weight = coefficients[i][0];
+            t.a = coefficients[i][1];
+            t.b = coefficients[i][2];
+            t.c = coefficients[i][3];
+            t.d = coefficients[i][4];
+            t.e = coefficients[i][5];
+            t.f = coefficients[i][6];
+            t.color = i / 3.f;
+            flame.transforms.push_back(t);
+        }
+        flame.center_x = 0.25;
+        flame.center_y = 5.0;
+        flame.zoom = 0.19;
+    } else if(name == "swirl") {
+        FlameTransform spiral;
+        spiral.a = 0.74f; spiral.b = -0.42f; spiral.c = 0.18f;
+        spiral.d = 0.42f; spiral.e = 0.74f; spiral.f = -0.1f;
+        spiral.variations[VARIATION_LINEAR] = 0.6f;
+        spiral.variations[VARIATION_SWIRL] = 0.4f;
+        spiral.weight = 0.6f;
+        spiral.color = 0.f;
+        flame.transforms.push_back(spiral);
+
+        FlameTransform sphere;
+        sphere.a = 0.55f; sphere.b = 0.2f; sphere.c = -0.4f;
+        sphere.d = -0.25f; sphere.e = 0.5f; sphere.f = 0.35f;
+        sphere.variations[VARIATION_LINEAR] = 0.f;
+        sphere.variations[VARIATION_SPHERICAL] = 0.5f;
+        sphere.variations[VARIATION_HORSESHOE] = 0.5f;
+        sphere.weight = 0.25f;
+        sphere.color = 0.6f;
+        flame.transforms.push_back(sphere);
+
+        FlameTransform disc;
+        disc.a = 0.4f; disc.b = 0.f; disc.c = 0.3f;
+        disc.d = 0.f; disc.e = 0.4f; disc.f = 0.4f;
+        disc.variations[VARIATION_LINEAR] = 0.f;
+        disc.variations[VARIATION_DISC] = 0.8f;
+        disc.weight = 0.15f;
+        disc.color = 1.f;
+        flame.transforms.push_back(disc);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+FlameStats render_flame(const Flame& flame, const View& view, const FlameParams& params, FlameBuffer& out) {
+    auto start = chrono::steady_clock::now();
+    out.resize(view.width, view.height);
+    FlameStats stats;
+    if(flame.transforms.empty()) {
+        return stats;
+    }
+    const TransformTable table(flame);
+
+    // Each task has its own walkers, several tasks per thread balance the load
+    const size_t n_tasks = size_t(worker_count()) * 4;
+    const size_t n_pixels = size_t(view.width) * view.height;
+    vector<vector<float>> buffers(worker_count());
+    vector<FlameStats> task_stats(n_tasks);
+
+    parallel_for(n_tasks, 1, [&](size_t begin, size_t end, unsigned int thread) {
+        // Density then colors
+        if(buffers[thread].empty()) {
+            buffers[thread].assign(2 * n_pixels, 0.f);
+        }
+        float* density = buffers[thread].data();
+        for(size_t task = begin; task < end; task++) {
+            size_t points = params.points / n_tasks + (task < params.points % n_tasks ? 1 : 0);
+            walk(table, view, points, params.skip, params.seed * n_tasks + task,
+                 density, density + n_pixels, task_stats[task]);
+        }
+    });
+
+    parallel_for(n_pixels, 1 << 16, [&](size_t begin, size_t end, unsigned int) {
+        for(const vector<float>& buffer : buffers) {
+            if(buffer.empty()) {
+                continue;
+            }
+            for(size_t i = begin; i < end; i++) {
+                out.density[i] += buffer[i];
+                out.color[i] += buffer[n_pixels + i];
+            }
+        }
+    });
+
+    for(const FlameStats& s : task_stats) {
+        stats.points += s.points;
+        stats.plotted += s.plotted;
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void tonemap(const FlameBuffer& buffer, const Palette& palette, float gamma, Image& image) {
+    image.resize(buffer.width, buffer.height);
+
+    // The densest 0.1% of the pixels hit saturate, like the Buddhabrot
+    vector<float> hit;
+    for(float d : buffer.density) {
+        if(d > 0.f) {
+            hit.push_back(d);
+        }
+    }
+    if(hit.empty()) {
+        return;
+    }
+    size_t rank = std::min(hit.size() - 1, size_t(0.999 * hit.size()));
+    std::nth_element(hit.begin(), hit.begin() + rank, hit.end());
+
+    const float inv_log_white = 1.f / std::log1p(hit[rank]);
+    parallel_for(buffer.density.size(), 1 << 14, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t i = begin; i < end; i++) {
+            float d = buffer.density[i];
+            if(d == 0.f) {
+                continue;
+            }
+            float alpha = std::pow(std::min(std::log1p(d) * inv_log_white, 1.f), 1.f / gamma);
+            float rgb[3];
+            palette.sample(buffer.color[i] / d, rgb);
+            for(unsigned int c = 0; c < 3; c++) {
+                image.rgb[3 * i + c] = uint8_t(std::min(255.f * alpha * rgb[c] + 0.5f, 255.f));
+            }
+        }
+    });
+}
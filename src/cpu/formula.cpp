@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include "cpu/formula.hpp"
+#include "cpu/hybrid.hpp"
+
+bool render_formula(const string& formula, bool double_precision, const View& view, const EscapeParams& params, IterationBuffer& out) {
+    vector<FormulaId> sequence;
+    if(!parse_formula_sequence(formula, sequence)) {
+        return false;
+    }
+    if(std::count(sequence.begin(), sequence.end(), sequence[0]) != ptrdiff_t(sequence.size())) {
+        render_hybrid(sequence, double_precision, view, params, out);
+        return true;
+    }
+
+    switch(sequence[0]) {
+        case FORMULA_MANDELBROT:
+            render_engine<Multibrot<2>>(double_precision, view, params, out);
+            break;
+        case FORMULA_MULTIBROT3:
+            render_engine<Multibrot<3>>(double_precision, view, params, out);
+            break;
+        case FORMULA_MULTIBROT4:
+            render_engine<Multibrot<4>>(double_precision, view, params, out);
+            break;
+        case FORMULA_MULTIBROT5:
+            render_engine<Multibrot<5>>(double_precision, view, params, out);
+            break;
+        case FORMULA_BURNING_SHIP:
+            render_engine<BurningShip>(double_precision, view, params, out);
+            break;
+        default:
+            render_engine<Tricorn>(double_precision, view, params, out);
+            break;
+    }
+    return true;
+}
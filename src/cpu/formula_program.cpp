@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "cpu/formula_program.hpp"
+#include "cpu/glsl.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+    // Value and derivative of one register for FORMULA_BLOCKS * SIMD_LANES pixels
+    struct Register {
+        vfloat re[FORMULA_BLOCKS];
+        vfloat im[FORMULA_BLOCKS];
+        vfloat d_re[FORMULA_BLOCKS];
+        vfloat d_im[FORMULA_BLOCKS];
+    };
+
+    const char* OPCODE_NAMES[] = {"add", "sub", "mul", "div", "neg", "sqr", "conj", "fold", "re", "im", "exp"};
+
+    bool is_unary(uint8_t op) {
+        return op >= OP_NEG;
+    }
+
+    // One pass over the bytecode. Registers are assigned once, so the
+    // destination never aliases an operand.
+    void execute(const vector<FormulaInstruction>& code, Register* regs) {
+        for(const FormulaInstruction& ins : code) {
+            Register& d = regs[ins.dst];
+            const Register& a = regs[ins.a];
+            const Register& b = regs[ins.b];
+            switch(ins.op) {
+                case OP_ADD:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k] + b.re[k];
+                        d.im[k] = a.im[k] + b.im[k];
+                        d.d_re[k] = a.d_re[k] + b.d_re[k];
+                        d.d_im[k] = a.d_im[k] + b.d_im[k];
+                    }
+                    break;
+                case OP_SUB:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k] - b.re[k];
+                        d.im[k] = a.im[k] - b.im[k];
+                        d.d_re[k] = a.d_re[k] - b.d_re[k];
+                        d.d_im[k] = a.d_im[k] - b.d_im[k];
+                    }
+                    break;
+                case OP_MUL:
+                    // (ab)' = a b' + a' b
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k] * b.re[k] - a.im[k] * b.im[k];
+                        d.im[k] = a.re[k] * b.im[k] + a.im[k] * b.re[k];
+                        d.d_re[k] = a.re[k] * b.d_re[k] - a.im[k] * b.d_im[k] + a.d_re[k] * b.re[k] - a.d_im[k] * b.im[k];
+                        d.d_im[k] = a.re[k] * b.d_im[k] + a.im[k] * b.d_re[k] + a.d_re[k] * b.im[k] + a.d_im[k] * b.re[k];
+                    }
+                    break;
+                case OP_DIV:
+                    // q = a / b, q' = (a' - q b') / b
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        vfloat inv = 1.f / (b.re[k] * b.re[k] + b.im[k] * b.im[k]);
+                        vfloat q_re = (a.re[k] * b.re[k] + a.im[k] * b.im[k]) * inv;
+                        vfloat q_im = (a.im[k] * b.re[k] - a.re[k] * b.im[k]) * inv;
+                        vfloat t_re = a.d_re[k] - (q_re * b.d_re[k] - q_im * b.d_im[k]);
+                        vfloat t_im = a.d_im[k] - (q_re * b.d_im[k] + q_im * b.d_re[k]);
+                        d.d_re[k] = (t_re * b.re[k] + t_im * b.im[k]) * inv;
+                        d.d_im[k] = (t_im * b.re[k] - t_re * b.im[k]) * inv;
+                        d.re[k] = q_re;
+                        d.im[k] = q_im;
+                    }
+                    break;
+                case OP_NEG:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = -a.re[k];
+                        d.im[k] = -a.im[k];
+                        d.d_re[k] = -a.d_re[k];
+                        d.d_im[k] = -a.d_im[k];
+                    }
+                    break;
+                case OP_SQR:
+                    // (a^2)' = 2 a a'
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k] * a.re[k] - a.im[k] * a.im[k];
+                        d.im[k] = 2.f * a.re[k] * a.im[k];
+                        d.d_re[k] = 2.f * (a.re[k] * a.d_re[k] - a.im[k] * a.d_im[k]);
+                        d.d_im[k] = 2.f * (a.re[k] * a.d_im[k] + a.im[k] * a.d_re[k]);
+                    }
+                    break;
+                case OP_CONJ:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k];
+                        d.im[k] = -a.im[k];
+                        d.d_re[k] = a.d_re[k];
+                        d.d_im[k] = -a.d_im[k];
+                    }
+                    break;
+                case OP_FOLD:
+                    // Same derivative as the BurningShip formula
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.d_re[k] = a.re[k] < 0.f ? -a.d_re[k] : a.d_re[k];
+                        d.d_im[k] = a.im[k] < 0.f ? -a.d_im[k] : a.d_im[k];
+                        d.re[k] = vabs(a.re[k]);
+                        d.im[k] = vabs(a.im[k]);
+                    }
+                    break;
+                case OP_RE:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.re[k];
+                        d.im[k] = vbroadcast(0.f);
+                        d.d_re[k] = a.d_re[k];
+                        d.d_im[k] = vbroadcast(0.f);
+                    }
+                    break;
+                case OP_IM:
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        d.re[k] = a.im[k];
+                        d.im[k] = vbroadcast(0.f);
+                        d.d_re[k] = a.d_im[k];
+                        d.d_im[k] = vbroadcast(0.f);
+                    }
+                    break;
+                case OP_EXP:
+                    // exp(a)' = exp(a) a'
+                    for(unsigned int k = 0; k < FORMULA_BLOCKS; k++) {
+                        vfloat e = vexp(a.re[k]);
+                        vfloat e_re = e * vcos(a.im[k]);
+                        vfloat e_im = e * vsin(a.im[k]);
+                        d.d_re[k] = e_re * a.d_re[k] - e_im * a.d_im[k];
+                        d.d_im[k] = e_re * a.d_im[k] + e_im * a.d_re[k];
+                        d.re[k] = e_re;
+                        d.im[k] = e_im;
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+FormulaProgram::FormulaProgram() : m_position(0), m_result(FORMULA_REGISTER_Z), m_degree(2) {
+}
+
+bool FormulaProgram::compile(const string& source) {
+    m_source = source;
+    m_position = 0;
+    m_code.clear();
+    m_constants.clear();
+    // z and c
+    m_degrees.assign(2, 0);
+    m_degrees[FORMULA_REGISTER_Z] = 1;
+
+    int reg;
+    if(!parse_expression(reg)) {
+        return false;
+    }
+    skip_spaces();
+    if(m_position < m_source.size()) {
+        return fail("unexpected character");
+    }
+
+    m_result = unsigned(reg);
+    m_degree = std::max(m_degrees[reg], 2u);
+    return true;
+}
+
+const string& FormulaProgram::source() const {
+    return m_source;
+}
+
+const vector<FormulaInstruction>& FormulaProgram::code() const {
+    return m_code;
+}
+
+unsigned int FormulaProgram::registers() const {
+    return unsigned(m_degrees.size());
+}
+
+unsigned int FormulaProgram::degree() const {
+    return m_degree;
+}
+
+void FormulaProgram::skip_spaces() {
+    while(m_position < m_source.size() && isspace((unsigned char)m_source[m_position])) {
+        m_position++;
+    }
+}
+
+bool FormulaProgram::fail(const string& message) {
+    std::cout << "ERROR::FORMULA::PARSE at column " << m_position + 1 << ": " << message << std::endl;
+    std::cout << m_source << std::endl << string(m_position, ' ') << "^" << std::endl;
+    return false;
+}
+
+bool FormulaProgram::emit(FormulaOpcode op, int a, int b, int& reg) {
+    if(m_degrees.size() >= FORMULA_MAX_REGISTERS) {
+        return fail("formula too long");
+    }
+    reg = int(m_degrees.size());
+    m_code.push_back({uint8_t(op), uint8_t(reg), uint8_t(a), uint8_t(b)});
+
+    unsigned int da = m_degrees[a], db = m_degrees[b];
+    unsigned int degree = da;
+    if(op == OP_ADD || op == OP_SUB) {
+        degree = std::max(da, db);
+    } else if(op == OP_MUL) {
+        degree = da + db;
+    } else if(op == OP_DIV) {
+        degree = da > db ? da - db : 0;
+    } else if(op == OP_SQR) {
+        degree = 2 * da;
+    }
+    m_degrees.push_back(degree);
+    return true;
+}
+
+bool FormulaProgram::constant(float re, float im, int& reg) {
+    if(m_degrees.size() >= FORMULA_MAX_REGISTERS) {
+        return fail("formula too long");
+    }
+    reg = int(m_degrees.size());
+    m_constants.push_back({uint8_t(reg), re, im});
+    m_degrees.push_back(0);
+    return true;
+}
+
+bool FormulaProgram::parse_expression(int& reg) {
+    if(!parse_term(reg)) {
+        return false;
+    }
+    skip_spaces();
+    while(m_position < m_source.size() && (m_source[m_position] == '+' || m_source[m_position] == '-')) {
+        FormulaOpcode op = m_source[m_position] == '+' ? OP_ADD : OP_SUB;
+        m_position++;
+        int rhs;
+        if(!parse_term(rhs) || !emit(op, reg, rhs, reg)) {
+            return false;
+        }
+        skip_spaces();
+    }
+    return true;
+}
+
+bool FormulaProgram::parse_term(int& reg) {
+    if(!parse_unary(reg)) {
+        return false;
+    }
+    skip_spaces();
+    while(m_position < m_source.size() && (m_source[m_position] == '*' || m_source[m_position] == '/')) {
+        FormulaOpcode op = m_source[m_position] == '*' ? OP_MUL : OP_DIV;
+        m_position++;
+        int rhs;
+        if(!parse_unary(rhs) || !emit(op, reg, rhs, reg)) {
+            return false;
+        }
+        skip_spaces();
+    }
+    return true;
+}
+
+bool FormulaProgram::parse_unary(int& reg) {
+    skip_spaces();
+    if(m_position < m_source.size() && m_source[m_position] == '-') {
+        m_position++;
+        int operand;
+        if(!parse_unary(operand)) {
+            return false;
+        }
+        // A literal that was just parsed is negated in place
+        if(!m_constants.empty() && m_constants.back().reg == operand && operand + 1 == int(m_degrees.size())) {
+            m_constants.back().re = -m_constants.back().re;
+            m_constants.back().im = -m_constants.back().im;
+            reg = operand;
+            return true;
+        }
+        return emit(OP_NEG, operand, 0, reg);
+    }
+    return parse_power(reg);
+}
+
+bool FormulaProgram::parse_power(int& reg) {
+    if(!parse_primary(reg)) {
+        return false;
+    }
+    skip_spaces();
+    if(m_position >= m_source.size() || m_source[m_position] != '^') {
+        return true;
+    }
+    m_position++;
+    skip_spaces();
+
+    const char* begin = m_source.c_str() + m_position;
+    char* end;
+    long n = strtol(begin, &end, 10);
+    if(end == begin || n < 1 || n > 64) {
+        return fail("expected an integer power between 1 and 64");
+    }
+    m_position += end - begin;
+
+    // Square and multiply, from the highest bit down
+    int base = reg;
+    int bit = 6;
+    while(!(n & (1l << bit))) {
+        bit--;
+    }
+    for(bit--; bit >= 0; bit--) {
+        if(!emit(OP_SQR, reg, 0, reg)) {
+            return false;
+        }
+        if((n & (1l << bit)) && !emit(OP_MUL, reg, base, reg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FormulaProgram::parse_primary(int& reg) {
+    skip_spaces();
+    if(m_position >= m_source.size()) {
+        return fail("unexpected end of formula");
+    }
+
+    char ch = m_source[m_position];
+    if(isdigit((unsigned char)ch) || ch == '.') {
+        const char* begin = m_source.c_str() + m_position;
+        char* end;
+        double value = strtod(begin, &end);
+        m_position += end - begin;
+        return constant(float(value), 0.f, reg);
+    }
+
+    if(ch == '(') {
+        m_position++;
+        if(!parse_expression(reg)) {
+            return false;
+        }
+        skip_spaces();
+        if(m_position >= m_source.size() || m_source[m_position] != ')') {
+            return fail("expected ')'");
+        }
+        m_position++;
+        return true;
+    }
+
+    if(!isalpha((unsigned char)ch)) {
+        return fail("unexpected character");
+    }
+    size_t begin = m_position;
+    while(m_position < m_source.size() && isalpha((unsigned char)m_source[m_position])) {
+        m_position++;
+    }
+    string name = m_source.substr(begin, m_position - begin);
+    if(name == "z") {
+        reg = FORMULA_REGISTER_Z;
+        return true;
+    }
+    if(name == "c") {
+        reg = FORMULA_REGISTER_C;
+        return true;
+    }
+    if(name == "i") {
+        return constant(0.f, 1.f, reg);
+    }
+
+    FormulaOpcode op;
+    if(name == "conj") op = OP_CONJ;
+    else if(name == "fold") op = OP_FOLD;
+    else if(name == "sqr") op = OP_SQR;
+    else if(name == "re") op = OP_RE;
+    else if(name == "im") op = OP_IM;
+    else if(name == "exp") op = OP_EXP;
+    else {
+        m_position = begin;
+        return fail("unknown name '" + name + "'");
+    }
+
+    skip_spaces();
+    if(m_position >= m_source.size() || m_source[m_position] != '(') {
+        return fail("expected '(' after " + name);
+    }
+    int argument;
+    if(!parse_primary(argument)) {
+        return false;
+    }
+    return emit(op, argument, 0, reg);
+}
+
+string FormulaProgram::disassemble() const {
+    ostringstream out;
+    out << "r0 = z" << std::endl << "r1 = c" << std::endl;
+    for(const FormulaConstant& k : m_constants) {
+        out << "r" << int(k.reg) << " = " << k.re << (k.im < 0.f ? " - " : " + ") << std::fabs(k.im) << "i" << std::endl;
+    }
+    for(const FormulaInstruction& ins : m_code) {
+        out << "r" << int(ins.dst) << " = " << OPCODE_NAMES[ins.op] << " r" << int(ins.a);
+        if(!is_unary(ins.op)) {
+            out << ", r" << int(ins.b);
+        }
+        out << std::endl;
+    }
+    out << "z = r" << m_result << std::endl;
+    return out.str();
+}
+
+vector<string> FormulaProgram::glsl_defines() const {
+    // The whole step is one statement block on a single line, as a define
+    // holds one line. z, dz, c and dc are the variables of escape_time().
+    ostringstream out;
+    out << "CUSTOM_FORMULA { ";
+    out << "vec2 f_v0 = z; vec2 f_d0 = dz; vec2 f_v1 = c; vec2 f_d1 = vec2(dc, 0.f); ";
+    for(const FormulaConstant& k : m_constants) {
+        out << "vec2 f_v" << int(k.reg) << " = vec2(" << glsl_float(k.re) << ", " << glsl_float(k.im) << "); ";
+        out << "vec2 f_d" << int(k.reg) << " = vec2(0.f); ";
+    }
+    for(const FormulaInstruction& ins : m_code) {
+        string v = "f_v" + to_string(ins.dst), d = "f_d" + to_string(ins.dst);
+        string va = "f_v" + to_string(ins.a), da = "f_d" + to_string(ins.a);
+        string vb = "f_v" + to_string(ins.b), db = "f_d" + to_string(ins.b);
+        switch(ins.op) {
+            case OP_ADD:
+                out << "vec2 " << v << " = " << va << " + " << vb << "; vec2 " << d << " = " << da << " + " << db << "; ";
+                break;
+            case OP_SUB:
+                out << "vec2 " << v << " = " << va << " - " << vb << "; vec2 " << d << " = " << da << " - " << db << "; ";
+                break;
+            case OP_MUL:
+                out << "vec2 " << v << " = complex_mul(" << va << ", " << vb << "); ";
+                out << "vec2 " << d << " = complex_mul(" << va << ", " << db << ") + complex_mul(" << da << ", " << vb << "); ";
+                break;
+            case OP_DIV:
+                out << "vec2 " << v << " = complex_div(" << va << ", " << vb << "); ";
+                out << "vec2 " << d << " = complex_div(" << da << " - complex_mul(" << v << ", " << db << "), " << vb << "); ";
+                break;
+            case OP_NEG:
+                out << "vec2 " << v << " = -" << va << "; vec2 " << d << " = -" << da << "; ";
+                break;
+            case OP_SQR:
+                out << "vec2 " << v << " = complex_mul(" << va << ", " << va << "); ";
+                out << "vec2 " << d << " = 2.f*complex_mul(" << va << ", " << da << "); ";
+                break;
+            case OP_CONJ:
+                out << "vec2 " << v << " = vec2(" << va << ".x, -" << va << ".y); ";
+                out << "vec2 " << d << " = vec2(" << da << ".x, -" << da << ".y); ";
+                break;
+            case OP_FOLD:
+                out << "vec2 " << v << " = abs(" << va << "); ";
+                out << "vec2 " << d << " = vec2(" << va << ".x < 0.f ? -" << da << ".x : " << da << ".x, "
+                    << va << ".y < 0.f ? -" << da << ".y : " << da << ".y); ";
+                break;
+            case OP_RE:
+                out << "vec2 " << v << " = vec2(" << va << ".x, 0.f); vec2 " << d << " = vec2(" << da << ".x, 0.f); ";
+                break;
+            case OP_IM:
+                out << "vec2 " << v << " = vec2(" << va << ".y, 0.f); vec2 " << d << " = vec2(" << da << ".y, 0.f); ";
+                break;
+            case OP_EXP:
+                out << "vec2 " << v << " = complex_exp(" << va << "); ";
+                out << "vec2 " << d << " = complex_mul(" << v << ", " << da << "); ";
+                break;
+        }
+    }
+    out << "z = f_v" << m_result << "; dz = f_d" << m_result << "; }";
+
+    return vector<string>({out.str(), "DEGREE " + to_string(m_degree)});
+}
+
+void FormulaProgram::render(const View& view, const EscapeParams& params, IterationBuffer& out) const {
+    out.resize(view.width, view.height);
+    out.max_iter = params.max_iter;
+
+    const unsigned int group = FORMULA_BLOCKS * SIMD_LANES;
+    const vfloat lanes = vlane_index();
+    const float bailout2 = params.bailout * params.bailout;
+    const float re_left = float(view.center_x - 1.0 / view.zoom);
+    const float re_step = float(2.0 / (view.zoom * view.width));
+
+    parallel_for(view.height, 4, [&](size_t begin, size_t end, unsigned int) {
+        vector<Register> regs(m_degrees.size());
+        for(const FormulaConstant& k : m_constants) {
+            for(unsigned int b = 0; b < FORMULA_BLOCKS; b++) {
+                regs[k.reg].re[b] = vbroadcast(k.re);
+                regs[k.reg].im[b] = vbroadcast(k.im);
+                regs[k.reg].d_re[b] = vbroadcast(0.f);
+                regs[k.reg].d_im[b] = vbroadcast(0.f);
+            }
+        }
+        Register& z = regs[FORMULA_REGISTER_Z];
+        Register& c = regs[FORMULA_REGISTER_C];
+        const Register& result = regs[m_result];
+
+        for(size_t j = begin; j < end; j++) {
+            for(unsigned int i = 0; i < view.width; i += group) {
+                // State of the orbits when they escaped
+                vint active[FORMULA_BLOCKS];
+                Register escaped;
+                vfloat n_escaped[FORMULA_BLOCKS];
+                for(unsigned int b = 0; b < FORMULA_BLOCKS; b++) {
+                    c.re[b] = vbroadcast(re_left) + (vbroadcast(float(i + b * SIMD_LANES)) + lanes + 0.5f) * re_step;
+                    c.im[b] = vbroadcast(float(view.im(j)));
+                    c.d_re[b] = vbroadcast(1.f);
+                    c.d_im[b] = vbroadcast(0.f);
+                    z.re[b] = z.im[b] = z.d_re[b] = z.d_im[b] = vbroadcast(0.f);
+
+                    active[b] = vbroadcast(-1);
+                    escaped.re[b] = escaped.im[b] = escaped.d_re[b] = escaped.d_im[b] = vbroadcast(0.f);
+                    n_escaped[b] = vbroadcast(float(params.max_iter));
+                }
+
+                for(unsigned int n = 0; n < params.max_iter; n++) {
+                    execute(m_code, regs.data());
+
+                    bool running = false;
+                    for(unsigned int b = 0; b < FORMULA_BLOCKS; b++) {
+                        z.re[b] = select(active[b], result.re[b], z.re[b]);
+                        z.im[b] = select(active[b], result.im[b], z.im[b]);
+                        z.d_re[b] = select(active[b], result.d_re[b], z.d_re[b]);
+                        z.d_im[b] = select(active[b], result.d_im[b], z.d_im[b]);
+
+                        vint escaping = active[b] & (z.re[b] * z.re[b] + z.im[b] * z.im[b] > bailout2);
+                        if(any(escaping)) {
+                            n_escaped[b] = select(escaping, vbroadcast(float(n)), n_escaped[b]);
+                            escaped.re[b] = select(escaping, z.re[b], escaped.re[b]);
+                            escaped.im[b] = select(escaping, z.im[b], escaped.im[b]);
+                            escaped.d_re[b] = select(escaping, z.d_re[b], escaped.d_re[b]);
+                            escaped.d_im[b] = select(escaping, z.d_im[b], escaped.d_im[b]);
+                            active[b] &= ~escaping;
+                        }
+                        running = running || any(active[b]);
+                    }
+                    if(!running) {
+                        break;
+                    }
+                }
+
+                for(unsigned int b = 0; b < FORMULA_BLOCKS; b++) {
+                    for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                        unsigned int x = i + b * SIMD_LANES + k;
+                        if(x >= view.width) {
+                            break;
+                        }
+                        store_orbit<float>(escaped.re[b][k], escaped.im[b][k], escaped.d_re[b][k], escaped.d_im[b][k],
+                            n_escaped[b][k], active[b][k] != 0, m_degree, true, params, out, j * view.width + x);
+                    }
+                }
+            }
+        }
+    });
+}
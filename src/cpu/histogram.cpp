@@ -0,0 +1,99 @@
+#include <algorithm>
+
+#include "cpu/histogram.hpp"
+#include "cpu/parallel.hpp"
+
+IterationHistogram::IterationHistogram(unsigned int bins) :
+    m_bins(std::max(bins, 1u)), m_scale(0.f),
+    m_counts(m_bins, 0), m_cdf(m_bins + 1, 0.f) {
+}
+
+void IterationHistogram::build(const IterationBuffer& buffer) {
+    m_scale = float(m_bins) / float(std::max(buffer.max_iter, 1u));
+
+    // Privatized histograms, no atomics in the counting loop
+    unsigned int n_threads = worker_count();
+    vector<vector<uint64_t>> local(n_threads, vector<uint64_t>(m_bins, 0));
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int thread) {
+        vector<uint64_t>& counts = local[thread];
+        for(size_t i = begin * buffer.width; i < end * buffer.width; i++) {
+            if(buffer.escaped[i]) {
+                unsigned int bin = unsigned(buffer.smooth[i] * m_scale);
+                counts[std::min(bin, m_bins - 1)]++;
+            }
+        }
+    });
+
+    // Tree merge: at each level, histogram i absorbs histogram i + stride
+    for(size_t stride = 1; stride < n_threads; stride *= 2) {
+        size_t pairs = (n_threads + 2 * stride - 1) / (2 * stride);
+        parallel_for(pairs, 1, [&](size_t begin, size_t end, unsigned int) {
+            for(size_t p = begin; p < end; p++) {
+                size_t dst = p * 2 * stride;
+                size_t src = dst + stride;
+                if(src >= n_threads) {
+                    continue;
+                }
+                for(unsigned int b = 0; b < m_bins; b++) {
+                    local[dst][b] += local[src][b];
+                }
+            }
+        });
+    }
+    m_counts = local[0];
+
+    // Blocked prefix sum: scan each block, scan the block totals, then offset
+    size_t block = (m_bins + n_threads - 1) / n_threads;
+    size_t n_blocks = (m_bins + block - 1) / block;
+    vector<uint64_t> scan(m_bins);
+    vector<uint64_t> block_sums(n_blocks, 0);
+    parallel_for(n_blocks, 1, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t k = begin; k < end; k++) {
+            uint64_t sum = 0;
+            for(size_t b = k * block; b < std::min((k + 1) * block, size_t(m_bins)); b++) {
+                sum += m_counts[b];
+                scan[b] = sum;
+            }
+            block_sums[k] = sum;
+        }
+    });
+    uint64_t total = 0;
+    for(size_t k = 0; k < n_blocks; k++) {
+        uint64_t sum = block_sums[k];
+        block_sums[k] = total;
+        total += sum;
+    }
+    const float norm = total > 0 ? 1.f / float(total) : 0.f;
+    m_cdf[0] = 0.f;
+    parallel_for(n_blocks, 1, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t k = begin; k < end; k++) {
+            for(size_t b = k * block; b < std::min((k + 1) * block, size_t(m_bins)); b++) {
+                m_cdf[b + 1] = float(scan[b] + block_sums[k]) * norm;
+            }
+        }
+    });
+}
+
+vfloat IterationHistogram::equalize(vfloat iteration) const {
+    vfloat x = vclamp(iteration * m_scale, 0.f, float(m_bins) - 1e-3f);
+    vint bin = to_int(x);
+    vfloat below = gather(m_cdf.data(), bin);
+    vfloat upto = gather(m_cdf.data(), bin + 1);
+    return below + (x - to_float(bin)) * (upto - below);
+}
+
+float IterationHistogram::equalize(float iteration) const {
+    return this->equalize(vbroadcast(iteration))[0];
+}
+
+unsigned int IterationHistogram::bins() const {
+    return m_bins;
+}
+
+const vector<uint64_t>& IterationHistogram::counts() const {
+    return m_counts;
+}
+
+const vector<float>& IterationHistogram::cdf() const {
+    return m_cdf;
+}
@@ -0,0 +1,168 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "cpu/hybrid.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+    const char* FORMULA_NAMES[FORMULA_COUNT] = {
+        "mandelbrot", "multibrot3", "multibrot4", "multibrot5", "burning_ship", "tricorn"
+    };
+
+    const float FORMULA_DEGREES[FORMULA_COUNT] = {2.f, 3.f, 4.f, 5.f, 2.f, 2.f};
+
+    // Step of each formula in frag_fractals.glsl
+    const char* FORMULA_GLSL[FORMULA_COUNT] = {
+        "step_quadratic(z, dz)", "step_power(z, dz, 3)", "step_power(z, dz, 4)", "step_power(z, dz, 5)",
+        "step_burning_ship(z, dz)", "step_tricorn(z, dz)"
+    };
+
+    float sequence_degree(const vector<FormulaId>& sequence) {
+        float product = 1.f;
+        for(FormulaId id : sequence) {
+            product *= FORMULA_DEGREES[id];
+        }
+        return std::pow(product, 1.f / sequence.size());
+    }
+
+    // One compiled iteration per formula, all with the same signature
+    template<typename Real>
+    struct JumpTable {
+        typedef bool (*Advance)(EscapeOrbit<Real>&, EscapeLanes<Real>&, unsigned int, Real);
+
+        static Advance entry(FormulaId id) {
+            switch(id) {
+                case FORMULA_MANDELBROT: return &FormulaEngine<Multibrot<2>, Real>::template advance<0>;
+                case FORMULA_MULTIBROT3: return &FormulaEngine<Multibrot<3>, Real>::template advance<0>;
+                case FORMULA_MULTIBROT4: return &FormulaEngine<Multibrot<4>, Real>::template advance<0>;
+                case FORMULA_MULTIBROT5: return &FormulaEngine<Multibrot<5>, Real>::template advance<0>;
+                case FORMULA_BURNING_SHIP: return &FormulaEngine<BurningShip, Real>::template advance<0>;
+                default: return &FormulaEngine<Tricorn, Real>::template advance<0>;
+            }
+        }
+    };
+
+    // Any sequence: the formula of iteration n is called through the table
+    template<typename Real>
+    void render_jump_table(const vector<FormulaId>& sequence, const View& view, const EscapeParams& params, IterationBuffer& out) {
+        typedef FormulaEngine<Multibrot<2>, Real> Engine;
+        typedef typename Engine::vreal vreal;
+        typedef typename JumpTable<Real>::Advance Advance;
+
+        out.resize(view.width, view.height);
+        out.max_iter = params.max_iter;
+
+        vector<Advance> steps;
+        for(FormulaId id : sequence) {
+            steps.push_back(JumpTable<Real>::entry(id));
+        }
+        const unsigned int period = unsigned(steps.size());
+        const float degree = sequence_degree(sequence);
+
+        const vreal lanes = __builtin_convertvector(vlane_index(), vreal);
+        const vreal zero = vreal{} + Real(0);
+        const Real bailout2 = Real(params.bailout) * Real(params.bailout);
+        const Real re_left = Real(view.center_x - 1.0 / view.zoom);
+        const Real re_step = Real(2.0 / (view.zoom * view.width));
+
+        parallel_for(view.height, 4, [&](size_t begin, size_t end, unsigned int) {
+            for(size_t j = begin; j < end; j++) {
+                const vreal im = vreal{} + Real(view.im(j));
+                for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                    const vreal re = (vreal{} + re_left) + ((vreal{} + Real(i)) + lanes + Real(0.5)) * re_step;
+
+                    typename Engine::Orbit orbit;
+                    typename Engine::Lanes result;
+                    Engine::start(zero, zero, re, im, params.max_iter, orbit, result);
+                    unsigned int phase = 0;
+                    for(unsigned int n = 0; n < params.max_iter; n++) {
+                        if(!steps[phase](orbit, result, n, bailout2)) {
+                            break;
+                        }
+                        if(++phase == period) {
+                            phase = 0;
+                        }
+                    }
+                    result.inside = orbit.active;
+
+                    for(unsigned int k = 0; k < SIMD_LANES && i + k < view.width; k++) {
+                        store_orbit<Real>(result.re_z[k], result.im_z[k], result.re_dz[k], result.im_dz[k], result.n[k],
+                            result.inside[k] != 0, degree, true, params, out, j * view.width + i + k);
+                    }
+                }
+            }
+        });
+    }
+
+    bool matches(const vector<FormulaId>& sequence, const vector<FormulaId>& pattern) {
+        return sequence == pattern;
+    }
+}
+
+bool parse_formula_sequence(const string& text, vector<FormulaId>& sequence) {
+    sequence.clear();
+    stringstream stream(text);
+    string item;
+    while(getline(stream, item, ',')) {
+        unsigned int count = 1;
+        size_t star = item.find('*');
+        string name = item.substr(0, star);
+        if(star != string::npos) {
+            count = unsigned(atoi(item.c_str() + star + 1));
+        }
+
+        int id = -1;
+        for(int k = 0; k < FORMULA_COUNT; k++) {
+            if(name == FORMULA_NAMES[k]) {
+                id = k;
+            }
+        }
+        if(id < 0 || count == 0) {
+            std::cout << "ERROR::FORMULA::UNKNOWN " << item << std::endl;
+            return false;
+        }
+        sequence.insert(sequence.end(), count, FormulaId(id));
+    }
+    if(sequence.empty()) {
+        std::cout << "ERROR::FORMULA::UNKNOWN " << text << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void render_hybrid(const vector<FormulaId>& sequence, bool double_precision, const View& view, const EscapeParams& params, IterationBuffer& out) {
+    if(matches(sequence, {FORMULA_MANDELBROT, FORMULA_BURNING_SHIP})) {
+        render_engine<Hybrid<Multibrot<2>, BurningShip>>(double_precision, view, params, out);
+    } else if(matches(sequence, {FORMULA_MANDELBROT, FORMULA_MANDELBROT, FORMULA_BURNING_SHIP})) {
+        render_engine<Hybrid<Multibrot<2>, Multibrot<2>, BurningShip>>(double_precision, view, params, out);
+    } else if(matches(sequence, {FORMULA_MANDELBROT, FORMULA_TRICORN})) {
+        render_engine<Hybrid<Multibrot<2>, Tricorn>>(double_precision, view, params, out);
+    } else if(matches(sequence, {FORMULA_MANDELBROT, FORMULA_MULTIBROT3})) {
+        render_engine<Hybrid<Multibrot<2>, Multibrot<3>>>(double_precision, view, params, out);
+    } else if(double_precision) {
+        render_jump_table<double>(sequence, view, params, out);
+    } else {
+        render_jump_table<float>(sequence, view, params, out);
+    }
+}
+
+vector<string> hybrid_glsl_defines(const vector<FormulaId>& sequence) {
+    // n is the iteration of escape_time(), the same for every pixel still
+    // running so the switch does not diverge
+    ostringstream out;
+    out << "HYBRID switch(n % " << sequence.size() << ") {";
+    for(size_t k = 0; k < sequence.size(); k++) {
+        out << " case " << k << ": " << FORMULA_GLSL[sequence[k]] << "; break;";
+    }
+    out << " }";
+
+    ostringstream log2_degree;
+    log2_degree.precision(9);
+    log2_degree << std::log2(sequence_degree(sequence));
+    string value = log2_degree.str();
+    if(value.find('.') == string::npos) {
+        value += ".0";
+    }
+    return vector<string>({out.str(), "LOG2_DEGREE " + value});
+}
@@ -0,0 +1,16 @@
+#include <fstream>
+#include <iostream>
+
+#include "cpu/image.hpp"
+
+bool Image::write_ppm(const string& filename) const {
+    ofstream file(filename, ios::binary);
+    if(!file.is_open()) {
+        std::cout << "ERROR::IMAGE::CANNOT_OPEN " << filename << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return file.good();
+}
@@ -0,0 +1,51 @@
+#include <algorithm>
+
+#include "cpu/julia.hpp"
+#include "cpu/parallel.hpp"
+
+typedef FormulaEngine<Multibrot<2>, float, FEATURE_DERIVATIVE | FEATURE_JULIA> JuliaEngine;
+
+void render_julia(const View& view, float re_c, float im_c, const EscapeParams& params, IterationBuffer& out) {
+    JuliaEngine(params, re_c, im_c).render(view, out);
+}
+
+void render_julia_atlas(const View& c_grid, const View& thumb, const EscapeParams& params, IterationBuffer& atlas) {
+    const unsigned int n_thumbs = c_grid.width * c_grid.height;
+    atlas.resize(c_grid.width * thumb.width, c_grid.height * thumb.height);
+    atlas.max_iter = params.max_iter;
+
+    // One task per group of SIMD_LANES thumbnails
+    size_t n_groups = (n_thumbs + SIMD_LANES - 1) / SIMD_LANES;
+    parallel_for(n_groups, 1, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t g = begin; g < end; g++) {
+            unsigned int first = unsigned(g) * SIMD_LANES;
+            unsigned int count = std::min(SIMD_LANES, n_thumbs - first);
+
+            // c of every lane, the last thumbnail is repeated in unused lanes
+            vfloat re_c, im_c;
+            size_t origin[SIMD_LANES];
+            for(unsigned int k = 0; k < SIMD_LANES; k++) {
+                unsigned int t = first + std::min(k, count - 1);
+                unsigned int ti = t % c_grid.width, tj = t / c_grid.width;
+                re_c[k] = float(c_grid.re(ti));
+                im_c[k] = float(c_grid.im(tj));
+                origin[k] = size_t(tj) * thumb.height * atlas.width + size_t(ti) * thumb.width;
+            }
+
+            // z0 is computed as in FormulaEngine::render() so that a
+            // thumbnail matches the full render of its c
+            const float re_left = float(thumb.center_x - 1.0 / thumb.zoom);
+            const float re_step = float(2.0 / (thumb.zoom * thumb.width));
+            for(unsigned int j = 0; j < thumb.height; j++) {
+                const vfloat im_z = vbroadcast(float(thumb.im(j)));
+                for(unsigned int i = 0; i < thumb.width; i++) {
+                    const vfloat re_z = vbroadcast(re_left + (float(i) + 0.5f) * re_step);
+                    JuliaEngine::Lanes result = JuliaEngine::iterate(re_z, im_z, re_c, im_c, params);
+                    for(unsigned int k = 0; k < count; k++) {
+                        JuliaEngine::store(result, k, params, atlas, origin[k] + size_t(j) * atlas.width + i);
+                    }
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cpu/lighting.hpp"
+#include "cpu/parallel.hpp"
+
+void Light::direction(float dir[3]) const {
+    const float to_rad = float(M_PI) / 180.f;
+    dir[0] = std::cos(azimuth * to_rad) * std::cos(elevation * to_rad);
+    dir[1] = std::sin(azimuth * to_rad) * std::cos(elevation * to_rad);
+    dir[2] = std::sin(elevation * to_rad);
+}
+
+void shade_slope(const IterationBuffer& buffer, const Light& light, Image& image) {
+    float l[3];
+    light.direction(l);
+    // Half vector with the viewer looking down the z axis
+    float h[3] = {l[0], l[1], l[2] + 1.f};
+    float h_norm = std::sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+    for(float& c: h) {
+        c /= h_norm;
+    }
+
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t i = begin * buffer.width; i < end * buffer.width; i++) {
+            if(!buffer.escaped[i]) {
+                continue;
+            }
+            // u = z / dz
+            float zr = buffer.z[2 * i], zi = buffer.z[2 * i + 1];
+            float dr = buffer.dz[2 * i], di = buffer.dz[2 * i + 1];
+            float ur = zr * dr + zi * di;
+            float ui = zi * dr - zr * di;
+            float u_norm = std::sqrt(ur * ur + ui * ui);
+            if(u_norm > 0.f) {
+                ur /= u_norm;
+                ui /= u_norm;
+            }
+
+            float n_norm = std::sqrt(1.f + light.height * light.height);
+            float n[3] = {ur / n_norm, ui / n_norm, light.height / n_norm};
+
+            float diffuse = std::max(n[0] * l[0] + n[1] * l[1] + n[2] * l[2], 0.f);
+            float specular = std::pow(std::max(n[0] * h[0] + n[1] * h[1] + n[2] * h[2], 0.f), light.shininess);
+            float gain = light.ambient + light.diffuse * diffuse;
+            float highlight = 255.f * light.specular * specular;
+
+            uint8_t* rgb = &image.rgb[3 * i];
+            for(int c = 0; c < 3; c++) {
+                rgb[c] = uint8_t(std::min(rgb[c] * gain + highlight, 255.f) + 0.5f);
+            }
+        }
+    });
+}
@@ -0,0 +1,138 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "cpu/lyapunov.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+namespace {
+    template <bool Fast>
+    inline vfloat lyapunov_log(vfloat x) {
+        return Fast ? fast_log(x) : vlog(x);
+    }
+
+    template <bool Fast>
+    void render_rows(const View& view, const LyapunovParams& params, const vector<uint8_t>& sequence, LyapunovBuffer& out) {
+        const vfloat lanes = vlane_index();
+        const float a_left = float(view.center_x - 1.0 / view.zoom);
+        const float a_step = float(2.0 / (view.zoom * view.width));
+        const size_t length = sequence.size();
+        const float scale = params.iterations ? 1.f / float(params.iterations) : 0.f;
+
+        parallel_for(view.height, 4, [&](size_t begin, size_t end, unsigned int) {
+            for(size_t j = begin; j < end; j++) {
+                const vfloat b = vbroadcast(float(view.im(j)));
+                for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                    const vfloat a = a_left + (float(i) + lanes + 0.5f) * a_step;
+                    vfloat x = vbroadcast(0.5f);
+
+                    // The letter is the same for all the lanes, r is picked
+                    // with a scalar branch
+                    size_t k = 0;
+                    for(unsigned int n = 0; n < params.warmup; n++) {
+                        const vfloat r = sequence[k] ? b : a;
+                        x = r * x * (1.f - x);
+                        if(++k == length) {
+                            k = 0;
+                        }
+                    }
+                    vfloat sum = vbroadcast(0.f);
+                    for(unsigned int n = 0; n < params.iterations; n++) {
+                        const vfloat r = sequence[k] ? b : a;
+                        // Superstable orbits go through x = 1/2, where the
+                        // derivative is 0, the floor keeps their sum finite
+                        sum += lyapunov_log<Fast>(vmax(vabs(r * (1.f - 2.f * x)), vbroadcast(1e-30f)));
+                        x = r * x * (1.f - x);
+                        if(++k == length) {
+                            k = 0;
+                        }
+                    }
+
+                    const vfloat exponent = sum * scale;
+                    for(unsigned int l = 0; l < SIMD_LANES && i + l < view.width; l++) {
+                        out.exponent[j * view.width + i + l] = exponent[l];
+                    }
+                }
+            }
+        });
+    }
+
+    // Yellow below 0, blue above, black at 0 and for diverging orbits
+    void exponent_color(float exponent, uint8_t* rgb) {
+        const float stable[3] = {1.f, 0.85f, 0.15f};
+        const float chaotic[3] = {0.1f, 0.25f, 0.8f};
+        if(std::isnan(exponent)) {
+            rgb[0] = rgb[1] = rgb[2] = 0;
+            return;
+        }
+        float value = 1.f - std::exp(-2.f * std::fabs(exponent));
+        const float* color = exponent < 0.f ? stable : chaotic;
+        for(unsigned int c = 0; c < 3; c++) {
+            rgb[c] = uint8_t(255.f * value * color[c] + 0.5f);
+        }
+    }
+}
+
+LyapunovSequence::LyapunovSequence() {
+    this->parse("AB");
+}
+
+bool LyapunovSequence::parse(const string& letters) {
+    vector<uint8_t> sequence;
+    for(char ch : letters) {
+        if(ch == 'A' || ch == 'a') {
+            sequence.push_back(0);
+        } else if(ch == 'B' || ch == 'b') {
+            sequence.push_back(1);
+        } else {
+            sequence.clear();
+            break;
+        }
+    }
+    if(sequence.empty()) {
+        std::cout << "ERROR::LYAPUNOV::INVALID_SEQUENCE " << letters << std::endl;
+        return false;
+    }
+    m_letters = letters;
+    m_sequence = sequence;
+    return true;
+}
+
+const string& LyapunovSequence::letters() const {
+    return m_letters;
+}
+
+vector<string> LyapunovSequence::glsl_defines(const LyapunovParams& params) const {
+    ostringstream sequence;
+    sequence << "LYAPUNOV_SEQUENCE bool[" << m_sequence.size() << "](";
+    for(size_t k = 0; k < m_sequence.size(); k++) {
+        sequence << (k ? ", " : "") << (m_sequence[k] ? "true" : "false");
+    }
+    sequence << ")";
+    return vector<string>({
+        "LYAPUNOV",
+        "LYAPUNOV_LENGTH " + to_string(m_sequence.size()),
+        sequence.str(),
+        "LYAPUNOV_WARMUP " + to_string(params.warmup),
+        "LYAPUNOV_ITERATIONS " + to_string(params.iterations)
+    });
+}
+
+void LyapunovSequence::render(const View& view, const LyapunovParams& params, LyapunovBuffer& out) const {
+    out.resize(view.width, view.height);
+    if(params.fast_log) {
+        render_rows<true>(view, params, m_sequence, out);
+    } else {
+        render_rows<false>(view, params, m_sequence, out);
+    }
+}
+
+void colorize_lyapunov(const LyapunovBuffer& buffer, Image& out) {
+    out.resize(buffer.width, buffer.height);
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t idx = begin * buffer.width; idx < end * buffer.width; idx++) {
+            exponent_color(buffer.exponent[idx], &out.rgb[3 * idx]);
+        }
+    });
+}
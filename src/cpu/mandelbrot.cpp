@@ -0,0 +1,5 @@
+#include "cpu/mandelbrot.hpp"
+
+void render_mandelbrot(const View& view, const EscapeParams& params, IterationBuffer& out) {
+    FormulaEngine<Multibrot<2>>(params).render(view, out);
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "cpu/mipmap.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+    // Length of [a0, a1) inside [b0, b1)
+    double overlap(double a0, double a1, double b0, double b1) {
+        return max(0.0, min(a1, b1) - max(a0, b0));
+    }
+}
+
+MipmapWriter::MipmapWriter(const string& stem, unsigned int width, unsigned int height, bool mipmaps) :
+    m_good(true) {
+    unsigned int w = width, h = height;
+    for(unsigned int k = 0;; k++) {
+        unique_ptr<Level> level(new Level());
+        level->width = w;
+        level->height = h;
+        level->filename = k == 0 ? stem + ".ppm" : stem + "_mip" + to_string(k) + ".ppm";
+        level->file.open(level->filename, ios::binary);
+        if(!level->file.is_open()) {
+            std::cout << "ERROR::MIPMAP::CANNOT_OPEN " << level->filename << std::endl;
+            m_good = false;
+        }
+        level->file << "P6\n" << w << " " << h << "\n255\n";
+        level->rows_in = 0;
+        level->rows_out = 0;
+        const bool last = !mipmaps || (w == 1 && h == 1);
+        if(!last) {
+            // Pixel i of the next level covers [i r, (i + 1) r) of this one
+            const unsigned int next_width = max(1u, w / 2);
+            const double r = double(w) / next_width;
+            level->taps_per_pixel = unsigned(ceil(r)) + 1;
+            level->first.resize(next_width);
+            level->taps.assign(size_t(next_width) * level->taps_per_pixel, 0.f);
+            for(unsigned int i = 0; i < next_width; i++) {
+                const double x0 = i * r, x1 = (i + 1) * r;
+                level->first[i] = unsigned(floor(x0));
+                for(unsigned int t = 0; t < level->taps_per_pixel; t++) {
+                    const unsigned int x = level->first[i] + t;
+                    if(x < w) {
+                        level->taps[i * level->taps_per_pixel + t] = float(overlap(x, x + 1, x0, x1) / r);
+                    }
+                }
+            }
+            level->carry.assign(size_t(next_width) * 3, 0.f);
+        }
+        m_levels.push_back(std::move(level));
+        if(last) {
+            break;
+        }
+        w = max(1u, w / 2);
+        h = max(1u, h / 2);
+    }
+}
+
+MipmapWriter::~MipmapWriter() {
+    this->close();
+}
+
+unsigned int MipmapWriter::getLevels() const {
+    return (unsigned int)m_levels.size();
+}
+
+bool MipmapWriter::write(const uint8_t* rgb, unsigned int rows) {
+    Level& level = *m_levels[0];
+    rows = min(rows, level.height - level.rows_in);
+    if(!m_good || rows == 0) {
+        return m_good;
+    }
+    level.file.write(reinterpret_cast<const char*>(rgb), streamsize(size_t(level.width) * rows * 3));
+    m_good = level.file.good();
+    if(m_levels.size() == 1) {
+        level.rows_in += rows;
+        return m_good;
+    }
+    vector<float> band(size_t(level.width) * rows * 3);
+    parallel_for(band.size(), 4096, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t k = begin; k < end; k++) {
+            band[k] = float(rgb[k]);
+        }
+    });
+    return this->writeLevel(0, band.data(), rows) && m_good;
+}
+
+// The band filtered along x on the rows, then along y on the columns: a row
+// of the next level takes the rows it covers, the first one the ones of the
+// previous bands from the carry, and the rows it completes go down a level
+bool MipmapWriter::writeLevel(unsigned int k, const float* rgb, unsigned int rows) {
+    Level& level = *m_levels[k];
+    Level& next = *m_levels[k + 1];
+    const unsigned int width = next.width * 3;
+    const unsigned int taps = level.taps_per_pixel;
+
+    vector<float> filtered(size_t(width) * rows);
+    parallel_for(rows, 1, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t y = begin; y < end; y++) {
+            const float* src = rgb + y * level.width * 3;
+            float* dst = filtered.data() + y * width;
+            for(unsigned int i = 0; i < next.width; i++) {
+                float r = 0.f, g = 0.f, b = 0.f;
+                for(unsigned int t = 0; t < taps; t++) {
+                    const float weight = level.taps[i * taps + t];
+                    if(weight > 0.f) {
+                        const float* pixel = src + (level.first[i] + t) * 3;
+                        r += weight * pixel[0];
+                        g += weight * pixel[1];
+                        b += weight * pixel[2];
+                    }
+                }
+                dst[3 * i] = r;
+                dst[3 * i + 1] = g;
+                dst[3 * i + 2] = b;
+            }
+        }
+    });
+
+    const double r = double(level.height) / next.height;
+    const unsigned int y0 = level.rows_in, y1 = y0 + rows;
+    level.rows_in = y1;
+    const unsigned int j_begin = level.rows_out;
+    const unsigned int j_end = y1 == level.height ? next.height : min(next.height, unsigned(floor(y1 / r + 1e-9)));
+    const unsigned int j_last = min(j_end + 1, next.height);
+    level.rows_out = j_end;
+
+    vector<float> complete(size_t(width) * (j_end - j_begin));
+    parallel_for(width, 64, [&](size_t begin, size_t end, unsigned int) {
+        for(unsigned int j = j_begin; j < j_last; j++) {
+            const double t0 = j * r, t1 = (j + 1) * r;
+            const unsigned int ys = max(y0, unsigned(floor(t0))), ye = min(y1, unsigned(ceil(t1)));
+            for(size_t c = begin; c < end; c++) {
+                float sum = j == j_begin ? level.carry[c] : 0.f;
+                for(unsigned int y = ys; y < ye; y++) {
+                    sum += float(overlap(y, y + 1, t0, t1) / r) * filtered[size_t(y - y0) * width + c];
+                }
+                if(j < j_end) {
+                    complete[size_t(j - j_begin) * width + c] = sum;
+                } else {
+                    level.carry[c] = sum;
+                }
+            }
+        }
+    });
+
+    const unsigned int count = j_end - j_begin;
+    if(count == 0) {
+        return m_good;
+    }
+    if(!this->writeFile(next, complete.data(), count)) {
+        return false;
+    }
+    if(k + 2 < m_levels.size()) {
+        return this->writeLevel(k + 1, complete.data(), count);
+    }
+    next.rows_in += count;
+    return m_good;
+}
+
+bool MipmapWriter::writeFile(Level& level, const float* rgb, unsigned int rows) {
+    vector<uint8_t> bytes(size_t(level.width) * rows * 3);
+    for(size_t k = 0; k < bytes.size(); k++) {
+        bytes[k] = uint8_t(min(255.f, max(0.f, rgb[k] + 0.5f)));
+    }
+    level.file.write(reinterpret_cast<const char*>(bytes.data()), streamsize(bytes.size()));
+    m_good = m_good && level.file.good();
+    return m_good;
+}
+
+bool MipmapWriter::close() {
+    for(auto& level : m_levels) {
+        if(!level->file.is_open()) {
+            continue;
+        }
+        if(level->rows_in != level->height) {
+            std::cout << "ERROR::MIPMAP::INCOMPLETE " << level->filename << " " << level->rows_in << "/" << level->height << " rows" << std::endl;
+            m_good = false;
+        }
+        level->file.close();
+        m_good = m_good && !level->file.fail();
+    }
+    return m_good;
+}
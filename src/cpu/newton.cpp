@@ -0,0 +1,252 @@
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "cpu/glsl.hpp"
+#include "cpu/newton.hpp"
+#include "cpu/parallel.hpp"
+#include "cpu/simd.hpp"
+
+namespace {
+    // Hue of root k of degree roots, saturation 0.75, value 0.92^steps
+    void basin_color(int root, unsigned int degree, float steps, uint8_t* rgb) {
+        if(root < 0) {
+            rgb[0] = rgb[1] = rgb[2] = 0;
+            return;
+        }
+        float hue = float(root) / float(degree);
+        float value = std::pow(0.92f, steps);
+        const float offsets[3] = {0.f, 2.f / 3.f, 1.f / 3.f};
+        for(unsigned int c = 0; c < 3; c++) {
+            float h = hue + offsets[c];
+            h -= std::floor(h);
+            float channel = std::min(std::max(std::fabs(h * 6.f - 3.f) - 1.f, 0.f), 1.f);
+            rgb[c] = uint8_t(255.f * value * (1.f + 0.75f * (channel - 1.f)) + 0.5f);
+        }
+    }
+}
+
+NewtonPolynomial::NewtonPolynomial() {
+    this->parse("1 0 0 -1");
+}
+
+bool NewtonPolynomial::parse(const string& coefficients) {
+    string text = coefficients;
+    for(char& ch : text) {
+        if(ch == ',') {
+            ch = ' ';
+        }
+    }
+    istringstream in(text);
+    vector<double> parsed;
+    double x;
+    while(in >> x) {
+        parsed.push_back(x);
+    }
+    if(!in.eof()) {
+        std::cout << "ERROR::NEWTON::PARSE_FAILED " << coefficients << std::endl;
+        return false;
+    }
+    // Leading zeros do not count in the degree
+    while(!parsed.empty() && parsed[0] == 0.0) {
+        parsed.erase(parsed.begin());
+    }
+    if(parsed.size() < 3 || parsed.size() > NEWTON_MAX_DEGREE + 1) {
+        std::cout << "ERROR::NEWTON::DEGREE_NOT_SUPPORTED " << coefficients << std::endl;
+        return false;
+    }
+    vector<double> previous = m_coefficients;
+    m_coefficients = parsed;
+    if(!this->solve()) {
+        std::cout << "ERROR::NEWTON::ROOTS_NOT_FOUND " << coefficients << std::endl;
+        m_coefficients = previous;
+        this->solve();
+        return false;
+    }
+    return true;
+}
+
+unsigned int NewtonPolynomial::degree() const {
+    return m_coefficients.size() - 1;
+}
+
+const vector<double>& NewtonPolynomial::coefficients() const {
+    return m_coefficients;
+}
+
+const vector<complex<double>>& NewtonPolynomial::roots() const {
+    return m_roots;
+}
+
+bool NewtonPolynomial::solve() {
+    // Durand-Kerner on the monic polynomial: every root estimate moves by
+    // p(z_k) / prod_{j != k} (z_k - z_j) until none of them moves
+    const unsigned int n = this->degree();
+    auto p = [&](complex<double> z) {
+        complex<double> value = 1.0;
+        for(unsigned int k = 1; k <= n; k++) {
+            value = value * z + m_coefficients[k] / m_coefficients[0];
+        }
+        return value;
+    };
+
+    m_roots.resize(n);
+    const complex<double> seed(0.4, 0.9);
+    for(unsigned int k = 0; k < n; k++) {
+        m_roots[k] = pow(seed, double(k));
+    }
+    for(unsigned int iteration = 0; iteration < 1000; iteration++) {
+        double change = 0.0;
+        for(unsigned int k = 0; k < n; k++) {
+            complex<double> denominator = 1.0;
+            for(unsigned int j = 0; j < n; j++) {
+                if(j != k) {
+                    denominator *= m_roots[k] - m_roots[j];
+                }
+            }
+            const complex<double> value = p(m_roots[k]);
+            complex<double> delta = value / denominator;
+            if(std::isfinite(abs(value)) && !std::isfinite(abs(delta))) {
+                // Estimates merged on a repeated root, push this one aside.
+                // A value out of range is left to give a NaN root.
+                delta = -1e-6 * (1.0 + abs(m_roots[k])) * seed;
+            }
+            m_roots[k] -= delta;
+            change = std::max(change, abs(delta));
+        }
+        if(change < 1e-15) {
+            break;
+        }
+    }
+
+    // A root of multiplicity m only converges to about 1e-16^(1/m), the
+    // estimates around it snap to their mean and all basins take the color
+    // of its first copy
+    for(unsigned int k = 0; k < n; k++) {
+        complex<double> sum = m_roots[k];
+        unsigned int count = 1;
+        for(unsigned int j = k + 1; j < n; j++) {
+            if(abs(m_roots[j] - m_roots[k]) < NEWTON_ROOT_MERGE * (1.0 + abs(m_roots[k]))) {
+                sum += m_roots[j];
+                count++;
+            }
+        }
+        const complex<double> mean = sum / double(count);
+        for(unsigned int j = k + 1; j < n; j++) {
+            if(abs(m_roots[j] - m_roots[k]) < NEWTON_ROOT_MERGE * (1.0 + abs(m_roots[k]))) {
+                m_roots[j] = mean;
+            }
+        }
+        m_roots[k] = mean;
+    }
+    for(const complex<double>& root : m_roots) {
+        if(!std::isfinite(root.real()) || !std::isfinite(root.imag())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<string> NewtonPolynomial::glsl_defines() const {
+    const unsigned int n = this->degree();
+    ostringstream roots;
+    roots << "NEWTON_ROOTS vec2[" << n << "](";
+    for(unsigned int k = 0; k < n; k++) {
+        roots << (k ? ", " : "") << "vec2(" << glsl_float(m_roots[k].real()) << ", " << glsl_float(m_roots[k].imag()) << ")";
+    }
+    roots << ")";
+    return vector<string>({"NEWTON", "NEWTON_DEGREE " + to_string(n), roots.str()});
+}
+
+void NewtonPolynomial::render(const View& view, const NewtonParams& params, NewtonBuffer& out) const {
+    out.resize(view.width, view.height, params.max_iter);
+    out.degree = this->degree();
+
+    const unsigned int n = this->degree();
+    float re_roots[NEWTON_MAX_DEGREE], im_roots[NEWTON_MAX_DEGREE];
+    for(unsigned int k = 0; k < n; k++) {
+        re_roots[k] = float(m_roots[k].real());
+        im_roots[k] = float(m_roots[k].imag());
+    }
+
+    const vfloat lanes = vlane_index();
+    const float re_left = float(view.center_x - 1.0 / view.zoom);
+    const float re_step = float(2.0 / (view.zoom * view.width));
+    const float epsilon2 = params.epsilon * params.epsilon;
+    const float log_epsilon = std::log(params.epsilon);
+
+    parallel_for(view.height, 4, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const vfloat im = vbroadcast(float(view.im(j)));
+            for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                vfloat re_z = re_left + (float(i) + lanes + 0.5f) * re_step;
+                vfloat im_z = im;
+                vint active = (float(i) + lanes) < float(view.width);
+                vint root = vbroadcast(int32_t(-1));
+                vfloat smooth = vbroadcast(float(params.max_iter));
+
+                // Squared distance to the nearest root, before and after the step
+                vfloat previous = vbroadcast(INFINITY);
+                for(unsigned int step = 0; step < params.max_iter; step++) {
+                    // p'(z)/p(z) = sum 1/(z - root) from the factored
+                    // polynomial: Horner's scheme on the coefficients loses
+                    // p(z) to rounding around a repeated root
+                    vfloat re_s = vbroadcast(0.f), im_s = vbroadcast(0.f);
+                    for(unsigned int k = 0; k < n; k++) {
+                        vfloat dx = re_z - re_roots[k], dy = im_z - im_roots[k];
+                        vfloat inv = 1.f / vmax(dx * dx + dy * dy, vbroadcast(1e-30f));
+                        re_s += dx * inv;
+                        im_s -= dy * inv;
+                    }
+                    // z -= p/p' = 1/s, lanes on a critical point stay where they are
+                    vfloat norm = re_s * re_s + im_s * im_s;
+                    vint moving = active & (norm > 0.f);
+                    vfloat inv = 1.f / select(moving, norm, vbroadcast(1.f));
+                    re_z = select(moving, re_z - re_s * inv, re_z);
+                    im_z = select(moving, im_z + im_s * inv, im_z);
+
+                    vfloat distance = vbroadcast(INFINITY);
+                    vint nearest = vbroadcast(int32_t(0));
+                    for(unsigned int k = 0; k < n; k++) {
+                        vfloat dx = re_z - re_roots[k], dy = im_z - im_roots[k];
+                        vfloat d = dx * dx + dy * dy;
+                        nearest = select(d < distance, vbroadcast(int32_t(k)), nearest);
+                        distance = vmin(d, distance);
+                    }
+
+                    // Early exit within epsilon of a root, the fraction of
+                    // the step crossing epsilon is interpolated on log(distance)
+                    vint converged = active & (distance < epsilon2);
+                    if(any(converged)) {
+                        vfloat log_previous = 0.5f * vlog(vmin(previous, vbroadcast(1e30f)));
+                        vfloat log_distance = 0.5f * vlog(vmax(distance, vbroadcast(1e-30f)));
+                        vfloat fraction = vclamp((log_epsilon - log_previous) / (log_distance - log_previous), 0.f, 1.f);
+                        smooth = select(converged, float(step) + fraction, smooth);
+                        root = select(converged, nearest, root);
+                        active &= ~converged;
+                        if(!any(active)) {
+                            break;
+                        }
+                    }
+                    previous = distance;
+                }
+
+                for(unsigned int k = 0; k < SIMD_LANES && i + k < view.width; k++) {
+                    size_t idx = j * view.width + i + k;
+                    out.smooth[idx] = smooth[k];
+                    out.root[idx] = int8_t(root[k]);
+                }
+            }
+        }
+    });
+}
+
+void colorize_newton(const NewtonBuffer& buffer, Image& out) {
+    out.resize(buffer.width, buffer.height);
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t idx = begin * buffer.width; idx < end * buffer.width; idx++) {
+            basin_color(buffer.root[idx], buffer.degree, buffer.smooth[idx], &out.rgb[3 * idx]);
+        }
+    });
+}
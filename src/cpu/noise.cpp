@@ -0,0 +1,179 @@
+#include <algorithm>
+
+#include "cpu/noise.hpp"
+#include "cpu/parallel.hpp"
+
+namespace {
+    template <WarpKernel Kernel>
+    void render_rows(const View& view, const NoiseParams& params, NoiseBuffer& out, size_t begin, size_t end) {
+        const vfloat lanes = vlane_index();
+        const float x_left = float(view.center_x - 1.0 / view.zoom);
+        const float x_step = float(2.0 / (view.zoom * view.width));
+        for(size_t j = begin; j < end; j++) {
+            const vfloat y = vbroadcast(float(view.im(j)));
+            for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                const vfloat x = x_left + (float(i) + lanes + 0.5f) * x_step;
+                vfloat value;
+                if(Kernel == WarpKernel::FBM) {
+                    value = fbm(x, y, params);
+                } else if(Kernel == WarpKernel::WARP_SECOND) {
+                    value = warp_second(x, y, params);
+                } else {
+                    value = warp_third(x, y, params);
+                }
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < view.width; l++) {
+                    out.value[j * view.width + i + l] = value[l];
+                }
+            }
+        }
+    }
+
+    void render_rows(const View& view, WarpKernel kernel, const NoiseParams& params, NoiseBuffer& out, size_t begin, size_t end) {
+        switch(kernel) {
+            case WarpKernel::FBM:
+                render_rows<WarpKernel::FBM>(view, params, out, begin, end);
+                break;
+            case WarpKernel::WARP_SECOND:
+                render_rows<WarpKernel::WARP_SECOND>(view, params, out, begin, end);
+                break;
+            case WarpKernel::WARP_THIRD:
+                render_rows<WarpKernel::WARP_THIRD>(view, params, out, begin, end);
+                break;
+        }
+    }
+}
+
+void bake_noise_tile(NoiseTile& tile) {
+    const unsigned int size = tile.size();
+    tile.texels.resize(size, size);
+    const vfloat lanes = vlane_index();
+    const float step = 1.f / float(tile.texels_per_cell);
+    const float period = float(tile.period);
+    parallel_for(size, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const vfloat y = vbroadcast(float(j) * step);
+            for(unsigned int i = 0; i < size; i += SIMD_LANES) {
+                const vfloat x = (float(i) + lanes) * step;
+                vfloat value;
+                if(tile.basis == NoiseBasis::HASH) {
+                    value = periodic_noise<NoiseBasis::HASH>(x, y, period);
+                } else if(tile.basis == NoiseBasis::GRADIENT) {
+                    value = periodic_noise<NoiseBasis::GRADIENT>(x, y, period);
+                } else {
+                    value = periodic_noise<NoiseBasis::SIN>(x, y, period);
+                }
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < size; l++) {
+                    tile.texels.value[j * size + i + l] = value[l];
+                }
+            }
+        }
+    });
+}
+
+void render_warp(const View& view, WarpKernel kernel, const NoiseParams& params, NoiseBuffer& out) {
+    out.resize(view.width, view.height);
+    // A warp_third() pixel is 200 rand(), one row is plenty of work
+    parallel_for(view.height, 1, [&](size_t begin, size_t end, unsigned int) {
+        render_rows(view, kernel, params, out, begin, end);
+    });
+}
+
+void render_warp_loop(const View& view, WarpKernel kernel, const NoiseParams& params, unsigned int frames,
+                      const function<void(unsigned int, const NoiseBuffer&)>& done) {
+    const float loop = warp_loop_time(params.period);
+    vector<NoiseBuffer> buffers(worker_count());
+    parallel_for(frames, 1, [&](size_t begin, size_t end, unsigned int thread) {
+        NoiseBuffer& out = buffers[thread];
+        out.resize(view.width, view.height);
+        for(size_t k = begin; k < end; k++) {
+            NoiseParams frame = params;
+            frame.time = params.time + loop * float(k) / float(frames);
+            render_rows(view, kernel, frame, out, 0, view.height);
+            done((unsigned int)k, out);
+        }
+    });
+}
+
+void render_warp_field(const View& view, WarpKernel kernel, const NoiseParams& params, unsigned int divisor, NoiseBuffer& out) {
+    if(divisor <= 1 || kernel == WarpKernel::FBM) {
+        render_warp(view, kernel, params, out);
+        return;
+    }
+    out.resize(view.width, view.height);
+
+    // Sample (i, j) of the field is at the center of the divisor x divisor
+    // pixels from ((i - 2) divisor, (j - 2) divisor)
+    const unsigned int field_width = (view.width + divisor - 1) / divisor + 4;
+    const unsigned int field_height = (view.height + divisor - 1) / divisor + 4;
+    const float s = float(divisor);
+    const float center = 0.5f * (s - 1.f);
+    vector<float> field_x(size_t(field_width) * field_height), field_y(field_x.size());
+    const vfloat lanes = vlane_index();
+    const float x_left = float(view.center_x - 1.0 / view.zoom);
+    const float x_step = float(2.0 / (view.zoom * view.width));
+    parallel_for(field_height, 1, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const vfloat y = vbroadcast(float(view.im((float(j) - 2.f) * s + center)));
+            for(unsigned int i = 0; i < field_width; i += SIMD_LANES) {
+                const vfloat x = x_left + ((float(i) + lanes - 2.f) * s + center + 0.5f) * x_step;
+                vfloat dx, dy;
+                if(kernel == WarpKernel::WARP_SECOND) {
+                    warp_second_offset(x, y, params, dx, dy);
+                } else {
+                    warp_third_offset(x, y, params, dx, dy);
+                }
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < field_width; l++) {
+                    field_x[j * field_width + i + l] = dx[l];
+                    field_y[j * field_width + i + l] = dy[l];
+                }
+            }
+        }
+    });
+
+    parallel_for(view.height, 1, [&](size_t begin, size_t end, unsigned int) {
+        const vint last = vbroadcast(int32_t(field_width - 1));
+        for(size_t j = begin; j < end; j++) {
+            const float fy = (float(j) - center) / s + 2.f;
+            const float by = std::floor(fy);
+            vfloat wy[4];
+            catmull_rom(vbroadcast(fy - by), wy);
+            const int32_t row = (int32_t(by) - 1) * int32_t(field_width);
+            const vfloat y = vbroadcast(float(view.im(j)));
+            for(unsigned int i = 0; i < view.width; i += SIMD_LANES) {
+                const vfloat fx = (float(i) + lanes - center) / s + 2.f;
+                const vfloat bx = vfloor(fx);
+                vfloat wx[4];
+                catmull_rom(fx - bx, wx);
+                // The lanes past the width read the last column
+                const vint first = to_int(bx) - 1;
+                const vint column = select(first < last - 3, first, last - 3);
+                vfloat dx = vbroadcast(0.f), dy = vbroadcast(0.f);
+                for(int32_t m = 0; m < 4; m++) {
+                    vfloat row_x = vbroadcast(0.f), row_y = vbroadcast(0.f);
+                    for(int32_t k = 0; k < 4; k++) {
+                        const vint idx = row + m * int32_t(field_width) + column + k;
+                        row_x += wx[k] * gather(field_x.data(), idx);
+                        row_y += wx[k] * gather(field_y.data(), idx);
+                    }
+                    dx += wy[m] * row_x;
+                    dy += wy[m] * row_y;
+                }
+                const vfloat x = x_left + (float(i) + lanes + 0.5f) * x_step;
+                const vfloat value = fbm(x + dx, y + dy, params);
+                for(unsigned int l = 0; l < SIMD_LANES && i + l < view.width; l++) {
+                    out.value[j * view.width + i + l] = value[l];
+                }
+            }
+        }
+    });
+}
+
+void colorize_noise(const NoiseBuffer& buffer, float scale, Image& out) {
+    out.resize(buffer.width, buffer.height);
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t idx = begin * buffer.width; idx < end * buffer.width; idx++) {
+            const float v = std::min(std::max(buffer.value[idx] * scale, 0.f), 1.f);
+            out.rgb[3 * idx] = out.rgb[3 * idx + 1] = out.rgb[3 * idx + 2] = uint8_t(255.f * v + 0.5f);
+        }
+    });
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cpu/occlusion.hpp"
+
+void ShadowMap::basis(const float light[3], float right[3], float up[3]) {
+    const float horizontal = std::sqrt(light[0] * light[0] + light[1] * light[1]);
+    if(horizontal < 1e-4f) {
+        right[0] = 1.f;
+        right[1] = 0.f;
+    } else {
+        right[0] = light[1] / horizontal;
+        right[1] = -light[0] / horizontal;
+    }
+    right[2] = 0.f;
+    up[0] = -(right[1] * light[2] - right[2] * light[1]);
+    up[1] = -(right[2] * light[0] - right[0] * light[2]);
+    up[2] = -(right[0] * light[1] - right[1] * light[0]);
+}
+
+float ShadowMap::visibility(const float p[3]) const {
+    if(depth.empty()) {
+        return 1.f;
+    }
+    const float u = (p[0] * right[0] + p[1] * right[1] + p[2] * right[2]) / bound;
+    const float v = (p[0] * up[0] + p[1] * up[1] + p[2] * up[2]) / bound;
+    const float d = bound - (p[0] * light[0] + p[1] * light[1] + p[2] * light[2]);
+
+    const float s = (0.5f * u + 0.5f) * float(width) - 0.5f;
+    const float r = (0.5f * v + 0.5f) * float(height) - 0.5f;
+    const float fs = std::floor(s), fr = std::floor(r);
+    const int i0 = int(fs), j0 = int(fr);
+    auto lit = [&](int i, int j) {
+        i = std::min(std::max(i, 0), int(width) - 1);
+        j = std::min(std::max(j, 0), int(height) - 1);
+        return d <= depth[size_t(j) * width + i] ? 1.f : 0.f;
+    };
+    const float x = s - fs, y = r - fr;
+    const float bottom = lit(i0, j0) + x * (lit(i0 + 1, j0) - lit(i0, j0));
+    const float top = lit(i0, j0 + 1) + x * (lit(i0 + 1, j0 + 1) - lit(i0, j0 + 1));
+    return bottom + y * (top - bottom);
+}
+
+float OcclusionVolume::ambient(const float p[3]) const {
+    if(directions == 0) {
+        return 1.f;
+    }
+    float s[3];
+    int i0[3];
+    for(unsigned int c = 0; c < 3; c++) {
+        float x = (p[c] + bound) / (2.f * bound) * float(size) - 0.5f;
+        x = std::min(std::max(x, 0.f), float(size - 1));
+        i0[c] = std::min(int(x), int(size) - 2);
+        s[c] = x - float(i0[c]);
+    }
+    auto at = [&](int dx, int dy, int dz) {
+        return visibility[(size_t(i0[2] + dz) * size + i0[1] + dy) * size + i0[0] + dx];
+    };
+    float v[2];
+    for(int dz = 0; dz < 2; dz++) {
+        float bottom = at(0, 0, dz) + s[0] * (at(1, 0, dz) - at(0, 0, dz));
+        float top = at(0, 1, dz) + s[0] * (at(1, 1, dz) - at(0, 1, dz));
+        v[dz] = bottom + s[1] * (top - bottom);
+    }
+    return std::min(2.f * (v[0] + s[2] * (v[1] - v[0])), 1.f);
+}
+
+void fibonacci_direction(unsigned int k, unsigned int count, float dir[3]) {
+    const float z = 1.f - (2.f * float(k) + 1.f) / float(count);
+    const float r = std::sqrt(std::max(1.f - z * z, 0.f));
+    const float phi = 2.39996323f * float(k);
+    dir[0] = r * std::cos(phi);
+    dir[1] = r * std::sin(phi);
+    dir[2] = z;
+}
+
+void light_march(const MarchBuffer& buffer, const Camera& camera, const ShadowMap& shadow, const OcclusionVolume& volume,
+                 const OcclusionParams& occlusion, vector<float>& lit, vector<float>& ambient) {
+    const size_t pixels = size_t(buffer.width) * buffer.height;
+    lit.assign(pixels, 1.f);
+    ambient.assign(pixels, 1.f);
+    float right[3], up[3], forward[3];
+    camera.rays(buffer.width, buffer.height, right, up, forward);
+    const float shadow_offset = shadow.width ? occlusion.shadow_bias * 2.f * shadow.bound / float(std::min(shadow.width, shadow.height)) : 0.f;
+    const float voxel = volume.size ? 2.f * volume.bound / float(volume.size) : 0.f;
+
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const float v = 1.f - 2.f * (float(j) + 0.5f + camera.jitter[1]) / float(buffer.height);
+            for(size_t i = 0; i < buffer.width; i++) {
+                size_t idx = j * buffer.width + i;
+                if(std::isinf(buffer.depth[idx])) {
+                    continue;
+                }
+                const float u = 2.f * (float(i) + 0.5f + camera.jitter[0]) / float(buffer.width) - 1.f;
+                float dir[3];
+                for(unsigned int c = 0; c < 3; c++) {
+                    dir[c] = forward[c] + u * right[c] + v * up[c];
+                }
+                const float norm = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+                const float* n = &buffer.normal[3 * idx];
+                float p[3], q[3];
+                for(unsigned int c = 0; c < 3; c++) {
+                    const float x = camera.eye[c] + buffer.depth[idx] * dir[c] / norm;
+                    p[c] = x + shadow_offset * n[c];
+                    q[c] = x + voxel * n[c];
+                }
+                lit[idx] = shadow.visibility(p);
+                ambient[idx] = volume.ambient(q);
+            }
+        }
+    });
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "cpu/palette.hpp"
+
+Palette::Palette() {
+    m_stops = {
+        {0.f, 10 / 255.f, 10 / 255.f, 100 / 255.f},
+        {0.33f, 10 / 255.f, 10 / 255.f, 130 / 255.f},
+        {0.66f, 50 / 255.f, 10 / 255.f, 176 / 255.f},
+        {1.f, 10 / 255.f, 10 / 255.f, 0 / 255.f},
+    };
+    // The shader saturates to c3 inside the set
+    m_interior[0] = 10 / 255.f;
+    m_interior[1] = 10 / 255.f;
+    m_interior[2] = 0.f;
+}
+
+bool Palette::load(const string& filename) {
+    ifstream file(filename);
+    if(!file.is_open()) {
+        std::cout << "ERROR::PALETTE::CANNOT_OPEN " << filename << std::endl;
+        return false;
+    }
+
+    vector<PaletteStop> stops;
+    string line;
+    while(getline(file, line)) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream in(line);
+        string first;
+        float r, g, b;
+        if(!(in >> first >> r >> g >> b)) {
+            std::cout << "ERROR::PALETTE::BAD_LINE " << line << std::endl;
+            return false;
+        }
+        if(first == "interior") {
+            m_interior[0] = r / 255.f;
+            m_interior[1] = g / 255.f;
+            m_interior[2] = b / 255.f;
+        } else {
+            stops.push_back({stof(first), r / 255.f, g / 255.f, b / 255.f});
+        }
+    }
+
+    if(stops.empty()) {
+        std::cout << "ERROR::PALETTE::NO_STOPS " << filename << std::endl;
+        return false;
+    }
+    std::sort(stops.begin(), stops.end(), [](const PaletteStop& a, const PaletteStop& b) {
+        return a.position < b.position;
+    });
+    m_stops = stops;
+    return true;
+}
+
+void Palette::sample(float t, float rgb[3]) const {
+    t = std::min(std::max(t, 0.f), 1.f);
+
+    const PaletteStop* prev = &m_stops.front();
+    rgb[0] = prev->r;
+    rgb[1] = prev->g;
+    rgb[2] = prev->b;
+    for(size_t i = 1; i < m_stops.size(); i++) {
+        const PaletteStop& next = m_stops[i];
+        if(t <= prev->position) {
+            break;
+        }
+        float x = (t - prev->position) / std::max(next.position - prev->position, 1e-6f);
+        x = std::min(x, 1.f);
+        float s = x * x * (3.f - 2.f * x);
+        rgb[0] += (next.r - rgb[0]) * s;
+        rgb[1] += (next.g - rgb[1]) * s;
+        rgb[2] += (next.b - rgb[2]) * s;
+        prev = &next;
+    }
+}
+
+const float* Palette::interior() const {
+    return m_interior;
+}
+
+vector<uint32_t> Palette::lut(unsigned int size) const {
+    vector<uint32_t> table(size);
+    for(unsigned int i = 0; i < size; i++) {
+        float rgb[3];
+        this->sample(size > 1 ? float(i) / (size - 1) : 0.f, rgb);
+        table[i] = pack_rgba(rgb);
+    }
+    return table;
+}
+
+uint32_t Palette::interior_rgba() const {
+    return pack_rgba(m_interior);
+}
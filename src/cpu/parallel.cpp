@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "cpu/parallel.hpp"
+
+unsigned int worker_count() {
+    unsigned int n = thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+void parallel_for(size_t count, size_t grain, const function<void(size_t, size_t, unsigned int)>& fn) {
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    unsigned int n_threads = static_cast<unsigned int>(std::min<size_t>(worker_count(), chunks));
+    if(n_threads <= 1) {
+        if(count > 0) {
+            fn(0, count, 0);
+        }
+        return;
+    }
+
+    atomic<size_t> next(0);
+    auto worker = [&](unsigned int thread_id) {
+        while(true) {
+            size_t chunk = next.fetch_add(1);
+            if(chunk >= chunks) {
+                break;
+            }
+            size_t begin = chunk * grain;
+            fn(begin, std::min(begin + grain, count), thread_id);
+        }
+    };
+
+    vector<thread> threads;
+    for(unsigned int t = 1; t < n_threads; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for(auto& t: threads) {
+        t.join();
+    }
+}
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "cpu/raymarch.hpp"
+
+namespace {
+    const float to_rad = float(M_PI) / 180.f;
+
+    // Surface color and the background gradient, from the top of the image
+    // to its bottom
+    const float surface[3] = {0.85f, 0.72f, 0.55f};
+    const float sky_top[3] = {0.12f, 0.16f, 0.24f};
+    const float sky_bottom[3] = {0.02f, 0.02f, 0.04f};
+
+    // k written in base, mirrored around the radix point
+    float radical_inverse(unsigned int k, unsigned int base) {
+        float inverse = 0.f, digit = 1.f / float(base);
+        for(; k > 0; k /= base, digit /= float(base)) {
+            inverse += float(k % base) * digit;
+        }
+        return inverse;
+    }
+
+    float dot(const float a[3], const float b[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+}
+
+void Camera::orbit(const float target[3], float distance, float azimuth, float elevation) {
+    // Looking back at the target
+    yaw = azimuth + 180.f;
+    pitch = -elevation;
+    const float toward_eye[3] = {
+        std::cos(elevation * to_rad) * std::cos(azimuth * to_rad),
+        std::cos(elevation * to_rad) * std::sin(azimuth * to_rad),
+        std::sin(elevation * to_rad)
+    };
+    for(unsigned int c = 0; c < 3; c++) {
+        eye[c] = target[c] + distance * toward_eye[c];
+    }
+}
+
+void Camera::rays(unsigned int width, unsigned int height, float right[3], float up[3], float forward[3]) const {
+    forward[0] = std::cos(pitch * to_rad) * std::cos(yaw * to_rad);
+    forward[1] = std::cos(pitch * to_rad) * std::sin(yaw * to_rad);
+    forward[2] = std::sin(pitch * to_rad);
+    // Horizontal right vector, up = right x forward
+    const float r[3] = {std::sin(yaw * to_rad), -std::cos(yaw * to_rad), 0.f};
+    const float u[3] = {
+        r[1] * forward[2] - r[2] * forward[1],
+        r[2] * forward[0] - r[0] * forward[2],
+        r[0] * forward[1] - r[1] * forward[0]
+    };
+    const float half_height = std::tan(0.5f * fov * to_rad);
+    const float half_width = half_height * float(width) / float(height);
+    for(unsigned int c = 0; c < 3; c++) {
+        right[c] = half_width * r[c];
+        up[c] = half_height * u[c];
+    }
+}
+
+float Camera::pixel_angle(unsigned int height) const {
+    return 2.f * std::tan(0.5f * fov * to_rad) / float(height);
+}
+
+void reproject_hits(const MarchBuffer& previous, const Camera& previous_camera, const Camera& camera,
+                    unsigned int width, unsigned int height, vector<float>& depth) {
+    float previous_right[3], previous_up[3], previous_forward[3];
+    previous_camera.rays(previous.width, previous.height, previous_right, previous_up, previous_forward);
+    float right[3], up[3], forward[3];
+    camera.rays(width, height, right, up, forward);
+
+    // The hit at depth t along the previous ray dir is at o + t dir/|dir|
+    // from the eye, o the move of the eye. Its offsets along the axes of
+    // camera are linear in the pixel coordinates: a row only adds u times
+    // their projection on previous_right. right and up are orthogonal to
+    // forward, a unit vector.
+    const float* axes[3] = {forward, right, up};
+    const float scale[3] = {1.f, 1.f / dot(right, right), 1.f / dot(up, up)};
+    float o[3], eye[3], along_forward[3], along_right[3], along_up[3];
+    for(unsigned int c = 0; c < 3; c++) {
+        o[c] = previous_camera.eye[c] - camera.eye[c];
+    }
+    for(unsigned int a = 0; a < 3; a++) {
+        eye[a] = scale[a] * dot(o, axes[a]);
+        along_forward[a] = scale[a] * dot(previous_forward, axes[a]);
+        along_right[a] = scale[a] * dot(previous_right, axes[a]);
+        along_up[a] = scale[a] * dot(previous_up, axes[a]);
+    }
+    const float o_forward = dot(o, previous_forward), o_right = dot(o, previous_right), o_up = dot(o, previous_up);
+    const float right2 = dot(previous_right, previous_right), up2 = dot(previous_up, previous_up);
+
+    // The square of the distance of the nearest hit of each pixel, kept
+    // with an atomic minimum on its bits: positive floats order as their
+    // bits do, and INFINITY above them all
+    const uint32_t none = 0x7f800000u;
+    vector<atomic<uint32_t>> nearest(size_t(width) * height);
+    parallel_for(height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t k = begin * width; k < end * width; k++) {
+            nearest[k].store(none, memory_order_relaxed);
+        }
+    });
+    // SIMD_LANES hits are projected together, then kept one by one
+    const vfloat lanes = vlane_index();
+    parallel_for(previous.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const float v = 1.f - 2.f * (float(j) + 0.5f + previous_camera.jitter[1]) / float(previous.height);
+            float row[3];
+            for(unsigned int a = 0; a < 3; a++) {
+                row[a] = along_forward[a] + v * along_up[a];
+            }
+            const float row_o = o_forward + v * o_up, row_norm2 = 1.f + v * v * up2;
+            const float* hits = &previous.depth[j * previous.width];
+            for(size_t i = 0; i < previous.width; i += SIMD_LANES) {
+                const size_t count = std::min(size_t(SIMD_LANES), previous.width - i);
+                vfloat t = vbroadcast(INFINITY);
+                if(count == SIMD_LANES) {
+                    t = vload(hits + i);
+                } else {
+                    for(size_t l = 0; l < count; l++) {
+                        t[l] = hits[i + l];
+                    }
+                }
+                const vint hit = t < INFINITY;
+                if(!any(hit)) {
+                    continue;
+                }
+                const vfloat u = 2.f * (float(i) + lanes + (0.5f + previous_camera.jitter[0])) / float(previous.width) - 1.f;
+                const vfloat s = t / vsqrt(row_norm2 + u * u * right2);
+                const vfloat z = eye[0] + s * (row[0] + u * along_right[0]);
+                const vfloat inverse_z = 1.f / z;
+                const vfloat x = 0.5f * ((eye[1] + s * (row[1] + u * along_right[1])) * inverse_z + 1.f) * float(width) - camera.jitter[0];
+                const vfloat y = 0.5f * (1.f - (eye[2] + s * (row[2] + u * along_right[2])) * inverse_z) * float(height) - camera.jitter[1];
+                // |o + s dir|^2, s |dir| being t
+                const vfloat distance2 = dot(o, o) + 2.f * s * (row_o + u * o_right) + t * t;
+                const vint inside = hit & (z > 0.f) & (x >= 0.f) & (y >= 0.f) & (x < float(width)) & (y < float(height));
+                for(size_t l = 0; l < count; l++) {
+                    if(!inside[l]) {
+                        continue;
+                    }
+                    uint32_t bits;
+                    const float d2 = distance2[l];
+                    memcpy(&bits, &d2, sizeof(bits));
+                    atomic<uint32_t>& pixel = nearest[size_t(y[l]) * width + size_t(x[l])];
+                    uint32_t current = pixel.load(memory_order_relaxed);
+                    while(bits < current && !pixel.compare_exchange_weak(current, bits, memory_order_relaxed)) {
+                    }
+                }
+            }
+        }
+    });
+    depth.resize(nearest.size());
+    parallel_for(height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t k = begin * width; k < end * width; k++) {
+            const uint32_t bits = nearest[k].load(memory_order_relaxed);
+            float distance2;
+            memcpy(&distance2, &bits, sizeof(distance2));
+            depth[k] = bits == none ? INFINITY : std::sqrt(std::max(distance2, 0.f));
+        }
+    });
+}
+
+void reprojection_start(const vector<float>& depth, unsigned int width, unsigned int height, float pixel_angle,
+                        const MarchParams& params, vector<float>& start) {
+    start.resize(size_t(width) * height);
+    const float margin = 1.f - params.reproject_margin * params.epsilon * pixel_angle;
+
+    // Nearest and farthest hits of the 3x3 neighbourhoods, the rows of 3
+    // first (0 stands for no hit in farthest), kept for the 3 rows around
+    // the current one by row modulo 3. The rows are read padded with
+    // INFINITY, which changes neither, and the image's first and last rows
+    // stand in for the ones beyond them.
+    const size_t stride = (width + SIMD_LANES - 1) / SIMD_LANES * SIMD_LANES;
+    parallel_for(height, 16, [&](size_t begin, size_t end, unsigned int) {
+        vector<float> padded(stride + 2, INFINITY), row_nearest(3 * stride), row_farthest(3 * stride);
+        const vfloat zero = vbroadcast(0.f);
+        auto rows_of_3 = [&](size_t y) {
+            std::copy(depth.begin() + y * width, depth.begin() + (y + 1) * width, padded.begin() + 1);
+            float* nearest = &row_nearest[(y % 3) * stride];
+            float* farthest = &row_farthest[(y % 3) * stride];
+            for(size_t i = 0; i < stride; i += SIMD_LANES) {
+                const vfloat left = vload(&padded[i]), center = vload(&padded[i + 1]), right = vload(&padded[i + 2]);
+                vstore(nearest + i, vmin(vmin(left, center), right));
+                vstore(farthest + i, vmax(vmax(select(left < INFINITY, left, zero), select(center < INFINITY, center, zero)),
+                                          select(right < INFINITY, right, zero)));
+            }
+        };
+        if(begin > 0) {
+            rows_of_3(begin - 1);
+        }
+        rows_of_3(begin);
+        for(size_t j = begin; j < end; j++) {
+            if(j + 1 < height) {
+                rows_of_3(j + 1);
+            }
+            const size_t above = ((j ? j - 1 : j) % 3) * stride, row = (j % 3) * stride;
+            const size_t below = ((j + 1 < height ? j + 1 : j) % 3) * stride;
+            for(size_t i = 0; i < width; i += SIMD_LANES) {
+                const vfloat nearest = vmin(vmin(vload(&row_nearest[above + i]), vload(&row_nearest[row + i])),
+                                            vload(&row_nearest[below + i]));
+                const vfloat farthest = vmax(vmax(vload(&row_farthest[above + i]), vload(&row_farthest[row + i])),
+                                             vload(&row_farthest[below + i]));
+                const size_t count = std::min(size_t(SIMD_LANES), width - i);
+                vfloat own = vbroadcast(INFINITY);
+                for(size_t l = 0; l < count; l++) {
+                    own[l] = depth[j * width + i + l];
+                }
+                const vint disoccluded = (nearest == INFINITY) | (farthest - nearest > params.reproject_edge * nearest);
+                const vint smooth = (own < INFINITY) & (farthest - nearest <= params.reproject_smooth * nearest);
+                // The hit of the pixel may be up to half a pixel off its ray,
+                // its depth is moved back by the change of depth over half a
+                // pixel: a hit taken inside the surface would otherwise be
+                // reprojected again, a little deeper every frame
+                const vfloat value = margin * select(smooth, vmax(nearest, own - 0.25f * (farthest - nearest)), nearest);
+                const vfloat out = select(disoccluded, vbroadcast(-1.f), value);
+                for(size_t l = 0; l < count; l++) {
+                    start[j * width + i + l] = out[l];
+                }
+            }
+        }
+    });
+}
+
+void halton_jitter(unsigned int k, float jitter[2]) {
+    jitter[0] = k ? radical_inverse(k, 2) - 0.5f : 0.f;
+    jitter[1] = k ? radical_inverse(k, 3) - 0.5f : 0.f;
+}
+
+void shade_march(const MarchBuffer& buffer, const Light& light, Image& image,
+                 const vector<float>& lit, const vector<float>& ambient) {
+    image.resize(buffer.width, buffer.height);
+    float l[3];
+    light.direction(l);
+
+    parallel_for(buffer.height, 16, [&](size_t begin, size_t end, unsigned int) {
+        for(size_t j = begin; j < end; j++) {
+            const float y = (float(j) + 0.5f) / float(buffer.height);
+            for(size_t i = 0; i < buffer.width; i++) {
+                size_t idx = j * buffer.width + i;
+                uint8_t* rgb = &image.rgb[3 * idx];
+                if(std::isinf(buffer.depth[idx])) {
+                    for(unsigned int c = 0; c < 3; c++) {
+                        rgb[c] = uint8_t(255.f * (sky_top[c] + y * (sky_bottom[c] - sky_top[c])) + 0.5f);
+                    }
+                    continue;
+                }
+                const float* n = &buffer.normal[3 * idx];
+                float lambert = std::max(n[0] * l[0] + n[1] * l[1] + n[2] * l[2], 0.f);
+                if(!lit.empty()) {
+                    lambert *= lit[idx];
+                }
+                float intensity = std::min(light.ambient * (ambient.empty() ? 1.f : ambient[idx]) + light.diffuse * lambert, 1.f);
+                for(unsigned int c = 0; c < 3; c++) {
+                    rgb[c] = uint8_t(255.f * intensity * surface[c] + 0.5f);
+                }
+            }
+        }
+    });
+}
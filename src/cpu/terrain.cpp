@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cpu/parallel.hpp"
+#include "cpu/terrain.hpp"
+
+namespace {
+    // Maximum over the 2x2 texels of the previous level
+    void halve(const NoiseBuffer& level, NoiseBuffer& next) {
+        const unsigned int size = level.width / 2;
+        next.resize(size, size);
+        for(unsigned int j = 0; j < size; j++) {
+            for(unsigned int i = 0; i < size; i++) {
+                const unsigned int x0 = 2 * i, x1 = x0 + 1, y0 = 2 * j, y1 = y0 + 1;
+                next.value[j * size + i] = max(max(level.value[y0 * level.width + x0], level.value[y0 * level.width + x1]),
+                                               max(level.value[y1 * level.width + x0], level.value[y1 * level.width + x1]));
+            }
+        }
+    }
+}
+
+void build_height_pyramid(const TerrainParams& params, HeightPyramid& pyramid) {
+    const unsigned int period = params.period;
+    const unsigned int octave = params.pyramid_octave;
+
+    // Highest corner of each lattice cell, the same in every octave, and
+    // the highest over blocks of 2^l x 2^l cells
+    NoiseBuffer corners;
+    corners.resize(period, period);
+    const vfloat lanes = vlane_index();
+    for(unsigned int j = 0; j < period; j++) {
+        for(unsigned int i = 0; i < period; i += SIMD_LANES) {
+            const vfloat value = hash_rand(float(i) + lanes, vbroadcast(float(j)));
+            for(unsigned int l = 0; l < SIMD_LANES && i + l < period; l++) {
+                corners.value[j * period + i + l] = value[l];
+            }
+        }
+    }
+    vector<NoiseBuffer> cells(1);
+    cells[0].resize(period, period);
+    for(unsigned int j = 0; j < period; j++) {
+        for(unsigned int i = 0; i < period; i++) {
+            const unsigned int i1 = (i + 1) % period, j1 = (j + 1) % period;
+            cells[0].value[j * period + i] = max(max(corners.value[j * period + i], corners.value[j * period + i1]),
+                                                 max(corners.value[j1 * period + i], corners.value[j1 * period + i1]));
+        }
+    }
+    while(cells.back().width > 1) {
+        cells.emplace_back();
+        halve(cells[cells.size() - 2], cells.back());
+    }
+
+    // A texel lies in a single cell of the octaves up to pyramid_octave.
+    // Their noise is a bilinear blend of the corners of the cell in the
+    // smoothsteps of the coordinates, the highest over the texel is at one
+    // of its corners. The finer octaves take the highest corner of the
+    // block of 2^(i - pyramid_octave) cells the texel covers. The margin
+    // covers the roundings of the sums of fbm().
+    const unsigned int size = params.pyramid_size();
+    pyramid.levels.assign(1, NoiseBuffer());
+    NoiseBuffer& base = pyramid.levels[0];
+    base.resize(size, size);
+    parallel_for(size, 16, [&](size_t begin, size_t end, unsigned int) {
+        vector<float> below(size + SIMD_LANES + 1), above(below.size());
+        for(size_t j = begin; j < end; j++) {
+            float* bound = &base.value[j * size];
+            fill(bound, bound + size, 1e-4f);
+            float a = 1.f;
+            for(unsigned int k = 0; k < params.octaves; k++) {
+                if(k <= octave) {
+                    const float step = std::exp2(float(k) - float(octave));
+                    for(unsigned int i = 0; i <= size; i += SIMD_LANES) {
+                        const vfloat x = (float(i) + lanes) * step;
+                        const vfloat low = periodic_noise<NoiseBasis::HASH>(x, vbroadcast(float(j) * step), float(period));
+                        const vfloat high = periodic_noise<NoiseBasis::HASH>(x, vbroadcast(float(j + 1) * step), float(period));
+                        for(unsigned int l = 0; l < SIMD_LANES; l++) {
+                            below[i + l] = low[l];
+                            above[i + l] = high[l];
+                        }
+                    }
+                    for(unsigned int i = 0; i < size; i++) {
+                        bound[i] += a * max(max(below[i], below[i + 1]), max(above[i], above[i + 1]));
+                    }
+                } else {
+                    const NoiseBuffer& block = cells[min(k - octave, (unsigned int)cells.size() - 1)];
+                    const unsigned int mask = block.width - 1;
+                    for(unsigned int i = 0; i < size; i++) {
+                        bound[i] += a * block.value[((unsigned int)j & mask) * block.width + (i & mask)];
+                    }
+                }
+                a *= 0.5f;
+            }
+        }
+    });
+    while(pyramid.levels.back().width > 1) {
+        pyramid.levels.emplace_back();
+        halve(pyramid.levels[pyramid.levels.size() - 2], pyramid.levels.back());
+    }
+}
+
+float terrain_height(const TerrainParams& params, float x, float y) {
+    return params.height * fbm(vbroadcast(x), vbroadcast(y), params.noise())[0];
+}
@@ -0,0 +1,114 @@
+#include <iostream>
+
+#include "framebuffer.hpp"
+
+namespace {
+
+// Pixel transfer format and type matching an internal format
+void transfer_format(GLenum internal_format, GLenum& format, GLenum& type) {
+    switch(internal_format) {
+        case GL_R32F: format = GL_RED; type = GL_FLOAT; break;
+        case GL_RG32F: format = GL_RG; type = GL_FLOAT; break;
+        case GL_RGB32F: format = GL_RGB; type = GL_FLOAT; break;
+        case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; break;
+        case GL_R16F: format = GL_RED; type = GL_HALF_FLOAT; break;
+        case GL_RG16F: format = GL_RG; type = GL_HALF_FLOAT; break;
+        case GL_RGBA16F: format = GL_RGBA; type = GL_HALF_FLOAT; break;
+        default: format = GL_RGBA; type = GL_UNSIGNED_BYTE; break;
+    }
+}
+
+}
+
+FrameBuffer::FrameBuffer(unsigned int width, unsigned int height, const vector<GLenum>& formats) :
+    m_fbo(0), m_formats(formats), m_width(width), m_height(height) {
+    this->create();
+}
+
+FrameBuffer::~FrameBuffer() {
+    this->destroy();
+}
+
+void FrameBuffer::create() {
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+    m_textures.resize(m_formats.size());
+    glGenTextures(m_textures.size(), m_textures.data());
+
+    vector<GLenum> draw_buffers;
+    for(unsigned int i = 0; i < m_textures.size(); i++) {
+        GLenum format, type;
+        transfer_format(m_formats[i], format, type);
+
+        glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, m_formats[i], m_width, m_height, 0, format, type, NULL);
+        // Iteration results must not be interpolated
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_textures[i], 0);
+        draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDrawBuffers(draw_buffers.size(), draw_buffers.data());
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::FRAMEBUFFER::INCOMPLETE" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FrameBuffer::destroy() {
+    glDeleteTextures(m_textures.size(), m_textures.data());
+    glDeleteFramebuffers(1, &m_fbo);
+    m_textures.clear();
+    m_fbo = 0;
+}
+
+void FrameBuffer::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void FrameBuffer::unbind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FrameBuffer::blitTo(unsigned int width, unsigned int height) const {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GLenum filter = (m_width == width && m_height == height) ? GL_NEAREST : GL_LINEAR;
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, filter);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+}
+
+void FrameBuffer::resize(unsigned int width, unsigned int height) {
+    if(width == m_width && height == m_height) {
+        return;
+    }
+    this->destroy();
+    m_width = width;
+    m_height = height;
+    this->create();
+}
+
+GLuint FrameBuffer::getTexture(unsigned int attachment) const {
+    return m_textures[attachment];
+}
+
+GLuint FrameBuffer::getFramebuffer() const {
+    return m_fbo;
+}
+
+unsigned int FrameBuffer::getWidth() const {
+    return m_width;
+}
+
+unsigned int FrameBuffer::getHeight() const {
+    return m_height;
+}
@@ -0,0 +1,71 @@
+#include "histogram_pass.hpp"
+
+HistogramPass::HistogramPass(unsigned int bins) : m_bins(bins), m_result(0) {
+    m_scatter = make_shared<Shader>("./shaders/vertex_histogram.glsl", "./shaders/frag_histogram.glsl");
+    m_merge = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_histogram_merge.glsl");
+    m_scan = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_prefix_sum.glsl");
+
+    m_private = make_unique<FrameBuffer>(m_bins, HISTOGRAM_COPIES, vector<GLenum>({GL_R32F}));
+    m_sums[0] = make_unique<FrameBuffer>(m_bins, 1, vector<GLenum>({GL_R32F}));
+    m_sums[1] = make_unique<FrameBuffer>(m_bins, 1, vector<GLenum>({GL_R32F}));
+
+    glGenVertexArrays(1, &m_vao);
+}
+
+HistogramPass::~HistogramPass() {
+    glDeleteVertexArrays(1, &m_vao);
+}
+
+void HistogramPass::update(const ScreenQuad& screen, GLuint iteration, unsigned int width, unsigned int height, int max_iter) {
+    glActiveTexture(GL_TEXTURE0);
+
+    // Scatter
+    m_private->bind();
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    m_scatter->bind();
+    glBindTexture(GL_TEXTURE_2D, iteration);
+    m_scatter->sendUniform1i("iteration", 0);
+    m_scatter->sendUniform1i("max_iter", max_iter);
+    m_scatter->sendUniform1i("bins", m_bins);
+    m_scatter->sendUniform1i("copies", HISTOGRAM_COPIES);
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_POINTS, 0, width * height);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+
+    // Merge the private copies
+    m_sums[0]->bind();
+    m_merge->bind();
+    glBindTexture(GL_TEXTURE_2D, m_private->getTexture(0));
+    m_merge->sendUniform1i("histograms", 0);
+    m_merge->sendUniform1i("copies", HISTOGRAM_COPIES);
+    screen.draw(m_merge);
+
+    // Prefix sum, ping-ponging between the two rows
+    m_result = 0;
+    m_scan->bind();
+    m_scan->sendUniform1i("counts", 0);
+    for(unsigned int stride = 1; stride < m_bins; stride *= 2) {
+        m_sums[1 - m_result]->bind();
+        glBindTexture(GL_TEXTURE_2D, m_sums[m_result]->getTexture(0));
+        m_scan->sendUniform1i("stride", stride);
+        screen.draw(m_scan);
+        m_result = 1 - m_result;
+    }
+
+    m_sums[m_result]->unbind();
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint HistogramPass::getCdf() const {
+    return m_sums[m_result]->getTexture(0);
+}
+
+unsigned int HistogramPass::getBins() const {
+    return m_bins;
+}
@@ -1,6 +1,8 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <string>
@@ -9,8 +11,31 @@
 
 #include "shader.hpp"
 #include "screen.hpp"
+#include "framebuffer.hpp"
+#include "gbuffer.hpp"
+#include "palette_texture.hpp"
+#include "histogram_pass.hpp"
+#include "raymarch_pass.hpp"
 #include "settings.hpp"
 #include "stb_image.h"
+#include "trap_texture.hpp"
+#include "terrain_pass.hpp"
+#include "texture_baker.hpp"
+#include "warp_pass.hpp"
+
+#include <dirent.h>
+
+#include "cpu/coloring.hpp"
+#include "cpu/formula_program.hpp"
+#include "cpu/hybrid.hpp"
+#include "cpu/lighting.hpp"
+#include "cpu/lyapunov.hpp"
+#include "cpu/kifs.hpp"
+#include "cpu/mandelbox.hpp"
+#include "cpu/mandelbulb.hpp"
+#include "cpu/quaternion_julia.hpp"
+#include "cpu/newton.hpp"
+#include "cpu/palette.hpp"
 
 using namespace std;
 
@@ -23,11 +48,32 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+// Images of a directory that stb_image decodes, sorted by name
+vector<string> list_images(const string& directory) {
+    vector<string> images;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        return images;
+    }
+    const vector<string> extensions = {".jpg", ".jpeg", ".png", ".bmp", ".tga"};
+    while (struct dirent* entry = readdir(dir)) {
+        string name = entry->d_name;
+        size_t dot = name.find_last_of('.');
+        if (dot != string::npos && std::find(extensions.begin(), extensions.end(), name.substr(dot)) != extensions.end()) {
+            images.push_back(directory + name);
+        }
+    }
+    closedir(dir);
+    std::sort(images.begin(), images.end());
+    return images;
+}
 
 
 class App {
     public:
-        App(const std::string& name) : m_closed(false) {
+        // custom_formula, when not empty, is compiled and added to the formulas.
+        // newton_polynomial holds the coefficients of the Newton fractal.
+        App(const std::string& name, const std::string& custom_formula = "", const std::string& newton_polynomial = "") : m_closed(false) {
             // glfw: initialize and configure
             // ------------------------------
             glfwInit();
@@ -76,15 +122,90 @@ class App {
             stbi_set_flip_vertically_on_load(true);
 
             // Loading shaders
-            shared_ptr<Shader> fractals_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_fractals.glsl");
-            m_shaders.insert(pair<string, shared_ptr<Shader>>("fractals", fractals_shader));
+            // 2x Mandelbrot then 1x Burning Ship
+            vector<FormulaId> hybrid({FORMULA_MANDELBROT, FORMULA_MANDELBROT, FORMULA_BURNING_SHIP});
+            m_formulas.push_back(pair<string, vector<string>>("hybrid", hybrid_glsl_defines(hybrid)));
+
+            FormulaProgram program;
+            if (!custom_formula.empty() && program.compile(custom_formula)) {
+                m_formulas.push_back(pair<string, vector<string>>("custom", program.glsl_defines()));
+            }
+
+            // One variant of the fractals shader per formula, and one more
+            // per formula for its Julia sets ("<formula>_julia")
+            for (const pair<string, vector<string>>& formula : m_formulas) {
+                shared_ptr<Shader> formula_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_fractals.glsl", formula.second);
+                m_shaders.insert(pair<string, shared_ptr<Shader>>(formula.first, formula_shader));
+
+                vector<string> julia_defines = formula.second;
+                julia_defines.push_back("JULIA");
+                shared_ptr<Shader> julia_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_fractals.glsl", julia_defines);
+                m_shaders.insert(pair<string, shared_ptr<Shader>>(formula.first + "_julia", julia_shader));
+            }
+            // Newton fractal, z^3 - 1 unless another polynomial is given
+            NewtonPolynomial newton;
+            if (!newton_polynomial.empty()) {
+                newton.parse(newton_polynomial);
+            }
+            shared_ptr<Shader> newton_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_fractals.glsl", newton.glsl_defines());
+            m_shaders.insert(pair<string, shared_ptr<Shader>>("newton", newton_shader));
+            // Lyapunov fractal of the sequence AB
+            LyapunovSequence lyapunov;
+            shared_ptr<Shader> lyapunov_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_fractals.glsl", lyapunov.glsl_defines(LyapunovParams()));
+            m_shaders.insert(pair<string, shared_ptr<Shader>>("lyapunov", lyapunov_shader));
+
+            shared_ptr<Shader> coloring_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_coloring.glsl");
+            m_shaders.insert(pair<string, shared_ptr<Shader>>("coloring", coloring_shader));
+            shared_ptr<Shader> lighting_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_lighting.glsl");
+            m_shaders.insert(pair<string, shared_ptr<Shader>>("lighting", lighting_shader));
 
             m_screen = make_unique<ScreenQuad>();
+
+            // The fractals shader writes its results in the G-buffer, the
+            // coloring pass then maps them through the palette texture
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            m_gbuffer = make_unique<FrameBuffer>(width, height, gbuffer_formats());
+            m_colors = make_unique<FrameBuffer>(width, height, vector<GLenum>({GL_RGBA8}));
+            m_palette_texture = make_unique<PaletteTexture>(m_palette, PALETTE_LUT_SIZE);
+            m_histogram = make_unique<HistogramPass>(1024);
+
+            // Distance-estimated 3D scenes
+            m_raymarch = make_unique<RaymarchPass>();
+            m_raymarch->addScene("mandelbulb", Mandelbulb().glsl_defines());
+            m_raymarch->addScene("quaternion_julia", QuaternionJulia().glsl_defines());
+            m_raymarch->addScene("sierpinski", KaleidoscopicIFS::sierpinski().glsl_defines());
+            m_raymarch->addScene("menger", KaleidoscopicIFS::menger().glsl_defines());
+            m_raymarch->addScene("mandelbox", Mandelbox().glsl_defines());
+
+            // Domain warp on the procedural noise, and on tiles of 1, 4
+            // and 16 texels per lattice cell
+            m_noise.basis = NoiseBasis::HASH;
+            m_warp = make_unique<WarpPass>(m_noise, vector<unsigned int>({1, 4, 16}), WARP_TILE_PERIOD);
+
+            // fbm() heightfield
+            m_terrain = make_unique<TerrainPass>(TerrainParams());
+
+            // Orbit trap images, the first one starts decoding right away
+            m_trap_images = list_images("./images/");
+            m_trap_texture = make_unique<TrapTexture>();
+            if (!m_trap_images.empty()) {
+                m_trap_texture->request(m_trap_images[0]);
+            }
             std::cout << "Init terminated successfully" << std::endl;
         }
 
         ~App() {
             m_shaders.clear();
+            m_gbuffer.reset();
+            m_colors.reset();
+            m_palette_texture.reset();
+            m_histogram.reset();
+            m_raymarch.reset();
+            m_warp.reset();
+            m_terrain.reset();
+            m_trap_texture.reset();
+            m_screen.reset();
 
             glfwDestroyWindow(window);
             glfwTerminate();
@@ -99,6 +220,76 @@ class App {
             float pos_center_y = 0.f;
             float depl_val = 0.1f;
             float zoom = 1.f;
+            int max_iter = 100;
+
+            // View of the last iteration pass, it only runs again when the view changes
+            bool dirty = true;
+            float iterated_x = pos_center_x;
+            float iterated_y = pos_center_y;
+            float iterated_zoom = zoom;
+            bool edge_aa = false;
+            bool lighting = false;
+            bool histogram_dirty = true;
+
+            // Formula, an index in m_formulas, and whether its Julia set is
+            // shown. The Julia set is the one of the c at the center of the
+            // parameter plane view, which is restored when coming back, as
+            // from the Newton and Lyapunov fractals and the domain warp.
+            size_t formula = 0;
+            bool julia = false;
+            bool newton = false;
+            bool lyapunov = false;
+            bool warp = false;
+            float julia_c_x = 0.f;
+            float julia_c_y = 0.f;
+            float mandelbrot_x = 0.f;
+            float mandelbrot_y = 0.f;
+            float mandelbrot_zoom = 1.f;
+
+            // 3D scene drawn instead of the plane when not empty. The camera
+            // looks at the origin from camera_azimuth and camera_elevation,
+            // the scene is marched at half resolution while it moves. The
+            // Mandelbox is flown through instead, with fly_camera, and the
+            // terrain with terrain_camera, kept above the ground.
+            string scene;
+            float camera_distance = 3.f;
+            float camera_azimuth = 45.f;
+            float camera_elevation = 30.f;
+            Camera fly_camera;
+            fly_camera.eye[0] = 4.f;
+            Camera terrain_camera;
+            terrain_camera.eye[0] = 0.3f;
+            terrain_camera.eye[1] = 0.2f;
+            terrain_camera.eye[2] = terrain_height(m_terrain->getParams(), 0.3f, 0.2f) + 0.3f;
+            terrain_camera.yaw = 30.f;
+            terrain_camera.pitch = -8.f;
+            bool scene_dirty = false;
+            float scene_scale = 1.f;
+            // GPU time of a frame of the 3D scenes while the camera moves,
+            // 30 fps
+            const float raymarch_budget = 33.f;
+            Light scene_light = m_light;
+
+            // Domain warp kernel, and its noise: procedural (0) or one of
+            // the textures of m_warp. The plane view shows warp(10 p), as
+            // the fractals shader once did.
+            WarpKernel warp_kernel = WarpKernel::WARP_THIRD;
+            unsigned int warp_source = 1;
+            const float warp_scale = 10.f;
+            // The inner fields of the warps are computed once per
+            // warp_divisor x warp_divisor pixels, and upsampled
+            unsigned int warp_divisor = 1;
+            // Time slicing of the animation: the tiles redrawn each frame
+            // take at most warp_budget ms of GPU time, the others are
+            // interpolated. The budget leaves room for the composition
+            // within a 60 fps frame.
+            bool warp_sliced = false;
+            const float warp_budget = 12.f;
+
+            // Image orbit trap, on the square of side trap_size around the origin
+            bool trap = false;
+            size_t trap_image = 0;
+            const float trap_size = 1.f;
             while (!glfwWindowShouldClose(window)) {
                 prev_time = time;
                 time = glfwGetTime();
@@ -116,33 +307,463 @@ class App {
                     glfwSetWindowShouldClose(window, true);
                 }
 
-                if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-                    pos_center_y += dt*(depl_val/zoom);
+                // Arrows and W/S move the view, or the camera around the 3D
+                // scene. In the Mandelbox and over the terrain the arrows
+                // turn the camera and W/S move it forward and backward.
+                bool camera_moved = false;
+                if (scene == "mandelbox" || scene == "terrain") {
+                    Camera& camera = scene == "terrain" ? terrain_camera : fly_camera;
+                    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+                        camera.yaw += 5.f*dt;
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+                        camera.yaw -= 5.f*dt;
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+                        camera.pitch = std::min(camera.pitch + 5.f*dt, 89.f);
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+                        camera.pitch = std::max(camera.pitch - 5.f*dt, -89.f);
+                        camera_moved = true;
+                    }
+                    const float speed = scene == "terrain" ? 0.1f*dt : 0.02f*dt;
+                    const float step = (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS ? speed : 0.f)
+                                     - (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS ? speed : 0.f);
+                    if (step != 0.f) {
+                        float right[3], up[3], forward[3];
+                        camera.rays(1, 1, right, up, forward);
+                        for (int k = 0; k < 3; k++) {
+                            camera.eye[k] += step*forward[k];
+                        }
+                        if (scene == "terrain") {
+                            const float ground = terrain_height(m_terrain->getParams(), camera.eye[0], camera.eye[1]);
+                            camera.eye[2] = std::max(camera.eye[2], ground + 0.05f);
+                        }
+                        camera_moved = true;
+                    }
+                } else if (!scene.empty()) {
+                    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+                        camera_azimuth -= 5.f*dt;
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+                        camera_azimuth += 5.f*dt;
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+                        camera_elevation = std::min(camera_elevation + 5.f*dt, 89.f);
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+                        camera_elevation = std::max(camera_elevation - 5.f*dt, -89.f);
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+                        camera_distance = std::max(camera_distance/(1.f + 0.05f*dt), 1.3f);
+                        camera_moved = true;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+                        camera_distance = std::min(camera_distance*(1.f + 0.05f*dt), 10.f);
+                        camera_moved = true;
+                    }
+                } else {
+                    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+                        pos_center_y += dt*(depl_val/zoom);
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+                        pos_center_y -= dt*(depl_val/zoom);
+                    }
+
+                    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+                        pos_center_x += dt*(depl_val/zoom);
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+                        pos_center_x -= dt*(depl_val/zoom);
+                    }
+
+                    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+                        zoom += 1.f;
+                    }
+                    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+                        zoom -= 1.f;
+
+                        zoom = std::max(1.f, zoom);
+                    }
+                }
+
+                // Formula (F), parameter plane (1), Julia set of its center (2),
+                // Newton fractal (3), Lyapunov fractal (4), Mandelbulb (5),
+                // quaternion Julia set (6), Sierpinski tetrahedron (7), Menger
+                // sponge (8), Mandelbox (9), domain warp (0) or fbm terrain (E)
+                if (key_toggled(GLFW_KEY_F)) {
+                    formula = (formula + 1) % m_formulas.size();
+                    dirty = true;
+                }
+                if (key_toggled(GLFW_KEY_1) && (julia || newton || lyapunov || warp || !scene.empty())) {
+                    julia = false;
+                    newton = false;
+                    lyapunov = false;
+                    warp = false;
+                    scene.clear();
+                    pos_center_x = mandelbrot_x;
+                    pos_center_y = mandelbrot_y;
+                    zoom = mandelbrot_zoom;
+                    dirty = true;
+                }
+                if (key_toggled(GLFW_KEY_2) && !julia && !newton && !lyapunov && !warp && scene.empty()) {
+                    julia = true;
+                    julia_c_x = mandelbrot_x = pos_center_x;
+                    julia_c_y = mandelbrot_y = pos_center_y;
+                    mandelbrot_zoom = zoom;
+                    pos_center_x = 0.f;
+                    pos_center_y = 0.f;
+                    zoom = 1.f;
+                    dirty = true;
+                }
+                if (key_toggled(GLFW_KEY_3) && !newton) {
+                    if (!julia && !lyapunov && !warp) {
+                        mandelbrot_x = pos_center_x;
+                        mandelbrot_y = pos_center_y;
+                        mandelbrot_zoom = zoom;
+                    }
+                    julia = false;
+                    lyapunov = false;
+                    warp = false;
+                    scene.clear();
+                    newton = true;
+                    pos_center_x = 0.f;
+                    pos_center_y = 0.f;
+                    zoom = 1.f;
+                    dirty = true;
+                }
+                // The Lyapunov fractal starts on (a, b) in [2, 4]^2
+                if (key_toggled(GLFW_KEY_4) && !lyapunov) {
+                    if (!julia && !newton && !warp) {
+                        mandelbrot_x = pos_center_x;
+                        mandelbrot_y = pos_center_y;
+                        mandelbrot_zoom = zoom;
+                    }
+                    julia = false;
+                    newton = false;
+                    warp = false;
+                    scene.clear();
+                    lyapunov = true;
+                    pos_center_x = 3.f;
+                    pos_center_y = 3.f;
+                    zoom = 1.f;
+                    dirty = true;
+                }
+                // The 3D scenes leave the plane view as it is
+                const pair<int, string> scene_keys[] = {
+                    {GLFW_KEY_5, "mandelbulb"}, {GLFW_KEY_6, "quaternion_julia"}, {GLFW_KEY_7, "sierpinski"}, {GLFW_KEY_8, "menger"},
+                    {GLFW_KEY_9, "mandelbox"}, {GLFW_KEY_E, "terrain"}
+                };
+                for (const auto& scene_key : scene_keys) {
+                    if (key_toggled(scene_key.first) && scene != scene_key.second) {
+                        if (!julia && !newton && !lyapunov && !warp && scene.empty()) {
+                            mandelbrot_x = pos_center_x;
+                            mandelbrot_y = pos_center_y;
+                            mandelbrot_zoom = zoom;
+                        }
+                        julia = false;
+                        newton = false;
+                        lyapunov = false;
+                        warp = false;
+                        scene = scene_key.second;
+                        scene_dirty = true;
+                    }
+                }
+                if (key_toggled(GLFW_KEY_0) && !warp) {
+                    if (!julia && !newton && !lyapunov && scene.empty()) {
+                        mandelbrot_x = pos_center_x;
+                        mandelbrot_y = pos_center_y;
+                        mandelbrot_zoom = zoom;
+                    }
+                    julia = false;
+                    newton = false;
+                    lyapunov = false;
+                    scene.clear();
+                    warp = true;
+                    pos_center_x = 0.f;
+                    pos_center_y = 0.f;
+                    zoom = 1.f;
+                }
+                // Domain warp kernel (G), procedural or baked noise (V),
+                // resolution of the inner fields (X), time slicing (Z)
+                if (key_toggled(GLFW_KEY_G)) {
+                    warp_kernel = warp_kernel == WarpKernel::FBM ? WarpKernel::WARP_SECOND
+                                : warp_kernel == WarpKernel::WARP_SECOND ? WarpKernel::WARP_THIRD : WarpKernel::FBM;
+                }
+                if (key_toggled(GLFW_KEY_V)) {
+                    warp_source = (warp_source + 1) % m_warp->getSources();
+                    std::cout << "Noise: " << m_warp->getSourceName(warp_source) << std::endl;
+                }
+                if (key_toggled(GLFW_KEY_X)) {
+                    warp_divisor = warp_divisor == 8 ? 1 : 2*warp_divisor;
+                    std::cout << "Warp fields: 1/" << warp_divisor << " of the resolution" << std::endl;
+                }
+                if (key_toggled(GLFW_KEY_Z)) {
+                    warp_sliced = !warp_sliced;
+                    std::cout << "Warp time slicing: " << (warp_sliced ? "on" : "off") << std::endl;
+                }
+
+                // Orbit trap coloring (T) and next trap image (Y). The image
+                // is loaded in the background, the previous one stays until
+                // the new one is uploaded.
+                if (key_toggled(GLFW_KEY_T)) {
+                    trap = !trap;
+                    dirty = true;
+                }
+                if (key_toggled(GLFW_KEY_Y) && !m_trap_images.empty()) {
+                    trap_image = (trap_image + 1) % m_trap_images.size();
+                    m_trap_texture->request(m_trap_images[trap_image]);
+                }
+                if (m_trap_texture->update() && trap) {
+                    dirty = true;
+                }
+
+                // Palette animation: offset (O/P), density (N/M), cyclic toggle (C)
+                if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+                    m_mapping.offset -= 0.05f*dt;
+                }
+                if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+                    m_mapping.offset += 0.05f*dt;
+                }
+                if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) {
+                    m_mapping.density /= 1.f + 0.1f*dt;
+                }
+                if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+                    m_mapping.density *= 1.f + 0.1f*dt;
+                }
+                if (key_toggled(GLFW_KEY_C)) {
+                    m_mapping.cyclic = !m_mapping.cyclic;
                 }
-                if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-                    pos_center_y -= dt*(depl_val/zoom);
+                // Histogram equalized palette (H)
+                if (key_toggled(GLFW_KEY_H)) {
+                    m_mapping.equalize = !m_mapping.equalize;
+                }
+                // Distance estimate boundary antialiasing (B)
+                if (key_toggled(GLFW_KEY_B)) {
+                    edge_aa = !edge_aa;
                 }
 
-                if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-                    pos_center_x += dt*(depl_val/zoom);
+                // Slope lighting (L), light azimuth (J/K) and elevation (U/I).
+                // Moving the light only runs the lighting pass again.
+                if (key_toggled(GLFW_KEY_L)) {
+                    lighting = !lighting;
+                }
+                if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
+                    m_light.azimuth -= 10.f*dt;
+                }
+                if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+                    m_light.azimuth += 10.f*dt;
                 }
-                if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-                    pos_center_x -= dt*(depl_val/zoom);
+                if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
+                    m_light.elevation = std::max(m_light.elevation - 5.f*dt, 0.f);
+                }
+                if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
+                    m_light.elevation = std::min(m_light.elevation + 5.f*dt, 90.f);
                 }
 
-                if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-                    zoom += 1.f;
+                int width, height;
+                glfwGetFramebufferSize(window, &width, &height);
+                if (width != (int)m_gbuffer->getWidth() || height != (int)m_gbuffer->getHeight()) {
+                    m_gbuffer->resize(width, height);
+                    m_colors->resize(width, height);
+                    dirty = true;
+                }
+                if (pos_center_x != iterated_x || pos_center_y != iterated_y || zoom != iterated_zoom) {
+                    dirty = true;
                 }
-                if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-                    zoom -= 1.f;
 
-                    zoom = std::max(1.f, zoom);
+                // Terrain, marched again at half resolution while the camera
+                // or the light moves and at full resolution once they stop
+                if (scene == "terrain") {
+                    const bool light_moved = m_light.azimuth != scene_light.azimuth || m_light.elevation != scene_light.elevation;
+                    scene_light = m_light;
+                    if (camera_moved || light_moved) {
+                        scene_scale = 0.5f;
+                        scene_dirty = true;
+                    } else if (scene_scale < 1.f) {
+                        scene_scale = 1.f;
+                        scene_dirty = true;
+                    }
+                    if (scene_dirty) {
+                        m_terrain->render(*m_screen, terrain_camera, m_light, width, height, scene_scale);
+                        scene_dirty = false;
+                    }
+                    m_terrain->display(width, height);
+
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                    continue;
+                }
+
+                // 3D scene, marched again at a lower resolution while the
+                // camera or the light moves, the one whose frames fit in
+                // raymarch_budget ms, and at full resolution once they stop.
+                // The shadow map is only rendered again when the light moves,
+                // and the occlusion volume takes more directions while both
+                // are still. Each frame starts its rays from the hits of the
+                // previous one but the first full resolution one, then the
+                // still camera averages m_march.samples jittered frames.
+                if (!scene.empty()) {
+                    bool light_moved = false;
+                    if (m_light.azimuth != scene_light.azimuth || m_light.elevation != scene_light.elevation) {
+                        scene_light = m_light;
+                        light_moved = true;
+                    }
+                    if (!camera_moved && !light_moved && !scene_dirty && m_raymarch->refineOcclusion(*m_screen, m_occlusion)) {
+                        scene_dirty = true;
+                    }
+                    bool reproject = true;
+                    bool sample = false;
+                    if (camera_moved || light_moved) {
+                        scene_scale = m_raymarch->interactiveScale(width, height, raymarch_budget);
+                        scene_dirty = true;
+                    } else if (scene_scale < 1.f) {
+                        scene_scale = 1.f;
+                        scene_dirty = true;
+                        reproject = false;
+                    } else if (!scene_dirty && m_raymarch->getSamples() < m_march.samples) {
+                        scene_dirty = true;
+                        sample = true;
+                    }
+                    if (scene_dirty) {
+                        Camera camera = fly_camera;
+                        if (scene != "mandelbox") {
+                            const float origin[3] = {0.f, 0.f, 0.f};
+                            camera.orbit(origin, camera_distance, camera_azimuth, camera_elevation);
+                        }
+                        halton_jitter(sample ? m_raymarch->getSamples() : 0, camera.jitter);
+                        m_raymarch->render(*m_screen, scene, camera, m_march, m_occlusion, m_light, width, height, scene_scale,
+                                           reproject, sample);
+                        scene_dirty = false;
+                    }
+                    m_raymarch->display(width, height);
+
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                    continue;
+                }
+
+                // Domain warp, drawn again every frame as time slides the
+                // inner fields of warp_second()
+                if (warp) {
+                    if (warp_sliced) {
+                        m_warp->renderSliced(*m_screen, warp_kernel, warp_source, time, warp_scale*pos_center_x,
+                                             warp_scale*pos_center_y, zoom/warp_scale, width, height, warp_budget,
+                                             warp_divisor);
+                    } else {
+                        m_warp->render(*m_screen, warp_kernel, warp_source, time, warp_scale*pos_center_x, warp_scale*pos_center_y,
+                                       zoom/warp_scale, width, height, warp_divisor);
+                    }
+                    m_warp->display(width, height);
+
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                    continue;
                 }
 
                 // draw
                 // ------
-                // Update the viewers
-                m_screen->draw(m_shaders["fractals"], time, pos_center_x, pos_center_y, zoom);
+                // Iteration pass
+                if (dirty) {
+                    m_gbuffer->bind();
+                    shared_ptr<Shader> iterate = newton ? m_shaders["newton"] : lyapunov ? m_shaders["lyapunov"] : m_shaders[m_formulas[formula].first + (julia ? "_julia" : "")];
+                    iterate->bind();
+                    iterate->sendUniform1i("max_iter", max_iter);
+                    iterate->sendUniform2f("julia_c", julia_c_x, julia_c_y);
+                    m_trap_texture->bind(0);
+                    iterate->sendUniform1i("trap", trap && m_trap_texture->isReady());
+                    iterate->sendUniform1i("trap_image", 0);
+                    iterate->sendUniform2f("trap_center", 0.f, 0.f);
+                    iterate->sendUniform1f("trap_size", trap_size);
+                    iterate->sendUniform1f("pixel_size", 2.f/(zoom*width));
+                    m_screen->draw(iterate, time, pos_center_x, pos_center_y, zoom);
+                    m_gbuffer->unbind();
+                    glViewport(0, 0, width, height);
+
+                    iterated_x = pos_center_x;
+                    iterated_y = pos_center_y;
+                    iterated_zoom = zoom;
+                    dirty = false;
+                    histogram_dirty = true;
+                }
+                if (m_mapping.equalize && histogram_dirty) {
+                    m_histogram->update(*m_screen, m_gbuffer->getTexture(GBUFFER_ITERATION), width, height, max_iter);
+                    glViewport(0, 0, width, height);
+                    histogram_dirty = false;
+                }
+
+                // Coloring pass, written offscreen when it is lit afterwards
+                if (lighting) {
+                    m_colors->bind();
+                }
+                shared_ptr<Shader> coloring = m_shaders["coloring"];
+                coloring->bind();
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_ITERATION));
+                m_palette_texture->bind(1);
+                glActiveTexture(GL_TEXTURE2);
+                glBindTexture(GL_TEXTURE_2D, m_histogram->getCdf());
+                glActiveTexture(GL_TEXTURE3);
+                glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_DISTANCE));
+                coloring->sendUniform1i("iteration", 0);
+                coloring->sendUniform1i("palette", 1);
+                coloring->sendUniform1i("cdf", 2);
+                glActiveTexture(GL_TEXTURE4);
+                glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_COLOR));
+                coloring->sendUniform1i("distance_estimate", 3);
+                coloring->sendUniform1i("direct_color", 4);
+                coloring->sendUniform1i("direct", newton || lyapunov || (trap && m_trap_texture->isReady()));
+                coloring->sendUniform1i("edge_aa", edge_aa);
+                coloring->sendUniform1f("pixel_size", 2.f/(zoom*width));
+                coloring->sendUniform1i("bins", m_histogram->getBins());
+                coloring->sendUniform1i("equalize", m_mapping.equalize);
+                coloring->sendUniform1i("palette_size", m_palette_texture->getSize());
+                coloring->sendUniform1i("max_iter", max_iter);
+                coloring->sendUniform1f("density", m_mapping.density);
+                coloring->sendUniform1f("offset", m_mapping.offset);
+                coloring->sendUniform1i("cyclic", m_mapping.cyclic);
+                const float* interior = m_palette.interior();
+                coloring->sendUniform3f("interior", interior[0], interior[1], interior[2]);
+                m_screen->draw(coloring);
+
+                // Lighting pass
+                if (lighting) {
+                    m_colors->unbind();
+                    glViewport(0, 0, width, height);
+
+                    shared_ptr<Shader> shading = m_shaders["lighting"];
+                    shading->bind();
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, m_colors->getTexture(0));
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_ITERATION));
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_Z));
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, m_gbuffer->getTexture(GBUFFER_DERIVATIVE));
+                    shading->sendUniform1i("colors", 0);
+                    shading->sendUniform1i("iteration", 1);
+                    shading->sendUniform1i("final_z", 2);
+                    shading->sendUniform1i("derivative", 3);
+                    shading->sendUniform1i("max_iter", max_iter);
+
+                    float light[3];
+                    m_light.direction(light);
+                    shading->sendUniform3f("light", light[0], light[1], light[2]);
+                    shading->sendUniform1f("height", m_light.height);
+                    shading->sendUniform1f("ambient", m_light.ambient);
+                    shading->sendUniform1f("diffuse", m_light.diffuse);
+                    shading->sendUniform1f("specular", m_light.specular);
+                    shading->sendUniform1f("shininess", m_light.shininess);
+                    m_screen->draw(shading);
+                }
 
                 // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
                 // -------------------------------------------------------------------------------
@@ -151,19 +772,123 @@ class App {
             }
         }
 
+    private:
+        // true on the frame where the key goes down
+        bool key_toggled(int key) {
+            bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+            bool toggled = pressed && !m_keys[key];
+            m_keys[key] = pressed;
+            return toggled;
+        }
+
     private:
         bool m_closed;
         GLFWwindow* window;
         const GLFWvidmode* m_mode;
 
         map<string, shared_ptr<Shader>> m_shaders;
+        // Name and defines of the formula variants of frag_fractals.glsl
+        vector<pair<string, vector<string>>> m_formulas = {
+            {"mandelbrot", {}},
+            {"multibrot3", {"DEGREE 3"}},
+            {"multibrot4", {"DEGREE 4"}},
+            {"burning_ship", {"BURNING_SHIP"}},
+            {"tricorn", {"TRICORN"}}
+        };
 
         unique_ptr<ScreenQuad> m_screen;
+
+        map<int, bool> m_keys;
+
+        unique_ptr<FrameBuffer> m_gbuffer;
+        // Output of the coloring pass when lighting is enabled
+        unique_ptr<FrameBuffer> m_colors;
+        Light m_light;
+        Palette m_palette;
+        ColorMapping m_mapping;
+        unique_ptr<PaletteTexture> m_palette_texture;
+        unique_ptr<HistogramPass> m_histogram;
+        unique_ptr<RaymarchPass> m_raymarch;
+        MarchParams m_march;
+        // Lattice hash of the domain warp noise
+        NoiseParams m_noise;
+        unique_ptr<WarpPass> m_warp;
+        unique_ptr<TerrainPass> m_terrain;
+        OcclusionParams m_occlusion;
+        vector<string> m_trap_images;
+        unique_ptr<TrapTexture> m_trap_texture;
 };
 
-int main(void)
+// Bakes the textures of a job file, one job per line in the options of
+// parse_bake_job(), lines starting with # left out. The context comes from
+// a hidden window, nothing is shown. Returns the number of jobs that failed.
+int bake_textures(const std::string& filename)
+{
+    ifstream jobs(filename);
+    if(!jobs.is_open()) {
+        std::cout << "ERROR::BAKE::CANNOT_OPEN " << filename << std::endl;
+        return 1;
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "Fractals bake", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    int failed = 0, baked = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        ScreenQuad screen;
+        TextureBaker baker;
+        std::string line;
+        while(std::getline(jobs, line)) {
+            const size_t first = line.find_first_not_of(" \t");
+            if(first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            BakeJob job;
+            if(parse_bake_job(line, job) && baker.bake(screen, job)) {
+                baked++;
+            } else {
+                failed++;
+            }
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Baked " << baked << " textures in " << ms << " ms, " << failed << " failed" << std::endl;
+
+    glfwTerminate();
+    return failed;
+}
+
+// The first argument, if any, is a custom formula such as "fold(z)^2 + c",
+// the second one the coefficients of the Newton fractal such as "1 0 0 -1".
+// "-bake jobs.txt" bakes the textures of the file instead (bake_textures()).
+int main(int argc, char** argv)
 {	
-    App app("Fractals");
+    if (argc > 2 && std::string(argv[1]) == "-bake")
+    {
+        return bake_textures(argv[2]) == 0 ? 0 : 1;
+    }
+    App app("Fractals", argc > 1 ? argv[1] : "", argc > 2 ? argv[2] : "");
     app.run();
 	
     return 0;
@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "noise_texture.hpp"
+
+namespace {
+
+// Header of the cached tiles, followed by their size x size float texels
+struct CacheHeader {
+    char magic[4];
+    uint32_t basis;
+    uint32_t period;
+    uint32_t texels_per_cell;
+};
+
+const char CACHE_MAGIC[4] = {'N', 'O', 'I', 'Z'};
+
+const char* basis_name(NoiseBasis basis) {
+    switch(basis) {
+        case NoiseBasis::HASH:
+            return "hash";
+        case NoiseBasis::GRADIENT:
+            return "gradient";
+        default:
+            return "sin";
+    }
+}
+
+}
+
+NoiseTexture::NoiseTexture(const NoiseTile& tile) {
+    m_tile.basis = tile.basis;
+    m_tile.period = tile.period;
+    m_tile.texels_per_cell = tile.texels_per_cell;
+    if(m_tile.texels_per_cell == 1 && m_tile.basis == NoiseBasis::GRADIENT) {
+        std::cout << "ERROR::NOISE_TEXTURE::GRADIENT_LATTICE one texel per cell only holds value noise" << std::endl;
+        m_tile.texels_per_cell = 2;
+    }
+
+    const unsigned int size = m_tile.size();
+    m_tile.texels.resize(size, size);
+    if(!this->readCache(m_tile.texels.value)) {
+        auto start = std::chrono::steady_clock::now();
+        bake_noise_tile(m_tile);
+        this->writeCache(m_tile.texels.value);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Baked the " << size << "x" << size << " " << basis_name(m_tile.basis) << " noise tile in " << ms << " ms" << std::endl;
+    }
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, m_tile.texels.value.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The texels were only needed for the upload
+    m_tile.texels = NoiseBuffer();
+}
+
+NoiseTexture::~NoiseTexture() {
+    glDeleteTextures(1, &m_texture);
+}
+
+void NoiseTexture::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+}
+
+void NoiseTexture::sendUniforms(const shared_ptr<Shader>& shader, unsigned int unit) const {
+    this->bind(unit);
+    shader->sendUniform1i("noise_texture", unit);
+    shader->sendUniform1f("noise_size", float(m_tile.size()));
+    shader->sendUniform1f("noise_texels_per_cell", float(m_tile.texels_per_cell));
+}
+
+vector<string> NoiseTexture::glsl_defines() const {
+    NoiseParams params;
+    params.basis = m_tile.basis;
+    params.tile = &m_tile;
+    return noise_defines(params);
+}
+
+const NoiseTile& NoiseTexture::getTile() const {
+    return m_tile;
+}
+
+string NoiseTexture::cacheFilename() const {
+    return NOISE_CACHE_DIRECTORY + "noise_" + basis_name(m_tile.basis) + "_" + to_string(m_tile.period) + "_" +
+           to_string(m_tile.texels_per_cell) + ".r32f";
+}
+
+bool NoiseTexture::readCache(vector<float>& texels) const {
+    FILE* file = fopen(this->cacheFilename().c_str(), "rb");
+    if(!file) {
+        return false;
+    }
+    CacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                 header.basis == uint32_t(m_tile.basis) && header.period == m_tile.period &&
+                 header.texels_per_cell == m_tile.texels_per_cell &&
+                 fread(texels.data(), sizeof(float), texels.size(), file) == texels.size();
+    fclose(file);
+    return valid;
+}
+
+void NoiseTexture::writeCache(const vector<float>& texels) const {
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.basis = uint32_t(m_tile.basis);
+    header.period = m_tile.period;
+    header.texels_per_cell = m_tile.texels_per_cell;
+
+    // Written aside and renamed, another run never reads half a file
+    mkdir(NOISE_CACHE_DIRECTORY.c_str(), 0755);
+    string cached = this->cacheFilename();
+    string temporary = cached + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if(!file) {
+        std::cout << "ERROR::NOISE_TEXTURE::CACHE_NOT_WRITTEN " << cached << std::endl;
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(texels.data(), sizeof(float), texels.size(), file) == texels.size();
+    written = fclose(file) == 0 && written;
+    if(!written || rename(temporary.c_str(), cached.c_str()) != 0) {
+        std::cout << "ERROR::NOISE_TEXTURE::CACHE_NOT_WRITTEN " << cached << std::endl;
+        remove(temporary.c_str());
+    }
+}
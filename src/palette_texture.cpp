@@ -0,0 +1,37 @@
+#include <vector>
+
+#include "palette_texture.hpp"
+
+PaletteTexture::PaletteTexture(const Palette& palette, unsigned int size) : m_size(size) {
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_1D, m_texture);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, m_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    this->update(palette);
+}
+
+PaletteTexture::~PaletteTexture() {
+    glDeleteTextures(1, &m_texture);
+}
+
+void PaletteTexture::update(const Palette& palette) {
+    // Packed as r | g << 8 | b << 16 | a << 24, i.e. RGBA bytes in memory
+    std::vector<uint32_t> lut = palette.lut(m_size);
+
+    glBindTexture(GL_TEXTURE_1D, m_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, m_size, GL_RGBA, GL_UNSIGNED_BYTE, lut.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void PaletteTexture::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_1D, m_texture);
+}
+
+unsigned int PaletteTexture::getSize() const {
+    return m_size;
+}
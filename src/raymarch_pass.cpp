@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "raymarch_pass.hpp"
+
+RaymarchPass::RaymarchPass() :
+    m_frame(0), m_samples(0),
+    m_shadow_light{0.f, 0.f, 0.f}, m_shadow_right{1.f, 0.f, 0.f}, m_shadow_up{0.f, 1.f, 0.f},
+    m_occlusion_size(0), m_occlusion_tiles(1), m_occlusion_directions(0),
+    m_pixel_ms(0.f), m_query_pending(false), m_query_pixels(0) {
+    for(unique_ptr<FrameBuffer>& frame : m_frames) {
+        frame = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_RGBA8, GL_R32F, GL_R32F}));
+    }
+    m_cone = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R32F, GL_R32F}));
+    m_shadow = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R32F}));
+    m_occlusion = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R32F}));
+
+    m_splat = make_shared<Shader>("./shaders/vertex_reproject.glsl", "./shaders/frag_temporal.glsl", vector<string>({"REPROJECT_SPLAT"}));
+    m_start = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_temporal.glsl", vector<string>({"REPROJECT_START"}));
+    m_accumulate = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_temporal.glsl");
+    m_reprojected = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R32F}));
+    m_reprojection = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R32F}));
+    m_accumulation = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_RGBA16F}));
+    glGenVertexArrays(1, &m_vao);
+    glGenQueries(1, &m_query);
+}
+
+RaymarchPass::~RaymarchPass() {
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteQueries(1, &m_query);
+}
+
+namespace {
+
+// Uniforms shared by the cone prepass and the full pass
+void send_march_uniforms(const shared_ptr<Shader>& shader, const Camera& camera, const MarchParams& params,
+                         unsigned int width, unsigned int height) {
+    float right[3], up[3], forward[3];
+    camera.rays(width, height, right, up, forward);
+
+    shader->sendUniform3f("camera_eye", camera.eye[0], camera.eye[1], camera.eye[2]);
+    shader->sendUniform3f("camera_right", right[0], right[1], right[2]);
+    shader->sendUniform3f("camera_up", up[0], up[1], up[2]);
+    shader->sendUniform3f("camera_forward", forward[0], forward[1], forward[2]);
+    shader->sendUniform2f("jitter", camera.jitter[0], camera.jitter[1]);
+    shader->sendUniform1f("pixel_angle", camera.pixel_angle(height));
+    shader->sendUniform1f("pixel_size", 0.f);
+    shader->sendUniform1i("max_steps", params.max_steps);
+    shader->sendUniform1f("max_distance", params.max_distance);
+    shader->sendUniform1f("relaxation", params.relaxation);
+    shader->sendUniform1f("epsilon", params.epsilon);
+    shader->sendUniform1i("cone_tile", params.cone_tile);
+    shader->sendUniform2f("resolution", float(width), float(height));
+}
+
+shared_ptr<Shader> scene_shader(const vector<string>& defines, const string& pass) {
+    vector<string> pass_defines(defines);
+    if(!pass.empty()) {
+        pass_defines.push_back(pass);
+    }
+    return make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_raymarch.glsl", pass_defines);
+}
+
+}
+
+void RaymarchPass::addScene(const string& name, const vector<string>& defines) {
+    SceneShaders& shaders = m_scenes[name];
+    shaders.march = scene_shader(defines, "");
+    shaders.cone = scene_shader(defines, "CONE_PREPASS");
+    shaders.shadow = scene_shader(defines, "SHADOW_PASS");
+    shaders.occlusion = scene_shader(defines, "OCCLUSION_PASS");
+
+    if(m_shadow_scene == name) {
+        m_shadow_scene.clear();
+    }
+    if(m_occlusion_scene == name) {
+        m_occlusion_scene.clear();
+    }
+    if(m_previous_scene == name) {
+        m_previous_scene.clear();
+    }
+}
+
+void RaymarchPass::render(const ScreenQuad& screen, const string& scene, const Camera& camera, const MarchParams& params,
+                          const OcclusionParams& occlusion, const Light& light, unsigned int width, unsigned int height, float scale,
+                          bool reproject, bool accumulate) {
+    auto found = m_scenes.find(scene);
+    if(found == m_scenes.end()) {
+        std::cout << "ERROR::RAYMARCH::UNKNOWN_SCENE " << scene << std::endl;
+        return;
+    }
+    const SceneShaders& shaders = found->second;
+    const unsigned int w = std::max(1u, (unsigned int)(scale * width));
+    const unsigned int h = std::max(1u, (unsigned int)(scale * height));
+
+    float l[3];
+    light.direction(l);
+
+    // Shadow map, only when the scene or the light changed
+    const bool light_moved = l[0] != m_shadow_light[0] || l[1] != m_shadow_light[1] || l[2] != m_shadow_light[2];
+    if(scene != m_shadow_scene || light_moved || m_shadow->getWidth() != occlusion.shadow_width ||
+       m_shadow->getHeight() != occlusion.shadow_height) {
+        ShadowMap::basis(l, m_shadow_right, m_shadow_up);
+        m_shadow->resize(occlusion.shadow_width, occlusion.shadow_height);
+        m_shadow->bind();
+        const shared_ptr<Shader>& shadow = shaders.shadow;
+        shadow->bind();
+        shadow->sendUniform1f("pixel_angle", 0.f);
+        shadow->sendUniform1f("pixel_size", 2.f / float(std::min(occlusion.shadow_width, occlusion.shadow_height)));
+        shadow->sendUniform1i("max_steps", params.max_steps);
+        shadow->sendUniform1f("relaxation", params.relaxation);
+        shadow->sendUniform1f("epsilon", params.epsilon);
+        shadow->sendUniform2f("resolution", float(occlusion.shadow_width), float(occlusion.shadow_height));
+        shadow->sendUniform3f("light", l[0], l[1], l[2]);
+        shadow->sendUniform3f("shadow_right", m_shadow_right[0], m_shadow_right[1], m_shadow_right[2]);
+        shadow->sendUniform3f("shadow_up", m_shadow_up[0], m_shadow_up[1], m_shadow_up[2]);
+        screen.draw(shadow);
+        m_shadow->unbind();
+        m_shadow_scene = scene;
+        std::copy(l, l + 3, m_shadow_light);
+    }
+
+    // Occlusion volume, started over for a new scene with its first
+    // directions
+    if(scene != m_occlusion_scene || m_occlusion_size != occlusion.volume_size) {
+        m_occlusion_size = occlusion.volume_size;
+        m_occlusion_tiles = (unsigned int)std::ceil(std::sqrt(float(m_occlusion_size)));
+        m_occlusion->resize(m_occlusion_size * m_occlusion_tiles,
+                            m_occlusion_size * ((m_occlusion_size + m_occlusion_tiles - 1) / m_occlusion_tiles));
+        m_occlusion_scene = scene;
+        m_occlusion_directions = 0;
+        this->refineOcclusion(screen, occlusion);
+    }
+
+    // GPU time of the last frame measured, once it is available
+    if(m_query_pending) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &ns);
+            const float ms = float(ns)/1e6f/float(m_query_pixels);
+            m_pixel_ms = m_pixel_ms > 0.f ? 0.5f*(m_pixel_ms + ms) : ms;
+            m_query_pending = false;
+        }
+    }
+    const bool query = !m_query_pending;
+    if(query) {
+        glBeginQuery(GL_TIME_ELAPSED, m_query);
+        m_query_pixels = w*h;
+    }
+
+    // Hits of the previous frame scattered into the pixels of this one, the
+    // nearest one kept, then the start depths
+    const bool reprojection = reproject && scene == m_previous_scene;
+    if(reprojection) {
+        const unique_ptr<FrameBuffer>& previous = m_frames[m_frame];
+        m_reprojected->resize(w, h);
+        m_reprojected->bind();
+        const float none[4] = {1e30f, 0.f, 0.f, 0.f};
+        glClearBufferfv(GL_COLOR, 0, none);
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_MIN);
+
+        float right[3], up[3], forward[3];
+        m_previous_camera.rays(previous->getWidth(), previous->getHeight(), right, up, forward);
+        m_splat->bind();
+        m_splat->sendUniform3f("previous_eye", m_previous_camera.eye[0], m_previous_camera.eye[1], m_previous_camera.eye[2]);
+        m_splat->sendUniform3f("previous_right", right[0], right[1], right[2]);
+        m_splat->sendUniform3f("previous_up", up[0], up[1], up[2]);
+        m_splat->sendUniform3f("previous_forward", forward[0], forward[1], forward[2]);
+        m_splat->sendUniform2f("previous_jitter", m_previous_camera.jitter[0], m_previous_camera.jitter[1]);
+        camera.rays(w, h, right, up, forward);
+        m_splat->sendUniform3f("camera_eye", camera.eye[0], camera.eye[1], camera.eye[2]);
+        m_splat->sendUniform3f("camera_right", right[0], right[1], right[2]);
+        m_splat->sendUniform3f("camera_up", up[0], up[1], up[2]);
+        m_splat->sendUniform3f("camera_forward", forward[0], forward[1], forward[2]);
+        m_splat->sendUniform2f("jitter", camera.jitter[0], camera.jitter[1]);
+        m_splat->sendUniform2f("resolution", float(w), float(h));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, previous->getTexture(RAYMARCH_DEPTH));
+        m_splat->sendUniform1i("previous_depth", 0);
+        glBindVertexArray(m_vao);
+        glDrawArrays(GL_POINTS, 0, previous->getWidth() * previous->getHeight());
+        glBindVertexArray(0);
+        glBlendEquation(GL_FUNC_ADD);
+        glDisable(GL_BLEND);
+
+        m_reprojection->resize(w, h);
+        m_reprojection->bind();
+        m_start->bind();
+        glBindTexture(GL_TEXTURE_2D, m_reprojected->getTexture(0));
+        m_start->sendUniform1i("reprojected", 0);
+        m_start->sendUniform1f("reproject_margin", params.reproject_margin);
+        m_start->sendUniform1f("reproject_smooth", params.reproject_smooth);
+        m_start->sendUniform1f("reproject_edge", params.reproject_edge);
+        m_start->sendUniform1f("epsilon", params.epsilon);
+        m_start->sendUniform1f("pixel_angle", camera.pixel_angle(h));
+        screen.draw(m_start);
+        m_reprojection->unbind();
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_reprojection->getTexture(0));
+    glActiveTexture(GL_TEXTURE0);
+
+    const unsigned int tile = params.cone_tile;
+    if(tile > 0) {
+        // One cone per tile, wide enough to contain the rays of its
+        // corners (half diagonal of the tile)
+        m_cone->resize((w + tile - 1) / tile, (h + tile - 1) / tile);
+        m_cone->bind();
+        const shared_ptr<Shader>& cone = shaders.cone;
+        cone->bind();
+        send_march_uniforms(cone, camera, params, w, h);
+        cone->sendUniform1f("cone_angle", 0.7072f * float(tile) * camera.pixel_angle(h));
+        cone->sendUniform1i("reprojection", reprojection);
+        cone->sendUniform1i("reprojection_start", 3);
+        screen.draw(cone);
+        m_cone->unbind();
+    }
+
+    m_frame = 1 - m_frame;
+    const unique_ptr<FrameBuffer>& target = m_frames[m_frame];
+    target->resize(w, h);
+    target->bind();
+
+    const shared_ptr<Shader>& march = shaders.march;
+    march->bind();
+    send_march_uniforms(march, camera, params, w, h);
+    march->sendUniform1i("reprojection", reprojection);
+    march->sendUniform1i("reprojection_start", 3);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_cone->getTexture(CONE_DEPTH));
+    march->sendUniform1i("cone_start", 0);
+    march->sendUniform3f("light", l[0], l[1], l[2]);
+    march->sendUniform1f("ambient", light.ambient);
+    march->sendUniform1f("diffuse", light.diffuse);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_shadow->getTexture(0));
+    march->sendUniform1i("shadow_map", 1);
+    march->sendUniform3f("shadow_right", m_shadow_right[0], m_shadow_right[1], m_shadow_right[2]);
+    march->sendUniform3f("shadow_up", m_shadow_up[0], m_shadow_up[1], m_shadow_up[2]);
+    march->sendUniform1f("shadow_bias", occlusion.shadow_bias);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_occlusion->getTexture(0));
+    march->sendUniform1i("occlusion", 2);
+    march->sendUniform1i("occlusion_size", m_occlusion_size);
+    march->sendUniform1i("occlusion_tiles", m_occlusion_tiles);
+    march->sendUniform1i("occlusion_directions", m_occlusion_directions);
+    screen.draw(march);
+    glActiveTexture(GL_TEXTURE0);
+    target->unbind();
+    if(query) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_query_pending = true;
+    }
+    m_previous_scene = scene;
+    m_previous_camera = camera;
+
+    // Running mean of the frames, the first one replaces it
+    const bool mean = accumulate && m_samples > 0 && m_accumulation->getWidth() == w && m_accumulation->getHeight() == h;
+    m_samples = mean ? m_samples + 1 : 1;
+    m_accumulation->resize(w, h);
+    m_accumulation->bind();
+    if(mean) {
+        glEnable(GL_BLEND);
+        glBlendColor(0.f, 0.f, 0.f, 1.f / float(m_samples));
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    }
+    m_accumulate->bind();
+    glBindTexture(GL_TEXTURE_2D, target->getTexture(RAYMARCH_COLOR));
+    m_accumulate->sendUniform1i("frame", 0);
+    screen.draw(m_accumulate);
+    glDisable(GL_BLEND);
+    m_accumulation->unbind();
+}
+
+float RaymarchPass::interactiveScale(unsigned int width, unsigned int height, float budget_ms) const {
+    if(m_pixel_ms <= 0.f) {
+        return 0.5f;
+    }
+    // The time goes with the pixels, the square of the scale
+    const float scale = std::sqrt(budget_ms/(m_pixel_ms*float(width)*float(height)));
+    return std::min(std::max(std::floor(32.f*scale)/32.f, RAYMARCH_MIN_SCALE), 1.f);
+}
+
+bool RaymarchPass::refineOcclusion(const ScreenQuad& screen, const OcclusionParams& occlusion) {
+    auto found = m_scenes.find(m_occlusion_scene);
+    if(found == m_scenes.end() || m_occlusion_directions >= occlusion.max_directions) {
+        return false;
+    }
+    const unsigned int first = m_occlusion_directions;
+    const unsigned int count = std::min(occlusion.directions, occlusion.max_directions - first);
+
+    // Running mean over the directions, as accumulate_occlusion()
+    m_occlusion->bind();
+    glEnable(GL_BLEND);
+    glBlendColor(0.f, 0.f, 0.f, float(count) / float(first + count));
+    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    const shared_ptr<Shader>& shader = found->second.occlusion;
+    shader->bind();
+    shader->sendUniform1i("occlusion_size", m_occlusion_size);
+    shader->sendUniform1i("occlusion_tiles", m_occlusion_tiles);
+    shader->sendUniform1i("occlusion_first", first);
+    shader->sendUniform1i("occlusion_count", count);
+    shader->sendUniform1i("occlusion_total", occlusion.max_directions);
+    shader->sendUniform1i("occlusion_steps", occlusion.occlusion_steps);
+    shader->sendUniform1f("occlusion_radius", occlusion.radius);
+    screen.draw(shader);
+    glDisable(GL_BLEND);
+    m_occlusion->unbind();
+
+    m_occlusion_directions += count;
+    return true;
+}
+
+void RaymarchPass::display(unsigned int width, unsigned int height) const {
+    m_accumulation->blitTo(width, height);
+}
+
+GLuint RaymarchPass::getTexture(RaymarchAttachment attachment) const {
+    return m_frames[m_frame]->getTexture(attachment);
+}
+
+GLuint RaymarchPass::getConeTexture(ConeAttachment attachment) const {
+    return m_cone->getTexture(attachment);
+}
+
+GLuint RaymarchPass::getShadowTexture() const {
+    return m_shadow->getTexture(0);
+}
+
+GLuint RaymarchPass::getOcclusionTexture() const {
+    return m_occlusion->getTexture(0);
+}
+
+unsigned int RaymarchPass::getOcclusionDirections() const {
+    return m_occlusion_directions;
+}
+
+unsigned int RaymarchPass::getSamples() const {
+    return m_samples;
+}
+
+unsigned int RaymarchPass::getWidth() const {
+    return m_frames[m_frame]->getWidth();
+}
+
+unsigned int RaymarchPass::getHeight() const {
+    return m_frames[m_frame]->getHeight();
+}
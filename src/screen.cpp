@@ -55,6 +55,12 @@ void ScreenQuad::draw(const shared_ptr<Shader> shader, float time, float depl_x,
     shader->sendUniform1f("deplt_x", depl_x);
     shader->sendUniform1f("deplt_y", depl_y);
 
+    this->draw(shader);
+}
+
+void ScreenQuad::draw(const shared_ptr<Shader> shader) const {
+    shader->bind();
+
     // bind the VAO before drawing
     glBindVertexArray(m_vao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
@@ -7,7 +7,7 @@
 
 #include "shader.hpp"
 
-Shader::Shader(const std::string& vertex_filename, const std::string& fragment_filename) {
+Shader::Shader(const std::string& vertex_filename, const std::string& fragment_filename, const vector<string>& defines) : m_defines(defines) {
     // VERTEX shader compilation
     GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     this->compile(vertex_shader, vertex_filename);
@@ -42,9 +42,19 @@ void Shader::read_file(const std::string& filename, std::string& content) const
     std::ifstream file(filename);
     std::string line;
     if (file.is_open()) {
+        const std::string include = "#include \"";
         while (getline(file, line)) {
+            if (line.compare(0, include.size(), include) == 0) {
+                size_t end = line.find('"', include.size());
+                size_t slash = filename.find_last_of('/');
+                std::string directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+                this->read_file(directory + line.substr(include.size(), end - include.size()), content);
+                continue;
+            }
             content += line + '\n';
         }
+    } else {
+        std::cout << "ERROR::SHADER::FILE_NOT_FOUND " << filename << std::endl;
     }
 
     file.close();
@@ -56,6 +66,16 @@ void Shader::compile(GLuint shader, const std::string& filename) const {
     std::string content;
     this->read_file(filename, content);
 
+    // The defines must come after #version
+    if(!m_defines.empty()) {
+        std::string defines;
+        for(const std::string& define : m_defines) {
+            defines += "#define " + define + '\n';
+        }
+        size_t version = content.find("#version");
+        size_t line_end = version == std::string::npos ? 0 : content.find('\n', version) + 1;
+        content.insert(line_end, defines);
+    }
 
     std::cout << content << std::endl;
     const char *c_str = content.c_str();
@@ -102,6 +122,20 @@ void Shader::sendUniform1i(const std::string& attribute, unsigned int data) cons
         glUniform1i(dataLocation, data);
     }
 }
+
+void Shader::sendUniform2f(const std::string& attribute, float x, float y) const {
+    int dataLocation = glGetUniformLocation(m_program, attribute.c_str());
+    if(dataLocation != -1) {
+        glUniform2f(dataLocation, x, y);
+    }
+}
+
+void Shader::sendUniform3f(const std::string& attribute, float x, float y, float z) const {
+    int dataLocation = glGetUniformLocation(m_program, attribute.c_str());
+    if(dataLocation != -1) {
+        glUniform3f(dataLocation, x, y, z);
+    }
+}
 /*
 void Shader::sendUniform3f(const std::string& attribute, const glm::vec3& data) const {
     int dataLocation = glGetUniformLocation(m_program, attribute.c_str());
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "terrain_pass.hpp"
+
+TerrainPass::TerrainPass(const TerrainParams& params) : m_params(params) {
+    m_shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_terrain.glsl", m_params.glsl_defines());
+    m_target = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_RGBA8, GL_R32F, GL_R32F}));
+
+    auto start = std::chrono::steady_clock::now();
+    HeightPyramid pyramid;
+    build_height_pyramid(m_params, pyramid);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Built the " << m_params.pyramid_size() << "x" << m_params.pyramid_size() << " height pyramid in " << ms
+              << " ms" << std::endl;
+
+    m_pyramid_levels = pyramid.levels.size();
+    glGenTextures(1, &m_pyramid);
+    glBindTexture(GL_TEXTURE_2D, m_pyramid);
+    for(unsigned int level = 0; level < m_pyramid_levels; level++) {
+        const NoiseBuffer& texels = pyramid.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, texels.width, texels.height, 0, GL_RED, GL_FLOAT, texels.value.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_pyramid_levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+TerrainPass::~TerrainPass() {
+    glDeleteTextures(1, &m_pyramid);
+}
+
+void TerrainPass::render(const ScreenQuad& screen, const Camera& camera, const Light& light, unsigned int width,
+                         unsigned int height, float scale) {
+    const unsigned int w = std::max(1u, (unsigned int)(scale*width));
+    const unsigned int h = std::max(1u, (unsigned int)(scale*height));
+    if(m_target->getWidth() != w || m_target->getHeight() != h) {
+        m_target->resize(w, h);
+    }
+
+    float right[3], up[3], forward[3], toward[3];
+    camera.rays(w, h, right, up, forward);
+    light.direction(toward);
+
+    m_target->bind();
+    m_shader->bind();
+    m_shader->sendUniform3f("camera_eye", camera.eye[0], camera.eye[1], camera.eye[2]);
+    m_shader->sendUniform3f("camera_right", right[0], right[1], right[2]);
+    m_shader->sendUniform3f("camera_up", up[0], up[1], up[2]);
+    m_shader->sendUniform3f("camera_forward", forward[0], forward[1], forward[2]);
+    m_shader->sendUniform1f("pixel_angle", camera.pixel_angle(h));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_pyramid);
+    m_shader->sendUniform1i("pyramid", 0);
+    m_shader->sendUniform1i("pyramid_levels", m_pyramid_levels);
+    m_shader->sendUniform1i("pyramid_size", m_params.pyramid_size());
+    m_shader->sendUniform1f("height", m_params.height);
+    m_shader->sendUniform1f("lod", m_params.lod);
+    m_shader->sendUniform1i("max_steps", m_params.max_steps);
+    m_shader->sendUniform1f("max_distance", m_params.max_distance);
+    m_shader->sendUniform3f("light", toward[0], toward[1], toward[2]);
+    m_shader->sendUniform1f("ambient", light.ambient);
+    m_shader->sendUniform1f("diffuse", light.diffuse);
+    m_shader->sendUniform1f("time", 0.f);
+    screen.draw(m_shader);
+    m_target->unbind();
+}
+
+void TerrainPass::display(unsigned int width, unsigned int height) const {
+    m_target->blitTo(width, height);
+}
+
+GLuint TerrainPass::getTexture(TerrainAttachment attachment) const {
+    return m_target->getTexture(attachment);
+}
+
+GLuint TerrainPass::getPyramidTexture() const {
+    return m_pyramid;
+}
+
+const TerrainParams& TerrainPass::getParams() const {
+    return m_params;
+}
+
+unsigned int TerrainPass::getWidth() const {
+    return m_target->getWidth();
+}
+
+unsigned int TerrainPass::getHeight() const {
+    return m_target->getHeight();
+}
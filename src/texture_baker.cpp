@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "texture_baker.hpp"
+
+bool parse_bake_job(const string& line, BakeJob& job) {
+    istringstream words(line);
+    string opt, val;
+    while(words >> opt) {
+        if(!(words >> val)) {
+            std::cout << "ERROR::BAKE::MISSING_VALUE " << opt << std::endl;
+            return false;
+        }
+        if(opt == "-k") {
+            if(val == "fbm") job.kernel = WarpKernel::FBM;
+            else if(val == "second") job.kernel = WarpKernel::WARP_SECOND;
+            else if(val == "third") job.kernel = WarpKernel::WARP_THIRD;
+            else {
+                std::cout << "ERROR::BAKE::UNKNOWN_KERNEL " << val << std::endl;
+                return false;
+            }
+        }
+        else if(opt == "-N") {
+            if(val == "hash") job.basis = NoiseBasis::HASH;
+            else if(val == "gradient") job.basis = NoiseBasis::GRADIENT;
+            else {
+                std::cout << "ERROR::BAKE::UNKNOWN_NOISE " << val << std::endl;
+                return false;
+            }
+        }
+        else if(opt == "-o") job.output = val;
+        else if(opt == "-w") job.width = atoi(val.c_str());
+        else if(opt == "-h") job.height = atoi(val.c_str());
+        else if(opt == "-P") job.period = atoi(val.c_str());
+        else if(opt == "-t") job.time = atof(val.c_str());
+        else if(opt == "-m") job.mipmaps = atoi(val.c_str()) != 0;
+        else {
+            std::cout << "ERROR::BAKE::UNKNOWN_OPTION " << opt << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+TextureBaker::TextureBaker(unsigned int tile_size) :
+    m_tile_size(tile_size),
+    m_band_bytes(0) {
+    m_tile = make_unique<FrameBuffer>(tile_size, tile_size, vector<GLenum>({GL_RGBA8}));
+    glGenBuffers(2, m_bands.data());
+}
+
+TextureBaker::~TextureBaker() {
+    glDeleteBuffers(2, m_bands.data());
+}
+
+shared_ptr<Shader> TextureBaker::shader(const BakeJob& job) {
+    NoiseParams params;
+    params.basis = job.basis;
+    params.period = job.period;
+    vector<string> defines = noise_defines(params);
+    defines.push_back("WARP_BAKE");
+    if(job.kernel == WarpKernel::WARP_SECOND) {
+        defines.push_back("WARP_SECOND");
+    } else if(job.kernel == WarpKernel::WARP_THIRD) {
+        defines.push_back("WARP_THIRD");
+    }
+
+    string key;
+    for(const string& define : defines) {
+        key += define + ";";
+    }
+    auto found = m_shaders.find(key);
+    if(found != m_shaders.end()) {
+        return found->second;
+    }
+    shared_ptr<Shader> shader = make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_warp.glsl", defines);
+    m_shaders[key] = shader;
+    return shader;
+}
+
+// The rows of the band go up in the pixel buffer, the files go down
+bool TextureBaker::flush(MipmapWriter& writer, unsigned int slot, unsigned int width, unsigned int rows) {
+    const size_t row_bytes = size_t(width) * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_bands[slot]);
+    const uint8_t* band = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row_bytes * rows, GL_MAP_READ_BIT));
+    if(!band) {
+        std::cout << "ERROR::BAKE::READBACK_FAILED" << std::endl;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return false;
+    }
+    m_rows.resize(row_bytes * rows);
+    for(unsigned int y = 0; y < rows; y++) {
+        memcpy(m_rows.data() + (rows - 1 - y) * row_bytes, band + y * row_bytes, row_bytes);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return writer.write(m_rows.data(), rows);
+}
+
+bool TextureBaker::bake(const ScreenQuad& screen, const BakeJob& job) {
+    if(job.width == 0 || job.height == 0 || job.period == 0 || (job.period & (job.period - 1)) != 0) {
+        std::cout << "ERROR::BAKE::INVALID_JOB " << job.output << " needs a size and a power of two period" << std::endl;
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    shared_ptr<Shader> shader = this->shader(job);
+
+    const size_t band_bytes = size_t(job.width) * m_tile_size * 3;
+    if(band_bytes > m_band_bytes) {
+        for(GLuint band : m_bands) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, band);
+            glBufferData(GL_PIXEL_PACK_BUFFER, band_bytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_band_bytes = band_bytes;
+    }
+
+    MipmapWriter writer(job.output, job.width, job.height, job.mipmaps);
+    shader->bind();
+    shader->sendUniform1f("time", job.time);
+    shader->sendUniform2f("bake_texel", float(job.period) / float(job.width), float(job.period) / float(job.height));
+
+    // Bands from the top of the image, whose rows are the highest in y
+    const unsigned int bands = (job.height + m_tile_size - 1) / m_tile_size;
+    bool written = true;
+    unsigned int pending_rows = 0;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, job.width);
+    for(unsigned int b = 0; b < bands && written; b++) {
+        const unsigned int rows = min(m_tile_size, job.height - b * m_tile_size);
+        const unsigned int y = job.height - b * m_tile_size - rows;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_bands[b % 2]);
+        for(unsigned int x = 0; x < job.width; x += m_tile_size) {
+            const unsigned int columns = min(m_tile_size, job.width - x);
+            m_tile->bind();
+            glViewport(0, 0, columns, rows);
+            shader->bind();
+            shader->sendUniform2f("bake_origin", float(x), float(y));
+            screen.draw(shader);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glReadPixels(0, 0, columns, rows, GL_RGB, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(size_t(x) * 3));
+        }
+        m_tile->unbind();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // The previous band is on the CPU side while the GPU draws this one
+        if(b > 0) {
+            written = this->flush(writer, (b - 1) % 2, job.width, pending_rows);
+        }
+        pending_rows = rows;
+    }
+    if(written) {
+        written = this->flush(writer, (bands - 1) % 2, job.width, pending_rows);
+    }
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    written = writer.close() && written;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Baked " << job.output << " " << job.width << "x" << job.height << ", " << writer.getLevels()
+              << " levels, in " << ms << " ms" << std::endl;
+    return written;
+}
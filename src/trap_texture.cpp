@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "stb_image.h"
+#include "trap_texture.hpp"
+
+namespace {
+
+// Header of the cached images, followed by the RGBA pixels of all their
+// mipmap levels, from the full size one down to 1x1. The size and the
+// modification time of the image file tell whether the cache is still valid.
+struct CacheHeader {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t padding;
+    int64_t source_size;
+    int64_t source_time;
+};
+
+const char CACHE_MAGIC[4] = {'T', 'R', 'A', 'P'};
+
+string cache_filename(const string& filename) {
+    size_t slash = filename.find_last_of('/');
+    return TRAP_CACHE_DIRECTORY + (slash == string::npos ? filename : filename.substr(slash + 1)) + ".rgba";
+}
+
+unsigned int mip_levels(unsigned int width, unsigned int height) {
+    unsigned int levels = 1;
+    while(width > 1 || height > 1) {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        levels++;
+    }
+    return levels;
+}
+
+// Bytes of all the mipmap levels
+size_t mip_chain_size(unsigned int width, unsigned int height) {
+    size_t size = 0;
+    for(unsigned int level = 0; level < mip_levels(width, height); level++) {
+        size += size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+    }
+    return size;
+}
+
+// Appends the levels below the first one, which chain already holds. Each
+// texel is the mean of the 2x2 texels above it, the last row or column of
+// an odd size is dropped.
+void build_mip_chain(unsigned int width, unsigned int height, vector<uint8_t>& chain) {
+    chain.resize(mip_chain_size(width, height));
+    const uint8_t* above = chain.data();
+    uint8_t* level = chain.data() + size_t(width) * height * 4;
+    while(width > 1 || height > 1) {
+        unsigned int w = std::max(width / 2, 1u);
+        unsigned int h = std::max(height / 2, 1u);
+        for(unsigned int j = 0; j < h; j++) {
+            unsigned int j0 = std::min(2 * j, height - 1), j1 = std::min(2 * j + 1, height - 1);
+            for(unsigned int i = 0; i < w; i++) {
+                unsigned int i0 = std::min(2 * i, width - 1), i1 = std::min(2 * i + 1, width - 1);
+                for(unsigned int c = 0; c < 4; c++) {
+                    unsigned int sum = above[(size_t(j0) * width + i0) * 4 + c] + above[(size_t(j0) * width + i1) * 4 + c] +
+                                       above[(size_t(j1) * width + i0) * 4 + c] + above[(size_t(j1) * width + i1) * 4 + c];
+                    level[(size_t(j) * w + i) * 4 + c] = uint8_t((sum + 2) / 4);
+                }
+            }
+        }
+        above = level;
+        level += size_t(w) * h * 4;
+        width = w;
+        height = h;
+    }
+}
+
+bool source_info(const string& filename, int64_t& size, int64_t& time) {
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0) {
+        return false;
+    }
+    size = int64_t(info.st_size);
+    time = int64_t(info.st_mtime);
+    return true;
+}
+
+}
+
+TrapTexture::TrapTexture() :
+    m_front(0), m_fence(0), m_width(0), m_height(0), m_back_width(0), m_back_height(0), m_ready(false),
+    m_quit(false), m_state(TRAP_IDLE), m_decoded_width(0), m_decoded_height(0), m_mapped(nullptr) {
+    // A single white texel until the first image arrives, so that the
+    // textures are complete
+    const uint8_t white[4] = {255, 255, 255, 255};
+    glGenTextures(2, m_textures);
+    for(unsigned int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenBuffers(1, &m_pbo);
+
+    m_thread = thread(&TrapTexture::decode, this);
+}
+
+TrapTexture::~TrapTexture() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+
+    if(m_mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    if(m_fence) {
+        glDeleteSync(m_fence);
+    }
+    glDeleteBuffers(1, &m_pbo);
+    glDeleteTextures(2, m_textures);
+}
+
+void TrapTexture::request(const string& filename) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_pending = filename;
+    }
+    m_condition.notify_all();
+}
+
+bool TrapTexture::update() {
+    // The back texture is busy until its fence signals, the flush makes
+    // sure the fence is submitted without waiting for the swap
+    bool swapped = false;
+    if(m_fence) {
+        GLenum status = glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return false;
+        }
+        glDeleteSync(m_fence);
+        m_fence = 0;
+        m_front = 1 - m_front;
+        m_filename = m_back_filename;
+        m_width = m_back_width;
+        m_height = m_back_height;
+        m_ready = true;
+        swapped = true;
+    }
+
+    unique_lock<mutex> lock(m_mutex);
+    if(m_state == TRAP_SIZED) {
+        // Orphaning the previous storage, the driver does not wait for its
+        // last upload to complete
+        GLsizeiptr size = GLsizeiptr(mip_chain_size(m_decoded_width, m_decoded_height));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        m_mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if(!m_mapped) {
+            std::cout << "ERROR::TRAP_TEXTURE::MAP_FAILED " << m_decoding << std::endl;
+        }
+        m_state = TRAP_MAPPED;
+        lock.unlock();
+        m_condition.notify_all();
+    } else if(m_state == TRAP_FILLED) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        bool valid = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+        m_mapped = nullptr;
+        if(valid) {
+            // The levels are read from the buffer by the GPU, the texture is
+            // ready once the fence signals. The mipmaps come with the image
+            // rather than from glGenerateMipmap(), which some drivers run
+            // on the calling thread.
+            unsigned int levels = mip_levels(m_decoded_width, m_decoded_height);
+            size_t offset = 0;
+            glBindTexture(GL_TEXTURE_2D, m_textures[1 - m_front]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            for(unsigned int level = 0; level < levels; level++) {
+                unsigned int w = std::max(m_decoded_width >> level, 1u);
+                unsigned int h = std::max(m_decoded_height >> level, 1u);
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+                offset += size_t(w) * h * 4;
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            m_back_filename = m_decoding;
+            m_back_width = m_decoded_width;
+            m_back_height = m_decoded_height;
+        } else {
+            std::cout << "ERROR::TRAP_TEXTURE::BUFFER_LOST " << m_decoding << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_state = TRAP_IDLE;
+        lock.unlock();
+        m_condition.notify_all();
+    }
+    return swapped;
+}
+
+void TrapTexture::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, m_textures[m_front]);
+}
+
+bool TrapTexture::isReady() const {
+    return m_ready;
+}
+
+const string& TrapTexture::getFilename() const {
+    return m_filename;
+}
+
+unsigned int TrapTexture::getWidth() const {
+    return m_width;
+}
+
+unsigned int TrapTexture::getHeight() const {
+    return m_height;
+}
+
+void TrapTexture::decode() {
+    unique_lock<mutex> lock(m_mutex);
+    while(true) {
+        m_condition.wait(lock, [this] { return m_quit || !m_pending.empty(); });
+        if(m_quit) {
+            return;
+        }
+        string filename = m_pending;
+        m_pending.clear();
+        lock.unlock();
+
+        // Only the size is read from the cache here, the pixels go straight
+        // to the pixel buffer once it is mapped
+        unsigned int width = 0, height = 0;
+        vector<uint8_t> decoded;
+        if(!this->readCache(filename, true, width, height, nullptr)) {
+            int x, y, channels;
+            stbi_uc* pixels = stbi_load(filename.c_str(), &x, &y, &channels, 4);
+            if(!pixels) {
+                std::cout << "ERROR::TRAP_TEXTURE::DECODE_FAILED " << filename << ": " << stbi_failure_reason() << std::endl;
+                lock.lock();
+                continue;
+            }
+            width = x;
+            height = y;
+            decoded.assign(pixels, pixels + size_t(width) * height * 4);
+            stbi_image_free(pixels);
+            build_mip_chain(width, height, decoded);
+            this->writeCache(filename, width, height, decoded.data());
+        }
+
+        // The previous image must be uploaded before the buffer is mapped again
+        lock.lock();
+        m_condition.wait(lock, [this] { return m_quit || m_state == TRAP_IDLE; });
+        if(!m_quit) {
+            m_decoding = filename;
+            m_decoded_width = width;
+            m_decoded_height = height;
+            m_state = TRAP_SIZED;
+            m_condition.wait(lock, [this] { return m_quit || m_state == TRAP_MAPPED; });
+        }
+        if(m_quit) {
+            return;
+        }
+
+        uint8_t* mapped = m_mapped;
+        lock.unlock();
+        if(mapped) {
+            if(!decoded.empty()) {
+                memcpy(mapped, decoded.data(), decoded.size());
+            } else if(!this->readCache(filename, false, width, height, mapped)) {
+                memset(mapped, 0, mip_chain_size(width, height));
+            }
+        }
+
+        lock.lock();
+        m_state = mapped ? TRAP_FILLED : TRAP_IDLE;
+    }
+}
+
+bool TrapTexture::readCache(const string& filename, bool size_only, unsigned int& width, unsigned int& height, uint8_t* pixels) const {
+    int64_t source_size, source_time;
+    if(!source_info(filename, source_size, source_time)) {
+        return false;
+    }
+    FILE* file = fopen(cache_filename(filename).c_str(), "rb");
+    if(!file) {
+        return false;
+    }
+
+    CacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                 header.source_size == source_size && header.source_time == source_time &&
+                 (size_only || (header.width == width && header.height == height));
+    if(valid) {
+        width = header.width;
+        height = header.height;
+        if(!size_only) {
+            size_t size = mip_chain_size(width, height);
+            valid = fread(pixels, 1, size, file) == size;
+        }
+    }
+    fclose(file);
+    return valid;
+}
+
+void TrapTexture::writeCache(const string& filename, unsigned int width, unsigned int height, const uint8_t* pixels) const {
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.width = width;
+    header.height = height;
+    header.padding = 0;
+    if(!source_info(filename, header.source_size, header.source_time)) {
+        return;
+    }
+
+    // Written aside and renamed, another run never reads half a file
+    mkdir(TRAP_CACHE_DIRECTORY.c_str(), 0755);
+    string cached = cache_filename(filename);
+    string temporary = cached + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if(!file) {
+        std::cout << "ERROR::TRAP_TEXTURE::CACHE_NOT_WRITTEN " << cached << std::endl;
+        return;
+    }
+    size_t size = mip_chain_size(width, height);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(pixels, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+    if(!written || rename(temporary.c_str(), cached.c_str()) != 0) {
+        std::cout << "ERROR::TRAP_TEXTURE::CACHE_NOT_WRITTEN " << cached << std::endl;
+        remove(temporary.c_str());
+    }
+}
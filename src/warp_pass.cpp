@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "warp_pass.hpp"
+
+namespace {
+
+// Time of the keys not drawn yet, the interpolation never reaches them
+const float EMPTY_KEY = -1e30f;
+
+shared_ptr<Shader> warp_shader(const vector<string>& defines, const vector<string>& pass) {
+    vector<string> pass_defines(defines);
+    pass_defines.insert(pass_defines.end(), pass.begin(), pass.end());
+    return make_shared<Shader>("./shaders/vertex_fractals.glsl", "./shaders/frag_warp.glsl", pass_defines);
+}
+
+}
+
+WarpPass::WarpPass(const NoiseParams& params, const vector<unsigned int>& texels_per_cell, unsigned int period) {
+    vector<vector<string>> defines({noise_defines(params)});
+    for(unsigned int texels : texels_per_cell) {
+        NoiseTile tile;
+        tile.basis = params.basis;
+        tile.period = period;
+        tile.texels_per_cell = texels;
+        m_textures.push_back(make_unique<NoiseTexture>(tile));
+        defines.push_back(m_textures.back()->glsl_defines());
+    }
+    for(const vector<string>& source : defines) {
+        SourceShaders shaders;
+        shaders.kernels[0] = warp_shader(source, {});
+        shaders.kernels[1] = warp_shader(source, {"WARP_SECOND"});
+        shaders.kernels[2] = warp_shader(source, {"WARP_THIRD"});
+        shaders.fields[0] = warp_shader(source, {"WARP_FIELD", "WARP_SECOND"});
+        shaders.fields[1] = warp_shader(source, {"WARP_FIELD", "WARP_THIRD"});
+        shaders.upsample = warp_shader(source, {"WARP_UPSAMPLE"});
+        m_shaders.push_back(shaders);
+    }
+    m_target = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_RGBA8, GL_R32F}));
+    m_field = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_RG32F}));
+
+    // The keys only need the values, the colors of the kernels go to GL_R8
+    m_compose = warp_shader({}, {"WARP_COMPOSE"});
+    for(unique_ptr<FrameBuffer>& key : m_keys) {
+        key = make_unique<FrameBuffer>(1, 1, vector<GLenum>({GL_R8, GL_R32F}));
+    }
+    glGenTextures(1, &m_key_times);
+    glBindTexture(GL_TEXTURE_2D, m_key_times);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenQueries(1, &m_query);
+    m_slice_valid = false;
+    m_tiles_x = m_tiles_y = 0;
+    m_next_tile = 0;
+    m_tile_step = 1;
+    m_tile_ms = 0.f;
+    m_frame_time = 0.f;
+    m_last_time = 0.f;
+    m_query_pending = false;
+    m_query_tiles = 0;
+}
+
+WarpPass::~WarpPass() {
+    glDeleteTextures(1, &m_key_times);
+    glDeleteQueries(1, &m_query);
+}
+
+void WarpPass::render(const ScreenQuad& screen, WarpKernel kernel, unsigned int source, float time, float center_x,
+                      float center_y, float zoom, unsigned int width, unsigned int height, unsigned int field_divisor) {
+    if(m_target->getWidth() != width || m_target->getHeight() != height) {
+        m_target->resize(width, height);
+    }
+    this->draw(screen, *m_target, kernel, source, time, center_x, center_y, zoom, field_divisor, 0, 0, width, height);
+}
+
+void WarpPass::renderSliced(const ScreenQuad& screen, WarpKernel kernel, unsigned int source, float time,
+                            float center_x, float center_y, float zoom, unsigned int width, unsigned int height,
+                            float budget_ms, unsigned int field_divisor) {
+    if(m_query_pending) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &ns);
+            const float ms = float(ns)/1e6f/float(m_query_tiles);
+            m_tile_ms = m_tile_ms > 0.f ? 0.5f*(m_tile_ms + ms) : ms;
+            m_query_pending = false;
+        }
+    }
+    if(m_slice_valid && time > m_last_time) {
+        const float interval = time - m_last_time;
+        m_frame_time = m_frame_time > 0.f ? 0.9f*m_frame_time + 0.1f*interval : interval;
+    }
+    m_last_time = time;
+
+    const bool query = !m_query_pending;
+    if(query) {
+        glBeginQuery(GL_TIME_ELAPSED, m_query);
+    }
+    if(m_target->getWidth() != width || m_target->getHeight() != height) {
+        m_target->resize(width, height);
+    }
+    const SliceView view = {kernel, source, center_x, center_y, zoom, width, height, field_divisor};
+    const unsigned int tiles = m_tiles_x*m_tiles_y;
+    if(!m_slice_valid || !view.same(m_slice)) {
+        if(m_keys[0]->getWidth() != width || m_keys[0]->getHeight() != height) {
+            for(unique_ptr<FrameBuffer>& key : m_keys) {
+                key->resize(width, height);
+            }
+            m_tiles_x = (width + WARP_SLICE_TILE - 1)/WARP_SLICE_TILE;
+            m_tiles_y = (height + WARP_SLICE_TILE - 1)/WARP_SLICE_TILE;
+            glBindTexture(GL_TEXTURE_2D, m_key_times);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, m_tiles_x, m_tiles_y, 0, GL_RG, GL_FLOAT, nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            // A step coprime with the number of tiles visits them all,
+            // the golden ratio of it keeps the next ones far apart
+            const unsigned int count = m_tiles_x*m_tiles_y;
+            m_tile_step = max(1u, (unsigned int)std::lround(0.618*count));
+            while(std::gcd(m_tile_step, count) != 1) {
+                m_tile_step++;
+            }
+        }
+        m_slice = view;
+        m_slice_valid = true;
+        m_next_tile = 0;
+
+        // The whole target in the first keys, the second ones are empty
+        this->draw(screen, *m_keys[0], kernel, source, time, center_x, center_y, zoom, field_divisor, 0, 0, width,
+                   height);
+        m_times.resize(2*m_tiles_x*m_tiles_y);
+        for(size_t k = 0; k < m_times.size(); k += 2) {
+            m_times[k] = time;
+            m_times[k + 1] = EMPTY_KEY;
+        }
+        m_query_tiles = m_tiles_x*m_tiles_y;
+    } else {
+        // The tiles drawn now are drawn again after a whole round, their
+        // key is for that time
+        unsigned int count = m_tile_ms > 0.f ? (unsigned int)(budget_ms/m_tile_ms) : 1;
+        count = min(max(count, 1u), tiles);
+        const unsigned int rounds = (tiles + count - 1)/count;
+        const float key_time = time + float(rounds)*m_frame_time;
+        for(unsigned int k = 0; k < count; k++) {
+            const unsigned int tile = (unsigned long long)m_next_tile*m_tile_step % tiles;
+            m_next_tile = (m_next_tile + 1) % tiles;
+            // The older key of the tile is replaced
+            const unsigned int key = m_times[2*tile] <= m_times[2*tile + 1] ? 0 : 1;
+            this->drawTile(screen, *m_keys[key], tile, key_time);
+            m_times[2*tile + key] = key_time;
+        }
+        m_query_tiles = count;
+    }
+    if(query) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_query_pending = true;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_key_times);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_tiles_x, m_tiles_y, GL_RG, GL_FLOAT, m_times.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->compose(screen, time);
+}
+
+void WarpPass::draw(const ScreenQuad& screen, FrameBuffer& target, WarpKernel kernel, unsigned int source, float time,
+                    float center_x, float center_y, float zoom, unsigned int field_divisor, unsigned int x,
+                    unsigned int y, unsigned int w, unsigned int h) {
+    const unsigned int width = target.getWidth(), height = target.getHeight();
+    const bool region = w < width || h < height;
+    const SourceShaders& shaders = m_shaders[source];
+    const NoiseTexture* texture = source > 0 ? m_textures[source - 1].get() : nullptr;
+
+    // Inner fields, with the margin of the splines
+    shared_ptr<Shader> shader = shaders.kernels[(unsigned int)kernel];
+    if(field_divisor > 1 && kernel != WarpKernel::FBM) {
+        const unsigned int field_width = (width + field_divisor - 1)/field_divisor + 4;
+        const unsigned int field_height = (height + field_divisor - 1)/field_divisor + 4;
+        if(m_field->getWidth() != field_width || m_field->getHeight() != field_height) {
+            m_field->resize(field_width, field_height);
+            glBindTexture(GL_TEXTURE_2D, m_field->getTexture(0));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        m_field->bind();
+        if(region) {
+            // Samples of the splines of the pixels of the region
+            const float s = float(field_divisor), center = 0.5f*(s - 1.f);
+            const int x0 = max(int(std::floor((float(x) - center)/s)) + 1, 0);
+            const int y0 = max(int(std::floor((float(y) - center)/s)) + 1, 0);
+            const int x1 = min(int(std::floor((float(x + w - 1) - center)/s)) + 5, int(field_width));
+            const int y1 = min(int(std::floor((float(y + h - 1) - center)/s)) + 5, int(field_height));
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(x0, y0, x1 - x0, y1 - y0);
+        }
+        shared_ptr<Shader> field = shaders.fields[kernel == WarpKernel::WARP_THIRD];
+        field->bind();
+        if(texture) {
+            texture->sendUniforms(field, 0);
+        }
+        field->sendUniform2f("resolution", float(width), float(height));
+        field->sendUniform1f("field_divisor", float(field_divisor));
+        screen.draw(field, time, center_x, center_y, zoom);
+        m_field->unbind();
+
+        shader = shaders.upsample;
+        shader->bind();
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_field->getTexture(0));
+        shader->sendUniform1i("field", 1);
+        shader->sendUniform1f("field_divisor", float(field_divisor));
+    }
+
+    target.bind();
+    if(region) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x, y, w, h);
+    }
+    shader->bind();
+    if(texture) {
+        texture->sendUniforms(shader, 0);
+    }
+    screen.draw(shader, time, center_x, center_y, zoom);
+    glDisable(GL_SCISSOR_TEST);
+    target.unbind();
+}
+
+void WarpPass::drawTile(const ScreenQuad& screen, FrameBuffer& target, unsigned int tile, float time) {
+    const unsigned int x = (tile % m_tiles_x)*WARP_SLICE_TILE, y = (tile / m_tiles_x)*WARP_SLICE_TILE;
+    const unsigned int w = min(WARP_SLICE_TILE, m_slice.width - x), h = min(WARP_SLICE_TILE, m_slice.height - y);
+    this->draw(screen, target, m_slice.kernel, m_slice.source, time, m_slice.center_x, m_slice.center_y, m_slice.zoom,
+               m_slice.field_divisor, x, y, w, h);
+}
+
+void WarpPass::compose(const ScreenQuad& screen, float time) {
+    m_target->bind();
+    m_compose->bind();
+    for(unsigned int k = 0; k < 2; k++) {
+        glActiveTexture(GL_TEXTURE2 + k);
+        glBindTexture(GL_TEXTURE_2D, m_keys[k]->getTexture(WARP_VALUE));
+        m_compose->sendUniform1i("keys[" + to_string(k) + "]", 2 + k);
+    }
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, m_key_times);
+    m_compose->sendUniform1i("key_times", 4);
+    m_compose->sendUniform1f("tile_size", float(WARP_SLICE_TILE));
+    m_compose->sendUniform1f("time", time);
+    screen.draw(m_compose);
+    m_target->unbind();
+}
+
+void WarpPass::display(unsigned int width, unsigned int height) const {
+    m_target->blitTo(width, height);
+}
+
+GLuint WarpPass::getTexture(WarpAttachment attachment) const {
+    return m_target->getTexture(attachment);
+}
+
+unsigned int WarpPass::getSources() const {
+    return m_shaders.size();
+}
+
+string WarpPass::getSourceName(unsigned int source) const {
+    if(source == 0) {
+        return "procedural";
+    }
+    const NoiseTile& tile = m_textures[source - 1]->getTile();
+    return to_string(tile.size()) + "x" + to_string(tile.size()) + " texture, " + to_string(tile.texels_per_cell) +
+           " texels per cell";
+}
@@ -0,0 +1,66 @@
+// Headless CPU render of the Buddhabrot and Nebulabrot.
+//
+//   buddhabrot [-w width] [-h height] [-x center_x] [-y center_y] [-z zoom]
+//              [-nr max_iter] [-ng max_iter] [-nb max_iter] [-nmin min_iter]
+//              [-N samples] [-m sampling] [-l large_step] [-s seed] [-o image.ppm]
+//
+// The channels default to the Nebulabrot limits 5000/500/50, give the three
+// the same limit for the plain Buddhabrot. -m 0 samples c uniformly, -m 1
+// with Metropolis chains and -m 2, the default, picks one from the fraction
+// of uniform orbits crossing the view.
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/buddhabrot.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    View view;
+    view.center_x = -0.5;
+    view.zoom = 0.75;
+    BuddhabrotParams params;
+    string image_file = "buddhabrot.ppm";
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-nr") params.max_iter[0] = atoi(val);
+        else if(opt == "-ng") params.max_iter[1] = atoi(val);
+        else if(opt == "-nb") params.max_iter[2] = atoi(val);
+        else if(opt == "-nmin") params.min_iter = atoi(val);
+        else if(opt == "-N") params.samples = strtoull(val, nullptr, 10);
+        else if(opt == "-m") params.sampling = BuddhabrotSampling(std::min(std::max(atoi(val), 0), 2));
+        else if(opt == "-l") params.large_step = atof(val);
+        else if(opt == "-s") params.seed = strtoull(val, nullptr, 10);
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    BuddhabrotBuffer buffer;
+    BuddhabrotStats stats = render_buddhabrot(view, params, buffer);
+    std::cout << "Sampled " << stats.samples << " values of c in " << stats.seconds * 1e3 << " ms ("
+              << stats.samples / stats.seconds / 1e6 << " Msamples/s)" << std::endl;
+    std::cout << "Skipped (cardioid and bulb): " << 100.0 * stats.skipped / stats.samples << "%, "
+              << "contributing orbits: " << 100.0 * stats.contributing / stats.samples << "%";
+    if(stats.sampling == BUDDHABROT_METROPOLIS) {
+        std::cout << ", Metropolis, accepted: " << 100.0 * stats.accepted / stats.samples << "%";
+    } else {
+        std::cout << ", uniform";
+    }
+    std::cout << std::endl;
+
+    Image image;
+    tonemap(buffer, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+// Headless CPU render of iterated function systems and fractal flames.
+//
+//   flame [-f sierpinski|fern|swirl] [-w width] [-h height] [-x center_x] [-y center_y]
+//         [-z zoom] [-N points] [-s seed] [-g gamma] [-p palette.txt] [-o image.ppm]
+//
+// The view is the one framing the preset unless -x, -y or -z are given.
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/flame.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    View view;
+    double center_x = NAN, center_y = NAN, zoom = NAN;
+    FlameParams params;
+    params.points = 20000000;
+    string preset = "swirl", palette_file, image_file = "flame.ppm";
+    float gamma = 2.2f;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-f") preset = val;
+        else if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") center_x = atof(val);
+        else if(opt == "-y") center_y = atof(val);
+        else if(opt == "-z") zoom = atof(val);
+        else if(opt == "-N") params.points = strtoull(val, nullptr, 10);
+        else if(opt == "-s") params.seed = strtoull(val, nullptr, 10);
+        else if(opt == "-g") gamma = atof(val);
+        else if(opt == "-p") palette_file = val;
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    Flame flame;
+    if(!flame_preset(preset, flame)) {
+        std::cout << "Unknown flame " << preset << std::endl;
+        return 1;
+    }
+    view.center_x = std::isnan(center_x) ? flame.center_x : center_x;
+    view.center_y = std::isnan(center_y) ? flame.center_y : center_y;
+    view.zoom = std::isnan(zoom) ? flame.zoom : zoom;
+    Palette palette;
+    if(!palette_file.empty() && !palette.load(palette_file)) {
+        return 1;
+    }
+
+    FlameBuffer buffer;
+    FlameStats stats = render_flame(flame, view, params, buffer);
+    std::cout << "Iterated " << stats.points << " points in " << stats.seconds * 1e3 << " ms ("
+              << stats.points / stats.seconds / 1e6 << " Mpoints/s), "
+              << 100.0 * stats.plotted / stats.points << "% inside the view" << std::endl;
+
+    Image image;
+    tonemap(buffer, palette, gamma, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
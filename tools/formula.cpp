@@ -0,0 +1,87 @@
+// Renders a formula written in the language of cpu/formula_program.hpp with
+// the bytecode interpreter, and times it against the compiled Mandelbrot
+// kernel on the same view.
+//
+//   formula "z^2 + c" [-w width] [-h height] [-x center_x] [-y center_y] [-z zoom]
+//           [-n max_iter] [-p palette.txt] [-d density] [-o image.ppm] [-g print_glsl]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/coloring.hpp"
+#include "cpu/formula_program.hpp"
+#include "cpu/mandelbrot.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        std::cout << "Usage: formula \"z^2 + c\" [-w width] [-h height] [-x center_x] [-y center_y] [-z zoom] "
+                  << "[-n max_iter] [-p palette.txt] [-d density] [-o image.ppm] [-g print_glsl]" << std::endl;
+        return 1;
+    }
+    View view;
+    EscapeParams params;
+    string palette_file, image_file = "formula.ppm";
+    float density = 0.f;
+    bool print_glsl = false;
+
+    for(int i = 2; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-n") params.max_iter = max(2, atoi(val));
+        else if(opt == "-p") palette_file = val;
+        else if(opt == "-d") density = atof(val);
+        else if(opt == "-o") image_file = val;
+        else if(opt == "-g") print_glsl = atoi(val) != 0;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    FormulaProgram program;
+    if(!program.compile(argv[1])) {
+        return 1;
+    }
+    std::cout << program.disassemble();
+    std::cout << "degree " << program.degree() << ", " << program.code().size() << " instructions, "
+              << program.registers() << " registers" << std::endl;
+    if(print_glsl) {
+        for(const string& define : program.glsl_defines()) {
+            std::cout << "#define " << define << std::endl;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    IterationBuffer buffer;
+    program.render(view, params, buffer);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // Reference: the hand-written kernel, whatever the formula is
+    start = chrono::steady_clock::now();
+    IterationBuffer reference;
+    render_mandelbrot(view, params, reference);
+    double reference_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    std::cout << "Interpreted " << view.width << "x" << view.height << " in " << ms << " ms, "
+              << "compiled Mandelbrot kernel " << reference_ms << " ms (x" << ms / reference_ms << ")" << std::endl;
+
+    Palette palette;
+    if(!palette_file.empty() && !palette.load(palette_file)) {
+        return 1;
+    }
+    ColorMapping mapping;
+    mapping.density = density > 0.f ? density : 5.f / (params.max_iter - 1);
+
+    Image image;
+    colorize(buffer, palette, mapping, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
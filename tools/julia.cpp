@@ -0,0 +1,85 @@
+// Headless CPU render of Julia sets.
+//
+//   julia [-w width] [-h height] [-x center_x] [-y center_y] [-z zoom]
+//         [-cr re_c] [-ci im_c] [-n max_iter] [-p palette.txt] [-d density] [-o image.ppm]
+//
+// With -gw, renders a parameter-space atlas instead: a grid of gw x gh
+// thumbnails of width x height pixels, the thumbnail of column i and row j
+// being the Julia set of the c at pixel (i, j) of the c plane view
+// centered on (gx, gy) with zoom gz.
+//
+//   julia -gw columns [-gh rows] [-gx center_x] [-gy center_y] [-gz zoom] ...
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/coloring.hpp"
+#include "cpu/julia.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    View view;
+    View c_grid;
+    c_grid.width = 0;
+    c_grid.height = 0;
+    c_grid.center_x = -0.5;
+    c_grid.zoom = 0.75;
+    float re_c = -0.8f, im_c = 0.156f;
+    EscapeParams params;
+    string palette_file, image_file = "julia.ppm";
+    float density = 0.f;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-cr") re_c = atof(val);
+        else if(opt == "-ci") im_c = atof(val);
+        else if(opt == "-gw") c_grid.width = atoi(val);
+        else if(opt == "-gh") c_grid.height = atoi(val);
+        else if(opt == "-gx") c_grid.center_x = atof(val);
+        else if(opt == "-gy") c_grid.center_y = atof(val);
+        else if(opt == "-gz") c_grid.zoom = atof(val);
+        else if(opt == "-n") params.max_iter = max(2, atoi(val));
+        else if(opt == "-p") palette_file = val;
+        else if(opt == "-d") density = atof(val);
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    IterationBuffer buffer;
+    if(c_grid.width > 0) {
+        if(c_grid.height == 0) {
+            c_grid.height = c_grid.width;
+        }
+        render_julia_atlas(c_grid, view, params, buffer);
+    } else {
+        render_julia(view, re_c, im_c, params, buffer);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double mpix = double(buffer.width) * buffer.height / 1e6;
+    std::cout << "Iterated " << buffer.width << "x" << buffer.height << " in " << ms << " ms ("
+              << mpix / (ms / 1e3) << " Mpixel/s)" << std::endl;
+
+    Palette palette;
+    if(!palette_file.empty() && !palette.load(palette_file)) {
+        return 1;
+    }
+    ColorMapping mapping;
+    mapping.density = density > 0.f ? density : 5.f / (params.max_iter - 1);
+
+    Image image;
+    colorize(buffer, palette, mapping, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// Headless CPU render of Lyapunov fractals.
+//
+//   lyapunov [-S sequence] [-w width] [-h height] [-x center_a] [-y center_b]
+//            [-z zoom] [-W warmup] [-n iterations] [-l fast|libm] [-c 1] [-o image.ppm]
+//
+// The default view covers [2, 4]^2. With -c 1 the image is rendered with
+// both logarithms, and the tool reports their speed, how far the exponents
+// moved and the error of fast_log() over all the floats of [1e-30, 1e30].
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "cpu/lyapunov.hpp"
+#include "cpu/simd.hpp"
+
+using namespace std;
+
+namespace {
+    double render(const LyapunovSequence& sequence, const View& view, const LyapunovParams& params, LyapunovBuffer& buffer) {
+        auto start = chrono::steady_clock::now();
+        sequence.render(view, params, buffer);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        double mpix = double(buffer.width) * buffer.height / 1e6;
+        std::cout << (params.fast_log ? "fast_log" : "libm log") << ": " << buffer.width << "x" << buffer.height
+                  << " in " << ms << " ms (" << mpix / (ms / 1e3) << " Mpixel/s, "
+                  << mpix * params.iterations / (ms / 1e3) << " Mlog/s)" << std::endl;
+        return ms;
+    }
+
+    // Largest relative error of fast_log() against a double log, over every
+    // 16th float of [1e-30, 1e30] where |log x| > 1e-3 and the largest
+    // absolute error on [1e-6, 4], the range of |r (1 - 2x)|
+    void measure_fast_log(double& relative, double& absolute) {
+        float lo = 1e-30f, hi = 1e30f;
+        uint32_t first, last;
+        memcpy(&first, &lo, sizeof(first));
+        memcpy(&last, &hi, sizeof(last));
+        relative = absolute = 0.0;
+        for(uint32_t bits = first; bits <= last; bits += 16 * SIMD_LANES) {
+            vfloat x;
+            for(unsigned int l = 0; l < SIMD_LANES; l++) {
+                uint32_t b = bits + 16 * l;
+                memcpy(&x[l], &b, sizeof(float));
+            }
+            vfloat y = fast_log(x);
+            for(unsigned int l = 0; l < SIMD_LANES; l++) {
+                double exact = std::log(double(x[l]));
+                double error = std::fabs(double(y[l]) - exact);
+                if(std::fabs(exact) > 1e-3) {
+                    relative = std::max(relative, error / std::fabs(exact));
+                }
+                if(x[l] >= 1e-6f && x[l] <= 4.f) {
+                    absolute = std::max(absolute, error);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    View view;
+    view.center_x = 3.0;
+    view.center_y = 3.0;
+    view.width = 800;
+    view.height = 800;
+    LyapunovParams params;
+    string letters = "AABAB", image_file = "lyapunov.ppm";
+    bool compare = false;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-S") letters = val;
+        else if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-W") params.warmup = atoi(val);
+        else if(opt == "-n") params.iterations = atoi(val);
+        else if(opt == "-l") params.fast_log = string(val) != "libm";
+        else if(opt == "-c") compare = atoi(val) != 0;
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    LyapunovSequence sequence;
+    if(!sequence.parse(letters)) {
+        return 1;
+    }
+
+    LyapunovBuffer buffer;
+    double ms = render(sequence, view, params, buffer);
+
+    if(compare) {
+        LyapunovParams other = params;
+        other.fast_log = !params.fast_log;
+        LyapunovBuffer reference;
+        double other_ms = render(sequence, view, other, reference);
+
+        double max_error = 0.0, mean_error = 0.0;
+        size_t sign_flips = 0;
+        for(size_t i = 0; i < buffer.exponent.size(); i++) {
+            double error = std::fabs(double(buffer.exponent[i]) - reference.exponent[i]);
+            max_error = std::max(max_error, error);
+            mean_error += error;
+            sign_flips += (buffer.exponent[i] < 0.f) != (reference.exponent[i] < 0.f);
+        }
+        std::cout << "Speedup of fast_log " << (params.fast_log ? other_ms / ms : ms / other_ms)
+                  << "x, exponent error max " << max_error << " mean " << mean_error / buffer.exponent.size()
+                  << ", " << sign_flips << " pixels changed sign" << std::endl;
+
+        double relative, absolute;
+        measure_fast_log(relative, absolute);
+        std::cout << "fast_log error: " << relative << " relative, " << absolute << " absolute on [1e-6, 4]" << std::endl;
+    }
+
+    Image image;
+    colorize_lyapunov(buffer, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Headless CPU render of Newton fractals.
+//
+//   newton [-P "coefficients"] [-w width] [-h height] [-x center_x] [-y center_y]
+//          [-z zoom] [-n max_iter] [-e epsilon] [-o image.ppm]
+//
+// The coefficients go from the highest degree down, "1 0 0 -1" (the
+// default) is z^3 - 1.
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/newton.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    View view;
+    NewtonParams params;
+    string polynomial = "1 0 0 -1", image_file = "newton.ppm";
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-P") polynomial = val;
+        else if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-n") params.max_iter = atoi(val);
+        else if(opt == "-e") params.epsilon = atof(val);
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    NewtonPolynomial newton;
+    if(!newton.parse(polynomial)) {
+        return 1;
+    }
+    std::cout << "Roots:";
+    for(const complex<double>& root : newton.roots()) {
+        std::cout << " " << root.real() << (root.imag() < 0 ? "-" : "+") << std::abs(root.imag()) << "i";
+    }
+    std::cout << std::endl;
+
+    auto start = chrono::steady_clock::now();
+    NewtonBuffer buffer;
+    newton.render(view, params, buffer);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    double steps = 0.0;
+    size_t converged = 0;
+    for(size_t i = 0; i < buffer.root.size(); i++) {
+        steps += buffer.smooth[i];
+        converged += buffer.root[i] >= 0;
+    }
+    double mpix = double(buffer.width) * buffer.height / 1e6;
+    std::cout << "Iterated " << buffer.width << "x" << buffer.height << " in " << ms << " ms ("
+              << mpix / (ms / 1e3) << " Mpixel/s), " << steps / buffer.root.size() << " steps per pixel, "
+              << 100.0 * converged / buffer.root.size() << "% converged" << std::endl;
+
+    Image image;
+    colorize_newton(buffer, image);
+    return image.write_ppm(image_file) ? 0 : 1;
+}
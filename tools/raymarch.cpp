@@ -0,0 +1,186 @@
+// Headless CPU render of the distance-estimated 3D scenes.
+//
+//   raymarch [-S mandelbulb|quaternion_julia|sierpinski|menger|mandelbox] [-w width]
+//            [-h height] [-d distance] [-a azimuth] [-e elevation] [-f fov]
+//            [-n max_steps] [-r relaxation] [-t cone_tile] [-i iterations] [-L 0|1]
+//            [-F frames] [-R 0|1] [-A samples] [-o image.ppm]
+//
+// The camera looks at the origin from the direction given by azimuth and
+// elevation, in degrees. -r 1 is plain sphere tracing, -t 0 turns the cone
+// marching prepass off. -L 1 adds the shadow map and the ambient occlusion
+// volume, computed once: -F renders that many frames of a camera orbit
+// reusing them, and -R 1 starts the rays of each frame from the hits of
+// the previous one. -A then averages that many jittered frames of the
+// last camera position, also reprojected with -R 1. -R 1 saves steps and
+// time on the Mandelbulb, but not on the Mandelbox, see MarchParams.
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/kifs.hpp"
+#include "cpu/mandelbox.hpp"
+#include "cpu/mandelbulb.hpp"
+#include "cpu/occlusion.hpp"
+#include "cpu/quaternion_julia.hpp"
+#include "cpu/raymarch.hpp"
+
+using namespace std;
+
+namespace {
+
+struct Orbit {
+    unsigned int width = 960, height = 540;
+    float distance = 3.f, azimuth = 45.f, elevation = 30.f;
+    bool lighting = true;
+    unsigned int frames = 1;
+    bool reproject = false;
+    unsigned int samples = 1;
+};
+
+template<typename Scene>
+bool render(const Scene& scene, const Orbit& orbit, Camera camera, const MarchParams& params, const string& image_file) {
+    const Light light;
+    const OcclusionParams occlusion;
+    ShadowMap shadow;
+    OcclusionVolume volume;
+    if(orbit.lighting) {
+        float l[3];
+        light.direction(l);
+        MarchStats s = render_shadow_map(scene, l, params, occlusion, shadow);
+        std::cout << "Shadow map " << shadow.width << "x" << shadow.height << " in " << s.seconds * 1e3 << " ms, "
+                  << double(s.steps) / s.rays << " steps per texel" << std::endl;
+
+        MarchStats o;
+        unsigned int passes = 0;
+        for(; volume.directions < occlusion.max_directions || passes == 0; passes++) {
+            MarchStats a = accumulate_occlusion(scene, occlusion, volume);
+            o.steps += a.steps;
+            o.seconds += a.seconds;
+        }
+        std::cout << "Occlusion volume " << volume.size << "^3, " << volume.directions << " directions in " << passes
+                  << " passes of " << o.seconds / passes * 1e3 << " ms, "
+                  << double(o.steps) / (double(volume.visibility.size()) * volume.directions) << " steps per ray" << std::endl;
+    }
+
+    const float origin[3] = {0.f, 0.f, 0.f};
+    MarchBuffer buffer, previous;
+    Camera previous_camera;
+    vector<float> reprojected, start;
+    MarchStats stats, total;
+    Image image;
+    vector<float> sum;
+    double seconds = 0.0;
+    const unsigned int samples = std::max(orbit.samples, 1u);
+    for(unsigned int f = 0; f < orbit.frames + samples - 1; f++) {
+        auto begin = chrono::steady_clock::now();
+        // The orbit, then the jittered frames of its last position
+        const unsigned int sample = f < orbit.frames ? 0 : f + 1 - orbit.frames;
+        camera.orbit(origin, orbit.distance, orbit.azimuth + 360.f * float(std::min(f, orbit.frames - 1)) / float(orbit.frames),
+                     orbit.elevation);
+        halton_jitter(sample, camera.jitter);
+        start.clear();
+        if(orbit.reproject && f > 0) {
+            reproject_hits(previous, previous_camera, camera, orbit.width, orbit.height, reprojected);
+            reprojection_start(reprojected, orbit.width, orbit.height, camera.pixel_angle(orbit.height), params, start);
+        }
+        stats = march(scene, camera, orbit.width, orbit.height, params, buffer, start);
+        if(orbit.lighting) {
+            vector<float> lit, ambient;
+            light_march(buffer, camera, shadow, volume, occlusion, lit, ambient);
+            shade_march(buffer, light, image, lit, ambient);
+        } else {
+            shade_march(buffer, light, image);
+        }
+        if(sample == 0) {
+            sum.assign(image.rgb.begin(), image.rgb.end());
+        } else {
+            for(size_t k = 0; k < sum.size(); k++) {
+                sum[k] += float(image.rgb[k]);
+            }
+        }
+        std::swap(buffer, previous);
+        previous_camera = camera;
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+        total.rays += stats.rays;
+        total.hits += stats.hits;
+        total.steps += stats.steps;
+        total.cone_steps += stats.cone_steps;
+        total.reprojected += stats.reprojected;
+        total.seconds += stats.seconds;
+    }
+    for(size_t k = 0; k < sum.size(); k++) {
+        image.rgb[k] = uint8_t(sum[k] / float(samples) + 0.5f);
+    }
+
+    const unsigned int frames = orbit.frames + samples - 1;
+    std::cout << "Marched " << orbit.width << "x" << orbit.height << " in " << total.seconds / frames * 1e3 << " ms ("
+              << total.rays / total.seconds / 1e6 << " Mrays/s), " << double(total.steps + total.cone_steps) / total.rays
+              << " steps per pixel (" << double(total.cone_steps) / total.rays << " in the cone prepass), "
+              << 100.0 * total.hits / total.rays << "% hits, " << 100.0 * total.reprojected / total.rays << "% reprojected"
+              << std::endl;
+    std::cout << frames << " frames, " << seconds / frames * 1e3 << " ms per frame" << std::endl;
+    return image.write_ppm(image_file);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Orbit orbit;
+    Camera camera;
+    MarchParams params;
+    Mandelbulb mandelbulb;
+    QuaternionJulia julia;
+    Mandelbox mandelbox;
+    KaleidoscopicIFS sierpinski = KaleidoscopicIFS::sierpinski(), menger = KaleidoscopicIFS::menger();
+    int iterations = -1;
+    string scene = "mandelbulb", image_file = "raymarch.ppm";
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-S") scene = val;
+        else if(opt == "-w") orbit.width = atoi(val);
+        else if(opt == "-h") orbit.height = atoi(val);
+        else if(opt == "-d") orbit.distance = atof(val);
+        else if(opt == "-a") orbit.azimuth = atof(val);
+        else if(opt == "-e") orbit.elevation = atof(val);
+        else if(opt == "-f") camera.fov = atof(val);
+        else if(opt == "-n") params.max_steps = atoi(val);
+        else if(opt == "-r") params.relaxation = atof(val);
+        else if(opt == "-t") params.cone_tile = atoi(val);
+        else if(opt == "-i") iterations = atoi(val);
+        else if(opt == "-L") orbit.lighting = atoi(val) != 0;
+        else if(opt == "-F") orbit.frames = std::max(1, atoi(val));
+        else if(opt == "-R") orbit.reproject = atoi(val) != 0;
+        else if(opt == "-A") orbit.samples = std::max(1, atoi(val));
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    bool written;
+    if(scene == "mandelbulb") {
+        if(iterations > 0) mandelbulb.iterations = iterations;
+        written = render(mandelbulb, orbit, camera, params, image_file);
+    } else if(scene == "quaternion_julia") {
+        if(iterations > 0) julia.iterations = iterations;
+        written = render(julia, orbit, camera, params, image_file);
+    } else if(scene == "sierpinski") {
+        if(iterations > 0) sierpinski.iterations = iterations;
+        written = render(sierpinski, orbit, camera, params, image_file);
+    } else if(scene == "menger") {
+        if(iterations > 0) menger.iterations = iterations;
+        written = render(menger, orbit, camera, params, image_file);
+    } else if(scene == "mandelbox") {
+        if(iterations > 0) mandelbox.iterations = iterations;
+        written = render(mandelbox, orbit, camera, params, image_file);
+    } else {
+        std::cout << "Unknown scene " << scene << std::endl;
+        return 1;
+    }
+    return written ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+// Applies a palette to an iteration archive written by render, without
+// iterating again.
+//
+//   recolor archive.frac image.ppm [-p palette.txt] [-d density] [-f offset] [-c cyclic] [-e equalize]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/archive.hpp"
+#include "cpu/coloring.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        std::cout << "Usage: recolor archive.frac image.ppm [-p palette.txt] [-d density] [-f offset] [-c cyclic] [-e equalize]" << std::endl;
+        return 1;
+    }
+    string archive_file = argv[1], image_file = argv[2], palette_file;
+    float density = 0.f, offset = 0.f;
+    bool cyclic = false, equalize = false;
+
+    for(int i = 3; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-p") palette_file = val;
+        else if(opt == "-d") density = atof(val);
+        else if(opt == "-f") offset = atof(val);
+        else if(opt == "-c") cyclic = atoi(val) != 0;
+        else if(opt == "-e") equalize = atoi(val) != 0;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    IterationArchive archive;
+    if(!archive.open(archive_file)) {
+        return 1;
+    }
+    Palette palette;
+    if(!palette_file.empty() && !palette.load(palette_file)) {
+        return 1;
+    }
+    ColorMapping mapping;
+    mapping.density = density > 0.f ? density : 5.f / (archive.max_iter() - 1);
+    mapping.offset = offset;
+    mapping.cyclic = cyclic;
+    mapping.equalize = equalize;
+
+    auto start = chrono::steady_clock::now();
+    Image image;
+    if(!recolor_archive(archive, palette, mapping, image)) {
+        std::cout << "ERROR::RECOLOR::CORRUPTED_TILES " << archive_file << std::endl;
+        return 1;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double mpix = double(archive.width()) * archive.height() / 1e6;
+    std::cout << "Recolored " << archive.width() << "x" << archive.height() << " in " << ms << " ms ("
+              << mpix / (ms / 1e3) << " Mpixel/s)" << std::endl;
+
+    return image.write_ppm(image_file) ? 0 : 1;
+}
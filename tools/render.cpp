@@ -0,0 +1,92 @@
+// Headless CPU render of the Mandelbrot set and of the other formulas of
+// cpu/formula.hpp. -F also takes hybrid sequences such as
+// "mandelbrot*2,burning_ship".
+//
+//   render [-w width] [-h height] [-x center_x] [-y center_y] [-z zoom]
+//          [-F formula] [-D double_precision] [-n max_iter] [-p palette.txt] [-d density] [-f offset] [-c cyclic] [-e equalize]
+//          [-l lighting] [-la light_azimuth] [-le light_elevation]
+//          [-o image.ppm] [-a archive.frac] [-t tile_size]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/archive.hpp"
+#include "cpu/coloring.hpp"
+#include "cpu/lighting.hpp"
+#include "cpu/formula.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    View view;
+    EscapeParams params;
+    string palette_file, image_file = "render.ppm", archive_file;
+    float density = 0.f, offset = 0.f;
+    bool cyclic = false, equalize = false, lighting = false;
+    Light light;
+    unsigned int tile_size = 64;
+    string formula = "mandelbrot";
+    bool double_precision = false;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-F") formula = val;
+        else if(opt == "-D") double_precision = atoi(val) != 0;
+        else if(opt == "-n") params.max_iter = max(2, atoi(val));
+        else if(opt == "-p") palette_file = val;
+        else if(opt == "-d") density = atof(val);
+        else if(opt == "-f") offset = atof(val);
+        else if(opt == "-c") cyclic = atoi(val) != 0;
+        else if(opt == "-e") equalize = atoi(val) != 0;
+        else if(opt == "-l") lighting = atoi(val) != 0;
+        else if(opt == "-la") light.azimuth = atof(val);
+        else if(opt == "-le") light.elevation = atof(val);
+        else if(opt == "-o") image_file = val;
+        else if(opt == "-a") archive_file = val;
+        else if(opt == "-t") tile_size = atoi(val);
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    IterationBuffer buffer;
+    if(!render_formula(formula, double_precision, view, params, buffer)) {
+        return 1;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    std::cout << "Iterated " << view.width << "x" << view.height << " in " << ms << " ms" << std::endl;
+
+    if(!archive_file.empty()) {
+        if(!IterationArchive::write(archive_file, buffer, tile_size)) {
+            return 1;
+        }
+        std::cout << "Archive written to " << archive_file << std::endl;
+    }
+
+    Palette palette;
+    if(!palette_file.empty() && !palette.load(palette_file)) {
+        return 1;
+    }
+    ColorMapping mapping;
+    mapping.density = density > 0.f ? density : 5.f / (params.max_iter - 1);
+    mapping.offset = offset;
+    mapping.cyclic = cyclic;
+    mapping.equalize = equalize;
+
+    Image image;
+    colorize(buffer, palette, mapping, image);
+    if(lighting) {
+        shade_slope(buffer, light, image);
+    }
+    return image.write_ppm(image_file) ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+// Headless CPU render of the domain warping kernels of shaders/noise.glsl.
+//
+//   warp [-k fbm|second|third] [-N sin|hash|gradient] [-w width] [-h height]
+//        [-x center_x] [-y center_y] [-z zoom] [-n octaves] [-H H] [-t time]
+//        [-P period] [-T texels_per_cell] [-F divisor] [-a frames] [-m 1]
+//        [-c 1] [-o image.ppm]
+//
+// The default view is the commented out warp_third(p*10) of frag_fractals.glsl.
+// -N picks the hash of the lattice points (NoiseBasis), -P wraps the
+// lattice around every period cells. With -c 1 the image is rendered
+// again one pixel at a time, in plain float code with the libm sin, and
+// the tool reports the speedup and how far the values moved, then the
+// time the sine hash takes for the same image.
+//
+// -T bakes a tile of the noise (NoiseTile), of 128 cells unless -P says
+// otherwise, and fbm() reads it instead of hashing the lattice. With -c 1
+// the reference is then the procedural noise of the same period.
+//
+// -F computes the inner fields of the warps once per divisor x divisor
+// pixels (render_warp_field()). With -c 1 the reference is then the full
+// resolution image, and the error tells what the divisor costs.
+//
+// -a renders a loopable animation of that many frames instead, over
+// warp_loop_time() of the period, which -P or -T must give. The frames are
+// rendered in parallel (render_warp_loop()) and written to image_0000.ppm,
+// image_0001.ppm, ... With -c 1 the tool renders them again one after
+// another, every frame on all cores, and reports how far the frame after
+// the last one is from the first.
+//
+// -m 1 writes the mipmap chain of the image too, image_mip1.ppm and on
+// (MipmapWriter). Over one period, -x and -y at period/2 and -z at
+// 2/period, the image and its levels tile.
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cpu/mipmap.hpp"
+#include "cpu/noise.hpp"
+#include "cpu/parallel.hpp"
+
+using namespace std;
+
+namespace {
+    // shaders/noise.glsl, line by line. The float sin of libm is off by an
+    // ulp on 1% of the arguments, the double one is rounded instead.
+    float rand(float x, float y) {
+        float s = float(std::sin(double(x * 12.9898f + y * 4.1414f))) * 43758.5453f;
+        return s - std::floor(s);
+    }
+
+    uint32_t pcg(uint32_t v) {
+        uint32_t state = v * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    uint32_t lattice_hash(float x, float y) {
+        return pcg(uint32_t(int32_t(x)) + pcg(uint32_t(int32_t(y))));
+    }
+
+    float corner(NoiseBasis basis, float x, float y, float dx, float dy) {
+        if(basis == NoiseBasis::SIN) {
+            return rand(x, y);
+        }
+        uint32_t h = lattice_hash(x, y);
+        if(basis == NoiseBasis::HASH) {
+            return float(h >> 8u) * (1.f / 16777216.f);
+        }
+        const float gradient_x[8] = {1.f, -1.f, 0.f, 0.f, 1.f, -1.f, 1.f, -1.f};
+        const float gradient_y[8] = {0.f, 0.f, 1.f, -1.f, 1.f, 1.f, -1.f, -1.f};
+        return gradient_x[h >> 29u] * dx + gradient_y[h >> 29u] * dy;
+    }
+
+    float wrap(float b, unsigned int period) {
+        return period ? b - std::floor(b / float(period)) * float(period) : b;
+    }
+
+    float noise(NoiseBasis basis, unsigned int period, float x, float y) {
+        float bx = std::floor(x), by = std::floor(y);
+        float fx = x - bx, fy = y - by;
+        float ux = fx * fx * (3.f - 2.f * fx), uy = fy * fy * (3.f - 2.f * fy);
+        float x0 = wrap(bx, period), y0 = wrap(by, period), x1 = wrap(bx + 1.f, period), y1 = wrap(by + 1.f, period);
+        float a = corner(basis, x0, y0, fx, fy), b = corner(basis, x1, y0, fx - 1.f, fy);
+        float c = corner(basis, x0, y1, fx, fy - 1.f), d = corner(basis, x1, y1, fx - 1.f, fy - 1.f);
+        float bottom = a + (b - a) * ux, top = c + (d - c) * ux;
+        float n = bottom + (top - bottom) * uy;
+        return basis == NoiseBasis::GRADIENT ? 0.5f + 0.5f * n : n;
+    }
+
+    float fbm(float x, float y, const NoiseParams& params) {
+        float gain = std::exp2(-params.H), f = 1.f, a = 1.f, t = 0.f;
+        for(unsigned int i = 0; i < params.octaves; i++) {
+            t += a * noise(params.basis, params.period, f * x, f * y);
+            f *= 2.f;
+            a *= gain;
+        }
+        return t;
+    }
+
+    float warp_second(float x, float y, const NoiseParams& params) {
+        float shift = params.time / 2.f;
+        float qx = fbm(x + 0.f * shift, y + 0.2f * shift, params), qy = fbm(x + 2.2f * shift, y + 0.3f * shift, params);
+        return fbm(x + 4.f * qx, y + 4.f * qy, params);
+    }
+
+    float warp_third(float x, float y, const NoiseParams& params) {
+        float qx = fbm(x + 5.f, y + 7.2f, params), qy = fbm(x - 2.5f, y + 5.3f, params);
+        return warp_second(x + 4.f * qx, y + 4.f * qy, params);
+    }
+
+    void render_scalar(const View& view, WarpKernel kernel, const NoiseParams& params, NoiseBuffer& out) {
+        out.resize(view.width, view.height);
+        const float x_left = float(view.center_x - 1.0 / view.zoom);
+        const float x_step = float(2.0 / (view.zoom * view.width));
+        parallel_for(view.height, 1, [&](size_t begin, size_t end, unsigned int) {
+            for(size_t j = begin; j < end; j++) {
+                const float y = float(view.im(j));
+                for(unsigned int i = 0; i < view.width; i++) {
+                    const float x = x_left + (float(i) + 0.5f) * x_step;
+                    out.value[j * view.width + i] = kernel == WarpKernel::FBM ? fbm(x, y, params)
+                                                  : kernel == WarpKernel::WARP_SECOND ? warp_second(x, y, params)
+                                                  : warp_third(x, y, params);
+                }
+            }
+        });
+    }
+
+    string file_stem(const string& image_file) {
+        size_t dot = image_file.rfind('.');
+        return dot == string::npos ? image_file : image_file.substr(0, dot);
+    }
+
+    string frame_filename(const string& image_file, unsigned int frame) {
+        string stem = file_stem(image_file);
+        string number = to_string(frame);
+        return stem + "_" + string(number.size() < 4 ? 4 - number.size() : 0, '0') + number + ".ppm";
+    }
+
+    int animate(const View& view, WarpKernel kernel, const NoiseParams& params, unsigned int frames, bool compare,
+                const string& image_file) {
+        if(!params.period) {
+            std::cout << "The animation only loops on periodic noise, set -P or -T" << std::endl;
+            return 1;
+        }
+        std::cout << frames << " frames over a loop of " << warp_loop_time(params.period) << " time units" << std::endl;
+
+        // Frames finish on every thread
+        atomic<bool> written(true);
+        auto start = chrono::steady_clock::now();
+        render_warp_loop(view, kernel, params, frames, [&](unsigned int frame, const NoiseBuffer& buffer) {
+            Image image;
+            colorize_noise(buffer, 0.5f, image);
+            if(!image.write_ppm(frame_filename(image_file, frame))) {
+                written = false;
+            }
+        });
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        std::cout << frames << " frames of " << view.width << "x" << view.height << " on " << worker_count()
+                  << " threads in " << ms << " ms (" << frames / (ms / 1e3) << " frames/s)" << std::endl;
+
+        if(compare) {
+            NoiseParams frame = params;
+            NoiseBuffer buffer;
+            start = chrono::steady_clock::now();
+            for(unsigned int k = 0; k < frames; k++) {
+                frame.time = params.time + warp_loop_time(params.period) * float(k) / float(frames);
+                render_warp(view, kernel, frame, buffer);
+            }
+            double serial_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            std::cout << "Frame after frame in " << serial_ms << " ms, speedup " << serial_ms / ms << "x" << std::endl;
+
+            NoiseBuffer first;
+            frame.time = params.time;
+            render_warp(view, kernel, frame, first);
+            frame.time = params.time + warp_loop_time(params.period);
+            render_warp(view, kernel, frame, buffer);
+            double max_error = 0.0;
+            for(size_t k = 0; k < buffer.value.size(); k++) {
+                max_error = std::max(max_error, std::fabs(double(buffer.value[k]) - first.value[k]));
+            }
+            std::cout << "Loop seam: error max " << max_error << " between the first frame and the one after the last"
+                      << std::endl;
+        }
+        return written ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    View view;
+    view.zoom = 0.1;
+    view.width = 1024;
+    view.height = 1024;
+    NoiseParams params;
+    WarpKernel kernel = WarpKernel::WARP_THIRD;
+    bool compare = false;
+    unsigned int texels_per_cell = 0;
+    unsigned int divisor = 1;
+    unsigned int frames = 0;
+    bool mipmaps = false;
+    string image_file = "warp.ppm";
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        const char* val = argv[i + 1];
+        if(opt == "-k") {
+            string name = val;
+            if(name == "fbm") kernel = WarpKernel::FBM;
+            else if(name == "second") kernel = WarpKernel::WARP_SECOND;
+            else if(name == "third") kernel = WarpKernel::WARP_THIRD;
+            else {
+                std::cout << "Unknown kernel " << name << std::endl;
+                return 1;
+            }
+        }
+        else if(opt == "-N") {
+            string name = val;
+            if(name == "sin") params.basis = NoiseBasis::SIN;
+            else if(name == "hash") params.basis = NoiseBasis::HASH;
+            else if(name == "gradient") params.basis = NoiseBasis::GRADIENT;
+            else {
+                std::cout << "Unknown noise " << name << std::endl;
+                return 1;
+            }
+        }
+        else if(opt == "-w") view.width = atoi(val);
+        else if(opt == "-h") view.height = atoi(val);
+        else if(opt == "-x") view.center_x = atof(val);
+        else if(opt == "-y") view.center_y = atof(val);
+        else if(opt == "-z") view.zoom = atof(val);
+        else if(opt == "-n") params.octaves = atoi(val);
+        else if(opt == "-H") params.H = atof(val);
+        else if(opt == "-t") params.time = atof(val);
+        else if(opt == "-P") params.period = atoi(val);
+        else if(opt == "-T") texels_per_cell = atoi(val);
+        else if(opt == "-F") divisor = atoi(val);
+        else if(opt == "-a") frames = atoi(val);
+        else if(opt == "-m") mipmaps = atoi(val) != 0;
+        else if(opt == "-c") compare = atoi(val) != 0;
+        else if(opt == "-o") image_file = val;
+        else {
+            std::cout << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    NoiseTile tile;
+    if(texels_per_cell == 1 && params.basis == NoiseBasis::GRADIENT) {
+        std::cout << "Gradient noise needs more than one texel per cell" << std::endl;
+        return 1;
+    }
+    if(texels_per_cell) {
+        tile.basis = params.basis;
+        tile.period = params.period ? params.period : tile.period;
+        tile.texels_per_cell = texels_per_cell;
+        auto start = chrono::steady_clock::now();
+        bake_noise_tile(tile);
+        double bake_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        std::cout << "Baked a " << tile.size() << "x" << tile.size() << " tile of " << tile.period << " cells in " << bake_ms
+                  << " ms" << std::endl;
+        params.period = tile.period;
+        params.tile = &tile;
+    }
+
+    if(frames) {
+        return animate(view, kernel, params, frames, compare, image_file);
+    }
+
+    NoiseBuffer buffer;
+    auto start = chrono::steady_clock::now();
+    render_warp_field(view, kernel, params, divisor, buffer);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double mpix = double(view.width) * view.height / 1e6;
+    std::cout << view.width << "x" << view.height << " on " << worker_count() << " threads in " << ms << " ms ("
+              << mpix / (ms / 1e3) << " Mpixel/s)" << std::endl;
+
+    if(compare) {
+        NoiseBuffer reference;
+        NoiseParams procedural = params;
+        procedural.tile = nullptr;
+        start = chrono::steady_clock::now();
+        string reference_name = "Scalar";
+        if(params.tile || divisor > 1) {
+            render_warp(view, kernel, procedural, reference);
+            reference_name = divisor > 1 ? "Full resolution" : "Procedural";
+        } else {
+            render_scalar(view, kernel, params, reference);
+        }
+        double scalar_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        double max_error = 0.0, mean_error = 0.0, square_error = 0.0;
+        size_t above = 0;
+        for(size_t k = 0; k < buffer.value.size(); k++) {
+            double error = std::fabs(double(buffer.value[k]) - reference.value[k]);
+            max_error = std::max(max_error, error);
+            mean_error += error;
+            square_error += error * error;
+            above += error > 1e-3;
+        }
+        std::cout << reference_name << " in " << scalar_ms << " ms, speedup " << scalar_ms / ms << "x, error max "
+                  << max_error << " mean " << mean_error / buffer.value.size() << " rms "
+                  << std::sqrt(square_error / buffer.value.size()) << ", "
+                  << 100.0 * above / buffer.value.size() << "% of pixels above 1e-3" << std::endl;
+
+        if(params.basis != NoiseBasis::SIN) {
+            NoiseParams sine = procedural;
+            sine.basis = NoiseBasis::SIN;
+            start = chrono::steady_clock::now();
+            render_warp_field(view, kernel, sine, divisor, reference);
+            double sin_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            std::cout << "Sine hash in " << sin_ms << " ms, " << sin_ms / ms << "x slower" << std::endl;
+        }
+    }
+
+    // fbm() stays below 2 for H = 1
+    Image image;
+    colorize_noise(buffer, 0.5f, image);
+    if(mipmaps) {
+        start = chrono::steady_clock::now();
+        MipmapWriter writer(file_stem(image_file), image.width, image.height, true);
+        bool written = writer.write(image.rgb.data(), image.height) && writer.close();
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        std::cout << "Wrote " << writer.getLevels() << " levels in " << ms << " ms" << std::endl;
+        return written ? 0 : 1;
+    }
+    return image.write_ppm(image_file) ? 0 : 1;
+}